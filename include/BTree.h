@@ -13,57 +13,104 @@
 #include "Lock.h"
 #include "PagedFile.h"
 
+#include <set>
+
 #define N_ORDER ((PAGE_SIZE - 24) / 8)
 
+// Appends in a row after which splits leave the new entry alone
+#define BTREE_SEQUENTIAL_RUN 2
+
+// Deletes never rebalance on their own. A leaf below BTREE_UNDERFULL keys is
+// underfull, and once BTREE_REBALANCE_THRESHOLD leaves have become so, a
+// pass merges each leaf a delete left underfull with its neighbours, while
+// they fit in BTREE_MERGE_FILL together. Other leaves are not visited.
+#define BTREE_UNDERFULL(order) (((order) - 1) / 4)
+#define BTREE_MERGE_FILL(order) (((order) - 1) * 3 / 4)
+#define BTREE_REBALANCE_THRESHOLD 32
+
 namespace Pumper
 {
-    struct BTNode
+    // A node fills one page: ORDER child pointers and ORDER - 1 keys
+    template <typename Key>
+    struct BTNodeOf
     {
+        static const int32_t ORDER = (PAGE_SIZE - 24) / (sizeof(Key) + 4);
+
         int32_t is_leaf;
         int32_t id;
         int32_t parent, prev, next;
         int32_t num_keys;
-        int32_t keys[N_ORDER - 1];
-        int32_t pointers[N_ORDER];
+        Key keys[ORDER - 1];
+        int32_t pointers[ORDER];
     };
 
-    class BTree
+    typedef BTNodeOf<int32_t> BTNode;
+
+    // Maps fixed width keys to page ids. Instantiated for uint64_t, which
+    // holds hashes of string keys (see BTree) or integer keys as they are.
+    template <typename Key>
+    class BasicBTree
     {
     public:
-        BTree(PagedFile &pf);
-        ~BTree();
+        typedef BTNodeOf<Key> Node;
 
-        void Insert(const String &key, int32_t page_id);
-        void Remove(const String &key);
-        bool Search(const String &key, int32_t &page_id);
-        bool Update(const String &key, int32_t new_page_id);
+        BasicBTree(PagedFile &pf);
+        ~BasicBTree();
+
+        void Insert(Key key, int32_t page_id);
+        void Remove(Key key);
+        bool Search(Key key, int32_t &page_id);
+        bool Update(Key key, int32_t new_page_id);
+
+        // Merges underfull leaves, returns the number of pages freed.
+        int32_t Rebalance();
         
         void PrintDebugInfo();
 
     private:
-        int32_t get_hash(const String &key);
-        BTNode * find_leaf(int32_t hash);
-
-        void make_root_leaf(int hash, int page_id);
-        void insert_in_leaf(BTNode * leaf, int hash, int page_id);
-        void insert_in_leaf_splitted(BTNode * leaf, int hash, int page_id);
-        void insert_into_parent(BTNode * left, BTNode * right, int hash);
-        void insert_into_new_root(BTNode * left, BTNode * right, int32_t key);
-        void insert_node(BTNode * parent, int left_index, int32_t key, BTNode * right);
-        void insert_node_split(BTNode * old_node, int left_index, int32_t key, BTNode * right);
-        void delete_entry(BTNode * node, int hash);
-        void coalesce_nodes(BTNode * node, BTNode * neighbor, int neighbor_index, int k_prime);
-        void redistribute_nodes(BTNode * node, BTNode * neighbor, int neighbor_index, 
-            int k_prime_index, int k_prime);
+        Node * find_leaf(Key key);
+
+        void make_root_leaf(Key key, int page_id);
+        void insert_in_leaf(Node * leaf, Key key, int page_id);
+        void insert_in_leaf_splitted(Node * leaf, Key key, int page_id);
+        int32_t split_point();
+        void insert_into_parent(Node * left, Node * right, Key key);
+        void insert_into_new_root(Node * left, Node * right, Key key);
+        void insert_node(Node * parent, int left_index, Key key, Node * right);
+        void insert_node_split(Node * old_node, int left_index, Key key, Node * left, Node * right);
+        void delete_entry(Node * node, Key key);
+        int32_t merge_leaves(Node * parent, int32_t slot);
         void adjust_root();
 
-        BTNode * load_page(int32_t id);
-        void unload_page(BTNode * bt_node);
+        Node * load_page(int32_t id);
+        void unload_page(Node * bt_node);
         int32_t lease_page();
         void recycle_page(int32_t id);
 
         PagedFile &pf;
         int32_t root;
+
+        // Rightmost leaf and its greatest key when last seen, -1 if unknown
+        int32_t tail_leaf;
+        Key tail_key;
+        int32_t append_run;                     // Appends in a row
+        bool is_appending;                      // Current insert is one
+        int32_t underfull_leaves;               // Since the last Rebalance()
+        std::set<int32_t> underfull;            // Leaves deletes left so, same
+    };
+
+    typedef BasicBTree<uint64_t> IntBTree;
+
+    // String keys, indexed by their 64-bit hash (see KeyHash.h)
+    class BTree : public BasicBTree<uint64_t>
+    {
+    public:
+        BTree(PagedFile &pf);
+
+        void Insert(const String &key, int32_t page_id);
+        void Remove(const String &key);
+        bool Search(const String &key, int32_t &page_id);
+        bool Update(const String &key, int32_t new_page_id);
     };
 } // namespace Pumper
 
@@ -0,0 +1,47 @@
+// BloomFilter.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// In-memory Bloom filter over string keys. MayContain() never returns false
+// for a key that was added, so a negative answer lets the caller skip the
+// index and data files entirely. Bits can not be cleared, removed keys
+// stay in the filter until it is rebuilt.
+
+#ifndef __BLOOM_FILTER_H__
+#define __BLOOM_FILTER_H__
+
+#include "Types.h"
+
+#include <vector>
+
+namespace Pumper {
+    const int32_t BLOOM_BITS_PER_KEY = 10;      // About 1% false positives
+    const int32_t BLOOM_HASHES = 7;
+
+    class BloomFilter {
+    public:
+        BloomFilter();
+        ~BloomFilter();
+
+        // Drop all keys and resize the filter to num_bytes
+        void Reset(int32_t num_bytes, int32_t num_hashes = BLOOM_HASHES);
+
+        void Add(const String& key);
+        bool MayContain(const String& key) const;
+
+        // Number of keys that fit before false positives exceed the target.
+        int32_t Capacity() const;
+
+        // Raw bitmap, for persistence
+        uint8_t * Bits();
+        int32_t Size() const;
+        int32_t NumHashes() const;
+
+    private:
+        static uint64_t hash(const String& key);
+
+        std::vector<uint8_t> bits;
+        int32_t num_hashes;
+    };
+} // namespace Pumper
+
+#endif // __BLOOM_FILTER_H__
@@ -4,6 +4,28 @@
 // Maintaining the background buffer process. Note that there should be only one
 // instance of Buffer class. We use Singleton technology to avoid creating more
 // than one Buffer in one time.
+//
+// All public methods are serialized by one mutex, so several threads may work
+// on different files at the same time. A pinned page is never evicted, so its
+// content can be used after FetchPage() returns without holding the lock.
+// A miss is read with the lock released, the slot pinned and marked loading;
+// other threads asking for that page wait until it is in.
+//
+// Pages are read and written through PageIo: FetchPageAsync() returns
+// before the read is done, and flushes write all dirty pages of a file as
+// one batch of vectored writes.
+//
+// Sequential fetches of a file are detected, and the next READAHEAD_PAGES
+// pages are read ahead in one batch; Prefetch() asks for a range directly.
+// A page being read ahead occupies an unpinned slot and is not evicted
+// before the read is done. Reads ahead only take free or clean slots, never
+// write a page back to make room, and hold at most MAX_READAHEAD_SLOTS.
+//
+// A background writer keeps the share of dirty slots under the dirty ratio,
+// writing the coldest dirty pages ahead of eviction, and writes every dirty
+// page once per checkpoint interval (a fuzzy checkpoint: pages stay usable
+// while a copy of them is written). Eviction prefers clean slots, so reads
+// rarely wait for a write-back and a final flush has little left to do.
 
 #ifndef __BUFFER_H__
 #define __BUFFER_H__
@@ -11,8 +33,22 @@
 #include "Types.h"
 #include "Status.h"
 #include "HashTable.h"
+#include "Lock.h"
+#include "PageIo.h"
+#include "Thread.h"
+
+#include <unordered_map>
 
 namespace Pumper {
+    const int32_t READAHEAD_PAGES = 8;
+    const int32_t SEQUENTIAL_TRIGGER = 2;   // Consecutive fetches before reading ahead
+    const int32_t MAX_READAHEAD_SLOTS = BUFFER_SIZE / 4;   // Reads ahead in flight at once
+    const double DEFAULT_DIRTY_RATIO = 0.25;
+    const int32_t DEFAULT_CHECKPOINT_INTERVAL = 1;  // Seconds
+
+    // Receives the pinned page, or NULL with the failure.
+    typedef std::function<void (const Status&, int8_t*)> PageFetchCallback;
+
     class Buffer: public noncopyable {
         // Forward declarations
     public:
@@ -30,6 +66,17 @@ namespace Pumper {
         Status FetchPage(int32_t fd, int32_t page_id, int8_t** page, bool read_physical_page = true,
             bool allow_multiple_pins = true);
 
+        // Pins the page like FetchPage(), but a miss is read on an I/O thread
+        // and callback runs there once the page is in memory; hits complete
+        // on the calling thread. If a slot cannot be had, the failure is
+        // returned and callback is not called.
+        Status FetchPageAsync(int32_t fd, int32_t page_id, const PageFetchCallback& callback);
+
+        // Starts reading pages [first_page, first_page + num_pages) that are
+        // not in memory, as far as there are slots to spare and the file
+        // reaches. Returns at once.
+        Status Prefetch(int32_t fd, int32_t first_page, int32_t num_pages);
+
         // Unpin a page so that it can be discarded from the buffer.
         Status UnpinPage(int32_t fd, int32_t page_id);
 
@@ -47,6 +94,20 @@ namespace Pumper {
         // it from buffer.
         Status ForcePage(int32_t fd, int32_t page_id = ALL_PAGES);
 
+        // Pages of fd are written to journal_fd before they are written in
+        // place, see PageIo::SetJournal().
+        void SetJournal(int32_t fd, int32_t journal_fd);
+
+        // Pages of fd are stored compressed, see PageIo::SetCompressed().
+        Status SetCompressed(int32_t fd, bool is_compressed);
+
+        // Share of slots (0..1) allowed to be dirty before the background
+        // writer starts writing them.
+        void SetDirtyRatio(double ratio);
+
+        // Seconds between checkpoints of all dirty pages, 0 to disable.
+        void SetCheckpointInterval(int32_t seconds);
+
         // Print debugging information.
         Status PrintDebugInfo();
 
@@ -55,6 +116,18 @@ namespace Pumper {
         Status enqueue_slot(int32_t slot_id);
         Status enqueue_free(int32_t slot_id);
         Status allocate_slot(int32_t& slot_id);
+        Status force_page(int32_t fd, int32_t page_id);
+        bool find_resident(int32_t fd, int32_t page_id, int32_t& slot_id);
+        Status find_or_allocate(int32_t fd, int32_t page_id, int32_t& slot_id, bool& is_resident);
+        void finish_load(int32_t slot_id, const Status& status);
+        void end_load(int32_t slot_id, const Status& status);
+        bool allocate_clean_slot(int32_t& slot_id);
+        void detect_sequential(int32_t fd, int32_t page_id);
+        void prefetch_pages(int32_t fd, int32_t first_page, int32_t num_pages);
+        int32_t count_dirty();
+        void wait_io(int32_t fd);
+        void writer_func();
+        void write_back(bool is_checkpoint);
         Status read_page(int32_t fd, int32_t page_id, int8_t* mapping);
         Status write_page(int32_t fd, int32_t page_id, int8_t* mapping);
         
@@ -67,14 +140,38 @@ namespace Pumper {
             int32_t fd;
             int32_t page_id;
             bool is_dirty;
+            bool is_loading;                // Read in flight, wait on page_loaded
+            bool is_writing;                // Copy being written back
             int8_t * mapping;              // Mapping to memory area
         };
 
         BufferChain buffer_chain[BUFFER_SIZE];
         HashTable hash_table;
 
+        // Access pattern of one file, for readahead
+        struct ReadAhead {
+            ReadAhead() : last_page(INVALID_PAGE_ID), run_length(0), prefetched_end(0) { }
+            int32_t last_page;
+            int32_t run_length;             // Sequential fetches in a row
+            int32_t prefetched_end;         // Read ahead up to, exclusive
+        };
+        std::unordered_map<int32_t, ReadAhead> read_ahead;
+
         int32_t free_list_head;             // The first index of free buffer space
         int32_t first, last;                // First and last element in LRU queue
+
+        MutexLock mutex;
+        Condition page_loaded;
+
+        // Background writer
+        Condition writer_wakeup;
+        Thread * writer_thread;
+        int8_t * writer_pages[BUFFER_SIZE];     // Copies being written
+        int32_t dirty_limit;
+        int32_t checkpoint_interval;
+        bool is_writer_stopping;
+
+        PageIo page_io;                     // Last, stopped before the rest goes
     }; // Buffer
 
 } // namespace Pumper
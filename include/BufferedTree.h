@@ -0,0 +1,108 @@
+// BufferedTree.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Write optimized alternative to the B+Tree of *.INDEX, a B-epsilon tree.
+// Internal nodes keep a small fan-out and spend the rest of their page on a
+// buffer of pending messages, puts and removes of key hashes. A write only
+// adds a message to the root. A full buffer hands the messages bound for its
+// busiest child one level down in a batch, so that each page written deeper
+// in the tree carries many updates at once. A lookup walks the same single
+// path as in the B+Tree: the first message for the key on the way down is
+// the newest one, and the leaf is only consulted without one.
+//
+// The root page holds the root node and the height. Pages are decoded into a
+// node, changed and encoded back, the way DataFile treats its buckets. Leaves
+// emptied by removals are kept, like the leaves of the B+Tree.
+
+#ifndef __BUFFERED_TREE_H__
+#define __BUFFERED_TREE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "PagedFile.h"
+
+#include <utility>
+#include <vector>
+
+namespace Pumper {
+    enum BufferedMessageType {
+        BufferedPut = 0,
+        BufferedRemove
+    };
+
+    struct BufferedMessage {
+        uint64_t key;
+        int32_t value;                          // Page id of a put
+        int32_t type;                           // BufferedMessageType
+    };
+
+    struct BufferedMeta {
+        int8_t magic[8];                        // `PMPBEPS\0`
+        int32_t root;
+        int32_t height;                         // 1 while the root is a leaf
+    };
+
+    // Followed by the keys and values, and the messages of internal nodes
+    struct BufferedNodeHeader {
+        int32_t is_leaf;
+        int32_t num_keys;
+        int32_t num_messages;
+        int32_t reserved;
+    };
+
+    const int32_t BUFFERED_FANOUT = 32;
+    const int32_t BUFFERED_LEAF_SLOTS = (PAGE_SIZE - sizeof(BufferedNodeHeader)) / 12;
+    const int32_t BUFFERED_MESSAGE_SLOTS = (PAGE_SIZE - sizeof(BufferedNodeHeader) - 
+        (BUFFERED_FANOUT - 1) * 8 - BUFFERED_FANOUT * 4) / sizeof(BufferedMessage);
+
+    struct BufferedNode {
+        int32_t id;
+        bool is_leaf;
+        std::vector<uint64_t> keys;             // Sorted; pivots of internal nodes
+        std::vector<int32_t> values;            // Page ids; children of internal nodes
+        std::vector<BufferedMessage> messages;  // Sorted, internal nodes only
+    };
+
+    class BufferedTree : public noncopyable {
+    public:
+        explicit BufferedTree(PagedFile &pf);
+        ~BufferedTree();
+
+        // Writes an empty index into a newly created, opened file.
+        static Status Format(PagedFile &pf);
+        // Whether the opened file holds a BufferedTree.
+        static bool IsBufferedTree(PagedFile &pf);
+
+        // Reads the root page, before any other call.
+        Status Load();
+
+        Status Insert(const String &key, int32_t page_id);
+        // Blind: succeeds whether the key is there or not.
+        Status Remove(const String &key);
+        bool Search(const String &key, int32_t &page_id);
+        bool Update(const String &key, int32_t new_page_id);
+
+        int32_t Height() const;
+
+    private:
+        typedef std::vector<std::pair<uint64_t, int32_t> > Splits;   // Pivot, right node
+
+        Status apply(uint64_t key, int32_t value, BufferedMessageType type);
+        Status push_down(int32_t id, const std::vector<BufferedMessage>& messages, Splits& splits);
+        Status flush_child(BufferedNode& node);
+        Status store_split(BufferedNode& node, Splits& splits);
+        static void apply_to_leaf(BufferedNode& leaf, const std::vector<BufferedMessage>& messages);
+        static void merge_messages(std::vector<BufferedMessage>& older, 
+            const std::vector<BufferedMessage>& newer);
+
+        Status load_node(int32_t id, BufferedNode& node);
+        Status store_node(const BufferedNode& node);
+        Status store_meta();
+
+        PagedFile &pf;
+        int32_t meta_page;
+        BufferedMeta meta;
+    };
+} // namespace Pumper
+
+#endif // __BUFFERED_TREE_H__
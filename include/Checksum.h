@@ -0,0 +1,22 @@
+// Checksum.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// CRC32C (Castagnoli), the checksum of data pages. The SSE4.2 crc32
+// instruction computes it at several bytes per cycle; CPUs without it take a
+// table driven fallback that gives the same values.
+
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include "Types.h"
+
+namespace Pumper {
+    // Extends crc, the checksum of the data before, by length bytes. Pass 0
+    // to start a new checksum.
+    uint32_t Crc32c(const void * data, size_t length, uint32_t crc = 0);
+
+    // Whether Crc32c() runs on the crc32 instruction.
+    bool IsCrc32cAccelerated();
+} // namespace Pumper
+
+#endif // __CHECKSUM_H__
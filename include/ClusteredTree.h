@@ -0,0 +1,112 @@
+// ClusteredTree.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Clustered storage: a B+Tree ordered by the key bytes whose leaves hold the
+// key/value records themselves, in one file *.TREE. A point read is one
+// root-to-leaf walk, and a range scan walks the leaves through their sibling
+// links, reading the values in key order as it goes.
+//
+// Pages are decoded into a node, changed and encoded back, the way DataFile
+// treats its buckets. Values longer than CLUSTERED_MAX_INLINE live in a
+// chain of overflow pages named by the record. Like the hashed B+Tree,
+// nodes emptied by removals are not merged.
+//
+// Not thread safe: Engine calls it under its own lock.
+
+#ifndef __CLUSTERED_TREE_H__
+#define __CLUSTERED_TREE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "PagedFile.h"
+#include "KvEngine.h"
+
+#include <vector>
+
+namespace Pumper {
+    const int32_t CLUSTERED_MAX_KEY = 512;
+    const int32_t CLUSTERED_MAX_INLINE = 1024;
+
+    struct ClusteredNodeHeader {
+        int32_t is_leaf;
+        int32_t num_entries;
+        int32_t next;               // Right sibling of a leaf, -1 for the last
+        int32_t first_child;        // Internal nodes: child left of all keys
+    };
+
+    // Followed by key_length key bytes and inline_length value bytes
+    struct ClusteredEntryHeader {
+        uint16_t key_length;
+        uint16_t inline_length;
+        int32_t value_length;
+        int32_t page;               // Leaves: first overflow page or -1; internal: right child
+    };
+
+    struct OverflowHeader {
+        int32_t next;
+        int32_t length;
+    };
+
+    struct ClusteredEntry {
+        String key;
+        String value;               // Inline bytes
+        int32_t value_length;
+        int32_t page;
+    };
+
+    struct ClusteredNode {
+        int32_t id;
+        bool is_leaf;
+        int32_t next;
+        int32_t first_child;
+        std::vector<ClusteredEntry> entries;    // Sorted by key
+    };
+
+    class ClusteredTree : public noncopyable {
+    public:
+        ClusteredTree();
+        ~ClusteredTree();
+
+        static Status Create(const String& name);
+        static Status Unlink(const String& name);
+        static bool Exists(const String& name);
+
+        Status Open(const String& name);
+        Status Close();
+        Status UpdateChanges();
+
+        Status Put(const String& key, const String& value);
+        Status Get(const String& key, String& value);
+        Status Remove(const String& key);
+        bool Contains(const String& key);
+        std::vector<String> ListKeys();
+        // Keys >= start of the first leaf that has some, for scans that take
+        // a leaf at a time. is_last tells that no leaf follows.
+        Status ListKeys(const String& start, std::vector<String>& keys, bool& is_last);
+
+        // Pairs with key >= start in key order, at most limit (no limit if it
+        // is not positive).
+        Status Scan(const String& start, int32_t limit, KeyValueList& items);
+
+    private:
+        Status find_leaf(const String& key, ClusteredNode& leaf, std::vector<int32_t>& path);
+        Status insert_into_parent(std::vector<int32_t>& path, int32_t left_id, 
+            String key, int32_t right_id);
+        Status split_node(ClusteredNode& node, ClusteredNode& right, String& separator);
+
+        Status load_node(int32_t id, ClusteredNode& node);
+        Status store_node(const ClusteredNode& node);
+        static int32_t entry_size(const ClusteredEntry& entry);
+        static int32_t node_size(const ClusteredNode& node);
+
+        Status read_value(const ClusteredEntry& entry, String& value);
+        Status make_entry(const String& key, const String& value, ClusteredEntry& entry);
+        Status release_overflow(int32_t page);
+
+        PagedFile pf;
+        int32_t root;
+        bool is_opened;
+    };
+} // namespace Pumper
+
+#endif // __CLUSTERED_TREE_H__
@@ -0,0 +1,25 @@
+// Compression.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Page compression in the LZ4 block format: a greedy single-probe matcher,
+// fast enough to run on every page write, and a decoder that checks every
+// length against its buffers. Blocks are limited to 64 KB, which a page
+// always is.
+
+#ifndef __COMPRESSION_H__
+#define __COMPRESSION_H__
+
+#include "Types.h"
+
+namespace Pumper {
+    const int32_t LZ4_MAX_INPUT = 65535;
+
+    // Returns the compressed length, or 0 when it does not fit in capacity.
+    int32_t Lz4Compress(const int8_t * input, int32_t length, int8_t * output, int32_t capacity);
+
+    // Returns the decompressed length, or -1 for a malformed block or one
+    // that does not fit in capacity.
+    int32_t Lz4Decompress(const int8_t * input, int32_t length, int8_t * output, int32_t capacity);
+} // namespace Pumper
+
+#endif // __COMPRESSION_H__
@@ -0,0 +1,133 @@
+// CowTree.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Copy-on-write alternative to the B+Tree of *.INDEX, for tables that are
+// read far more often than written. Pages of the tree are never overwritten:
+// a write copies the path from the leaf to the root into new pages and
+// publishes the new root with SetRootPage(). A reader pins the root of the
+// moment with BeginRead() and searches it without taking any lock, whatever
+// the writers do meanwhile. Engine::Get() searches it this way before taking
+// the engine lock for the data page.
+//
+// Commit() syncs the pages, then records the root in the older of two
+// checksummed meta pages, the first pages of the file, and syncs again. After
+// a crash the file opens at the root of the newest valid meta page, with
+// nothing to replay, or at the other one if that is torn. The free list is
+// made again from the pages the roots reach, as pages on the recorded one may
+// have been taken since.
+//
+// Pages replaced by a write are retired, and go back to the file once no
+// reader pins an older root and, for pages that were on disk, once neither
+// meta page leads to them. Leaves emptied by removals are dropped from their
+// parents on the way, but nodes are never merged.
+//
+// Nodes have the layout of the B+Tree on 64-bit key hashes; the parent and
+// sibling links stay unused, they could not survive the copies.
+
+#ifndef __COW_TREE_H__
+#define __COW_TREE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+#include "PagedFile.h"
+#include "BTree.h"
+
+#include <atomic>
+#include <deque>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace Pumper {
+    typedef BTNodeOf<uint64_t> CowNode;
+
+    // Readers pinning a root at the same time
+    const int32_t COW_READER_SLOTS = 64;
+    // Pages 0 and 1 of the file, written in turns
+    const int32_t COW_META_PAGES = 2;
+
+    struct CowMeta;
+
+    // Root pinned by BeginRead(), valid until EndRead()
+    struct CowReader {
+        int32_t slot;
+        int32_t root;
+        uint32_t txn;
+    };
+
+    class CowTree : public noncopyable {
+    public:
+        explicit CowTree(PagedFile &pf);
+        ~CowTree();
+
+        // Writes an empty index into a newly created, opened file.
+        static Status Format(PagedFile &pf);
+
+        // Finds the root of the last commit, before any other call.
+        Status Load();
+
+        // Writers are serialized among themselves.
+        Status Insert(const String &key, int32_t page_id);
+        Status Remove(const String &key);
+        bool Update(const String &key, int32_t new_page_id);
+
+        // Pins the current root. Fails when all reader slots are taken.
+        Status BeginRead(CowReader &reader);
+        void EndRead(const CowReader &reader);
+        bool Search(const CowReader &reader, const String &key, int32_t &page_id);
+        // Pins a root for the one lookup
+        bool Search(const String &key, int32_t &page_id);
+
+        // Makes the current root durable and releases the pages it retired.
+        Status Commit();
+        // The last commit before the file is closed, which also records the
+        // free list for the next Load().
+        Status Close();
+
+        // Pages replaced by writes and not released yet
+        int32_t RetiredPages();
+
+    private:
+        enum Operation {
+            OperationPut = 0,
+            OperationUpdate,
+            OperationRemove
+        };
+
+        typedef std::pair<uint32_t, int32_t> Retired;   // Txn that replaced it, page
+
+        Status apply(uint64_t key, int32_t value, Operation operation, bool &is_found);
+        bool search(int32_t root, uint64_t key, int32_t &page_id);
+        Status store_node(CowNode * node);
+        Status store_split(CowNode * node, int32_t slot, uint64_t key, int32_t value,
+            uint64_t &pivot, int32_t &right_id);
+        void retire(int32_t page_id, uint32_t replaced_txn);
+        Status reclaim();
+
+        Status load_node(int32_t id, CowNode * node);
+        Status write_meta(bool is_closed);
+        bool read_meta(int32_t page_id, CowMeta &meta);
+        Status recover_free_space(const CowMeta &meta, const CowMeta * older);
+        Status mark_reached(int32_t root, int8_t mark, std::vector<int8_t> &reached);
+
+        static uint64_t pack(uint32_t txn, int32_t root);
+        static bool txn_before(uint32_t lhs, uint32_t rhs);
+
+        PagedFile &pf;
+        MutexLock write_mutex;
+        uint32_t txn;                           // Of the published root
+        uint32_t durable_txn;                   // Of the root on disk
+        uint32_t previous_txn;                  // Of the root in the other meta page
+        uint32_t meta_seq;                      // Of the newest meta page
+        std::atomic<uint64_t> published;        // See pack()
+        std::atomic<uint64_t> readers[COW_READER_SLOTS];
+
+        // Allocated since the last Commit(), never reachable from disk
+        std::unordered_set<int32_t> fresh_pages;
+        std::deque<Retired> fresh_retired;
+        std::deque<Retired> durable_retired;
+    };
+} // namespace Pumper
+
+#endif // __COW_TREE_H__
@@ -9,7 +9,7 @@
 
 #include "Status.h"
 #include "TcpServer.h"
-#include "Engine.h"
+#include "KvEngine.h"
 #include "Message.h"
 #include "Thread.h"
 
@@ -22,14 +22,17 @@ namespace Pumper {
     	Daemon();
     	~Daemon();
 
-    	Status Start(const String& file, int32_t port);
+    	// cache_capacity: bytes of the engine value cache, 0 to disable.
+    	// kind: storage engine serving the requests.
+    	Status Start(const String& file, int32_t port, size_t cache_capacity = 0,
+    		EngineKind kind = EnginePaged);
         Status Join();
         Status UpdateChanges();
         Status Stop();
     private: 
     	Message execute_command(const Message &msg);
         Thread epoll_thread;
-        Engine engine;
+        KvEngine * engine;
     	TcpServer tcpServer;
 
         void epoll_thread_func(void * args);
@@ -40,6 +43,8 @@ namespace Pumper {
         Message func_get(int argc, char **argv, const Message &msg);
         Message func_remove(int argc, char **argv, const Message &msg);
         Message func_list(int argc, char **argv, const Message &msg);        
+        Message func_scan(int argc, char **argv, const Message &msg);
+        Message func_stats(int argc, char **argv, const Message &msg);
     };
 
    
@@ -24,7 +24,7 @@ namespace Pumper {
     	DataFile(PagedFile& paged_file);
     	~DataFile();
 
-    	static Status Create(const String& file);
+    	static Status Create(const String& file, bool is_compressed = false);
     	static Status Unlink(const String& file);
 
         // Open or close one file.
@@ -36,8 +36,9 @@ namespace Pumper {
         Status Close();
         Status UpdateChanges();
 
-        // Will be sequence looking-up, which is very inefficient
-        Status Put(const String& key, const String& value);
+        // Will be sequence looking-up, which is very inefficient. is_inserted
+        // tells whether the key was not stored before.
+        Status Put(const String& key, const String& value, bool &is_inserted);
         Status Get(const String& key, String& value);
         Status Remove(const String& key);
         bool Contains(const String& key);
@@ -46,6 +47,11 @@ namespace Pumper {
         // Fast lookup, which specified page_id
         Status Put(int32_t page_id, const String& key, const String& value);
         Status Put(const String& key, const String& value, int32_t &page_id, int32_t first_scan = 0);
+        // Rewrites the value if the page holds the key, reading and writing
+        // the page once: StatusNotFound if it does not, StatusOutOfSpace if
+        // the new value does not fit, in which case the key has been taken
+        // out of the page for the caller to put elsewhere.
+        Status Update(int32_t page_id, const String& key, const String& value);
         Status Get(int32_t page_id, const String& key, String& value);
         Status Remove(int32_t page_id, const String& key);
         bool Contains(int32_t page_id, const String& key);
@@ -3,7 +3,16 @@
 //
 // Container of all keys and values in one file *.INDEX
 // Which could also support random lookup. 
-
+//
+// The layout is chosen when the database is created: UpdateInPlace keeps
+// the hashed index and data pages (*.DATA, *.INDEX, *.BLOOM), while
+// LogStructured hands everything to an LsmTree (*.LSM, *.RUN.<n>) for
+// write-heavy workloads, and Clustered keeps the records in the leaves of
+// one ordered B+Tree (*.TREE) for cheap point reads and range scans.
+// IntegerKeys only takes keys that are decimal 64-bit unsigned integers and
+// indexes the integers themselves (*.INTINDEX, *.INTDATA, see IntTable).
+// OpenDb detects the layout from the files.
+// Engine is the paged implementation of KvEngine.
 
 #ifndef __ENGINE_H__
 #define __ENGINE_H__
@@ -11,18 +20,36 @@
 #include "Types.h"
 #include "Status.h"
 #include "Lock.h"
+#include "KvEngine.h"
 #include "DataFile.h"
 #include "IndexFile.h"
+#include "FilterFile.h"
+#include "Snapshot.h"
+#include "ValueCache.h"
+#include "LsmTree.h"
+#include "ClusteredTree.h"
+#include "IntTable.h"
 
 #include <vector>
 
 namespace Pumper {
-    class Engine : public noncopyable {
+    enum StorageLayout {
+        UpdateInPlace = 0,
+        LogStructured,
+        Clustered,
+        IntegerKeys
+    };
+
+    class Engine : public KvEngine {
     public:
     	Engine();
         ~Engine();
 
-        static Status CreateDb(const String& file);
+        // is_compressed keeps the data pages of UpdateInPlace LZ4 compressed,
+        // index_type picks the B+Tree, the hash index or the buffered tree
+        // of its *.INDEX.
+        static Status CreateDb(const String& file, StorageLayout layout = UpdateInPlace, 
+            bool is_compressed = false, IndexType index_type = OrderedIndex);
         static Status UnlinkDb(const String& file);
 
         Status OpenDb(const String& file);
@@ -35,15 +62,61 @@ namespace Pumper {
         bool Contains(const String& key);
         std::vector<String> ListKeys();
 
+        // Reads at a snapshot see the database as it was when GetSnapshot()
+        // was called. They only hold the engine lock for one key or one data
+        // page at a time, so long scans do not stall concurrent writers.
+        Snapshot * GetSnapshot();
+        Status ReleaseSnapshot(Snapshot * snapshot);
+        Status Get(const Snapshot * snapshot, const String& key, String& value);
+        bool Contains(const Snapshot * snapshot, const String& key);
+        std::vector<String> ListKeys(const Snapshot * snapshot);
+
+        // Keep up to capacity bytes of recently read values in memory. Passing
+        // zero drops the cache. Disabled by default, and should be set before
+        // the engine serves requests.
+        Status EnableCache(size_t capacity);
+
+        // The whole batch is applied under the engine lock.
+        Status Write(const WriteBatch& batch);
+
+        // The Clustered layout walks its leaves under the engine lock, the
+        // others read at a snapshot.
+        Status Scan(const String& start, int32_t limit, KeyValueList& items);
+
         bool IsOpened();
         String OpenDbName();
+        const char * Name();
 
     private:
+        Status apply_put(const String& key, const String& value);
+        Status apply_remove(const String& key);
+        Status put_entry(const String& key, const String& value);
+        Status get_entry(const String& key, String& value);
+        // Reads the data page an index search led to
+        Status get_at(const String& key, int32_t page_id, String& value);
+        // page_id was found in the copy-on-write index without the engine lock
+        Status get_cow_entry(const String& key, int32_t page_id, String& value);
+        Status remove_entry(const String& key);
+        bool contains_entry(const String& key);
+        void record_version(const String& key);
+        Status rebuild_filter();
+        // Canonical decimal form only, so every key has one spelling.
+        static bool parse_int_key(const String& key, uint64_t& int_key);
+        static String format_int_key(uint64_t int_key);
+
         DataFile * data_file;
         IndexFile * index_file;
+        FilterFile * filter_file;
+        LsmTree * lsm_tree;             // Only set in LogStructured layout
+        ClusteredTree * clustered_tree; // Only set in Clustered layout
+        IntTable * int_table;           // Only set in IntegerKeys layout
 
-        PagedFile data_paged_file, index_paged_file;
+        PagedFile data_paged_file, index_paged_file, filter_paged_file;
         String db_name;
+
+        MutexLock mutex;
+        VersionLog version_log;
+        ValueCache * value_cache;
     };
 } // namespace Pumper
 
@@ -0,0 +1,85 @@
+// ExtentMap.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Compressed pages of one file. Every page is LZ4 compressed and stored as
+// an extent of 512-byte sectors: an ExtentHeader, the compressed bytes and
+// zero padding. A sparse page takes one sector instead of a whole page, so
+// more of the file fits in the page cache and a scan reads fewer bytes.
+//
+// Writes never overwrite the current copy of a page: the new copy goes to
+// a free extent or the end of file. The old extent is freed by the next
+// Sync(), once the new copy is on disk, and not reused before. The map
+// from pages to extents is not stored; Load() rebuilds it by scanning the
+// extent headers, keeping the newest copy of each page whose checksums
+// hold. A write torn by a crash thus leaves the previous copy in place.
+
+#ifndef __EXTENT_MAP_H__
+#define __EXTENT_MAP_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+
+#include <vector>
+
+namespace Pumper {
+    const int32_t SECTOR_SIZE = 512;
+    const off_t EXTENT_ZERO_OFFSET = SECTOR_SIZE;   // After the file header
+
+    struct ExtentHeader {
+        uint32_t header_checksum;               // CRC32C of the fields below
+        uint32_t data_checksum;                 // CRC32C of the data
+        uint64_t sequence;                      // Higher is newer
+        int32_t page_id;
+        int32_t length;                         // Of the data, PAGE_SIZE if stored raw
+    };
+
+    const int32_t MAX_EXTENT_SECTORS = 
+        (sizeof(ExtentHeader) + PAGE_SIZE + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    class ExtentMap : public noncopyable {
+    public:
+        explicit ExtentMap(int32_t fd);
+
+        // Scans the file, once before anything else.
+        Status Load();
+
+        Status ReadPage(int32_t page_id, int8_t * mapping);
+        Status WritePage(int32_t page_id, const int8_t * mapping);
+
+        // Syncs the file, then frees the extents of the copies replaced
+        // before, which the new copies no longer need.
+        Status Sync();
+
+        // Highest page stored + 1
+        int32_t NumPages();
+
+        // Collects the pages below num_pages that are missing, fail their
+        // checksums, or have a newer copy that does.
+        Status Verify(int32_t num_pages, std::vector<int32_t>& bad_pages);
+
+    private:
+        struct Extent {
+            int64_t sector;
+            int32_t num_sectors;                // 0 if the page is not stored
+            uint64_t sequence;
+            bool is_superseded;                 // A newer copy failed its checksums
+        };
+
+        static int32_t sectors_of(int32_t length);
+        static bool is_header_valid(const ExtentHeader& header);
+        static bool decode(const int8_t * extent, int32_t size, int32_t page_id, int8_t * mapping);
+        int64_t allocate(int32_t num_sectors);
+        void release(int64_t sector, int32_t num_sectors);
+
+        MutexLock mutex;
+        int32_t fd;
+        std::vector<Extent> extents;            // By page id
+        std::vector<int64_t> free_extents[MAX_EXTENT_SECTORS + 1];  // By size
+        std::vector<std::pair<int64_t, int32_t> > retired;  // Freed by the next Sync()
+        int64_t end_sector;
+        uint64_t next_sequence;
+    };
+} // namespace Pumper
+
+#endif // __EXTENT_MAP_H__
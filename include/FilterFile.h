@@ -0,0 +1,73 @@
+// FilterFile.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Bloom filter of all keys of a database, persisted in one file *.BLOOM so
+// that definite misses are answered without touching the INDEX and DATA
+// files. Page 0 holds a small header, the bitmap follows in pages 1..n.
+//
+// The filter on disk is trusted only if the database was closed cleanly:
+// opening the file clears the valid flag on disk, and only Close() sets it
+// again. After a crash, or for databases created before the filter
+// existed, the owner has to Rebuild() it from the data file.
+
+#ifndef __FILTER_FILE_H__
+#define __FILTER_FILE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "BloomFilter.h"
+
+#include <vector>
+
+namespace Pumper {
+    class PagedFile;
+
+    const int32_t BLOOM_MIN_PAGES = 8;
+
+    struct FilterHeader {
+        int8_t  magic[8];           // Should be `BLOOM\0\0\0`
+        int32_t is_valid;           // Closed cleanly, bitmap matches data
+        int32_t num_pages;          // Pages of bitmap after this one
+        int32_t num_hashes;
+        int32_t num_keys;           // Keys added since last rebuild
+        int32_t num_removed;        // Keys removed since last rebuild
+    };
+
+    class FilterFile : public noncopyable {
+    public:
+        FilterFile(PagedFile& paged_file);
+        ~FilterFile();
+
+        static Status Create(const String& file);
+        static Status Unlink(const String& file);
+
+        Status OpenFile(const String& file);
+        Status Close();
+        Status UpdateChanges();
+
+        // False if the filter must be rebuilt before it can be used
+        bool IsValid();
+        Status Rebuild(const std::vector<String>& keys);
+
+        void Add(const String& key);
+        void Remove(const String& key);
+        bool MayContain(const String& key);
+
+        // Too many keys for the bitmap, or too many stale bits left by removes
+        bool NeedsRebuild();
+        // Keys added since the last rebuild
+        int32_t NumKeys() const;
+
+    private:
+        Status load();
+        Status save(bool is_valid);
+
+        PagedFile& paged_file;
+        BloomFilter bloom_filter;
+        FilterHeader header;
+        bool is_valid;
+        bool is_dirty;
+    };
+} // namespace Pumper
+
+#endif // __FILTER_FILE_H__
@@ -0,0 +1,83 @@
+// HashIndex.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Extendible hashing index, the unordered alternative to the B+Tree of
+// *.INDEX for tables that only see point lookups. Key hashes are spread over
+// bucket pages by their lowest `global depth` bits through a directory,
+// which is kept in memory, so a lookup reads exactly one bucket page. A full
+// bucket splits in two on its next bit, doubling the directory when the
+// bucket already uses all of its bits; nothing is ever moved in bulk.
+//
+// The root page holds the depth and the list of directory pages. Buckets
+// emptied by removals are kept, like the leaves of the B+Tree. Buckets hold
+// 64-bit key hashes.
+
+#ifndef __HASH_INDEX_H__
+#define __HASH_INDEX_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "PagedFile.h"
+
+#include <vector>
+
+namespace Pumper {
+    const int32_t HASH_DIRECTORY_SLOTS = PAGE_SIZE / 4;
+    const int32_t HASH_MAX_DIRECTORY_PAGES = (PAGE_SIZE - 16) / 4;
+    const int32_t HASH_MAX_DEPTH = 19;         // 2^19 entries fit the root page
+
+    struct HashMeta {
+        int8_t magic[8];                        // `PMPHASH\0`
+        int32_t global_depth;
+        int32_t num_directory_pages;
+        int32_t directory_pages[HASH_MAX_DIRECTORY_PAGES];
+    };
+
+    const int32_t HASH_BUCKET_SLOTS = (PAGE_SIZE - 8) / 12;
+
+    struct HashBucket {
+        int32_t local_depth;
+        int32_t num_keys;
+        uint64_t keys[HASH_BUCKET_SLOTS];       // Sorted
+        int32_t pointers[HASH_BUCKET_SLOTS];
+    };
+
+    class HashIndex : public noncopyable {
+    public:
+        explicit HashIndex(PagedFile &pf);
+        ~HashIndex();
+
+        // Writes an empty index into a newly created, opened file.
+        static Status Format(PagedFile &pf);
+        // Whether the opened file holds a HashIndex rather than a B+Tree.
+        static bool IsHashIndex(PagedFile &pf);
+
+        // Reads the directory, before any other call.
+        Status Load();
+
+        Status Insert(const String &key, int32_t page_id);
+        Status Remove(const String &key);
+        bool Search(const String &key, int32_t &page_id);
+        bool Update(const String &key, int32_t new_page_id);
+
+        int32_t GlobalDepth() const;
+
+    private:
+        static uint32_t mix(uint64_t hash);
+        Status read_bucket(int32_t page_id, HashBucket &bucket);
+        Status write_bucket(int32_t page_id, const HashBucket &bucket);
+        Status split_bucket(uint32_t slot, HashBucket &bucket);
+        Status double_directory();
+        void set_entry(uint32_t slot, int32_t page_id);
+        Status flush_directory();
+
+        PagedFile &pf;
+        int32_t meta_page;
+        HashMeta meta;
+        std::vector<int32_t> directory;
+        std::vector<bool> dirty_pages;          // Directory pages to write back
+        bool is_meta_dirty;
+    };
+} // namespace Pumper
+
+#endif // __HASH_INDEX_H__
@@ -3,6 +3,13 @@
 //
 // Container of all keys and values in one file *.INDEX
 // Which could also support random lookup. 
+//
+// The index is either the ordered B+Tree or, for tables that are only ever
+// read by key, an extendible hash (HashIndex) answering a lookup with one
+// page read, or for ingest heavy tables a B-epsilon tree (BufferedTree)
+// that batches its writes, or for read heavy ones a copy-on-write B+Tree
+// (CowTree) whose readers never wait for writers. The type is fixed by
+// Create() and detected by OpenFile().
 
 
 #ifndef __INDEX_FILE_H__
@@ -12,14 +19,24 @@
 #include "Status.h"
 #include "Lock.h"
 #include "BTree.h"
+#include "HashIndex.h"
+#include "BufferedTree.h"
+#include "CowTree.h"
 
 namespace Pumper {
+    enum IndexType {
+        OrderedIndex = 0,
+        HashedIndex,
+        BufferedIndex,
+        CopyOnWriteIndex
+    };
+
     class IndexFile : public noncopyable {
     public:
     	IndexFile(PagedFile& paged_file);
     	~IndexFile();
 
-    	static Status Create(const String& file);
+    	static Status Create(const String& file, IndexType type = OrderedIndex);
     	static Status Unlink(const String& file);
 
         // Open or close one file.
@@ -35,11 +52,20 @@ namespace Pumper {
         Status Get(const String& key, int32_t &data_pid);
         Status Update(const String &key, int32_t new_page_id);
         bool Exist(const String& key);
+        // Exist() and Get() in one descent
+        bool Find(const String& key, int32_t &data_pid);
         Status Remove(const String& key);
 
+        IndexType Type();
+        // The copy-on-write tree of a CopyOnWriteIndex, for pinned reads
+        CowTree * GetCowTree();
+
     private:
     	PagedFile& paged_file;
         BTree * btree;
+        HashIndex * hash_index;
+        BufferedTree * buffered_tree;
+        CowTree * cow_tree;
     };
 } // namespace Pumper
 
@@ -0,0 +1,60 @@
+// IntBucket.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Data page of integer keyed tables (IntTable). Unlike Bucket, which chains
+// string slices, records are fixed size and sorted by key at the front of
+// the page, so a lookup is a binary search over integers; the values are
+// packed from the back of the page. A removed value leaves a hole that is
+// squeezed out when an insert needs the room.
+//
+// An all zero page is a valid empty bucket.
+
+#ifndef __INT_BUCKET_H__
+#define __INT_BUCKET_H__
+
+#include "Types.h"
+#include "Status.h"
+
+#include <vector>
+
+namespace Pumper {
+    struct IntBucketHeader {
+        int16_t num_records;
+        int16_t heap_start;         // Lowest value byte, 0 for an empty page
+        int32_t reserved;
+    };
+
+    struct IntRecord {
+        uint64_t key;
+        int16_t offset;
+        int16_t length;
+        int32_t reserved;
+    };
+
+    const int32_t INT_MAX_VALUE = PAGE_SIZE - sizeof(IntBucketHeader) - sizeof(IntRecord);
+
+    class IntBucket {
+    public:
+        // Works on the page in place
+        explicit IntBucket(int8_t * page);
+
+        // False if the value does not fit, the page is unchanged then.
+        bool Put(uint64_t key, const String &value);
+        bool Get(uint64_t key, String &value);
+        bool Remove(uint64_t key);
+        bool Exist(uint64_t key);
+        std::vector<uint64_t> ListKeys();
+
+    private:
+        int32_t find(uint64_t key);
+        int32_t heap_start();
+        int32_t free_space();
+        void compact();
+
+        int8_t * page;
+        IntBucketHeader * header;
+        IntRecord * records;
+    };
+} // namespace Pumper
+
+#endif // __INT_BUCKET_H__
@@ -0,0 +1,54 @@
+// IntTable.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Table keyed by 64-bit unsigned integers. The integer itself is the key of
+// the B+Tree in *.INTINDEX, so there is no hashing and there are no
+// collisions to fall back from; the records sit in IntBucket pages of
+// *.INTDATA. Keys and values never go through string compares.
+//
+// Not thread safe: Engine calls it under its own lock.
+
+#ifndef __INT_TABLE_H__
+#define __INT_TABLE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "PagedFile.h"
+#include "BTree.h"
+
+#include <vector>
+
+namespace Pumper {
+    class IntTable : public noncopyable {
+    public:
+        IntTable();
+        ~IntTable();
+
+        static Status Create(const String& name);
+        static Status Unlink(const String& name);
+        static bool Exists(const String& name);
+
+        Status Open(const String& name);
+        Status Close();
+        Status UpdateChanges();
+
+        Status Put(uint64_t key, const String& value);
+        Status Get(uint64_t key, String& value);
+        Status Remove(uint64_t key);
+        bool Contains(uint64_t key);
+        std::vector<uint64_t> ListKeys();
+
+        // For scans that take one *.INTDATA page at a time.
+        int32_t GetTotalPages() const;
+        std::vector<uint64_t> ListKeys(int32_t page_id);
+
+    private:
+        Status append(uint64_t key, const String& value, int32_t& page_id);
+        Status put_in_page(int32_t page_id, uint64_t key, const String& value, bool& is_stored);
+
+        PagedFile index_file, data_file;
+        IntBTree * index;
+    };
+} // namespace Pumper
+
+#endif // __INT_TABLE_H__
@@ -0,0 +1,30 @@
+// KeyHash.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Hash of a key in the index files. Keys with equal hashes share one index
+// entry, and the engine tells them apart in the data pages, at the cost of
+// a scan of the whole data file. The hash of an index file is recorded in
+// its header (PagedFile::GetKeyHash): files of older versions, hashed with
+// 30-bit BKDR, are refused when opened.
+
+#ifndef __KEY_HASH_H__
+#define __KEY_HASH_H__
+
+#include "Types.h"
+
+namespace Pumper {
+    enum KeyHashKind {
+        KeyHashWide = 1         // 64 bits of wyhash over the whole key; 0 was BKDR
+    };
+
+    // wyhash (final version 4): 64x64->128 bit multiplications, three
+    // independent lanes for long keys. Covers every byte of the key.
+    uint64_t KeyHash64(const void * data, size_t length, uint64_t seed = 0);
+
+    inline uint64_t KeyHash64(const String &key)
+    {
+        return KeyHash64(key.data(), key.size());
+    }
+} // namespace Pumper
+
+#endif // __KEY_HASH_H__
@@ -0,0 +1,27 @@
+// KeySearch.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Searches in the sorted key arrays of B+Tree nodes. A node holds hundreds
+// of keys, so a scan from the front costs hundreds of dependent compares.
+// These halve the range without branches down to a window of a few vectors,
+// then count the window with SSE2 compares; other CPUs count it one key at
+// a time.
+
+#ifndef __KEY_SEARCH_H__
+#define __KEY_SEARCH_H__
+
+#include "Types.h"
+
+namespace Pumper {
+    // Number of keys < key, the slot key would be inserted at.
+    int32_t LowerBound(const int32_t * keys, int32_t num_keys, int32_t key);
+
+    // Number of keys <= key, the child of an internal node holding key.
+    int32_t UpperBound(const int32_t * keys, int32_t num_keys, int32_t key);
+
+    // The same for integer keys
+    int32_t LowerBound(const uint64_t * keys, int32_t num_keys, uint64_t key);
+    int32_t UpperBound(const uint64_t * keys, int32_t num_keys, uint64_t key);
+} // namespace Pumper
+
+#endif // __KEY_SEARCH_H__
@@ -0,0 +1,113 @@
+// KvEngine.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Abstract key/value engine. The Daemon, the shell and the benchmarks only
+// talk to this interface, so storage designs can be swapped and compared
+// under the same front end. Implementations:
+//   Engine        paged files on disk (update-in-place or LSM layout)
+//   MemoryEngine  hash table in memory, nothing is persisted
+// Use KvEngine::New() to build one from its kind.
+
+#ifndef __KV_ENGINE_H__
+#define __KV_ENGINE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Snapshot.h"
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace Pumper {
+    enum EngineKind {
+        EnginePaged = 0,
+        EngineMemory
+    };
+
+    // Sequence of puts and removes applied by KvEngine::Write(). Engines
+    // apply a batch under one lock when they can, so readers see all of it
+    // or nothing.
+    class WriteBatch {
+    public:
+        struct Operation {
+            bool is_remove;
+            String key;
+            String value;
+        };
+
+        void Put(const String& key, const String& value);
+        void Remove(const String& key);
+        void Clear();
+
+        const std::vector<Operation>& Operations() const
+        {
+            return operations;
+        }
+
+    private:
+        std::vector<Operation> operations;
+    };
+
+    struct EngineStats {
+        String engine;              // Name of the implementation
+        uint64_t num_gets;
+        uint64_t num_get_misses;
+        uint64_t num_puts;
+        uint64_t num_removes;
+        uint64_t num_batches;
+        uint64_t num_scans;
+    };
+
+    typedef std::vector<std::pair<String, String> > KeyValueList;
+
+    class KvEngine : public noncopyable {
+    public:
+        KvEngine();
+        virtual ~KvEngine();
+
+        static KvEngine * New(EngineKind kind);
+
+        // Accepts "paged" or "memory", as given in configurations.
+        static Status ParseKind(const String& name, EngineKind& kind);
+
+        virtual Status OpenDb(const String& file) = 0;
+        virtual Status CloseDb() = 0;
+        virtual Status UpdateChanges() = 0;
+
+        virtual Status Put(const String& key, const String& value) = 0;
+        virtual Status Get(const String& key, String& value) = 0;
+        virtual Status Remove(const String& key) = 0;
+        virtual bool Contains(const String& key) = 0;
+        virtual std::vector<String> ListKeys() = 0;
+
+        virtual Snapshot * GetSnapshot() = 0;
+        virtual Status ReleaseSnapshot(Snapshot * snapshot) = 0;
+        virtual Status Get(const Snapshot * snapshot, const String& key, String& value) = 0;
+        virtual bool Contains(const Snapshot * snapshot, const String& key) = 0;
+        virtual std::vector<String> ListKeys(const Snapshot * snapshot) = 0;
+
+        // Applies the operations in order, stops at the first failure. The
+        // default issues one call per operation.
+        virtual Status Write(const WriteBatch& batch);
+
+        // Pairs with key >= start in key order, at most limit of them (no
+        // limit if it is not positive). The default reads at a snapshot, so
+        // the result is consistent even with concurrent writers.
+        virtual Status Scan(const String& start, int32_t limit, KeyValueList& items);
+
+        virtual Status EnableCache(size_t capacity) = 0;
+        virtual bool IsOpened() = 0;
+        virtual String OpenDbName() = 0;
+        virtual const char * Name() = 0;
+
+        EngineStats Stats();
+
+    protected:
+        // Bumped by the implementations on their public entry points
+        std::atomic<uint64_t> num_gets, num_get_misses, num_puts;
+        std::atomic<uint64_t> num_removes, num_batches, num_scans;
+    };
+} // namespace Pumper
+
+#endif // __KV_ENGINE_H__
@@ -0,0 +1,111 @@
+// LsmTree.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Log-structured storage for write-heavy workloads. Writes go into an
+// in-memory MemTable; once it is full it is frozen and a background thread
+// writes it out as an immutable SortedRun in level 0. When level 0 holds
+// too many runs they are merged with level 1, and a level that grows past
+// its budget is merged into the next one (leveled compaction, one run per
+// level from level 1 on, each level ten times bigger than the previous).
+// So random writes become sequential appends, and reads look at the
+// MemTables first, then the runs from newest to oldest.
+//
+// Files: *.LSM is the manifest listing the live runs of every level, and
+// *.RUN.<n> are the runs. Like the update-in-place layout, data is durable
+// after UpdateChanges() or Close(), which flush the MemTable.
+
+#ifndef __LSM_TREE_H__
+#define __LSM_TREE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+#include "Thread.h"
+#include "PagedFile.h"
+#include "MemTable.h"
+#include "SortedRun.h"
+#include "KvEngine.h"
+
+#include <memory>
+#include <vector>
+
+namespace Pumper {
+    const size_t LSM_MEMTABLE_SIZE = 4 << 20;
+    const int32_t LSM_L0_COMPACTION_TRIGGER = 4;
+    const int32_t LSM_LEVEL_MULTIPLIER = 10;
+    const int32_t LSM_MAX_LEVELS = 7;
+
+    struct ManifestHeader {
+        int8_t  magic[8];           // Should be `LSMTREE\0`
+        int32_t next_run_id;
+        int32_t num_runs;           // (level, run id) pairs follow the header
+    };
+
+    class LsmTree : public noncopyable {
+    public:
+        explicit LsmTree(size_t memtable_size = LSM_MEMTABLE_SIZE);
+        ~LsmTree();
+
+        static Status Create(const String& name);
+        static Status Unlink(const String& name);
+        static bool Exists(const String& name);
+
+        Status Open(const String& name);
+        Status Close();
+        Status UpdateChanges();
+
+        Status Put(const String& key, const String& value);
+        Status Get(const String& key, String& value);
+        Status Remove(const String& key);
+        bool Contains(const String& key);
+        std::vector<String> ListKeys();
+
+        // Live records >= start in key order, at most limit of them (all if
+        // limit <= 0). Merges the MemTables and the runs from start on.
+        Status Scan(const String& start, int32_t limit, KeyValueList& items);
+
+        // Runs in each level, for tests and statistics.
+        std::vector<int32_t> RunsPerLevel();
+
+    private:
+        typedef std::shared_ptr<SortedRun> RunPtr;
+        struct RunEntry {
+            int32_t run_id;
+            RunPtr run;
+        };
+        typedef std::vector<std::vector<RunEntry> > LevelList;
+
+        void background_func();
+        bool needs_compaction();
+        Status freeze_memtable();
+        Status flush_memtable();
+        Status compact();
+        bool scan_batch(const String& start, int32_t limit, KeyValueList& items, String& end);
+        Status write_manifest();
+        String run_file(int32_t run_id);
+        int32_t level_budget(int32_t level);
+
+        String name;
+        PagedFile manifest_file;
+        size_t memtable_size;
+
+        // mutex protects MemTables, levels and flags. work_mutex serializes
+        // flushes, compactions and manifest writes; never acquire it while
+        // holding mutex.
+        MutexLock mutex;
+        MutexLock work_mutex;
+        Condition work_cond;            // Wakes the background thread
+        Condition done_cond;            // Wakes writers stalled on a flush
+
+        MemTable * active;
+        MemTable * immutable;           // Frozen, being written to level 0
+        LevelList levels;               // Level 0 holds newest run first
+        int32_t next_run_id;
+
+        Thread * background_thread;
+        bool is_opened;
+        bool is_closing;
+    };
+} // namespace Pumper
+
+#endif // __LSM_TREE_H__
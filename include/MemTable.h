@@ -0,0 +1,73 @@
+// MemTable.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// In-memory write buffer of the log-structured engine. Keys are kept sorted
+// in a skip list, so a full MemTable can be written out as a sorted run in
+// one sequential pass. Removes are recorded as tombstones, because older
+// runs on disk may still hold the key. Not thread-safe, the owner locks.
+
+#ifndef __MEM_TABLE_H__
+#define __MEM_TABLE_H__
+
+#include "Types.h"
+#include "Status.h"
+
+#include <vector>
+
+namespace Pumper {
+    const int32_t SKIPLIST_MAX_HEIGHT = 12;
+
+    class MemTable : public noncopyable {
+    private:
+        struct Node {
+            String key;
+            String value;
+            bool is_deleted;
+            std::vector<Node *> next;
+        };
+
+    public:
+        MemTable();
+        ~MemTable();
+
+        void Put(const String& key, const String& value);
+        void Remove(const String& key);
+
+        // True if the key is known to the table, either with a value or as a
+        // tombstone (is_deleted set).
+        bool Get(const String& key, String& value, bool& is_deleted);
+
+        // Bytes of keys and values, used to decide when to flush.
+        size_t ApproximateSize() const;
+        int32_t Count() const;
+
+        // Iterates in key order, tombstones included.
+        class Iterator {
+        public:
+            explicit Iterator(const MemTable * mem_table) : node(mem_table->head->next[0]) { }
+            // At the first key >= start
+            Iterator(const MemTable * mem_table, const String& start)
+                : node(mem_table->find_greater_or_equal(start, NULL)) { }
+            bool Valid() const { return node != NULL; }
+            void Next() { node = node->next[0]; }
+            const String& Key() const { return node->key; }
+            const String& Value() const { return node->value; }
+            bool IsDeleted() const { return node->is_deleted; }
+        private:
+            Node * node;
+        };
+
+    private:
+        void insert(const String& key, const String& value, bool is_deleted);
+        Node * find_greater_or_equal(const String& key, Node ** prev) const;
+        int32_t random_height();
+
+        Node * head;
+        int32_t height;
+        size_t approximate_size;
+        int32_t count;
+        uint32_t random_seed;
+    };
+} // namespace Pumper
+
+#endif // __MEM_TABLE_H__
@@ -0,0 +1,68 @@
+// MemoryEngine.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// KvEngine kept entirely in a hash table in memory. Nothing is persisted:
+// OpenDb() only names an empty table and CloseDb() drops it. Useful as a
+// baseline when comparing storage designs, and for tests of the layers
+// above the engine.
+
+#ifndef __MEMORY_ENGINE_H__
+#define __MEMORY_ENGINE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+#include "KvEngine.h"
+#include "Snapshot.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace Pumper {
+    class MemoryEngine : public KvEngine {
+    public:
+        MemoryEngine();
+        ~MemoryEngine();
+
+        Status OpenDb(const String& file);
+        Status CloseDb();
+        Status UpdateChanges();
+
+        Status Put(const String& key, const String& value);
+        Status Get(const String& key, String& value);
+        Status Remove(const String& key);
+        bool Contains(const String& key);
+        std::vector<String> ListKeys();
+
+        Snapshot * GetSnapshot();
+        Status ReleaseSnapshot(Snapshot * snapshot);
+        Status Get(const Snapshot * snapshot, const String& key, String& value);
+        bool Contains(const Snapshot * snapshot, const String& key);
+        std::vector<String> ListKeys(const Snapshot * snapshot);
+
+        Status Write(const WriteBatch& batch);
+
+        // One pass over the table under the lock, no snapshot needed.
+        Status Scan(const String& start, int32_t limit, KeyValueList& items);
+
+        // Values are in memory already, there is nothing to cache.
+        Status EnableCache(size_t capacity);
+        bool IsOpened();
+        String OpenDbName();
+        const char * Name();
+
+    private:
+        void put_entry(const String& key, const String& value);
+        bool remove_entry(const String& key);
+        void record_version(const String& key);
+
+        std::unordered_map<String, String> table;
+        String db_name;
+        bool is_opened;
+
+        MutexLock mutex;
+        VersionLog version_log;
+    };
+} // namespace Pumper
+
+#endif // __MEMORY_ENGINE_H__
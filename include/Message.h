@@ -10,6 +10,8 @@
 #include "Types.h"
 #include "Status.h"
 
+#include <atomic>
+
 namespace Pumper {
 	enum MessageType {
 		Command = 1,
@@ -45,7 +47,7 @@ namespace Pumper {
     	int         seq_number;
         MessageType type;
     	String      payload;
-    	static int  seq_cnt;
+    	static std::atomic<int> seq_cnt;    // Commands may be built by many threads
     };
 } // namespace Pumper
 
@@ -0,0 +1,136 @@
+// PageIo.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Asynchronous page reads and writes for the buffer pool. A batch of
+// requests is sorted by file and page, runs of adjacent pages are coalesced
+// into one preadv()/pwritev(), and the runs are spread over a pool of I/O
+// threads so that many of them are in flight at once. The completion
+// callback of a batch runs on an I/O thread after its last run finished.
+//
+// This is the thread pool flavour of an io_uring submission queue: the
+// kernel interface is not available to this build, and the batches keep the
+// same shape either way.
+//
+// On disk every page is followed by a trailer with its id and a CRC32C of
+// both: written with the page and checked when it is read back, so that
+// bit rot, misdirected and torn writes surface as StatusCorruption. Files
+// registered with SetJournal() are written twice: the pages of a batch first
+// go to the journal, then in place, so that a page torn by a crash can be
+// restored from its journal copy (RecoverJournal).
+//
+// Pages of files registered with SetCompressed() are stored compressed, in
+// extents of their own size (see ExtentMap); callers see plain pages.
+
+#ifndef __PAGE_IO_H__
+#define __PAGE_IO_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+#include "Thread.h"
+#include "ExtentMap.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace Pumper {
+    const int32_t PAGE_IO_THREADS = 4;
+    const int32_t PAGE_IO_MAX_VECTOR = 64;      // Pages per preadv()/pwritev()
+
+    struct PageTrailer {
+        uint32_t checksum;                      // CRC32C of page and page_id
+        int32_t page_id;
+    };
+
+    const int32_t PAGE_TRAILER_SIZE = sizeof(PageTrailer);
+    const int32_t PHYSICAL_PAGE_SIZE = PAGE_SIZE + PAGE_TRAILER_SIZE;
+
+    struct PageIoRequest {
+        PageIoRequest(int32_t fd, int32_t page_id, int8_t * mapping, bool is_write)
+            : fd(fd), page_id(page_id), mapping(mapping), is_write(is_write) { }
+
+        int32_t fd;
+        int32_t page_id;
+        int8_t * mapping;                       // PAGE_SIZE bytes
+        bool is_write;
+    };
+
+    typedef std::function<void (const Status&)> PageIoCallback;
+
+    class PageIo : public noncopyable {
+    public:
+        explicit PageIo(int32_t num_threads = PAGE_IO_THREADS);
+        ~PageIo();
+
+        // Returns at once; callback gets the first failure of the batch, or
+        // STATUS_SUCCESS. Requests of one batch must not overlap.
+        void Submit(std::vector<PageIoRequest> requests, const PageIoCallback& callback);
+
+        // Submit() and wait for the completion.
+        Status Execute(const std::vector<PageIoRequest>& requests);
+
+        // Single page, on the calling thread
+        Status ReadPage(int32_t fd, int32_t page_id, int8_t * mapping);
+        Status WritePage(int32_t fd, int32_t page_id, int8_t * mapping);
+
+        // Pages of fd are stored compressed from now on, see above. Loads
+        // the extents of the file.
+        Status SetCompressed(int32_t fd, bool is_compressed);
+        // Compressed files only: syncs fd so that the extents of replaced
+        // copies can be reused (ExtentMap::Sync). Nothing to do otherwise.
+        Status SyncExtents(int32_t fd);
+        // Pages on disk, which reads ahead stay below
+        int32_t DiskPages(int32_t fd);
+
+        // Writes of fd go through journal_fd from now on, INVALID_FD to stop.
+        void SetJournal(int32_t fd, int32_t journal_fd);
+        bool HasJournal(int32_t fd);
+
+        // Restores the pages of fd torn by an interrupted batch from their
+        // journal copies, then empties the journal.
+        static Status RecoverJournal(int32_t fd, int32_t journal_fd, int32_t& num_restored);
+
+        static off_t PageOffset(int32_t page_id);
+
+        static void SealPage(int32_t page_id, const int8_t * mapping, PageTrailer * trailer);
+        // A page never written (all zeros, trailer included) passes as well.
+        static bool VerifyPage(int32_t page_id, const int8_t * mapping, const PageTrailer& trailer,
+            bool allow_blank = true);
+
+    private:
+        struct Batch;
+        struct Run {
+            std::shared_ptr<Batch> batch;
+            int32_t fd;
+            int32_t first_page;
+            bool is_write;
+            ExtentMap * extent_map;             // Compressed files only
+            std::vector<int8_t *> mappings;
+        };
+
+        void worker_func();
+        ExtentMap * find_extent_map(int32_t fd);
+        Status execute(const std::vector<PageIoRequest>& requests);
+        static Status write_journal(int32_t journal_fd, const std::vector<PageIoRequest>& requests);
+        static Status transfer(int32_t fd, int32_t first_page, bool is_write, ExtentMap * extent_map,
+            int8_t * const * mappings, int32_t count);
+
+        MutexLock mutex;
+        Condition cond;
+        std::deque<Run> runs;
+        std::vector<Thread *> workers;
+        bool is_stopping;
+        std::unordered_map<int32_t, ExtentMap *> extent_maps;
+
+        // Callers of HasJournal() may hold locks the I/O threads need, so
+        // the map has a lock of its own, never held across a batch.
+        MutexLock journal_mutex;
+        std::unordered_map<int32_t, int32_t> journals;
+        MutexLock journal_batch_mutex;          // Held across a journaled batch
+    };
+} // namespace Pumper
+
+#endif // __PAGE_IO_H__
@@ -14,15 +14,25 @@
 #include "Types.h"
 #include "Status.h"
 #include "Lock.h"
+#include "Buffer.h"
+
+#include <vector>
 
 namespace Pumper {
+    // Header flags, chosen at creation
+    const int8_t HEADER_DOUBLE_WRITE = 1;   // Journal page writes against torn pages
+    const int8_t HEADER_COMPRESSED = 2;     // LZ4 pages in extents, see ExtentMap
+    const int8_t HEADER_COPY_ON_WRITE = 4;  // Index pages never overwritten, see CowTree
+
     // The file header, comsuming the first 32 bytes of file
     struct Header {
         int8_t  magic[8];           // Magic bit, should be `PUMPER\0\0`.
         int32_t alloc_pages;        // Current allocated pages.
         int32_t free_list_head;     // Point to first free page.
         int32_t first_page;         // First page in logical perspective.
-        int8_t reserved[17];        // I don't know how to allocate them
+        int8_t flags;               // HEADER_DOUBLE_WRITE, HEADER_COMPRESSED, ...
+        int8_t key_hash;            // KeyHashKind of the index in this file
+        int8_t reserved[8];         // I don't know how to allocate them
         uint16_t checksum;          // For error detection (only for header part).
     };
 
@@ -33,10 +43,18 @@ namespace Pumper {
         PagedFile();
         ~PagedFile();
 
-        // Create or Unlink the physical file.
-        static Status Create(const String& file);
+        // Create or Unlink the physical file. With HEADER_DOUBLE_WRITE, pages
+        // are written to `file.DW` first, and pages torn by a crash are
+        // restored from there when the file is opened. HEADER_COMPRESSED never
+        // overwrites the current copy of a page, and does not combine with
+        // HEADER_DOUBLE_WRITE.
+        static Status Create(const String& file, int8_t flags = 0);
         static Status Unlink(const String& file);
 
+        // Offline check of a closed file: collects the pages whose checksum
+        // does not match. The header must be intact.
+        static Status Scrub(const String& file, std::vector<int32_t>& bad_pages);
+
         // Open or close one file.
         // In our implementation, a paged file object could open ONLY one file in disk,
         // and one file could be opened by one paged file object. Otherwise the file will
@@ -47,26 +65,45 @@ namespace Pumper {
         
         // Allocation management of pages
         Status AllocatePage(int32_t &page_id);
-        Status ReleasePage(int32_t page_id);
+        // Without read_physical_page the content, which may be torn, is not read.
+        Status ReleasePage(int32_t page_id, bool read_physical_page = true);
+        // Takes the allocation back to a state recorded before, see CowTree.
+        Status ResetFreeSpace(int32_t alloc_pages, int32_t free_list_head);
+        int32_t GetFreeListHead() const;
         
         // Fetch allocated page and do some operations by upper procedures.
-        Status FetchPage(int32_t page_id, int8_t** page);
+        // Without read_physical_page the page is about to be overwritten.
+        Status FetchPage(int32_t page_id, int8_t** page, bool read_physical_page = true);
+        // See Buffer::FetchPageAsync()
+        Status FetchPageAsync(int32_t page_id, const PageFetchCallback& callback);
+        // Hint that pages from first_page on are read next, see Buffer::Prefetch()
+        Status Prefetch(int32_t first_page, int32_t num_pages = READAHEAD_PAGES);
         Status ForcePage(int32_t page_id = ALL_PAGES);
+        // Waits until what ForcePage() wrote is on disk.
+        Status Sync();
         Status MarkDirty(int32_t page_id);
         Status UnpinPage(int32_t page_id);
 
         Status SetRootPage(int32_t page_id);
         Status GetRootPage(int32_t &page_id);
 
+        // Hash function of the keys indexed in this file, see KeyHash.h.
+        // Files of older versions have zero, and BKDR hashes.
+        Status SetKeyHash(int8_t key_hash);
+        int8_t GetKeyHash() const;
+        int8_t GetFlags() const;
+
         bool IsFileOpened() const;
         int32_t GetTotalPages() const;
     private:
         // calculate the file header checksum
         static uint16_t calculate_checksum(Header *hdr);
+        Status write_header();
 
         // file discriptor for manipulation.
         bool is_file_opened;
         int32_t fd;
+        int32_t journal_fd;         // HEADER_DOUBLE_WRITE only
 
         // memory mapping of header in specific file. All operations that modify this
         // structure should also set the dirty bit, so the destructor function or
@@ -0,0 +1,85 @@
+// Snapshot.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Consistent read views of an Engine. We do not keep several versions of
+// each record on disk; instead, while at least one snapshot is alive, every
+// write first saves the pre-image of the record it overwrites into an
+// in-memory undo log (VersionLog). A snapshot read checks the undo log and
+// only falls back to the live data when the key has not been touched since
+// the snapshot was taken. Once the oldest snapshot is released, the undo
+// entries nobody can see anymore are purged.
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+
+#include <map>
+#include <list>
+#include <vector>
+
+namespace Pumper {
+    class VersionLog;
+
+    class Snapshot : public noncopyable {
+    public:
+        // All writes with sequence number not greater than it are visible.
+        uint64_t Sequence() const
+        {
+            return sequence;
+        }
+
+    private:
+        friend class VersionLog;
+        explicit Snapshot(uint64_t sequence) : sequence(sequence) { }
+        ~Snapshot() { }
+
+        uint64_t sequence;
+    };
+
+    // Result of looking up a key in the undo log
+    enum VersionVisibility {
+        VersionLive = 0,            // Not modified since snapshot, read live data
+        VersionPresent,             // Value at snapshot time returned in `value`
+        VersionAbsent               // Key did not exist at snapshot time
+    };
+
+    class VersionLog : public noncopyable {
+    public:
+        VersionLog();
+        ~VersionLog();
+
+        Snapshot * CreateSnapshot();
+        Status ReleaseSnapshot(Snapshot * snapshot);
+        bool HasSnapshots();
+
+        // Must be called by the writer BEFORE it applies a modification of key,
+        // with the state of the key just before the write. Caller should hold
+        // the engine lock so that recording and applying look atomic to readers.
+        void Record(const String& key, bool existed, const String& old_value);
+
+        VersionVisibility Lookup(const Snapshot * snapshot, const String& key, String& value);
+
+        // Adjust the live key set collected by a scan so that it matches the
+        // view of snapshot.
+        void MergeKeys(const Snapshot * snapshot, std::vector<String>& keys);
+
+    private:
+        struct Version {
+            uint64_t sequence;      // Sequence of the write that overwrote this image
+            bool existed;
+            String value;
+        };
+
+        void purge();
+
+        MutexLock mutex;
+        uint64_t sequence;
+        std::list<Snapshot *> snapshots;                    // Ordered by sequence
+        std::map<String, std::vector<Version> > versions;   // Ordered by sequence
+    };
+} // namespace Pumper
+
+#endif // __SNAPSHOT_H__
@@ -0,0 +1,112 @@
+// SortedRun.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Immutable file of key/value records sorted by key, written once by the
+// log-structured engine when a MemTable is flushed or runs are compacted.
+//
+// Structure: data pages come first, each one packed with whole records
+// ([key length][value length][tombstone flag][key][value]) from the front.
+// Then a chain of index pages lists the first key of every data page; the
+// root page in the file header points to the first index page. Readers
+// keep the index in memory, so a lookup reads exactly one data page.
+
+#ifndef __SORTED_RUN_H__
+#define __SORTED_RUN_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "PagedFile.h"
+
+#include <vector>
+
+namespace Pumper {
+    struct RunPageHeader {
+        int16_t count;              // Records (or index entries) in this page
+        int16_t used;               // Bytes used, including this header
+        int32_t next;               // Next index page, unused for data pages
+    };
+
+    const int32_t RUN_RECORD_OVERHEAD = 5;
+    const int32_t RUN_MAX_RECORD = PAGE_SIZE - sizeof(RunPageHeader);
+
+    class SortedRun : public noncopyable {
+    public:
+        SortedRun();
+        ~SortedRun();
+
+        Status Open(const String& file);
+        Status Close();
+
+        // The file is unlinked when this object is destroyed, that is, when
+        // the last reader holding it lets go.
+        void MarkObsolete();
+
+        // True if the run holds the key, with a value or as a tombstone.
+        bool Get(const String& key, String& value, bool& is_deleted);
+
+        int32_t NumPages() const;
+        const String& FileName() const;
+
+        class Iterator {
+        public:
+            explicit Iterator(SortedRun * run);
+            // At the first key >= start, found through the fence keys
+            Iterator(SortedRun * run, const String& start);
+            bool Valid() const;
+            void Next();
+            const String& Key() const { return key; }
+            const String& Value() const { return value; }
+            bool IsDeleted() const { return is_deleted; }
+
+        private:
+            void load_page();
+            void decode();
+
+            SortedRun * run;
+            int32_t fence;              // Index of current page in fence list
+            int32_t record, offset;     // Position inside the current page
+            int8_t page[PAGE_SIZE];
+            String key, value;
+            bool is_deleted;
+        };
+
+    private:
+        Status read_page(int32_t page_id, int8_t * buffer);
+
+        PagedFile paged_file;
+        String file_name;
+        bool is_obsolete;
+
+        // First key of every data page, and where the page is.
+        std::vector<String> fence_keys;
+        std::vector<int32_t> fence_pages;
+    };
+
+    class SortedRunBuilder : public noncopyable {
+    public:
+        SortedRunBuilder();
+        ~SortedRunBuilder();
+
+        Status Open(const String& file);
+
+        // Keys must come in strictly ascending order.
+        Status Add(const String& key, const String& value, bool is_deleted);
+        Status Finish();
+
+        int32_t NumPages() const;
+
+    private:
+        Status flush_page();
+        Status write_index();
+
+        PagedFile paged_file;
+        int8_t page[PAGE_SIZE];
+        RunPageHeader * page_header;
+        String first_key;
+
+        std::vector<String> fence_keys;
+        std::vector<int32_t> fence_pages;
+    };
+} // namespace Pumper
+
+#endif // __SORTED_RUN_H__
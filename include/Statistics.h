@@ -0,0 +1,188 @@
+// Statistics.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Process wide runtime statistics: tickers (monotonic counters), gauges and
+// latency histograms, recorded by Buffer, PagedFile, BTree, Engine and
+// Daemon. Every thread writes into its own block of relaxed atomics, so
+// recording never takes a lock or bounces a shared cache line; readers sum
+// the blocks of all threads (and of threads that have exited).
+//
+// Histograms are HDR-style: values are bucketed by their highest bit and
+// the next HISTOGRAM_SUB_BITS bits, which keeps the relative error of any
+// percentile below 1 / 2^HISTOGRAM_SUB_BITS over the whole 64-bit range.
+//
+// Statistics can be rendered as text, or in the Prometheus text format and
+// dumped to a local file periodically by a background thread.
+
+#ifndef __STATISTICS_H__
+#define __STATISTICS_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+#include "Thread.h"
+
+#include <time.h>
+#include <atomic>
+#include <vector>
+
+namespace Pumper {
+    enum Ticker {
+        BufferHits = 0,
+        BufferMisses,
+        BufferEvictions,
+        BufferDirtyEvictions,
+        BufferPrefetches,
+        BufferBackgroundWrites,
+        BufferCheckpoints,
+        PageReads,
+        PageWrites,
+        PageJournalWrites,
+        PageChecksumFailures,
+        PageCompressedBytes,
+        PagesRestored,
+        PageAllocations,
+        PageReleases,
+        BTreeSplits,
+        BTreeMerges,
+        HashIndexSplits,
+        BufferedIndexFlushes,
+        EngineCollisionFallbacks,
+        EngineFilterNegatives,
+        EngineCacheHits,
+        EngineCacheMisses,
+        NetworkConnections,
+        NetworkCommands,
+        NetworkErrors,
+        NUM_TICKERS
+    };
+
+    enum Gauge {
+        BTreeDepth = 0,
+        NUM_GAUGES
+    };
+
+    enum HistogramType {
+        PageReadNanos = 0,
+        PageWriteNanos,
+        EngineGetNanos,
+        EnginePutNanos,
+        EngineRemoveNanos,
+        CommandPutNanos,
+        CommandGetNanos,
+        CommandRemoveNanos,
+        CommandListNanos,
+        CommandScanNanos,
+        CommandStatsNanos,
+        NUM_HISTOGRAMS
+    };
+
+    const int32_t HISTOGRAM_SUB_BITS = 4;
+    const int32_t HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS;
+
+    // Merged (read side) copy of a histogram
+    class HistogramData {
+    public:
+        HistogramData();
+
+        void Add(int32_t bucket, uint64_t count);
+        void Merge(const HistogramData& that);
+
+        uint64_t Count() const { return count; }
+        uint64_t Sum() const { return sum; }
+        uint64_t Max() const { return max; }
+        double Average() const;
+
+        // Upper bound of the bucket holding the given quantile (0..1)
+        uint64_t Percentile(double quantile) const;
+
+        static int32_t BucketOf(uint64_t value);
+        static uint64_t BucketLimit(int32_t bucket);
+
+    private:
+        friend class Statistics;
+        std::vector<uint64_t> buckets;
+        uint64_t count, sum, max;
+    };
+
+    // Use through Singleton<Statistics>::Instance(); the static recording
+    // functions go to the singleton on their own.
+    class Statistics : public noncopyable {
+    public:
+        Statistics();
+        ~Statistics();
+
+        // Recording, callable from any thread without locking
+        static void Tick(Ticker ticker, uint64_t count = 1);
+        static void SetGauge(Gauge gauge, int64_t value);
+        static void Record(HistogramType type, uint64_t value);
+
+        uint64_t GetTicker(Ticker ticker);
+        int64_t GetGauge(Gauge gauge);
+        HistogramData GetHistogram(HistogramType type);
+
+        // Clears everything recorded so far, for tests and benchmarks.
+        void Reset();
+
+        static const char * TickerName(Ticker ticker);
+        static const char * GaugeName(Gauge gauge);
+        static const char * HistogramName(HistogramType type);
+
+        // One `name value` line per ticker and gauge, and count, average and
+        // percentiles per histogram; only names that start with prefix.
+        String ToString(const String& prefix = "");
+        String ToPrometheus();
+
+        // Written to a temporary file first and renamed, so scrapers never
+        // see a partial dump.
+        Status DumpPrometheus(const String& file);
+        Status StartDumper(const String& file, int32_t interval_seconds);
+        Status StopDumper();
+
+    private:
+        struct ThreadBlock;
+        struct BlockHolder;
+        friend struct BlockHolder;
+
+        static ThreadBlock * local_block();
+        void register_block(ThreadBlock * block);
+        void retire_block(ThreadBlock * block);
+        void dumper_func();
+
+        MutexLock mutex;
+        std::vector<ThreadBlock *> blocks;      // Live threads
+        ThreadBlock * retired;                  // Sum of exited threads
+        std::atomic<int64_t> gauges[NUM_GAUGES];
+
+        // Periodic Prometheus dump
+        MutexLock dumper_mutex;
+        Condition dumper_cond;
+        Thread * dumper_thread;
+        String dumper_file;
+        int32_t dumper_interval;
+        bool is_dumper_stopping;
+    };
+
+    // Records the time from construction to destruction into a histogram.
+    class StopWatch : public noncopyable {
+    public:
+        explicit StopWatch(HistogramType type) : type(type)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+
+        ~StopWatch()
+        {
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            Statistics::Record(type, (end.tv_sec - start.tv_sec) * 1000000000ull +
+                end.tv_nsec - start.tv_nsec);
+        }
+
+    private:
+        HistogramType type;
+        struct timespec start;
+    };
+} // namespace Pumper
+
+#endif // __STATISTICS_H__
@@ -22,27 +22,44 @@
 #include "Types.h"
 #include "Singleton.h"
 
+#include <memory>
+
 // Use the following macros to return the status.
 #define RETURN_SUCCESS() do { \
     return STATUS_SUCCESS; \
 } while(0);
 
-#define RETURN_INFORMATION(msg) do { \
-    return Status(Success, msg); \
+// Expected outcomes (a miss, a full page): no allocation and no logging.
+// msg must be a string literal, it is kept by pointer.
+#define RETURN_CODE(code, msg) do { \
+    return Status(code, msg); \
 } while(0);
 
+#define RETURN_NOT_FOUND() RETURN_CODE(StatusNotFound, "Item not found")
+
+#define RETURN_INFORMATION(msg) RETURN_CODE(StatusInformation, msg)
+
 #define RETURN_WARNING(msg) do { \
     char buffer[256]; \
-    sprintf(buffer, "%s\n  at function %s:%s() at line %d", msg, __FILE__, __func__, __LINE__); \
-    sprintf(buffer, "%s\n  errno: %d[%s]\n", buffer, errno, strerror(errno)); \
-    Status status = Status(Error, buffer); \
+    snprintf(buffer, sizeof(buffer), "%s\n  at function %s:%s() at line %d\n  errno: %d[%s]\n", \
+        msg, __FILE__, __func__, __LINE__, errno, strerror(errno)); \
+    Status status = Status(Warning, buffer); \
     return status; \
 } while(0);
 
+// Data read back does not match what was written. A fault the caller may
+// recover from, e.g. by scrubbing or restoring the file.
+#define RETURN_CORRUPTION(msg) do { \
+    char buffer[256]; \
+    snprintf(buffer, sizeof(buffer), "%s\n  at function %s:%s() at line %d\n", \
+        msg, __FILE__, __func__, __LINE__); \
+    return Status(Warning, buffer, StatusCorruption); \
+} while(0);
+
 #define RETURN_ERROR(msg) do { \
     char buffer[256]; \
-    sprintf(buffer, "%s\n  at function %s:%s() at line %d", msg, __FILE__, __func__, __LINE__); \
-    sprintf(buffer, "%s\n  errno: %d[%s]\n", buffer, errno, strerror(errno)); \
+    snprintf(buffer, sizeof(buffer), "%s\n  at function %s:%s() at line %d\n  errno: %d[%s]\n", \
+        msg, __FILE__, __func__, __LINE__, errno, strerror(errno)); \
     Status status = Status(Error, buffer); \
     exit(-1); \
 } while(0);
@@ -69,10 +86,33 @@ namespace Pumper {
         Error = 2
     };
 
+    // What happened, for callers that branch on a non-success outcome
+    enum StatusCode {
+        StatusOk = 0,
+        StatusNotFound,
+        StatusOutOfSpace,
+        StatusInformation,      // Other expected outcomes
+        StatusFault,            // WARNING_ASSERT, RETURN_WARNING and alike
+        StatusCorruption        // Checksum mismatch
+    };
+
+// Entries below this level are compiled out of Status construction. The
+// runtime level of the Logger can only raise it.
+#ifndef PUMPER_MIN_LOG_LEVEL
+#define PUMPER_MIN_LOG_LEVEL 1
+#endif
+
     const int32_t LOG_ENTRY_LENGTH = 1024;
     const int32_t STACK_TRACE_LENGTH = 65536;
-    const LogLevel ignored_level = LogLevel::Success;
-
+    const int32_t STACK_TRACE_FRAMES = 32;
+    const int32_t LOG_QUEUE_LENGTH = 1024;      // Entries, power of 2
+    const LogLevel min_log_level = (LogLevel) PUMPER_MIN_LOG_LEVEL;
+
+    // Appending only copies the entry (and the raw return addresses when a
+    // stack trace is wanted) into a lock-free ring. A background thread
+    // formats timestamps, symbolizes stack traces and writes pumper.log and
+    // stderr in batches. When the ring is full, entries are dropped and
+    // counted rather than holding up the caller.
     class Logger
     {
     public:
@@ -80,30 +120,58 @@ namespace Pumper {
         ~Logger();
         void Append(LogLevel log_level, const String &message, bool with_stacktrace = false);
 
+        void SetLevel(LogLevel log_level);
+        LogLevel GetLevel();
+
+        // Stack traces are captured for entries at or above this level only,
+        // Error (fatal faults) by default.
+        void SetTraceLevel(LogLevel log_level);
+        LogLevel GetTraceLevel();
+
+        // Waits until everything appended so far has been written.
+        void Flush();
+        uint64_t Dropped();
+
     private:
-        void print_stacktrace(unsigned int max_frames = 63);        
-        int32_t log_fd;
+        struct LogQueue;
+        static void flusher_func(LogQueue * queue);
+        static int32_t drain(LogQueue * queue);
+        LogQueue * queue;
     };
 
     class Status {
     public:
-        // Default constructor. But please DO NOT USE IT! Use STATUS_SUCCESS, 
-        // STATUS_WARNING or STATUS_ERROR macros instead.
-        Status(LogLevel log_level, const String& backtrace) 
+        Status() : log_level(Success), code(StatusOk), message("")
+        {
+        }
+
+        // Expected outcome, costs no more than two stores. message must
+        // outlive the Status: pass a string literal.
+        Status(StatusCode code, const char * message) : log_level(Success), code(code),
+            message(message)
         {
-            this->log_level = log_level;
-            this->backtrace = backtrace;
-            Singleton<Logger>::Instance().Append(log_level, backtrace, true);        
+        }
+
+        // Fault: the text is copied and logged, with a stack trace when the
+        // Logger trace level asks for one.
+        Status(LogLevel log_level, const String& backtrace, StatusCode fault_code = StatusFault) :
+            log_level(log_level), code(log_level == Success ? StatusInformation : fault_code),
+            message("")
+        {
+            if (!backtrace.empty())
+                detail = std::make_shared<String>(backtrace);
+            if (log_level >= min_log_level)
+                Singleton<Logger>::Instance().Append(log_level, backtrace, true);
         }
 
         bool operator==(const Status& that) const
         {
-            return this->log_level == that.log_level && this->backtrace == that.backtrace;
+            return this->log_level == that.log_level && this->code == that.code;
         }
 
         String GetBacktrace() 
         {
-            return backtrace;
+            return detail ? *detail : String(message);
         }
 
         LogLevel GetLogLevel() 
@@ -111,14 +179,21 @@ namespace Pumper {
             return log_level;
         }
 
+        StatusCode GetCode() const
+        {
+            return code;
+        }
+
     private:
         LogLevel log_level;
-        String backtrace;
+        StatusCode code;
+        const char * message;
+        std::shared_ptr<const String> detail;   // Faults only
     };
 
     // Wrappers of constructors above. Because Success is frequent, we don't want to create
     // new object again and again.
-    const Status STATUS_SUCCESS = Status(Success, "");
+    const Status STATUS_SUCCESS = Status();
 
 } // namespace Pumper
 
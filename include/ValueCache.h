@@ -0,0 +1,66 @@
+// ValueCache.h
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Read-through cache of decoded key/value pairs that sits in front of the
+// Engine, so hot keys are answered without walking the index or copying a
+// data page. The cache is split into shards, each with its own lock and its
+// own LRU list, and the memory budget is divided evenly between shards.
+// Every entry is charged the length of key and value plus a fixed overhead.
+
+#ifndef __VALUE_CACHE_H__
+#define __VALUE_CACHE_H__
+
+#include "Types.h"
+#include "Status.h"
+#include "Lock.h"
+
+#include <list>
+#include <unordered_map>
+
+namespace Pumper {
+    const int32_t CACHE_SHARDS = 16;
+    const size_t CACHE_ENTRY_OVERHEAD = 64;
+
+    class ValueCache : public noncopyable {
+    public:
+        // capacity is the memory budget in bytes over all shards
+        explicit ValueCache(size_t capacity, int32_t shards = CACHE_SHARDS);
+        ~ValueCache();
+
+        bool Lookup(const String& key, String& value);
+
+        // Insert or overwrite. Entries bigger than one shard are not admitted.
+        void Insert(const String& key, const String& value);
+        void Erase(const String& key);
+        void Clear();
+
+        size_t Capacity() const;
+        size_t Usage();
+
+    private:
+        struct CacheEntry {
+            String key;
+            String value;
+            size_t charge;
+        };
+
+        typedef std::list<CacheEntry> LruList;
+
+        struct Shard {
+            MutexLock mutex;
+            LruList lru;                // Most recently used in front
+            std::unordered_map<String, LruList::iterator> table;
+            size_t usage;
+        };
+
+        Shard & get_shard(const String& key);
+        void evict(Shard & shard);
+
+        size_t capacity;
+        size_t shard_capacity;
+        int32_t shards;
+        Shard * shard_list;
+    };
+} // namespace Pumper
+
+#endif // __VALUE_CACHE_H__
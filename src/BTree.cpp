@@ -4,99 +4,133 @@
 // B+Tree Implementation. Will use a seperate index file for
 // managing each key/value row's location and provide fast lookup
 // property.
+//
+// The tree is instantiated here for the key types in use, see the end.
 
 #include "BTree.h"
 #include "PageHandle.h"
+#include "Statistics.h"
+#include "KeySearch.h"
+#include "KeyHash.h"
 
 namespace Pumper
 {
 
-    BTree::BTree(PagedFile &pf) : pf(pf)
+    template <typename Key>
+    BasicBTree<Key>::BasicBTree(PagedFile &pf) : pf(pf), tail_leaf(-1), tail_key(0), 
+        append_run(0), is_appending(false), underfull_leaves(0)
     {
         ERROR_ASSERT(pf.IsFileOpened());         
         pf.GetRootPage(root);
     }
 
-    BTree::~BTree()
+    template <typename Key>
+    BasicBTree<Key>::~BasicBTree()
     {
 
     }
 
-    void BTree::Insert(const String &key, int32_t page_id)
+    template <typename Key>
+    void BasicBTree<Key>::Insert(Key key, int32_t page_id)
     {
-        int32_t hash = get_hash(key);
         if (root < 0)
         {
-            make_root_leaf(hash, page_id);
+            make_root_leaf(key, page_id);
         }
         else
         {
-            BTNode *leaf = find_leaf(hash);
-            if (leaf->num_keys < N_ORDER - 1)
-                insert_in_leaf(leaf, hash, page_id);
+            // Keys above all others go to the rightmost leaf, which is known
+            // without a descent once it has been seen.
+            Node *leaf;
+            if (tail_leaf >= 0 && key > tail_key)
+            {
+                leaf = load_page(tail_leaf);
+                is_appending = true;
+            }
+            else
+            {
+                leaf = find_leaf(key);
+                is_appending = leaf->pointers[Node::ORDER - 1] == -1 && 
+                    (leaf->num_keys == 0 || key > leaf->keys[leaf->num_keys - 1]);
+            }
+            append_run = is_appending ? append_run + 1 : 0;
+
+            if (leaf->num_keys < Node::ORDER - 1)
+            {
+                insert_in_leaf(leaf, key, page_id);
+                if (leaf->pointers[Node::ORDER - 1] == -1)
+                {
+                    tail_leaf = leaf->id;
+                    tail_key = leaf->keys[leaf->num_keys - 1];
+                }
+            }
             else
-                insert_in_leaf_splitted(leaf, hash, page_id);
+                insert_in_leaf_splitted(leaf, key, page_id);
             unload_page(leaf);
         }
     }
 
-    void BTree::Remove(const String &key)
+    template <typename Key>
+    void BasicBTree<Key>::Remove(Key key)
     {
-        int32_t hash = get_hash(key);
-        BTNode * key_leaf = find_leaf(hash);
-        delete_entry(key_leaf, hash);
+        if (root < 0)
+            return;
+
+        Node * key_leaf = find_leaf(key);
+        delete_entry(key_leaf, key);
         unload_page(key_leaf);
+
+        // Rebalanced once enough leaves have run low
+        if (underfull_leaves >= BTREE_REBALANCE_THRESHOLD)
+            Rebalance();
     }
 
-    bool BTree::Search(const String &key, int32_t &page_id)
+    template <typename Key>
+    bool BasicBTree<Key>::Search(Key key, int32_t &page_id)
     {
-        int32_t hash = get_hash(key);
         int32_t slot;
 
         if (root < 0)
             return false;
 
-        BTNode *leaf = find_leaf(hash);
+        Node *leaf = find_leaf(key);
         
         // leaf should be leaf part now
-        for (slot = 0; slot < leaf->num_keys; slot++)
+        slot = LowerBound(leaf->keys, leaf->num_keys, key);
+        if (slot < leaf->num_keys && key == leaf->keys[slot])
         {
-            if (hash == leaf->keys[slot])
-            {
-                page_id = leaf->pointers[slot];
-                unload_page(leaf);
-                return true;
-            }
+            page_id = leaf->pointers[slot];
+            unload_page(leaf);
+            return true;
         }
         unload_page(leaf);
         return false;
     }
 
-    bool BTree::Update(const String &key, int32_t new_page_id)
+    template <typename Key>
+    bool BasicBTree<Key>::Update(Key key, int32_t new_page_id)
     {
-        int32_t hash = get_hash(key);
         int32_t slot;
 
         if (root < 0)
             return false;
 
-        BTNode *leaf = find_leaf(hash);
+        Node *leaf = find_leaf(key);
         
         // leaf should be leaf part now
-        for (slot = 0; slot < leaf->num_keys; slot++)
+        slot = LowerBound(leaf->keys, leaf->num_keys, key);
+        if (slot < leaf->num_keys && key == leaf->keys[slot])
         {
-            if (hash == leaf->keys[slot])
-            {
-                leaf->pointers[slot] = new_page_id;
-                unload_page(leaf);
-                return true;
-            }
+            leaf->pointers[slot] = new_page_id;
+            unload_page(leaf);
+            return true;
         }
         unload_page(leaf);
         return false;
     }
 
-    void BTree::PrintDebugInfo()
+    template <typename Key>
+    void BasicBTree<Key>::PrintDebugInfo()
     {
         /*
         for (int i = 0; i < 32; i++)
@@ -113,93 +147,84 @@ namespace Pumper
         */
     }
 
-    BTNode * BTree::find_leaf(int32_t hash)
+    template <typename Key>
+    typename BasicBTree<Key>::Node * BasicBTree<Key>::find_leaf(Key key)
     {
-        BTNode *node = load_page(root);
+        Node *node = load_page(root);
         int32_t slot, next;
+        int32_t depth = 1;
 
         while (node->is_leaf == 0)
         {
+            depth++;
             // Still in internal nodes
-            slot = 0;
-            while (slot < node->num_keys && hash >= node->keys[slot])
-                slot++;
+            slot = UpperBound(node->keys, node->num_keys, key);
             next = node->pointers[slot];
             unload_page(node);
             node = load_page(next);
         }
 
+        Statistics::SetGauge(BTreeDepth, depth);
         return node;
     }
 
-    // Using BKDR Hash
-    int32_t BTree::get_hash(const String &key)
-    {
-        uint32_t seed = 131;
-        uint32_t hash = 0;
-        uint8_t *p = (uint8_t *) key.c_str();
-
-        while (*p)
-            hash = hash * seed + (*p++);
-        return (int32_t) (hash % 1000000007);
-    }
-
-    void BTree::make_root_leaf(int hash, int page_id)
+    template <typename Key>
+    void BasicBTree<Key>::make_root_leaf(Key key, int page_id)
     {
         root = lease_page();
         pf.SetRootPage(root);
-        BTNode *node = load_page(root);
+        Node *node = load_page(root);
 
-        memset(node, 0, sizeof(BTNode));
+        memset(node, 0, sizeof(Node));
         node->is_leaf = 1;
         node->id = root;
         node->parent = -1;
         node->prev = -1;
         node->next = -1;
 
-        node->keys[0] = hash;
+        node->keys[0] = key;
         node->pointers[0] = page_id;
-        node->pointers[N_ORDER - 1] = -1;
+        node->pointers[Node::ORDER - 1] = -1;
         node->num_keys++;
+        tail_leaf = root;
+        tail_key = key;
 
         unload_page(node);
     }
 
-    void BTree::insert_in_leaf(BTNode * leaf, int hash, int page_id)
+    template <typename Key>
+    void BasicBTree<Key>::insert_in_leaf(Node * leaf, Key key, int page_id)
     {
-        int insert_point = 0;
-        while (insert_point < leaf->num_keys && leaf->keys[insert_point] < hash)
-            insert_point++;
+        int insert_point = LowerBound(leaf->keys, leaf->num_keys, key);
+        int num_moved = leaf->num_keys - insert_point;
 
-        for (int i = leaf->num_keys; i > insert_point; i--)
-        {
-            leaf->keys[i] = leaf->keys[i - 1];
-            leaf->pointers[i] = leaf->pointers[i - 1];
-        }
+        memmove(&leaf->keys[insert_point + 1], &leaf->keys[insert_point], num_moved * sizeof(Key));
+        memmove(&leaf->pointers[insert_point + 1], &leaf->pointers[insert_point], 
+            num_moved * sizeof(int32_t));
 
-        leaf->keys[insert_point] = hash;
+        leaf->keys[insert_point] = key;
         leaf->pointers[insert_point] = page_id;
         leaf->num_keys++;
     }
 
-    void BTree::insert_in_leaf_splitted(BTNode * leaf, int hash, int page_id)
+    template <typename Key>
+    void BasicBTree<Key>::insert_in_leaf_splitted(Node * leaf, Key key, int page_id)
     {
+        Statistics::Tick(BTreeSplits);
         int32_t new_leaf_id = lease_page();
-        BTNode *new_leaf = load_page(new_leaf_id);
+        Node *new_leaf = load_page(new_leaf_id);
 
-        memset(new_leaf, 0, sizeof(BTNode));
+        memset(new_leaf, 0, sizeof(Node));
         new_leaf->is_leaf = 1;
         new_leaf->id = new_leaf_id;
         new_leaf->parent = -1;
         new_leaf->prev = -1;
         new_leaf->next = -1;
 
-        int32_t temp_keys[N_ORDER];
-        int32_t temp_pointers[N_ORDER];
+        Key temp_keys[Node::ORDER];
+        int32_t temp_pointers[Node::ORDER];
 
-        int insert_point = 0;
-        while (insert_point < leaf->num_keys && leaf->keys[insert_point] < hash)
-            insert_point++;
+        int insert_point = LowerBound(leaf->keys, leaf->num_keys, key);
 
         int i, j;
         // j is used to skip the insert_point element.
@@ -211,12 +236,12 @@ namespace Pumper
             temp_pointers[j] = leaf->pointers[i];
         }
 
-        temp_keys[insert_point] = hash;
+        temp_keys[insert_point] = key;
         temp_pointers[insert_point] = page_id;
 
         leaf->num_keys = 0;
 
-        int split = (N_ORDER + 1) / 2;
+        int split = split_point();
 
         for (i = 0; i < split; i++) 
         {
@@ -225,51 +250,72 @@ namespace Pumper
             leaf->num_keys++;
         }
 
-        for (i = split, j = 0; i < N_ORDER; i++, j++) 
+        for (i = split, j = 0; i < Node::ORDER; i++, j++) 
         {
             new_leaf->pointers[j] = temp_pointers[i];
             new_leaf->keys[j] = temp_keys[i];
             new_leaf->num_keys++;
         }
         
-        new_leaf->pointers[N_ORDER - 1] = leaf->pointers[N_ORDER - 1];
-        leaf->pointers[N_ORDER - 1] = new_leaf->id;
+        new_leaf->pointers[Node::ORDER - 1] = leaf->pointers[Node::ORDER - 1];
+        leaf->pointers[Node::ORDER - 1] = new_leaf->id;
         new_leaf->parent = leaf->parent;
+        if (new_leaf->pointers[Node::ORDER - 1] == -1)
+        {
+            tail_leaf = new_leaf->id;
+            tail_key = new_leaf->keys[new_leaf->num_keys - 1];
+        }
 
-        int32_t new_key = new_leaf->keys[0];
+        Key new_key = new_leaf->keys[0];
         insert_into_parent(leaf, new_leaf, new_key);
 
         unload_page(new_leaf);
     }
 
-    void BTree::insert_into_parent(BTNode * left, BTNode * right, int hash)
+    // Where a full node of ORDER entries is cut: the left node keeps split
+    // of them. Appends only ever add to the rightmost nodes, so the left one
+    // is left (nearly) full instead of half empty: 90/10 on the first
+    // append, and the new entry alone in the new node once appends repeat.
+    template <typename Key>
+    int32_t BasicBTree<Key>::split_point()
+    {
+        if (!is_appending)
+            return (Node::ORDER + 1) / 2;
+        if (append_run >= BTREE_SEQUENTIAL_RUN)
+            return Node::ORDER - 1;
+        return Node::ORDER * 9 / 10;
+    }
+
+    template <typename Key>
+    void BasicBTree<Key>::insert_into_parent(Node * left, Node * right, Key key)
     {    
         if (left->parent == -1)
-            insert_into_new_root(left, right, hash);
+            insert_into_new_root(left, right, key);
         else
         {        
-            BTNode * parent = load_page(left->parent);
+            Node * parent = load_page(left->parent);
 
             int left_index = 0;
             while (left_index <= parent->num_keys && parent->pointers[left_index] != left->id)
                 left_index++;
 
-            if (parent->num_keys < N_ORDER - 1)
-                insert_node(parent, left_index, hash, right);
+            if (parent->num_keys < Node::ORDER - 1)
+                insert_node(parent, left_index, key, right);
             else
-                insert_node_split(parent, left_index, hash, right); 
+                insert_node_split(parent, left_index, key, left, right); 
 
             unload_page(parent);
         }
     }
 
-    void BTree::insert_into_new_root(BTNode * left, BTNode * right, int32_t key)
+    template <typename Key>
+    void BasicBTree<Key>::insert_into_new_root(Node * left, Node * right, Key key)
     {
         root = lease_page();
         pf.SetRootPage(root);
-        BTNode *node = load_page(root);
+        Node *node = load_page(root);
 
-        memset(node, 0, sizeof(BTNode));
+        memset(node, 0, sizeof(Node));
         node->id = root;
         node->parent = -1;
         node->prev = -1;
@@ -286,25 +332,29 @@ namespace Pumper
         unload_page(node);
     }
 
-    void BTree::insert_node(BTNode * parent, int left_index, int32_t key, BTNode * right)
+    template <typename Key>
+    void BasicBTree<Key>::insert_node(Node * parent, int left_index, Key key, Node * right)
     {
-        for (int i = parent->num_keys; i > left_index; i--)
-        {
-            parent->pointers[i + 1] = parent->pointers[i];
-            parent->keys[i] = parent->keys[i - 1];
-        }
+        int num_moved = parent->num_keys - left_index;
+
+        memmove(&parent->pointers[left_index + 2], &parent->pointers[left_index + 1], 
+            num_moved * sizeof(int32_t));
+        memmove(&parent->keys[left_index + 1], &parent->keys[left_index], num_moved * sizeof(Key));
 
         parent->pointers[left_index + 1] = right->id;
         parent->keys[left_index] = key;
         parent->num_keys++;
     }
 
-    void BTree::insert_node_split(BTNode * old_node, int left_index, int32_t key, BTNode * right)
+    template <typename Key>
+    void BasicBTree<Key>::insert_node_split(Node * old_node, int left_index, Key key, 
+        Node * left, Node * right)
     {
+        Statistics::Tick(BTreeSplits);
         int32_t new_node_id = lease_page();
-        BTNode *new_node = load_page(new_node_id);
+        Node *new_node = load_page(new_node_id);
 
-        memset(new_node, 0, sizeof(BTNode));
+        memset(new_node, 0, sizeof(Node));
         new_node->id = new_node_id;
         new_node->parent = -1;
         new_node->prev = -1;
@@ -312,8 +362,8 @@ namespace Pumper
 
         int i, j;
 
-        int32_t temp_keys[N_ORDER];
-        int32_t temp_pointers[N_ORDER];
+        Key temp_keys[Node::ORDER];
+        int32_t temp_pointers[Node::ORDER + 1];
 
         for (i = 0, j = 0; i < old_node->num_keys + 1; i++, j++) 
         {
@@ -332,7 +382,7 @@ namespace Pumper
         temp_pointers[left_index + 1] = right->id;
         temp_keys[left_index] = key;
         
-        int split = (N_ORDER + 1) / 2;
+        int split = split_point();
         old_node->num_keys = 0;
 
         for (i = 0; i < split - 1; i++) 
@@ -344,9 +394,9 @@ namespace Pumper
 
         old_node->pointers[i] = temp_pointers[i];
 
-        int32_t new_key = temp_keys[split - 1];
+        Key new_key = temp_keys[split - 1];
 
-        for (++i, j = 0; i < N_ORDER; i++, j++) 
+        for (++i, j = 0; i < Node::ORDER; i++, j++) 
         {
             new_node->pointers[j] = temp_pointers[i];
             new_node->keys[j] = temp_keys[i];
@@ -356,261 +406,223 @@ namespace Pumper
         new_node->pointers[j] = temp_pointers[i];
         new_node->parent = old_node->parent;
 
+        // left and right are written back by the callers, so they must not
+        // be reloaded here
         for (i = 0; i <= new_node->num_keys; i++) 
         {
-            BTNode * child = load_page(new_node->pointers[i]);
-            child->parent = new_node->id;
-            unload_page(child);
+            if (new_node->pointers[i] == left->id)
+                left->parent = new_node->id;
+            else if (new_node->pointers[i] == right->id)
+                right->parent = new_node->id;
+            else
+            {
+                Node * child = load_page(new_node->pointers[i]);
+                child->parent = new_node->id;
+                unload_page(child);
+            }
         }
 
         insert_into_parent(old_node, new_node, new_key);
         unload_page(new_node);
     }
 
-    void BTree::delete_entry(BTNode * node, int hash)
+    // Underfull nodes are left in place: a delete writes its leaf and
+    // nothing else, and Rebalance() merges leaves later on.
+    template <typename Key>
+    void BasicBTree<Key>::delete_entry(Node * node, Key key)
     {
-        int left = 0;
         int num_pointers = node->is_leaf ? node->num_keys : node->num_keys + 1;
+        int left = LowerBound(node->keys, node->num_keys, key);
 
-        while (node->keys[left] != hash)
-            left++;
-        for (int i = left + 1; i < node->num_keys; i++)
-            node->keys[i - 1] = node->keys[i];
-        for (int i = left + 1; i < num_pointers; i++)
-            node->pointers[i - 1] = node->pointers[i];
+        if (left == node->num_keys || node->keys[left] != key)
+            return;
+        memmove(&node->keys[left], &node->keys[left + 1], (node->num_keys - left - 1) * sizeof(Key));
+        memmove(&node->pointers[left], &node->pointers[left + 1], 
+            (num_pointers - left - 1) * sizeof(int32_t));
         
         node->num_keys--;
-
-        /*
-        if (node->id == root && node->num_keys == 0) 
-            adjust_root();
-        else
-        {
-            int min_keys = node->is_leaf ? (N_ORDER - 1) / 2 : N_ORDER / 2 - 1;
-            int capacity = node->is_leaf ? N_ORDER : N_ORDER - 1;
-
-            if (node->num_keys >= min_keys)
-                return;
-
-            BTNode *parent_node = load_page(node->parent);
-
-            int neighbor_index;
-            for (int i = 0; i <= parent_node->num_keys; i++)
-            {
-                if (parent_node->pointers[i] == node->id)
-                {
-                    neighbor_index = i - 1;
-                    break;
-                }
-            }
-
-            int k_prime_index = neighbor_index == -1 ? 0 : neighbor_index;
-            int k_prime = parent_node->keys[k_prime_index];
-            BTNode *neighbor = load_page(neighbor_index == -1 ? 
-                parent_node->pointers[1] : parent_node->pointers[neighbor_index]);
-
-            if (neighbor->num_keys + node->num_keys < capacity) {
-                int node_id = node->id;
-                coalesce_nodes(node, neighbor, neighbor_index, k_prime);
-                recycle_page(node_id);
-            }
-            else
-                redistribute_nodes(node, neighbor, neighbor_index, k_prime_index, k_prime);
-
-            unload_page(parent_node);
-            unload_page(neighbor);
-        }
-        */
+        if (node->is_leaf && node->num_keys == BTREE_UNDERFULL(Node::ORDER) - 1)
+            underfull_leaves++;
+        if (node->is_leaf && node->num_keys < BTREE_UNDERFULL(Node::ORDER))
+            underfull.insert(node->id);
     }
 
-    void BTree::adjust_root() 
+    template <typename Key>
+    int32_t BasicBTree<Key>::Rebalance()
     {
-        int32_t orig_root = root;
-        BTNode *root_node = load_page(root);
-
-        if (!root_node->is_leaf) {
-            root = root_node->pointers[0];
-            pf.SetRootPage(root);
-            unload_page(root_node);
-            root_node = load_page(root);
-            root_node->parent = -1;            
-        }
-        else
+        underfull_leaves = 0;
+        if (root < 0)
         {
-            root = -1;
-            pf.SetRootPage(root);
+            underfull.clear();
+            return 0;
         }
-        unload_page(root_node);
-        recycle_page(orig_root);
-    }
 
-    void BTree::coalesce_nodes(BTNode * node, BTNode * neighbor, int neighbor_index, int k_prime) 
-    {
-        int i, j, neighbor_insertion_index, node_end;
-
-        if (neighbor_index == -1) 
+        // A leaf merged away leaves the set, pages are only freed here.
+        int32_t num_freed = 0;
+        while (!underfull.empty())
         {
-            // swap node and neighbor
-            // swap_btnode(node, neighbor);
-            BTNode dummy;
-            memcpy(&dummy, node, sizeof(BTNode));
-            memcpy(node, neighbor, sizeof(BTNode));
-            memcpy(neighbor, node, sizeof(BTNode));
+            Node * leaf = load_page(*underfull.begin());
+            underfull.erase(underfull.begin());
+            int32_t id = leaf->id, parent_id = leaf->parent;
+            bool is_leaf = leaf->is_leaf;
+            delete leaf;
+            if (!is_leaf || parent_id < 0)
+                continue;
+
+            // Into its left neighbour, or else its right one into it
+            Node * parent = load_page(parent_id);
+            int32_t slot = 0;
+            while (slot <= parent->num_keys && parent->pointers[slot] != id)
+                slot++;
+            int32_t num_merged = 0;
+            if (slot > 0 && slot <= parent->num_keys)
+                num_merged = merge_leaves(parent, slot - 1);
+            if (!num_merged && slot <= parent->num_keys)
+                num_merged = merge_leaves(parent, slot);
+            if (num_merged)
+                unload_page(parent);
+            else
+                delete parent;
+            num_freed += num_merged;
         }
 
-        neighbor_insertion_index = neighbor->num_keys;
-
-        if (!node->is_leaf) 
-        {
-            neighbor->keys[neighbor_insertion_index] = k_prime;
-            neighbor->num_keys++;
-
-            node_end = node->num_keys;
-
-            for (i = neighbor_insertion_index + 1, j = 0; j < node_end; i++, j++) 
-            {
-                neighbor->keys[i] = node->keys[j];
-                neighbor->pointers[i] = node->pointers[j];
-                neighbor->num_keys++;
-                node->num_keys--;
-            }
-
-            neighbor->pointers[i] = node->pointers[j];
-
-            for (i = 0; i < neighbor->num_keys + 1; i++) 
-            {
-                BTNode * tmp = load_page(neighbor->pointers[i]);
-                tmp->parent = neighbor->id;
-                unload_page(tmp);
-            }
-        }
-        else 
+        // Inner nodes are not merged, but a root left with one child goes.
+        for (;;)
         {
-            for (i = neighbor_insertion_index, j = 0; j < node->num_keys; i++, j++) 
-            {
-                neighbor->keys[i] = node->keys[j];
-                neighbor->pointers[i] = node->pointers[j];
-                neighbor->num_keys++;
-            }
-            neighbor->pointers[N_ORDER - 1] = node->pointers[N_ORDER - 1];
+            Node * root_node = load_page(root);
+            bool is_collapsible = !root_node->is_leaf && root_node->num_keys == 0;
+            delete root_node;
+            if (!is_collapsible)
+                break;
+            adjust_root();
+            num_freed++;
         }
-
-        BTNode * parent_node = load_page(node->parent);
-        delete_entry(parent_node, k_prime);
-        unload_page(parent_node);
+        return num_freed;
     }
 
-    void BTree::redistribute_nodes(BTNode * node, BTNode * neighbor, int neighbor_index, 
-        int k_prime_index, int k_prime) 
+    // Merges the leaves right of the child in slot into it while they fill
+    // at most BTREE_MERGE_FILL of a leaf together. Returns the pages freed,
+    // the parent is changed and left to the caller to write if any.
+    template <typename Key>
+    int32_t BasicBTree<Key>::merge_leaves(Node * node, int32_t slot)
     {
-        int i;
-        BTNode * parent_node;
-
-        if (neighbor_index != -1) {
-            if (!node->is_leaf)
-                node->pointers[node->num_keys + 1] = node->pointers[node->num_keys];
-
-            for (i = node->num_keys; i > 0; i--) 
-            {
-                node->keys[i] = node->keys[i - 1];
-                node->pointers[i] = node->pointers[i - 1];
-            }
-
-            if (!node->is_leaf) 
-            {
-                node->pointers[0] = neighbor->pointers[neighbor->num_keys];
-
-                BTNode * tmp = load_page(neighbor->pointers[0]);
-                tmp->parent = node->id;
-                unload_page(tmp);
-
-                neighbor->pointers[neighbor->num_keys] = -1;
-                node->keys[0] = k_prime;
-
-                parent_node = load_page(node->parent);
-                parent_node->keys[k_prime_index] = neighbor->keys[neighbor->num_keys - 1];
-                unload_page(parent_node);
-            }
-            else 
-            {
-                node->pointers[0] = neighbor->pointers[neighbor->num_keys - 1];
-                neighbor->pointers[neighbor->num_keys - 1] = -1;
-                node->keys[0] = neighbor->keys[neighbor->num_keys - 1];
-
-                parent_node = load_page(node->parent);
-                parent_node->keys[k_prime_index] = node->keys[0];
-                unload_page(parent_node);
-            }
-        }
-        else 
-        {  
-            if (node->is_leaf) 
-            {
-                node->keys[node->num_keys] = neighbor->keys[0];
-                node->pointers[node->num_keys] = neighbor->pointers[0];
-
-                parent_node = load_page(node->parent);
-                parent_node->keys[k_prime_index] = neighbor->keys[1];
-                unload_page(parent_node);
-            }
-            else 
-            {
-                node->keys[node->num_keys] = k_prime;
-                node->pointers[node->num_keys + 1] = neighbor->pointers[0];
-
-                BTNode * tmp = load_page(node->pointers[node->num_keys + 1]);
-                tmp->parent = node->id;
-                unload_page(tmp);
-
-                parent_node = load_page(node->parent);
-                parent_node->keys[k_prime_index] = neighbor->keys[0];
-                unload_page(parent_node);
-            }
-
-            for (i = 0; i < neighbor->num_keys - 1; i++) 
+        int32_t num_freed = 0;
+        Node * left = load_page(node->pointers[slot]);
+        while (slot < node->num_keys)
+        {
+            Node * right = load_page(node->pointers[slot + 1]);
+            if (left->num_keys + right->num_keys > BTREE_MERGE_FILL(Node::ORDER))
             {
-                neighbor->keys[i] = neighbor->keys[i + 1];
-                neighbor->pointers[i] = neighbor->pointers[i + 1];
+                delete right;
+                break;
             }
 
-            if (!node->is_leaf)
-                neighbor->pointers[i] = neighbor->pointers[i + 1];
+            Statistics::Tick(BTreeMerges);
+            memcpy(&left->keys[left->num_keys], right->keys, right->num_keys * sizeof(Key));
+            memcpy(&left->pointers[left->num_keys], right->pointers, right->num_keys * sizeof(int32_t));
+            left->num_keys += right->num_keys;
+            left->pointers[Node::ORDER - 1] = right->pointers[Node::ORDER - 1];
+
+            // The separator left of right goes with it
+            memmove(&node->keys[slot], &node->keys[slot + 1], (node->num_keys - slot - 1) * sizeof(Key));
+            memmove(&node->pointers[slot + 1], &node->pointers[slot + 2], 
+                (node->num_keys - slot - 1) * sizeof(int32_t));
+            node->num_keys--;
+
+            int32_t right_id = right->id;
+            delete right;
+            underfull.erase(right_id);
+            recycle_page(right_id);
+            num_freed++;
         }
+        // Untouched leaves are not written back
+        if (num_freed)
+            unload_page(left);
+        else
+            delete left;
+        return num_freed;
+    }
 
-        node->num_keys++;
-        neighbor->num_keys--;
+    // Root is an inner node with a single child, which takes its place.
+    template <typename Key>
+    void BasicBTree<Key>::adjust_root() 
+    {
+        int32_t orig_root = root;
+        Node *root_node = load_page(root);
 
+        root = root_node->pointers[0];
+        pf.SetRootPage(root);
+        delete root_node;
+        root_node = load_page(root);
+        root_node->parent = -1;
+        unload_page(root_node);
+        recycle_page(orig_root);
     }
 
-    BTNode * BTree::load_page(int32_t id)
+    template <typename Key>
+    typename BasicBTree<Key>::Node * BasicBTree<Key>::load_page(int32_t id)
     {
-        BTNode * bt_node = new BTNode();
+        Node * bt_node = new Node();
         PageHandle ph;
         ph.OpenPage(pf, id);
-        ph.Read((char *) bt_node, sizeof(BTNode));
+        ph.Read((char *) bt_node, sizeof(Node));
         ph.ClosePage();
         return bt_node;
     }
 
-    void BTree::unload_page(BTNode * bt_node)
+    template <typename Key>
+    void BasicBTree<Key>::unload_page(Node * bt_node)
     {
         PageHandle ph;
         ph.OpenPage(pf, bt_node->id);
-        ph.Write((char *) bt_node, sizeof(BTNode));
+        ph.Write((char *) bt_node, sizeof(Node));
         ph.ClosePage();
         delete bt_node;
     }
 
-    int32_t BTree::lease_page()
+    template <typename Key>
+    int32_t BasicBTree<Key>::lease_page()
     {
         int32_t id;
         pf.AllocatePage(id);
         return id;
     }
 
-    void BTree::recycle_page(int32_t id)
+    template <typename Key>
+    void BasicBTree<Key>::recycle_page(int32_t id)
     {
+        // Leaves may have been merged, find the rightmost one again
+        tail_leaf = -1;
         pf.ReleasePage(id);
     }
 
+    template class BasicBTree<uint64_t>;
+
+    BTree::BTree(PagedFile &pf) : BasicBTree<uint64_t>(pf)
+    {
+        // Only a file without pages can take the hash
+        if (pf.GetTotalPages() == 0)
+            pf.SetKeyHash(KeyHashWide);
+    }
+
+    void BTree::Insert(const String &key, int32_t page_id)
+    {
+        BasicBTree<uint64_t>::Insert(KeyHash64(key), page_id);
+    }
+
+    void BTree::Remove(const String &key)
+    {
+        BasicBTree<uint64_t>::Remove(KeyHash64(key));
+    }
+
+    bool BTree::Search(const String &key, int32_t &page_id)
+    {
+        return BasicBTree<uint64_t>::Search(KeyHash64(key), page_id);
+    }
+
+    bool BTree::Update(const String &key, int32_t new_page_id)
+    {
+        return BasicBTree<uint64_t>::Update(KeyHash64(key), new_page_id);
+    }
+
 } // namespace Pumper
@@ -0,0 +1,98 @@
+// BloomFilter.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// In-memory Bloom filter over string keys.
+
+#include "BloomFilter.h"
+
+namespace Pumper {
+    BloomFilter::BloomFilter() : num_hashes(BLOOM_HASHES)
+    {
+
+    }
+
+    BloomFilter::~BloomFilter()
+    {
+
+    }
+
+    void BloomFilter::Reset(int32_t num_bytes, int32_t num_hashes)
+    {
+        bits.assign(num_bytes, 0);
+        this->num_hashes = num_hashes;
+    }
+
+    // Double hashing (Kirsch and Mitzenmacher): probe i is h1 + i * h2.
+    void BloomFilter::Add(const String& key)
+    {
+        if (bits.empty())
+            return;
+
+        uint64_t h = hash(key);
+        uint32_t h1 = (uint32_t) h, h2 = (uint32_t) (h >> 32) | 1;
+        uint64_t num_bits = (uint64_t) bits.size() * 8;
+        for (int32_t i = 0; i < num_hashes; i++)
+        {
+            uint64_t bit = (h1 + (uint64_t) i * h2) % num_bits;
+            bits[bit >> 3] |= (uint8_t) (1 << (bit & 7));
+        }
+    }
+
+    bool BloomFilter::MayContain(const String& key) const
+    {
+        // An empty filter knows nothing
+        if (bits.empty())
+            return true;
+
+        uint64_t h = hash(key);
+        uint32_t h1 = (uint32_t) h, h2 = (uint32_t) (h >> 32) | 1;
+        uint64_t num_bits = (uint64_t) bits.size() * 8;
+        for (int32_t i = 0; i < num_hashes; i++)
+        {
+            uint64_t bit = (h1 + (uint64_t) i * h2) % num_bits;
+            if (!(bits[bit >> 3] & (1 << (bit & 7))))
+                return false;
+        }
+        return true;
+    }
+
+    int32_t BloomFilter::Capacity() const
+    {
+        return (int32_t) (bits.size() * 8 / BLOOM_BITS_PER_KEY);
+    }
+
+    uint8_t * BloomFilter::Bits()
+    {
+        return bits.data();
+    }
+
+    int32_t BloomFilter::Size() const
+    {
+        return (int32_t) bits.size();
+    }
+
+    int32_t BloomFilter::NumHashes() const
+    {
+        return num_hashes;
+    }
+
+    // 64-bit FNV-1a over the whole key, followed by a murmur3 finalizer so
+    // that both halves are well mixed.
+    uint64_t BloomFilter::hash(const String& key)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (uint32_t i = 0; i < key.size(); i++)
+        {
+            h ^= (uint8_t) key[i];
+            h *= 1099511628211ULL;
+        }
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+} // namespace Pumper
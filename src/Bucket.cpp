@@ -259,7 +259,8 @@ namespace Pumper {
         while (slice_offset > 0) 
         {
             StringSlice * slice = (StringSlice *) (payload + slice_offset);
-            builder = builder + String(slice->str_buf, SLICE_LENGTH);
+            // The last slice is padded with zeros, do not leak them to callers.
+            builder.append(slice->str_buf, strnlen(slice->str_buf, SLICE_LENGTH));
 
             slice_offset = slice->next;
         }
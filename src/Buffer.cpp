@@ -9,6 +9,7 @@
 #include "Status.h"
 #include "Buffer.h"
 #include "HashTable.h"
+#include "Statistics.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -16,10 +17,14 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <algorithm>
 
 namespace Pumper {    
 
-    Buffer::Buffer()
+    Buffer::Buffer() : page_loaded(mutex), writer_wakeup(mutex),
+        dirty_limit(BUFFER_SIZE * DEFAULT_DIRTY_RATIO),
+        checkpoint_interval(DEFAULT_CHECKPOINT_INTERVAL), is_writer_stopping(false)
     {
         for (int i = 0; i < BUFFER_SIZE; i++)
         {
@@ -32,20 +37,36 @@ namespace Pumper {
             buffer_chain[i].fd = INVALID_FD;
             buffer_chain[i].page_id = INVALID_PAGE_ID;
             buffer_chain[i].pin_count = 0;
+            buffer_chain[i].is_dirty = false;
+            buffer_chain[i].is_loading = false;
+            buffer_chain[i].is_writing = false;
+            writer_pages[i] = new int8_t[PAGE_SIZE];
         }
 
         free_list_head = 0;
         first = INVALID_SLOT_ID;
         last = INVALID_SLOT_ID;
+
+        writer_thread = new Thread(std::bind(&Buffer::writer_func, this), "buffer_writer");
+        writer_thread->Start();
     }
 
     Buffer::~Buffer()
     {
+        {
+            LockGuard lock_guard(mutex);
+            is_writer_stopping = true;
+            writer_wakeup.Notify();
+        }
+        writer_thread->Join();
+        delete writer_thread;
+
         Clear(true);
         for (int i = 0; i < BUFFER_SIZE; i++)
         {
             if (buffer_chain[i].mapping)
                 delete[] buffer_chain[i].mapping;
+            delete[] writer_pages[i];
         }
     }
 
@@ -65,13 +86,17 @@ namespace Pumper {
     Status Buffer::FetchPage(int32_t fd, int32_t page_id, int8_t** page, bool read_physical_page, 
         bool allow_multiple_pins)
     {
+        LockGuard lock_guard(mutex);
         int32_t slot_id = 0;
-        if (hash_table.TryFind(fd, page_id, slot_id))
+        bool is_resident;
+        RETHROW_ON_EXCEPTION(find_or_allocate(fd, page_id, slot_id, is_resident));
+        if (is_resident)
         {
             // The slot exists, we should check if it's able to pin. Then pin it in the buffer
             WARNING_ASSERT(slot_id >= 0 && slot_id < BUFFER_SIZE);
             WARNING_ASSERT(!(allow_multiple_pins == false && buffer_chain[slot_id].pin_count > 0));
             buffer_chain[slot_id].pin_count++;
+            Statistics::Tick(BufferHits);
 
             // Putting in front of LRU queue
             RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
@@ -79,16 +104,9 @@ namespace Pumper {
         }
         else
         {
-            // Should allocate new slot. Someone may be victimed
-            RETHROW_ON_EXCEPTION(allocate_slot(slot_id));
-
-            Status status = STATUS_SUCCESS;
-            if (read_physical_page)            
-                status = read_page(fd, page_id, buffer_chain[slot_id].mapping);
-
-            if (status == STATUS_SUCCESS)
-                status = hash_table.Insert(fd, page_id, slot_id);
-
+            // A new slot is allocated. Someone may be victimed
+            Statistics::Tick(BufferMisses);
+            Status status = hash_table.Insert(fd, page_id, slot_id);
             if (!(status == STATUS_SUCCESS))
             {
                 RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
@@ -97,20 +115,250 @@ namespace Pumper {
             }
 
             // RETHROW_ON_EXCEPTION(enqueue_slot(slot_id));
-            // Initialize slot entry
+            // Initialize slot entry. While the page is read it is pinned and
+            // marked loading, as for FetchPageAsync(), so the lock can go.
             buffer_chain[slot_id].fd = fd;
             buffer_chain[slot_id].page_id = page_id;
             buffer_chain[slot_id].is_dirty = false;
+            buffer_chain[slot_id].is_loading = read_physical_page;
             buffer_chain[slot_id].pin_count = 1;
+
+            if (read_physical_page)
+            {
+                mutex.Unlock();
+                status = read_page(fd, page_id, buffer_chain[slot_id].mapping);
+                mutex.Lock();
+                end_load(slot_id, status);
+                if (!(status == STATUS_SUCCESS))
+                    return status;
+            }
         }
 
         *page = buffer_chain[slot_id].mapping;
+        if (read_physical_page)
+            detect_sequential(fd, page_id);
         // PrintDebugInfo();
         RETURN_SUCCESS();
     }
 
+    Status Buffer::FetchPageAsync(int32_t fd, int32_t page_id, const PageFetchCallback& callback)
+    {
+        int32_t slot_id = 0;
+        int8_t * mapping;
+        {
+            LockGuard lock_guard(mutex);
+            bool is_resident;
+            RETHROW_ON_EXCEPTION(find_or_allocate(fd, page_id, slot_id, is_resident));
+            if (is_resident)
+            {
+                buffer_chain[slot_id].pin_count++;
+                Statistics::Tick(BufferHits);
+                RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
+                RETHROW_ON_EXCEPTION(enqueue_slot(slot_id));
+                mapping = buffer_chain[slot_id].mapping;
+            }
+            else
+            {
+                Statistics::Tick(BufferMisses);
+                Status status = hash_table.Insert(fd, page_id, slot_id);
+                if (!(status == STATUS_SUCCESS))
+                {
+                    RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
+                    RETHROW_ON_EXCEPTION(enqueue_free(slot_id));
+                    return status;
+                }
+
+                // Pinned and marked loading: nobody evicts or uses it until
+                // the read is done.
+                buffer_chain[slot_id].fd = fd;
+                buffer_chain[slot_id].page_id = page_id;
+                buffer_chain[slot_id].is_dirty = false;
+                buffer_chain[slot_id].is_loading = true;
+                buffer_chain[slot_id].pin_count = 1;
+                mapping = NULL;
+            }
+        }
+
+        if (mapping)
+        {
+            callback(STATUS_SUCCESS, mapping);
+            RETURN_SUCCESS();
+        }
+
+        std::vector<PageIoRequest> requests(1, PageIoRequest(fd, page_id, 
+            buffer_chain[slot_id].mapping, false));
+        page_io.Submit(requests, [this, slot_id, callback](const Status& status) {
+            finish_load(slot_id, status);
+            callback(status, status == STATUS_SUCCESS ? buffer_chain[slot_id].mapping : NULL);
+        });
+        RETURN_SUCCESS();
+    }
+
+    void Buffer::finish_load(int32_t slot_id, const Status& status)
+    {
+        LockGuard lock_guard(mutex);
+        end_load(slot_id, status);
+    }
+
+    // Caller holds the lock.
+    void Buffer::end_load(int32_t slot_id, const Status& status)
+    {
+        buffer_chain[slot_id].is_loading = false;
+        if (!(status == STATUS_SUCCESS))
+        {
+            // Waiters find the page gone and read it themselves.
+            hash_table.Remove(buffer_chain[slot_id].fd, buffer_chain[slot_id].page_id);
+            unlink_slot(slot_id);
+            enqueue_free(slot_id);
+            buffer_chain[slot_id].fd = INVALID_FD;
+            buffer_chain[slot_id].page_id = INVALID_PAGE_ID;
+            buffer_chain[slot_id].pin_count = 0;
+        }
+        page_loaded.NotifyAll();
+    }
+
+    Status Buffer::Prefetch(int32_t fd, int32_t first_page, int32_t num_pages)
+    {
+        LockGuard lock_guard(mutex);
+        prefetch_pages(fd, first_page, num_pages);
+        RETURN_SUCCESS();
+    }
+
+    // Caller holds the lock. Like allocate_slot(), but only a free slot or a
+    // clean idle one will do: it never waits, and never writes a page back.
+    bool Buffer::allocate_clean_slot(int32_t& slot_id)
+    {
+        if (free_list_head != INVALID_SLOT_ID)
+        {
+            slot_id = free_list_head;
+            free_list_head = buffer_chain[free_list_head].next;
+        }
+        else
+        {
+            for (slot_id = last; slot_id != INVALID_SLOT_ID; slot_id = buffer_chain[slot_id].prev)
+                if (!buffer_chain[slot_id].pin_count && !buffer_chain[slot_id].is_loading &&
+                    !buffer_chain[slot_id].is_writing && !buffer_chain[slot_id].is_dirty)
+                    break;
+            if (slot_id == INVALID_SLOT_ID)
+                return false;
+            Statistics::Tick(BufferEvictions);
+            hash_table.Remove(buffer_chain[slot_id].fd, buffer_chain[slot_id].page_id);
+            unlink_slot(slot_id);
+        }
+        enqueue_slot(slot_id);
+        return true;
+    }
+
+    // Caller holds the lock.
+    void Buffer::detect_sequential(int32_t fd, int32_t page_id)
+    {
+        ReadAhead& state = read_ahead[fd];
+        if (page_id == state.last_page + 1)
+            state.run_length++;
+        else if (page_id != state.last_page)
+        {
+            state.run_length = 0;
+            state.prefetched_end = 0;
+        }
+        state.last_page = page_id;
+
+        // Keep half a window in front of the reader.
+        const int32_t window = std::min(READAHEAD_PAGES, MAX_READAHEAD_SLOTS);
+        if (state.run_length >= SEQUENTIAL_TRIGGER && 
+            page_id + window / 2 >= state.prefetched_end)
+        {
+            int32_t first_page = std::max(page_id + 1, state.prefetched_end);
+            state.prefetched_end = page_id + 1 + window;
+            prefetch_pages(fd, first_page, state.prefetched_end - first_page);
+        }
+    }
+
+    // Caller holds the lock.
+    void Buffer::prefetch_pages(int32_t fd, int32_t first_page, int32_t num_pages)
+    {
+        // Pages that exist on disk only: allocated pages may not be written yet.
+        int32_t end_page = std::min(first_page + num_pages, page_io.DiskPages(fd));
+
+        // Reads ahead still in flight count against the cap.
+        int32_t num_reading = 0;
+        for (int32_t i = 0; i < BUFFER_SIZE; i++)
+            num_reading += buffer_chain[i].is_loading && !buffer_chain[i].pin_count;
+
+        std::vector<PageIoRequest> requests;
+        std::vector<int32_t> slots;
+        for (int32_t page_id = std::max(first_page, 0); page_id < end_page; page_id++)
+        {
+            int32_t slot_id;
+            if (hash_table.TryFind(fd, page_id, slot_id))
+                continue;
+            if (num_reading >= MAX_READAHEAD_SLOTS || !allocate_clean_slot(slot_id))
+                break;
+            if (!(hash_table.Insert(fd, page_id, slot_id) == STATUS_SUCCESS))
+            {
+                unlink_slot(slot_id);
+                enqueue_free(slot_id);
+                break;
+            }
+
+            buffer_chain[slot_id].fd = fd;
+            buffer_chain[slot_id].page_id = page_id;
+            buffer_chain[slot_id].is_dirty = false;
+            buffer_chain[slot_id].is_loading = true;
+            buffer_chain[slot_id].pin_count = 0;
+            requests.push_back(PageIoRequest(fd, page_id, buffer_chain[slot_id].mapping, false));
+            slots.push_back(slot_id);
+            num_reading++;
+        }
+
+        // Never submit an empty batch here: its callback would run at once
+        // and take the lock we hold.
+        if (requests.empty())
+            return;
+        Statistics::Tick(BufferPrefetches, requests.size());
+        page_io.Submit(requests, [this, slots](const Status& status) {
+            for (uint32_t i = 0; i < slots.size(); i++)
+                finish_load(slots[i], status);
+        });
+    }
+
+    // Caller holds the lock. Waits out a read in flight for the page.
+    bool Buffer::find_resident(int32_t fd, int32_t page_id, int32_t& slot_id)
+    {
+        while (hash_table.TryFind(fd, page_id, slot_id))
+        {
+            if (!buffer_chain[slot_id].is_loading)
+                return true;
+            page_loaded.Wait();
+        }
+        return false;
+    }
+
+    // Caller holds the lock. allocate_slot() may release it, and another
+    // thread load the page meanwhile: the slot then goes back to the free
+    // list and the resident page is used.
+    Status Buffer::find_or_allocate(int32_t fd, int32_t page_id, int32_t& slot_id, bool& is_resident)
+    {
+        for (;;)
+        {
+            is_resident = find_resident(fd, page_id, slot_id);
+            if (is_resident)
+                RETURN_SUCCESS();
+
+            int32_t new_slot;
+            RETHROW_ON_EXCEPTION(allocate_slot(new_slot));
+            if (!hash_table.TryFind(fd, page_id, slot_id))
+            {
+                slot_id = new_slot;
+                RETURN_SUCCESS();
+            }
+            RETHROW_ON_EXCEPTION(unlink_slot(new_slot));
+            RETHROW_ON_EXCEPTION(enqueue_free(new_slot));
+        }
+    }
+
     Status Buffer::UnpinPage(int32_t fd, int32_t page_id)
     {
+        LockGuard lock_guard(mutex);
         int32_t slot_id = 0;
         WARNING_ASSERT(hash_table.TryFind(fd, page_id, slot_id));
         WARNING_ASSERT(buffer_chain[slot_id].pin_count > 0);
@@ -125,9 +373,12 @@ namespace Pumper {
 
     Status Buffer::MarkDirty(int32_t fd, int32_t page_id)
     {
+        LockGuard lock_guard(mutex);
         int32_t slot_id = 0;
         WARNING_ASSERT(hash_table.TryFind(fd, page_id, slot_id));
         WARNING_ASSERT(buffer_chain[slot_id].pin_count);
+        if (!buffer_chain[slot_id].is_dirty && count_dirty() >= dirty_limit)
+            writer_wakeup.Notify();
         buffer_chain[slot_id].is_dirty = true;
         RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
         RETHROW_ON_EXCEPTION(enqueue_slot(slot_id));
@@ -137,6 +388,22 @@ namespace Pumper {
 
     Status Buffer::FlushPages(int32_t fd)
     {
+        LockGuard lock_guard(mutex);
+        // The file is about to be closed: reads ahead and write-backs must
+        // land first.
+        wait_io(fd);
+        read_ahead.erase(fd);
+
+        // Dirty pages go out in one batch, then the clean slots are dropped.
+        // Pages fetched or dirtied while the batch ran go in another one.
+        for (bool is_dirty = true; is_dirty; )
+        {
+            RETHROW_ON_EXCEPTION(force_page(fd, ALL_PAGES));
+            wait_io(fd);
+            is_dirty = false;
+            for (int32_t i = 0; i < BUFFER_SIZE; i++)
+                is_dirty |= buffer_chain[i].fd == fd && buffer_chain[i].is_dirty;
+        }
         int32_t slot_id = first;
         while (slot_id != INVALID_SLOT_ID)
         {
@@ -153,13 +420,6 @@ namespace Pumper {
                 }
                 else
                 {
-                    if (buffer_chain[slot_id].is_dirty)
-                    {
-                        RETHROW_ON_EXCEPTION(write_page(fd, buffer_chain[slot_id].page_id, 
-                            buffer_chain[slot_id].mapping));
-                        buffer_chain[slot_id].is_dirty = false;
-                    }
-
                     RETHROW_ON_EXCEPTION(hash_table.Remove(buffer_chain[slot_id].fd,
                         buffer_chain[slot_id].page_id));
                     RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
@@ -169,17 +429,24 @@ namespace Pumper {
 
             slot_id = next;
         }
+
+        // Compressed files free the extents the pages were moved from.
+        mutex.Unlock();
+        Status status = page_io.SyncExtents(fd);
+        mutex.Lock();
         // PrintDebugInfo();
-        RETURN_SUCCESS();
+        return status;
     }
 
     Status Buffer::Clear(bool force)
     {
+        LockGuard lock_guard(mutex);
         int32_t slot_id = first;
         while (slot_id != INVALID_SLOT_ID)
         {
             int32_t next = buffer_chain[slot_id].next;
-            if (force || !buffer_chain[slot_id].pin_count)
+            if (force || (!buffer_chain[slot_id].pin_count && !buffer_chain[slot_id].is_loading &&
+                !buffer_chain[slot_id].is_writing))
             {
                 RETHROW_ON_EXCEPTION(hash_table.Remove(buffer_chain[slot_id].fd, 
                     buffer_chain[slot_id].page_id));
@@ -195,28 +462,190 @@ namespace Pumper {
 
     Status Buffer::ForcePage(int32_t fd, int32_t page_id)
     {
+        LockGuard lock_guard(mutex);
+        // Pages the writer took are on disk once it is done with them.
+        wait_io(fd);
+        RETHROW_ON_EXCEPTION(force_page(fd, page_id));
+
+        // Compressed files free the extents the pages were moved from.
+        mutex.Unlock();
+        Status status = page_io.SyncExtents(fd);
+        mutex.Lock();
+        return status;
+    }
+
+    Status Buffer::force_page(int32_t fd, int32_t page_id)
+    {
+        std::vector<PageIoRequest> requests;
+        std::vector<int32_t> slots;
         int32_t slot_id = first;
         while (slot_id != INVALID_SLOT_ID)
         {
-            int32_t next = buffer_chain[slot_id].next;
-            if (buffer_chain[slot_id].fd == fd && (page_id == ALL_PAGES || 
-                buffer_chain[slot_id].page_id == page_id))
+            if (buffer_chain[slot_id].fd == fd && buffer_chain[slot_id].is_dirty && 
+                (page_id == ALL_PAGES || buffer_chain[slot_id].page_id == page_id))
             {
-                if (buffer_chain[slot_id].is_dirty)
-                {
-                    RETHROW_ON_EXCEPTION(write_page(fd, buffer_chain[slot_id].page_id, 
-                        buffer_chain[slot_id].mapping));
-                    buffer_chain[slot_id].is_dirty = false;
-                }
+                requests.push_back(PageIoRequest(fd, buffer_chain[slot_id].page_id,
+                    buffer_chain[slot_id].mapping, true));
+                slots.push_back(slot_id);
             }
 
-            slot_id = next;
+            slot_id = buffer_chain[slot_id].next;
         }
-        RETURN_SUCCESS();
+
+        // A single page is cheaper to write right here, unless it goes
+        // through a journal.
+        if (requests.size() == 1 && !page_io.HasJournal(fd))
+        {
+            RETHROW_ON_EXCEPTION(write_page(fd, requests[0].page_id, requests[0].mapping));
+            buffer_chain[slots[0]].is_dirty = false;
+            RETURN_SUCCESS();
+        }
+        if (requests.empty())
+            RETURN_SUCCESS();
+
+        // The I/O threads take the lock to finish loads, so it is released
+        // for the batch as in write_back(), which copies are written from.
+        for (uint32_t i = 0; i < slots.size(); i++)
+        {
+            memcpy(writer_pages[slots[i]], requests[i].mapping, PAGE_SIZE);
+            requests[i].mapping = writer_pages[slots[i]];
+            buffer_chain[slots[i]].is_dirty = false;
+            buffer_chain[slots[i]].is_writing = true;
+        }
+
+        mutex.Unlock();
+        Status status = page_io.Execute(requests);
+        mutex.Lock();
+
+        for (uint32_t i = 0; i < slots.size(); i++)
+        {
+            buffer_chain[slots[i]].is_writing = false;
+            if (!(status == STATUS_SUCCESS))
+                buffer_chain[slots[i]].is_dirty = true;
+        }
+        page_loaded.NotifyAll();
+        return status;
+    }
+
+    void Buffer::SetJournal(int32_t fd, int32_t journal_fd)
+    {
+        page_io.SetJournal(fd, journal_fd);
+    }
+
+    Status Buffer::SetCompressed(int32_t fd, bool is_compressed)
+    {
+        return page_io.SetCompressed(fd, is_compressed);
+    }
+
+    void Buffer::SetDirtyRatio(double ratio)
+    {
+        LockGuard lock_guard(mutex);
+        dirty_limit = std::max(0.0, std::min(ratio, 1.0)) * BUFFER_SIZE;
+        writer_wakeup.Notify();
+    }
+
+    void Buffer::SetCheckpointInterval(int32_t seconds)
+    {
+        LockGuard lock_guard(mutex);
+        checkpoint_interval = std::max(seconds, 0);
+        writer_wakeup.Notify();
+    }
+
+    // Caller holds the lock.
+    int32_t Buffer::count_dirty()
+    {
+        int32_t count = 0;
+        for (int32_t i = 0; i < BUFFER_SIZE; i++)
+            if (buffer_chain[i].is_dirty)
+                count++;
+        return count;
+    }
+
+    // Caller holds the lock. Waits until no read or write-back of the file
+    // is in flight.
+    void Buffer::wait_io(int32_t fd)
+    {
+        bool is_busy = true;
+        while (is_busy)
+        {
+            is_busy = false;
+            for (int32_t i = 0; i < BUFFER_SIZE; i++)
+                if (buffer_chain[i].fd == fd && (buffer_chain[i].is_loading || buffer_chain[i].is_writing))
+                    is_busy = true;
+            if (is_busy)
+                page_loaded.Wait();
+        }
+    }
+
+    void Buffer::writer_func()
+    {
+        LockGuard lock_guard(mutex);
+        time_t last_checkpoint = time(NULL);
+        while (!is_writer_stopping)
+        {
+            bool is_checkpoint = checkpoint_interval > 0 && 
+                time(NULL) - last_checkpoint >= checkpoint_interval;
+            if (is_checkpoint)
+            {
+                write_back(true);
+                last_checkpoint = time(NULL);
+                Statistics::Tick(BufferCheckpoints);
+            }
+            else if (count_dirty() > dirty_limit)
+                write_back(false);
+            else
+                writer_wakeup.Wait(1);
+        }
+    }
+
+    // Caller holds the lock, which is released while writing. Takes the
+    // coldest unpinned dirty pages, down to half the dirty limit, or all of
+    // them for a checkpoint, and writes copies of them.
+    void Buffer::write_back(bool is_checkpoint)
+    {
+        int32_t target = is_checkpoint ? 0 : dirty_limit / 2;
+        int32_t dirty = count_dirty();
+        std::vector<PageIoRequest> requests;
+        std::vector<int32_t> slots;
+        for (int32_t slot_id = last; slot_id != INVALID_SLOT_ID && dirty > target;
+            slot_id = buffer_chain[slot_id].prev)
+        {
+            BufferChain& slot = buffer_chain[slot_id];
+            if (!slot.is_dirty || slot.pin_count || slot.is_loading || slot.is_writing)
+                continue;
+            memcpy(writer_pages[slot_id], slot.mapping, PAGE_SIZE);
+            requests.push_back(PageIoRequest(slot.fd, slot.page_id, writer_pages[slot_id], true));
+            slots.push_back(slot_id);
+            slot.is_dirty = false;
+            slot.is_writing = true;
+            dirty--;
+        }
+
+        if (requests.empty())
+        {
+            // Everything left is pinned, look again later.
+            if (!is_checkpoint)
+                writer_wakeup.Wait(1);
+            return;
+        }
+
+        mutex.Unlock();
+        Status status = page_io.Execute(requests);
+        mutex.Lock();
+
+        Statistics::Tick(BufferBackgroundWrites, requests.size());
+        for (uint32_t i = 0; i < slots.size(); i++)
+        {
+            buffer_chain[slots[i]].is_writing = false;
+            if (!(status == STATUS_SUCCESS))
+                buffer_chain[slots[i]].is_dirty = true;
+        }
+        page_loaded.NotifyAll();
     }
 
     Status Buffer::PrintDebugInfo()
     {
+        LockGuard lock_guard(mutex);
         printf("Buffer DebugInfo\n");
         printf("slot_id fd page_id pin_count is_dirty\n");
 
@@ -282,24 +711,57 @@ namespace Pumper {
 
     Status Buffer::allocate_slot(int32_t& slot_id)
     {
-        // If there is element in free list, reuse it
-        if (free_list_head != INVALID_SLOT_ID)
-        {
-            slot_id = free_list_head;
-            free_list_head = buffer_chain[free_list_head].next;
-        }
-        else
+        for (;;)
         {
+            // If there is element in free list, reuse it
+            if (free_list_head != INVALID_SLOT_ID)
+            {
+                slot_id = free_list_head;
+                free_list_head = buffer_chain[free_list_head].next;
+                break;
+            }
+
+            // A clean victim spares the caller a write-back; the background
+            // writer keeps some of them around.
+            bool is_io_pending = false;
             for (slot_id = last; slot_id != INVALID_SLOT_ID; slot_id = buffer_chain[slot_id].prev)
-                if (!buffer_chain[slot_id].pin_count)
+            {
+                if (!buffer_chain[slot_id].pin_count && !buffer_chain[slot_id].is_loading &&
+                    !buffer_chain[slot_id].is_writing && !buffer_chain[slot_id].is_dirty)
                     break;
+                is_io_pending |= buffer_chain[slot_id].is_loading || buffer_chain[slot_id].is_writing;
+            }
+            if (slot_id == INVALID_SLOT_ID)
+            {
+                for (slot_id = last; slot_id != INVALID_SLOT_ID; slot_id = buffer_chain[slot_id].prev)
+                    if (!buffer_chain[slot_id].pin_count && !buffer_chain[slot_id].is_loading &&
+                        !buffer_chain[slot_id].is_writing)
+                        break;
+            }
 
+            if (slot_id == INVALID_SLOT_ID && is_io_pending)
+            {
+                // A checkpoint may be writing back every unpinned page: wait
+                // for it rather than fail.
+                page_loaded.Wait();
+                continue;
+            }
             WARNING_ASSERT(slot_id != INVALID_SLOT_ID);
 
             if (buffer_chain[slot_id].is_dirty)
-                RETHROW_ON_EXCEPTION(ForcePage(buffer_chain[slot_id].fd, buffer_chain[slot_id].page_id));
+            {
+                Statistics::Tick(BufferDirtyEvictions);
+                RETHROW_ON_EXCEPTION(force_page(buffer_chain[slot_id].fd, buffer_chain[slot_id].page_id));
+                // The lock may have been released meanwhile, the victim
+                // taken again.
+                BufferChain& victim = buffer_chain[slot_id];
+                if (victim.pin_count || victim.is_loading || victim.is_writing || victim.is_dirty)
+                    continue;
+            }
+            Statistics::Tick(BufferEvictions);
             RETHROW_ON_EXCEPTION(hash_table.Remove(buffer_chain[slot_id].fd, buffer_chain[slot_id].page_id));
             RETHROW_ON_EXCEPTION(unlink_slot(slot_id));
+            break;
         }
 
         RETHROW_ON_EXCEPTION(enqueue_slot(slot_id));
@@ -309,19 +771,13 @@ namespace Pumper {
     Status Buffer::read_page(int32_t fd, int32_t page_id, int8_t* mapping)
     {
         // printf("Read operation: fd=%d, page=%d\n", fd, page_id);
-        int32_t offset = PAGE_ZERO_OFFSET + PAGE_SIZE * page_id;
-        WARNING_ASSERT(lseek(fd, offset, SEEK_SET));
-        WARNING_ASSERT(read(fd, mapping, PAGE_SIZE) == PAGE_SIZE);
-        RETURN_SUCCESS();
+        return page_io.ReadPage(fd, page_id, mapping);
     }
 
     Status Buffer::write_page(int32_t fd, int32_t page_id, int8_t* mapping)
     {
         // printf("Write operation: fd=%d, page=%d\n", fd, page_id);
-        int32_t offset = PAGE_ZERO_OFFSET + PAGE_SIZE * page_id;
-        WARNING_ASSERT(lseek(fd, offset, SEEK_SET));
-        WARNING_ASSERT(write(fd, mapping, PAGE_SIZE) == PAGE_SIZE);
-        RETURN_SUCCESS();
+        return page_io.WritePage(fd, page_id, mapping);
     }
 
 } // namespace Pumper
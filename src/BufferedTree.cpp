@@ -0,0 +1,411 @@
+// BufferedTree.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// B-epsilon tree over key hashes: message buffers in the internal nodes.
+
+#include "BufferedTree.h"
+#include "PageHandle.h"
+#include "KeyHash.h"
+#include "KeySearch.h"
+#include "Statistics.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Pumper {
+    static const int8_t BUFFERED_MAGIC[8] = { 'P', 'M', 'P', 'B', 'E', 'P', 'S', '\0' };
+
+    // Page layout: the header, then keys and values in arrays of fixed
+    // capacity, then (internal nodes) the messages.
+    static const int32_t KEYS_OFFSET = sizeof(BufferedNodeHeader);
+    static const int32_t LEAF_VALUES_OFFSET = KEYS_OFFSET + BUFFERED_LEAF_SLOTS * 8;
+    static const int32_t CHILDREN_OFFSET = KEYS_OFFSET + (BUFFERED_FANOUT - 1) * 8;
+    static const int32_t MESSAGES_OFFSET = CHILDREN_OFFSET + BUFFERED_FANOUT * 4;
+
+    static_assert(LEAF_VALUES_OFFSET + BUFFERED_LEAF_SLOTS * 4 <= PAGE_SIZE, 
+        "Leaf must fit in one page");
+    static_assert(MESSAGES_OFFSET + BUFFERED_MESSAGE_SLOTS * sizeof(BufferedMessage) <= PAGE_SIZE, 
+        "Internal node must fit in one page");
+
+    static bool message_less(const BufferedMessage& message, uint64_t key)
+    {
+        return message.key < key;
+    }
+
+    BufferedTree::BufferedTree(PagedFile &pf) : pf(pf), meta_page(INVALID_PAGE_ID)
+    {
+        ERROR_ASSERT(pf.IsFileOpened());
+        memset(&meta, 0, sizeof(BufferedMeta));
+    }
+
+    BufferedTree::~BufferedTree()
+    {
+
+    }
+
+    Status BufferedTree::Format(PagedFile &pf)
+    {
+        int32_t new_meta_page, leaf_page;
+        WARNING_ASSERT(pf.GetTotalPages() == 0);
+        RETHROW_ON_EXCEPTION(pf.SetKeyHash(KeyHashWide));
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(new_meta_page));
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(leaf_page));
+
+        BufferedTree tree(pf);
+        memcpy(tree.meta.magic, BUFFERED_MAGIC, sizeof(BUFFERED_MAGIC));
+        tree.meta.root = leaf_page;
+        tree.meta.height = 1;
+        tree.meta_page = new_meta_page;
+
+        BufferedNode leaf;
+        leaf.id = leaf_page;
+        leaf.is_leaf = true;
+        RETHROW_ON_EXCEPTION(tree.store_node(leaf));
+        RETHROW_ON_EXCEPTION(tree.store_meta());
+        RETHROW_ON_EXCEPTION(pf.SetRootPage(new_meta_page));
+        RETURN_SUCCESS();
+    }
+
+    bool BufferedTree::IsBufferedTree(PagedFile &pf)
+    {
+        int32_t root;
+        int8_t magic[8];
+        PageHandle ph;
+
+        pf.GetRootPage(root);
+        if (root < 0 || root >= pf.GetTotalPages())
+            return false;
+        if (!(ph.OpenPage(pf, root) == STATUS_SUCCESS))
+            return false;
+        ph.Read(magic, sizeof(magic));
+        ph.ClosePage();
+        return !memcmp(magic, BUFFERED_MAGIC, sizeof(BUFFERED_MAGIC));
+    }
+
+    Status BufferedTree::Load()
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(pf.GetRootPage(meta_page));
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, meta_page));
+        RETHROW_ON_EXCEPTION(ph.Read((int8_t *) &meta, sizeof(BufferedMeta)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        if (memcmp(meta.magic, BUFFERED_MAGIC, sizeof(BUFFERED_MAGIC)) || meta.root < 0 ||
+            meta.root >= pf.GetTotalPages())
+            RETURN_CORRUPTION("Bad buffered tree root page");
+        RETURN_SUCCESS();
+    }
+
+    Status BufferedTree::Insert(const String &key, int32_t page_id)
+    {
+        return apply(KeyHash64(key), page_id, BufferedPut);
+    }
+
+    Status BufferedTree::Remove(const String &key)
+    {
+        return apply(KeyHash64(key), INVALID_PAGE_ID, BufferedRemove);
+    }
+
+    bool BufferedTree::Search(const String &key, int32_t &page_id)
+    {
+        uint64_t hash = KeyHash64(key);
+        BufferedNode node;
+        int32_t id = meta.root;
+
+        for (;;)
+        {
+            if (!(load_node(id, node) == STATUS_SUCCESS))
+                return false;
+            if (node.is_leaf)
+            {
+                int32_t slot = LowerBound(node.keys.data(), node.keys.size(), hash);
+                if (slot == (int32_t) node.keys.size() || node.keys[slot] != hash)
+                    return false;
+                page_id = node.values[slot];
+                return true;
+            }
+
+            // Pending messages are newer than anything below them
+            std::vector<BufferedMessage>::iterator message = std::lower_bound(
+                node.messages.begin(), node.messages.end(), hash, message_less);
+            if (message != node.messages.end() && message->key == hash)
+            {
+                if (message->type == BufferedRemove)
+                    return false;
+                page_id = message->value;
+                return true;
+            }
+            id = node.values[UpperBound(node.keys.data(), node.keys.size(), hash)];
+        }
+    }
+
+    bool BufferedTree::Update(const String &key, int32_t new_page_id)
+    {
+        int32_t page_id;
+        if (!Search(key, page_id))
+            return false;
+        return apply(KeyHash64(key), new_page_id, BufferedPut) == STATUS_SUCCESS;
+    }
+
+    int32_t BufferedTree::Height() const
+    {
+        return meta.height;
+    }
+
+    // Every write goes through the root. Splits that reach it grow the tree
+    // by one level.
+    Status BufferedTree::apply(uint64_t key, int32_t value, BufferedMessageType type)
+    {
+        BufferedMessage message;
+        message.key = key;
+        message.value = value;
+        message.type = type;
+
+        int32_t old_root = meta.root;
+        Splits splits;
+        RETHROW_ON_EXCEPTION(push_down(meta.root, std::vector<BufferedMessage>(1, message), splits));
+        while (!splits.empty())
+        {
+            BufferedNode root;
+            root.is_leaf = false;
+            root.id = meta.root;
+            RETHROW_ON_EXCEPTION(pf.AllocatePage(root.id));
+            root.values.push_back(meta.root);
+            for (uint32_t i = 0; i < splits.size(); i++)
+            {
+                root.keys.push_back(splits[i].first);
+                root.values.push_back(splits[i].second);
+            }
+            meta.root = root.id;
+            meta.height++;
+            splits.clear();
+            RETHROW_ON_EXCEPTION(store_split(root, splits));
+        }
+        if (meta.root != old_root)
+            RETHROW_ON_EXCEPTION(store_meta());
+        RETURN_SUCCESS();
+    }
+
+    // Hands messages (sorted, newer than all in the subtree) to node id. The
+    // pieces it had to be split into, besides itself, are left in splits.
+    Status BufferedTree::push_down(int32_t id, const std::vector<BufferedMessage>& messages, 
+        Splits& splits)
+    {
+        BufferedNode node;
+        RETHROW_ON_EXCEPTION(load_node(id, node));
+        if (node.is_leaf)
+            apply_to_leaf(node, messages);
+        else
+        {
+            merge_messages(node.messages, messages);
+            while ((int32_t) node.messages.size() > BUFFERED_MESSAGE_SLOTS)
+            {
+                RETHROW_ON_EXCEPTION(flush_child(node));
+            }
+        }
+        return store_split(node, splits);
+    }
+
+    // Moves the messages of the child most of them are bound for one level
+    // down, in one batch.
+    Status BufferedTree::flush_child(BufferedNode& node)
+    {
+        Statistics::Tick(BufferedIndexFlushes);
+        int32_t best_child = 0, best_begin = 0, best_count = 0;
+        int32_t begin = 0;
+        for (int32_t child = 0; child < (int32_t) node.values.size(); child++)
+        {
+            // Messages are sorted, so those of one child are contiguous
+            int32_t end = begin;
+            while (end < (int32_t) node.messages.size() && (child == (int32_t) node.keys.size() || 
+                node.messages[end].key < node.keys[child]))
+                end++;
+            if (end - begin > best_count)
+            {
+                best_child = child;
+                best_begin = begin;
+                best_count = end - begin;
+            }
+            begin = end;
+        }
+
+        std::vector<BufferedMessage> batch(node.messages.begin() + best_begin, 
+            node.messages.begin() + best_begin + best_count);
+        node.messages.erase(node.messages.begin() + best_begin, 
+            node.messages.begin() + best_begin + best_count);
+
+        Splits splits;
+        RETHROW_ON_EXCEPTION(push_down(node.values[best_child], batch, splits));
+        for (uint32_t i = 0; i < splits.size(); i++)
+        {
+            node.keys.insert(node.keys.begin() + best_child + i, splits[i].first);
+            node.values.insert(node.values.begin() + best_child + i + 1, splits[i].second);
+        }
+        RETURN_SUCCESS();
+    }
+
+    // Stores node, cut into as many equal pieces as it takes to fit. The
+    // first piece keeps the page of node.
+    Status BufferedTree::store_split(BufferedNode& node, Splits& splits)
+    {
+        int32_t capacity = node.is_leaf ? BUFFERED_LEAF_SLOTS : BUFFERED_FANOUT;
+        int32_t count = node.values.size();
+        if (count <= capacity)
+            return store_node(node);
+
+        int32_t num_pieces = (count + capacity - 1) / capacity;
+        std::vector<BufferedNode> pieces(num_pieces);
+        uint32_t message = 0;
+        for (int32_t p = 0; p < num_pieces; p++)
+        {
+            int32_t begin = (int64_t) count * p / num_pieces;
+            int32_t end = (int64_t) count * (p + 1) / num_pieces;
+            BufferedNode& piece = pieces[p];
+            piece.is_leaf = node.is_leaf;
+            piece.id = node.id;
+            if (p > 0)
+            {
+                RETHROW_ON_EXCEPTION(pf.AllocatePage(piece.id));
+            }
+            piece.values.assign(node.values.begin() + begin, node.values.begin() + end);
+
+            if (node.is_leaf)
+            {
+                piece.keys.assign(node.keys.begin() + begin, node.keys.begin() + end);
+                if (p > 0)
+                    splits.push_back(std::make_pair(node.keys[begin], piece.id));
+                continue;
+            }
+
+            // Pivots between the children of the piece; the one left of it
+            // moves up.
+            piece.keys.assign(node.keys.begin() + begin, node.keys.begin() + end - 1);
+            if (p > 0)
+                splits.push_back(std::make_pair(node.keys[begin - 1], piece.id));
+            while (message < node.messages.size() && 
+                (p == num_pieces - 1 || node.messages[message].key < node.keys[end - 1]))
+                piece.messages.push_back(node.messages[message++]);
+        }
+
+        Statistics::Tick(BTreeSplits, num_pieces - 1);
+        for (int32_t p = 0; p < num_pieces; p++)
+        {
+            RETHROW_ON_EXCEPTION(store_node(pieces[p]));
+        }
+        RETURN_SUCCESS();
+    }
+
+    void BufferedTree::apply_to_leaf(BufferedNode& leaf, const std::vector<BufferedMessage>& messages)
+    {
+        std::vector<uint64_t> keys;
+        std::vector<int32_t> values;
+        keys.reserve(leaf.keys.size() + messages.size());
+        values.reserve(leaf.keys.size() + messages.size());
+
+        uint32_t i = 0, j = 0;
+        while (i < leaf.keys.size() || j < messages.size())
+        {
+            if (j == messages.size() || (i < leaf.keys.size() && leaf.keys[i] < messages[j].key))
+            {
+                keys.push_back(leaf.keys[i]);
+                values.push_back(leaf.values[i]);
+                i++;
+                continue;
+            }
+            // The message replaces or removes an equal key
+            if (i < leaf.keys.size() && leaf.keys[i] == messages[j].key)
+                i++;
+            if (messages[j].type == BufferedPut)
+            {
+                keys.push_back(messages[j].key);
+                values.push_back(messages[j].value);
+            }
+            j++;
+        }
+        leaf.keys.swap(keys);
+        leaf.values.swap(values);
+    }
+
+    // Both sorted; of two messages for one key the newer one is kept.
+    void BufferedTree::merge_messages(std::vector<BufferedMessage>& older, 
+        const std::vector<BufferedMessage>& newer)
+    {
+        std::vector<BufferedMessage> merged;
+        merged.reserve(older.size() + newer.size());
+
+        uint32_t i = 0, j = 0;
+        while (i < older.size() || j < newer.size())
+        {
+            if (j == newer.size() || (i < older.size() && older[i].key < newer[j].key))
+                merged.push_back(older[i++]);
+            else
+            {
+                if (i < older.size() && older[i].key == newer[j].key)
+                    i++;
+                merged.push_back(newer[j++]);
+            }
+        }
+        older.swap(merged);
+    }
+
+    Status BufferedTree::load_node(int32_t id, BufferedNode& node)
+    {
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, id));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+
+        BufferedNodeHeader * header = (BufferedNodeHeader *) page;
+        node.id = id;
+        node.is_leaf = header->is_leaf;
+        int32_t num_values = node.is_leaf ? header->num_keys : header->num_keys + 1;
+        if (header->num_keys < 0 || num_values > (node.is_leaf ? BUFFERED_LEAF_SLOTS : BUFFERED_FANOUT) ||
+            header->num_messages < 0 || header->num_messages > BUFFERED_MESSAGE_SLOTS)
+            RETURN_CORRUPTION("Buffered tree node overruns its page");
+
+        uint64_t * keys = (uint64_t *) (page + KEYS_OFFSET);
+        int32_t * values = (int32_t *) (page + (node.is_leaf ? LEAF_VALUES_OFFSET : CHILDREN_OFFSET));
+        node.keys.assign(keys, keys + header->num_keys);
+        node.values.assign(values, values + num_values);
+        node.messages.clear();
+        if (!node.is_leaf)
+        {
+            BufferedMessage * messages = (BufferedMessage *) (page + MESSAGES_OFFSET);
+            node.messages.assign(messages, messages + header->num_messages);
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status BufferedTree::store_node(const BufferedNode& node)
+    {
+        int8_t page[PAGE_SIZE];
+        memset(page, 0, PAGE_SIZE);
+
+        BufferedNodeHeader * header = (BufferedNodeHeader *) page;
+        header->is_leaf = node.is_leaf;
+        header->num_keys = node.keys.size();
+        header->num_messages = node.messages.size();
+
+        memcpy(page + KEYS_OFFSET, node.keys.data(), node.keys.size() * sizeof(uint64_t));
+        memcpy(page + (node.is_leaf ? LEAF_VALUES_OFFSET : CHILDREN_OFFSET), node.values.data(),
+            node.values.size() * sizeof(int32_t));
+        if (!node.is_leaf)
+            memcpy(page + MESSAGES_OFFSET, node.messages.data(), 
+                node.messages.size() * sizeof(BufferedMessage));
+
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, node.id));
+        RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    Status BufferedTree::store_meta()
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, meta_page));
+        RETHROW_ON_EXCEPTION(ph.Write((const int8_t *) &meta, sizeof(BufferedMeta)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+} // namespace Pumper
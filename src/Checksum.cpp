@@ -0,0 +1,85 @@
+// Checksum.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// CRC32C with the SSE4.2 instruction when the CPU has it.
+
+#include "Checksum.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace Pumper {
+    // Reflected form of the Castagnoli polynomial 0x1EDC6F41
+    static const uint32_t CRC32C_POLYNOMIAL = 0x82f63b78;
+
+    struct Crc32cTable {
+        Crc32cTable()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t crc = i;
+                for (int32_t bit = 0; bit < 8; bit++)
+                    crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+                entries[i] = crc;
+            }
+        }
+
+        uint32_t entries[256];
+    };
+
+    static uint32_t crc32c_software(const uint8_t * data, size_t length, uint32_t crc)
+    {
+        static const Crc32cTable table;
+        for (size_t i = 0; i < length; i++)
+            crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    static uint32_t crc32c_hardware(const uint8_t * data, size_t length, uint32_t crc)
+    {
+        uint64_t crc64 = crc;
+        while (length >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+            data += 8;
+            length -= 8;
+        }
+        crc = (uint32_t) crc64;
+        while (length > 0)
+        {
+            crc = _mm_crc32_u8(crc, *data);
+            data++;
+            length--;
+        }
+        return crc;
+    }
+#endif
+
+    bool IsCrc32cAccelerated()
+    {
+#if defined(__x86_64__)
+        static const bool is_accelerated = __builtin_cpu_supports("sse4.2");
+        return is_accelerated;
+#else
+        return false;
+#endif
+    }
+
+    uint32_t Crc32c(const void * data, size_t length, uint32_t crc)
+    {
+        crc = ~crc;
+#if defined(__x86_64__)
+        if (IsCrc32cAccelerated())
+            return ~crc32c_hardware((const uint8_t *) data, length, crc);
+#endif
+        return ~crc32c_software((const uint8_t *) data, length, crc);
+    }
+
+} // namespace Pumper
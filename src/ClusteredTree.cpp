@@ -0,0 +1,512 @@
+// ClusteredTree.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// B+Tree with the records in its leaves, see ClusteredTree.h.
+
+#include "ClusteredTree.h"
+#include "PageHandle.h"
+#include "Statistics.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace Pumper {
+    static const int32_t OVERFLOW_CAPACITY = PAGE_SIZE - sizeof(OverflowHeader);
+
+    struct EntryLess {
+        bool operator()(const ClusteredEntry& entry, const String& key) const
+        {
+            return entry.key < key;
+        }
+
+        bool operator()(const String& key, const ClusteredEntry& entry) const
+        {
+            return key < entry.key;
+        }
+    };
+
+    ClusteredTree::ClusteredTree() : root(INVALID_PAGE_ID), is_opened(false)
+    {
+
+    }
+
+    ClusteredTree::~ClusteredTree()
+    {
+        if (is_opened)
+            Close();
+    }
+
+    Status ClusteredTree::Create(const String& name)
+    {
+        PagedFile paged_file;
+        PageHandle ph;
+        int32_t page_id;
+        ClusteredNodeHeader header;
+
+        RETHROW_ON_EXCEPTION(PagedFile::Create(name + ".TREE"));
+        RETHROW_ON_EXCEPTION(paged_file.OpenFile(name + ".TREE"));
+        RETHROW_ON_EXCEPTION(paged_file.AllocatePage(page_id));
+
+        // The root starts as an empty leaf
+        header.is_leaf = 1;
+        header.num_entries = 0;
+        header.next = INVALID_PAGE_ID;
+        header.first_child = INVALID_PAGE_ID;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, page_id));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) &header, sizeof(ClusteredNodeHeader)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETHROW_ON_EXCEPTION(paged_file.SetRootPage(page_id));
+        RETHROW_ON_EXCEPTION(paged_file.Close());
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::Unlink(const String& name)
+    {
+        RETHROW_ON_EXCEPTION(PagedFile::Unlink(name + ".TREE"));
+        RETURN_SUCCESS();
+    }
+
+    bool ClusteredTree::Exists(const String& name)
+    {
+        return !access((name + ".TREE").c_str(), F_OK);
+    }
+
+    Status ClusteredTree::Open(const String& name)
+    {
+        WARNING_ASSERT(!is_opened);
+        RETHROW_ON_EXCEPTION(pf.OpenFile(name + ".TREE"));
+        RETHROW_ON_EXCEPTION(pf.GetRootPage(root));
+        is_opened = true;
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::Close()
+    {
+        WARNING_ASSERT(is_opened);
+        is_opened = false;
+        RETHROW_ON_EXCEPTION(pf.Close());
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::UpdateChanges()
+    {
+        RETHROW_ON_EXCEPTION(pf.ForcePage());
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::Put(const String& key, const String& value)
+    {
+        ClusteredNode leaf;
+        ClusteredEntry entry;
+        std::vector<int32_t> path;
+
+        WARNING_ASSERT(key.size() <= (size_t) CLUSTERED_MAX_KEY);
+        RETHROW_ON_EXCEPTION(find_leaf(key, leaf, path));
+        RETHROW_ON_EXCEPTION(make_entry(key, value, entry));
+
+        std::vector<ClusteredEntry>::iterator it = 
+            std::lower_bound(leaf.entries.begin(), leaf.entries.end(), key, EntryLess());
+        if (it != leaf.entries.end() && it->key == key)
+        {
+            RETHROW_ON_EXCEPTION(release_overflow(it->page));
+            *it = entry;
+        }
+        else
+            leaf.entries.insert(it, entry);
+
+        if (node_size(leaf) <= PAGE_SIZE)
+            return store_node(leaf);
+
+        ClusteredNode right;
+        String separator;
+        RETHROW_ON_EXCEPTION(split_node(leaf, right, separator));
+        RETHROW_ON_EXCEPTION(store_node(right));
+        RETHROW_ON_EXCEPTION(store_node(leaf));
+        return insert_into_parent(path, leaf.id, separator, right.id);
+    }
+
+    Status ClusteredTree::Get(const String& key, String& value)
+    {
+        ClusteredNode leaf;
+        std::vector<int32_t> path;
+
+        RETHROW_ON_EXCEPTION(find_leaf(key, leaf, path));
+        std::vector<ClusteredEntry>::iterator it = 
+            std::lower_bound(leaf.entries.begin(), leaf.entries.end(), key, EntryLess());
+        if (it == leaf.entries.end() || it->key != key)
+            RETURN_NOT_FOUND();
+        return read_value(*it, value);
+    }
+
+    Status ClusteredTree::Remove(const String& key)
+    {
+        ClusteredNode leaf;
+        std::vector<int32_t> path;
+
+        RETHROW_ON_EXCEPTION(find_leaf(key, leaf, path));
+        std::vector<ClusteredEntry>::iterator it = 
+            std::lower_bound(leaf.entries.begin(), leaf.entries.end(), key, EntryLess());
+        if (it == leaf.entries.end() || it->key != key)
+            RETURN_NOT_FOUND();
+        RETHROW_ON_EXCEPTION(release_overflow(it->page));
+        leaf.entries.erase(it);
+        return store_node(leaf);
+    }
+
+    bool ClusteredTree::Contains(const String& key)
+    {
+        ClusteredNode leaf;
+        std::vector<int32_t> path;
+
+        if (!(find_leaf(key, leaf, path) == STATUS_SUCCESS))
+            return false;
+        return std::binary_search(leaf.entries.begin(), leaf.entries.end(), key, EntryLess());
+    }
+
+    std::vector<String> ClusteredTree::ListKeys()
+    {
+        std::vector<String> keys;
+        ClusteredNode leaf;
+        std::vector<int32_t> path;
+
+        // The empty key sorts first, so this is the leftmost leaf
+        if (!(find_leaf("", leaf, path) == STATUS_SUCCESS))
+            return keys;
+        for (;;)
+        {
+            for (uint32_t i = 0; i < leaf.entries.size(); i++)
+                keys.push_back(leaf.entries[i].key);
+            if (leaf.next == INVALID_PAGE_ID || !(load_node(leaf.next, leaf) == STATUS_SUCCESS))
+                break;
+        }
+        return keys;
+    }
+
+    Status ClusteredTree::ListKeys(const String& start, std::vector<String>& keys, bool& is_last)
+    {
+        ClusteredNode leaf;
+        std::vector<int32_t> path;
+
+        keys.clear();
+        RETHROW_ON_EXCEPTION(find_leaf(start, leaf, path));
+        // Leaves emptied by removals are passed over
+        for (;;)
+        {
+            uint32_t slot = std::lower_bound(leaf.entries.begin(), leaf.entries.end(), start, EntryLess()) - 
+                leaf.entries.begin();
+            for (; slot < leaf.entries.size(); slot++)
+                keys.push_back(leaf.entries[slot].key);
+            if (!keys.empty() || leaf.next == INVALID_PAGE_ID)
+                break;
+            RETHROW_ON_EXCEPTION(load_node(leaf.next, leaf));
+        }
+        is_last = leaf.next == INVALID_PAGE_ID;
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::Scan(const String& start, int32_t limit, KeyValueList& items)
+    {
+        ClusteredNode leaf;
+        std::vector<int32_t> path;
+
+        items.clear();
+        RETHROW_ON_EXCEPTION(find_leaf(start, leaf, path));
+        uint32_t slot = std::lower_bound(leaf.entries.begin(), leaf.entries.end(), start, EntryLess()) - 
+            leaf.entries.begin();
+        while (limit <= 0 || (int32_t) items.size() < limit)
+        {
+            if (slot == leaf.entries.size())
+            {
+                if (leaf.next == INVALID_PAGE_ID)
+                    break;
+                RETHROW_ON_EXCEPTION(load_node(leaf.next, leaf));
+                slot = 0;
+                continue;
+            }
+
+            String value;
+            RETHROW_ON_EXCEPTION(read_value(leaf.entries[slot], value));
+            items.push_back(std::make_pair(leaf.entries[slot].key, value));
+            slot++;
+        }
+        RETURN_SUCCESS();
+    }
+
+    // path receives the internal nodes from the root down
+    Status ClusteredTree::find_leaf(const String& key, ClusteredNode& leaf, std::vector<int32_t>& path)
+    {
+        int32_t id = root;
+        path.clear();
+        for (;;)
+        {
+            RETHROW_ON_EXCEPTION(load_node(id, leaf));
+            if (leaf.is_leaf)
+                break;
+            path.push_back(id);
+            int32_t slot = std::upper_bound(leaf.entries.begin(), leaf.entries.end(), key, EntryLess()) - 
+                leaf.entries.begin();
+            id = slot == 0 ? leaf.first_child : leaf.entries[slot - 1].page;
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::insert_into_parent(std::vector<int32_t>& path, int32_t left_id, 
+        String key, int32_t right_id)
+    {
+        ClusteredEntry entry;
+        entry.value_length = 0;
+
+        for (;;)
+        {
+            entry.key = key;
+            entry.page = right_id;
+
+            if (path.empty())
+            {
+                ClusteredNode new_root;
+                RETHROW_ON_EXCEPTION(pf.AllocatePage(new_root.id));
+                new_root.is_leaf = false;
+                new_root.next = INVALID_PAGE_ID;
+                new_root.first_child = left_id;
+                new_root.entries.push_back(entry);
+                RETHROW_ON_EXCEPTION(store_node(new_root));
+                root = new_root.id;
+                RETHROW_ON_EXCEPTION(pf.SetRootPage(root));
+                RETURN_SUCCESS();
+            }
+
+            ClusteredNode parent;
+            RETHROW_ON_EXCEPTION(load_node(path.back(), parent));
+            path.pop_back();
+            parent.entries.insert(std::upper_bound(parent.entries.begin(), parent.entries.end(), key, 
+                EntryLess()), entry);
+            if (node_size(parent) <= PAGE_SIZE)
+                return store_node(parent);
+
+            ClusteredNode right;
+            RETHROW_ON_EXCEPTION(split_node(parent, right, key));
+            RETHROW_ON_EXCEPTION(store_node(right));
+            RETHROW_ON_EXCEPTION(store_node(parent));
+            left_id = parent.id;
+            right_id = right.id;
+        }
+    }
+
+    // Splits at the point that leaves the fuller half smallest; records vary
+    // in size, so the middle entry is not good enough.
+    Status ClusteredTree::split_node(ClusteredNode& node, ClusteredNode& right, String& separator)
+    {
+        Statistics::Tick(BTreeSplits);
+        int32_t num_entries = node.entries.size();
+        std::vector<int32_t> prefix(num_entries + 1, 0);
+        for (int32_t i = 0; i < num_entries; i++)
+            prefix[i + 1] = prefix[i] + entry_size(node.entries[i]);
+
+        // An internal node moves entry split up to the parent
+        int32_t moved = node.is_leaf ? 0 : 1;
+        int32_t split = 1, best = PAGE_SIZE * 2;
+        for (int32_t i = 1; i + moved < num_entries; i++)
+        {
+            int32_t fuller = std::max(prefix[i], prefix[num_entries] - prefix[i + moved]);
+            if (fuller < best)
+            {
+                best = fuller;
+                split = i;
+            }
+        }
+
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(right.id));
+        right.is_leaf = node.is_leaf;
+        if (node.is_leaf)
+        {
+            right.entries.assign(node.entries.begin() + split, node.entries.end());
+            right.next = node.next;
+            right.first_child = INVALID_PAGE_ID;
+            node.next = right.id;
+
+            // Shortest prefix of the right's first key above the left's last
+            // one, which keeps internal nodes wide.
+            const String& last = node.entries[split - 1].key;
+            const String& first = right.entries[0].key;
+            size_t length = 0;
+            while (length < last.size() && last[length] == first[length])
+                length++;
+            separator = first.substr(0, length + 1);
+        }
+        else
+        {
+            separator = node.entries[split].key;
+            right.entries.assign(node.entries.begin() + split + 1, node.entries.end());
+            right.next = INVALID_PAGE_ID;
+            right.first_child = node.entries[split].page;
+        }
+        node.entries.resize(split);
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::load_node(int32_t id, ClusteredNode& node)
+    {
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, id));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+
+        ClusteredNodeHeader * header = (ClusteredNodeHeader *) page;
+        node.id = id;
+        node.is_leaf = header->is_leaf;
+        node.next = header->next;
+        node.first_child = header->first_child;
+        node.entries.resize(header->num_entries);
+
+        int32_t offset = sizeof(ClusteredNodeHeader);
+        for (int32_t i = 0; i < header->num_entries; i++)
+        {
+            ClusteredEntryHeader entry_header;
+            if (offset + (int32_t) sizeof(ClusteredEntryHeader) > PAGE_SIZE)
+                RETURN_CORRUPTION("Clustered node overruns its page");
+            memcpy(&entry_header, page + offset, sizeof(ClusteredEntryHeader));
+            offset += sizeof(ClusteredEntryHeader);
+            if (offset + entry_header.key_length + entry_header.inline_length > PAGE_SIZE)
+                RETURN_CORRUPTION("Clustered node overruns its page");
+
+            ClusteredEntry& entry = node.entries[i];
+            entry.key.assign(page + offset, entry_header.key_length);
+            offset += entry_header.key_length;
+            entry.value.assign(page + offset, entry_header.inline_length);
+            offset += entry_header.inline_length;
+            entry.value_length = entry_header.value_length;
+            entry.page = entry_header.page;
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::store_node(const ClusteredNode& node)
+    {
+        int8_t page[PAGE_SIZE];
+        memset(page, 0, PAGE_SIZE);
+        WARNING_ASSERT(node_size(node) <= PAGE_SIZE);
+
+        ClusteredNodeHeader * header = (ClusteredNodeHeader *) page;
+        header->is_leaf = node.is_leaf;
+        header->num_entries = node.entries.size();
+        header->next = node.next;
+        header->first_child = node.first_child;
+
+        int32_t offset = sizeof(ClusteredNodeHeader);
+        for (uint32_t i = 0; i < node.entries.size(); i++)
+        {
+            const ClusteredEntry& entry = node.entries[i];
+            ClusteredEntryHeader entry_header;
+            entry_header.key_length = entry.key.size();
+            entry_header.inline_length = entry.value.size();
+            entry_header.value_length = entry.value_length;
+            entry_header.page = entry.page;
+            memcpy(page + offset, &entry_header, sizeof(ClusteredEntryHeader));
+            offset += sizeof(ClusteredEntryHeader);
+            memcpy(page + offset, entry.key.data(), entry.key.size());
+            offset += entry.key.size();
+            memcpy(page + offset, entry.value.data(), entry.value.size());
+            offset += entry.value.size();
+        }
+
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, node.id));
+        RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    int32_t ClusteredTree::entry_size(const ClusteredEntry& entry)
+    {
+        return sizeof(ClusteredEntryHeader) + entry.key.size() + entry.value.size();
+    }
+
+    int32_t ClusteredTree::node_size(const ClusteredNode& node)
+    {
+        int32_t size = sizeof(ClusteredNodeHeader);
+        for (uint32_t i = 0; i < node.entries.size(); i++)
+            size += entry_size(node.entries[i]);
+        return size;
+    }
+
+    Status ClusteredTree::read_value(const ClusteredEntry& entry, String& value)
+    {
+        if (entry.page == INVALID_PAGE_ID)
+        {
+            value = entry.value;
+            RETURN_SUCCESS();
+        }
+
+        int8_t page[PAGE_SIZE];
+        int32_t page_id = entry.page;
+        PageHandle ph;
+        value.clear();
+        value.reserve(entry.value_length);
+        while (page_id != INVALID_PAGE_ID)
+        {
+            RETHROW_ON_EXCEPTION(ph.OpenPage(pf, page_id));
+            RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+            OverflowHeader * header = (OverflowHeader *) page;
+            if (header->length < 0 || header->length > OVERFLOW_CAPACITY)
+                RETURN_CORRUPTION("Bad overflow page");
+            value.append(page + sizeof(OverflowHeader), header->length);
+            page_id = header->next;
+        }
+        if ((int32_t) value.size() != entry.value_length)
+            RETURN_CORRUPTION("Overflow chain does not match the value length");
+        RETURN_SUCCESS();
+    }
+
+    // Long values are written to their overflow pages here, before the record
+    // that names them.
+    Status ClusteredTree::make_entry(const String& key, const String& value, ClusteredEntry& entry)
+    {
+        entry.key = key;
+        entry.value_length = value.size();
+        entry.page = INVALID_PAGE_ID;
+        if (value.size() <= (size_t) CLUSTERED_MAX_INLINE)
+        {
+            entry.value = value;
+            RETURN_SUCCESS();
+        }
+        entry.value.clear();
+
+        int32_t num_pages = (value.size() + OVERFLOW_CAPACITY - 1) / OVERFLOW_CAPACITY;
+        std::vector<int32_t> pages(num_pages);
+        for (int32_t i = 0; i < num_pages; i++)
+            RETHROW_ON_EXCEPTION(pf.AllocatePage(pages[i]));
+
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+        for (int32_t i = 0; i < num_pages; i++)
+        {
+            OverflowHeader * header = (OverflowHeader *) page;
+            header->next = i + 1 < num_pages ? pages[i + 1] : INVALID_PAGE_ID;
+            header->length = std::min((int32_t) value.size() - i * OVERFLOW_CAPACITY, OVERFLOW_CAPACITY);
+            memcpy(page + sizeof(OverflowHeader), value.data() + i * OVERFLOW_CAPACITY, header->length);
+            RETHROW_ON_EXCEPTION(ph.OpenPage(pf, pages[i]));
+            RETHROW_ON_EXCEPTION(ph.Write(page, sizeof(OverflowHeader) + header->length));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+        }
+        entry.page = pages[0];
+        RETURN_SUCCESS();
+    }
+
+    Status ClusteredTree::release_overflow(int32_t page_id)
+    {
+        PageHandle ph;
+        while (page_id != INVALID_PAGE_ID)
+        {
+            OverflowHeader header;
+            RETHROW_ON_EXCEPTION(ph.OpenPage(pf, page_id));
+            RETHROW_ON_EXCEPTION(ph.Read((int8_t *) &header, sizeof(OverflowHeader)));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+            RETHROW_ON_EXCEPTION(pf.ReleasePage(page_id));
+            page_id = header.next;
+        }
+        RETURN_SUCCESS();
+    }
+} // namespace Pumper
@@ -0,0 +1,177 @@
+// Compression.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// LZ4 block format encoder and decoder.
+
+#include "Compression.h"
+
+#include <string.h>
+
+namespace Pumper {
+    static const int32_t MIN_MATCH = 4;
+    static const int32_t LAST_LITERALS = 5;     // The block ends with literals,
+    static const int32_t MATCH_LIMIT = 12;      // and no match starts this close to the end.
+    static const int32_t MAX_OFFSET = 65535;
+    static const int32_t HASH_BITS = 12;
+
+    static inline uint32_t read32(const int8_t * p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t hash_sequence(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Writes the extra bytes of a length that does not fit in its nibble.
+    static inline bool put_length(int8_t *& out, const int8_t * out_end, int32_t length)
+    {
+        while (length >= 255)
+        {
+            if (out >= out_end)
+                return false;
+            *out++ = (int8_t) 255;
+            length -= 255;
+        }
+        if (out >= out_end)
+            return false;
+        *out++ = (int8_t) length;
+        return true;
+    }
+
+    static bool put_sequence(int8_t *& out, const int8_t * out_end, const int8_t * literals,
+        int32_t num_literals, int32_t offset, int32_t match_length)
+    {
+        if (out >= out_end)
+            return false;
+        int8_t * token = out++;
+        int32_t literal_nibble = num_literals < 15 ? num_literals : 15;
+        int32_t match_nibble = 0;
+        if (match_length)
+            match_nibble = match_length - MIN_MATCH < 15 ? match_length - MIN_MATCH : 15;
+        *token = (int8_t) ((literal_nibble << 4) | match_nibble);
+
+        if (literal_nibble == 15 && !put_length(out, out_end, num_literals - 15))
+            return false;
+        if (out_end - out < num_literals)
+            return false;
+        memcpy(out, literals, num_literals);
+        out += num_literals;
+
+        // The last sequence has literals only.
+        if (!match_length)
+            return true;
+        if (out_end - out < 2)
+            return false;
+        *out++ = (int8_t) (offset & 0xff);
+        *out++ = (int8_t) (offset >> 8);
+        if (match_nibble == 15 && !put_length(out, out_end, match_length - MIN_MATCH - 15))
+            return false;
+        return true;
+    }
+
+    int32_t Lz4Compress(const int8_t * input, int32_t length, int8_t * output, int32_t capacity)
+    {
+        if (length < 0 || length > LZ4_MAX_INPUT)
+            return 0;
+
+        // Positions + 1, 0 for none
+        uint16_t table[1 << HASH_BITS];
+        memset(table, 0, sizeof(table));
+
+        int8_t * out = output;
+        const int8_t * out_end = output + capacity;
+        int32_t anchor = 0;
+        int32_t position = 0;
+        int32_t match_limit = length - MATCH_LIMIT;
+        while (position < match_limit)
+        {
+            uint32_t sequence = read32(input + position);
+            uint32_t hash = hash_sequence(sequence);
+            int32_t candidate = (int32_t) table[hash] - 1;
+            table[hash] = (uint16_t) (position + 1);
+            if (candidate < 0 || position - candidate > MAX_OFFSET || read32(input + candidate) != sequence)
+            {
+                position++;
+                continue;
+            }
+
+            int32_t match_length = MIN_MATCH;
+            while (position + match_length < length - LAST_LITERALS &&
+                input[candidate + match_length] == input[position + match_length])
+                match_length++;
+
+            if (!put_sequence(out, out_end, input + anchor, position - anchor, position - candidate,
+                match_length))
+                return 0;
+            position += match_length;
+            anchor = position;
+        }
+
+        if (!put_sequence(out, out_end, input + anchor, length - anchor, 0, 0))
+            return 0;
+        return out - output;
+    }
+
+    // Reads the extra bytes of a length whose nibble was 15.
+    static inline bool get_length(const int8_t *& in, const int8_t * in_end, int32_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (in >= in_end)
+                return false;
+            byte = (uint8_t) *in++;
+            length += byte;
+            if (length > LZ4_MAX_INPUT)
+                return false;
+        } while (byte == 255);
+        return true;
+    }
+
+    int32_t Lz4Decompress(const int8_t * input, int32_t length, int8_t * output, int32_t capacity)
+    {
+        const int8_t * in = input;
+        const int8_t * in_end = input + length;
+        int8_t * out = output;
+        int8_t * out_end = output + capacity;
+        while (in < in_end)
+        {
+            uint8_t token = (uint8_t) *in++;
+            int32_t num_literals = token >> 4;
+            if (num_literals == 15 && !get_length(in, in_end, num_literals))
+                return -1;
+            if (in_end - in < num_literals || out_end - out < num_literals)
+                return -1;
+            memcpy(out, in, num_literals);
+            in += num_literals;
+            out += num_literals;
+
+            // End of block
+            if (in == in_end)
+                break;
+
+            if (in_end - in < 2)
+                return -1;
+            int32_t offset = (uint8_t) in[0] | ((uint8_t) in[1] << 8);
+            in += 2;
+            int32_t match_length = token & 15;
+            if (match_length == 15 && !get_length(in, in_end, match_length))
+                return -1;
+            match_length += MIN_MATCH;
+            if (offset == 0 || offset > out - output || out_end - out < match_length)
+                return -1;
+
+            // Overlapping copies repeat the last offset bytes.
+            const int8_t * match = out - offset;
+            for (int32_t i = 0; i < match_length; i++)
+                out[i] = match[i];
+            out += match_length;
+        }
+        return out - output;
+    }
+
+} // namespace Pumper
@@ -0,0 +1,576 @@
+// CowTree.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Copy-on-write B+Tree over key hashes: path copies, pinned roots.
+
+#include "CowTree.h"
+#include "PageHandle.h"
+#include "KeyHash.h"
+#include "KeySearch.h"
+#include "Checksum.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Pumper {
+    struct CowMeta {
+        uint32_t checksum;          // Crc32c of the fields below
+        uint32_t seq;               // The newest valid meta page wins
+        uint32_t txn;
+        int32_t root;
+        int32_t alloc_pages;
+        int32_t free_list_head;     // Only trusted with is_closed
+        int32_t is_closed;          // Written by Close(), no page taken since
+    };
+
+    static uint32_t meta_checksum(const CowMeta &meta)
+    {
+        return Crc32c(&meta.seq, sizeof(CowMeta) - sizeof(uint32_t));
+    }
+
+    static void init_node(CowNode * node, bool is_leaf)
+    {
+        node->is_leaf = is_leaf;
+        node->id = INVALID_PAGE_ID;
+        node->parent = node->prev = node->next = INVALID_PAGE_ID;
+        node->num_keys = 0;
+    }
+
+    // Leaves keep the value of keys[slot] in pointers[slot], internal nodes
+    // the child right of it in pointers[slot + 1].
+    static void insert_entry(CowNode * node, int32_t slot, uint64_t key, int32_t value)
+    {
+        int32_t offset = node->is_leaf ? 0 : 1;
+        int32_t num_pointers = node->num_keys + offset;
+        memmove(&node->keys[slot + 1], &node->keys[slot], (node->num_keys - slot) * sizeof(uint64_t));
+        memmove(&node->pointers[slot + offset + 1], &node->pointers[slot + offset],
+            (num_pointers - slot - offset) * sizeof(int32_t));
+        node->keys[slot] = key;
+        node->pointers[slot + offset] = value;
+        node->num_keys++;
+    }
+
+    static void erase_entry(CowNode * node, int32_t key_slot, int32_t pointer_slot)
+    {
+        int32_t num_pointers = node->is_leaf ? node->num_keys : node->num_keys + 1;
+        memmove(&node->keys[key_slot], &node->keys[key_slot + 1],
+            (node->num_keys - key_slot - 1) * sizeof(uint64_t));
+        memmove(&node->pointers[pointer_slot], &node->pointers[pointer_slot + 1],
+            (num_pointers - pointer_slot - 1) * sizeof(int32_t));
+        node->num_keys--;
+    }
+
+    CowTree::CowTree(PagedFile &pf) : pf(pf), txn(1), durable_txn(1), previous_txn(1), meta_seq(0), published(0)
+    {
+        ERROR_ASSERT(pf.IsFileOpened());
+        for (int32_t i = 0; i < COW_READER_SLOTS; i++)
+            readers[i].store(0);
+    }
+
+    CowTree::~CowTree()
+    {
+
+    }
+
+    Status CowTree::Format(PagedFile &pf)
+    {
+        WARNING_ASSERT(pf.GetTotalPages() == 0);
+        RETHROW_ON_EXCEPTION(pf.SetKeyHash(KeyHashWide));
+
+        CowTree tree(pf);
+        for (int32_t i = 0; i < COW_META_PAGES; i++)
+        {
+            int32_t page_id;
+            RETHROW_ON_EXCEPTION(pf.AllocatePage(page_id));
+        }
+        CowNode leaf;
+        init_node(&leaf, true);
+        RETHROW_ON_EXCEPTION(tree.store_node(&leaf));
+        RETHROW_ON_EXCEPTION(pf.SetRootPage(leaf.id));
+        tree.published.store(pack(tree.txn, leaf.id));
+        RETHROW_ON_EXCEPTION(tree.write_meta(false));
+        RETURN_SUCCESS();
+    }
+
+    Status CowTree::Load()
+    {
+        CowMeta metas[COW_META_PAGES];
+        int32_t newest = -1, older = -1;
+        for (int32_t page_id = 0; page_id < COW_META_PAGES && page_id < pf.GetTotalPages(); page_id++)
+        {
+            if (!read_meta(page_id, metas[page_id]))
+                continue;
+            if (newest < 0 || txn_before(metas[newest].seq, metas[page_id].seq))
+            {
+                older = newest;
+                newest = page_id;
+            }
+            else
+                older = page_id;
+        }
+        if (newest < 0)
+            RETURN_CORRUPTION("No valid copy-on-write meta page");
+
+        const CowMeta &meta = metas[newest];
+        meta_seq = meta.seq;
+        txn = durable_txn = previous_txn = meta.txn;
+        RETHROW_ON_EXCEPTION(pf.SetRootPage(meta.root));
+        published.store(pack(txn, meta.root));
+        if (!meta.is_closed)
+            return recover_free_space(meta, older < 0 ? NULL : &metas[older]);
+
+        // Pages are taken from the free list from now on, a crash must not
+        // find it trusted any more.
+        RETHROW_ON_EXCEPTION(pf.ResetFreeSpace(meta.alloc_pages, meta.free_list_head));
+        LockGuard guard(write_mutex);
+        return write_meta(false);
+    }
+
+    Status CowTree::Insert(const String &key, int32_t page_id)
+    {
+        bool is_found;
+        return apply(KeyHash64(key), page_id, OperationPut, is_found);
+    }
+
+    Status CowTree::Remove(const String &key)
+    {
+        bool is_found;
+        return apply(KeyHash64(key), INVALID_PAGE_ID, OperationRemove, is_found);
+    }
+
+    bool CowTree::Update(const String &key, int32_t new_page_id)
+    {
+        bool is_found = false;
+        if (!(apply(KeyHash64(key), new_page_id, OperationUpdate, is_found) == STATUS_SUCCESS))
+            return false;
+        return is_found;
+    }
+
+    // The slot is claimed with the root of the moment, which is checked again
+    // afterwards: a writer that published in between may not have seen the
+    // slot, and reclaimed the pages of that root already.
+    Status CowTree::BeginRead(CowReader &reader)
+    {
+        uint64_t state = published.load();
+        for (int32_t i = 0; i < COW_READER_SLOTS; i++)
+        {
+            uint64_t expected = 0;
+            if (!readers[i].compare_exchange_strong(expected, state))
+                continue;
+
+            for (uint64_t current = published.load(); current != state; current = published.load())
+            {
+                state = current;
+                readers[i].store(state);
+            }
+            reader.slot = i;
+            reader.root = (int32_t) (state & 0xffffffff);
+            reader.txn = (uint32_t) (state >> 32);
+            RETURN_SUCCESS();
+        }
+        RETURN_INFORMATION("No free reader slot");
+    }
+
+    void CowTree::EndRead(const CowReader &reader)
+    {
+        readers[reader.slot].store(0);
+    }
+
+    bool CowTree::Search(const CowReader &reader, const String &key, int32_t &page_id)
+    {
+        return search(reader.root, KeyHash64(key), page_id);
+    }
+
+    bool CowTree::Search(const String &key, int32_t &page_id)
+    {
+        CowReader reader;
+        if (!(BeginRead(reader) == STATUS_SUCCESS))
+        {
+            // No writer runs while the lock is held
+            LockGuard guard(write_mutex);
+            return search((int32_t) (published.load() & 0xffffffff), KeyHash64(key), page_id);
+        }
+        bool is_found = search(reader.root, KeyHash64(key), page_id);
+        EndRead(reader);
+        return is_found;
+    }
+
+    Status CowTree::Commit()
+    {
+        LockGuard guard(write_mutex);
+        RETHROW_ON_EXCEPTION(write_meta(false));
+        previous_txn = durable_txn;
+        durable_txn = txn;
+        fresh_pages.clear();
+        RETHROW_ON_EXCEPTION(reclaim());
+        RETURN_SUCCESS();
+    }
+
+    // Both meta pages are brought to the last root first, so that every
+    // retired page is released before the free list is recorded.
+    Status CowTree::Close()
+    {
+        RETHROW_ON_EXCEPTION(Commit());
+        RETHROW_ON_EXCEPTION(Commit());
+        LockGuard guard(write_mutex);
+        return write_meta(true);
+    }
+
+    int32_t CowTree::RetiredPages()
+    {
+        LockGuard guard(write_mutex);
+        return fresh_retired.size() + durable_retired.size();
+    }
+
+    // Copies the path to the leaf of key, changes the copies bottom up and
+    // publishes the copy of the root. Nothing is written if nothing changes.
+    Status CowTree::apply(uint64_t key, int32_t value, Operation operation, bool &is_found)
+    {
+        LockGuard guard(write_mutex);
+        std::vector<CowNode> path;
+        std::vector<int32_t> slots, old_ids;
+        int32_t id = (int32_t) (published.load() & 0xffffffff);
+
+        for (;;)
+        {
+            path.push_back(CowNode());
+            RETHROW_ON_EXCEPTION(load_node(id, &path.back()));
+            old_ids.push_back(id);
+            if (path.back().is_leaf)
+                break;
+            int32_t slot = UpperBound(path.back().keys, path.back().num_keys, key);
+            slots.push_back(slot);
+            id = path.back().pointers[slot];
+        }
+
+        CowNode &leaf = path.back();
+        int32_t leaf_slot = LowerBound(leaf.keys, leaf.num_keys, key);
+        is_found = leaf_slot < leaf.num_keys && leaf.keys[leaf_slot] == key;
+        if (!is_found && operation != OperationPut)
+            RETURN_SUCCESS();
+
+        uint32_t next_txn = txn + 1 ? txn + 1 : 1;
+        int32_t child_id = INVALID_PAGE_ID, right_id = INVALID_PAGE_ID;
+        uint64_t pivot = 0;
+        bool is_dropped = false;
+
+        for (int32_t level = path.size() - 1; level >= 0; level--)
+        {
+            CowNode &node = path[level];
+            bool is_pending = false;
+            int32_t slot = 0;
+            uint64_t entry_key = 0;
+            int32_t entry_value = 0;
+
+            if (node.is_leaf)
+            {
+                if (operation == OperationRemove)
+                    erase_entry(&node, leaf_slot, leaf_slot);
+                else if (is_found)
+                    node.pointers[leaf_slot] = value;
+                else
+                {
+                    is_pending = true;
+                    slot = leaf_slot;
+                    entry_key = key;
+                    entry_value = value;
+                }
+                // Emptied leaves leave their parent
+                is_dropped = level > 0 && node.num_keys == 0;
+            }
+            else if (is_dropped)
+            {
+                int32_t child_slot = slots[level];
+                if (node.num_keys > 0)
+                {
+                    erase_entry(&node, child_slot > 0 ? child_slot - 1 : 0, child_slot);
+                    is_dropped = false;
+                }
+            }
+            else
+            {
+                int32_t child_slot = slots[level];
+                node.pointers[child_slot] = child_id;
+                if (right_id != INVALID_PAGE_ID)
+                {
+                    is_pending = true;
+                    slot = child_slot;
+                    entry_key = pivot;
+                    entry_value = right_id;
+                }
+            }
+
+            right_id = INVALID_PAGE_ID;
+            if (is_dropped)
+                continue;
+            if (is_pending && node.num_keys == CowNode::ORDER - 1)
+            {
+                RETHROW_ON_EXCEPTION(store_split(&node, slot, entry_key, entry_value, pivot, right_id));
+                child_id = node.id;
+                continue;
+            }
+            if (is_pending)
+                insert_entry(&node, slot, entry_key, entry_value);
+
+            // A root left with a single child gives way to it
+            if (level == 0 && !node.is_leaf && node.num_keys == 0)
+            {
+                child_id = node.pointers[0];
+                continue;
+            }
+            RETHROW_ON_EXCEPTION(store_node(&node));
+            child_id = node.id;
+        }
+
+        CowNode root;
+        if (is_dropped)
+        {
+            init_node(&root, true);
+            RETHROW_ON_EXCEPTION(store_node(&root));
+            child_id = root.id;
+        }
+        else if (right_id != INVALID_PAGE_ID)
+        {
+            init_node(&root, false);
+            root.num_keys = 1;
+            root.keys[0] = pivot;
+            root.pointers[0] = child_id;
+            root.pointers[1] = right_id;
+            RETHROW_ON_EXCEPTION(store_node(&root));
+            child_id = root.id;
+        }
+
+        txn = next_txn;
+        RETHROW_ON_EXCEPTION(pf.SetRootPage(child_id));
+        published.store(pack(txn, child_id));
+        // Only now, a failure before leaves the old path in use
+        for (size_t i = 0; i < old_ids.size(); i++)
+            retire(old_ids[i], txn);
+        RETHROW_ON_EXCEPTION(reclaim());
+        RETURN_SUCCESS();
+    }
+
+    bool CowTree::search(int32_t root, uint64_t key, int32_t &page_id)
+    {
+        CowNode node;
+        int32_t id = root;
+
+        for (;;)
+        {
+            if (!(load_node(id, &node) == STATUS_SUCCESS))
+                return false;
+            if (node.is_leaf)
+                break;
+            id = node.pointers[UpperBound(node.keys, node.num_keys, key)];
+        }
+
+        int32_t slot = LowerBound(node.keys, node.num_keys, key);
+        if (slot == node.num_keys || node.keys[slot] != key)
+            return false;
+        page_id = node.pointers[slot];
+        return true;
+    }
+
+    // Every store goes to a new page.
+    Status CowTree::store_node(CowNode * node)
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(node->id));
+        fresh_pages.insert(node->id);
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, node->id));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) node, sizeof(CowNode)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    // A full node is stored in halves, the entry going to the one it belongs
+    // in. Keys from pivot on are in the right half.
+    Status CowTree::store_split(CowNode * node, int32_t slot, uint64_t key, int32_t value,
+        uint64_t &pivot, int32_t &right_id)
+    {
+        CowNode right;
+        int32_t mid = node->num_keys / 2;
+        init_node(&right, node->is_leaf);
+
+        if (node->is_leaf)
+        {
+            right.num_keys = node->num_keys - mid;
+            memcpy(right.keys, &node->keys[mid], right.num_keys * sizeof(uint64_t));
+            memcpy(right.pointers, &node->pointers[mid], right.num_keys * sizeof(int32_t));
+            node->num_keys = mid;
+            pivot = right.keys[0];
+            if (slot <= mid)
+                insert_entry(node, slot, key, value);
+            else
+                insert_entry(&right, slot - mid, key, value);
+        }
+        else
+        {
+            // The middle key moves up
+            right.num_keys = node->num_keys - mid - 1;
+            memcpy(right.keys, &node->keys[mid + 1], right.num_keys * sizeof(uint64_t));
+            memcpy(right.pointers, &node->pointers[mid + 1], (right.num_keys + 1) * sizeof(int32_t));
+            node->num_keys = mid;
+            pivot = node->keys[mid];
+            if (slot <= mid)
+                insert_entry(node, slot, key, value);
+            else
+                insert_entry(&right, slot - mid - 1, key, value);
+        }
+
+        RETHROW_ON_EXCEPTION(store_node(node));
+        RETHROW_ON_EXCEPTION(store_node(&right));
+        right_id = right.id;
+        RETURN_SUCCESS();
+    }
+
+    // Pages never on disk only wait for the readers, the others also for the
+    // roots of both meta pages to be without them.
+    void CowTree::retire(int32_t page_id, uint32_t replaced_txn)
+    {
+        if (fresh_pages.erase(page_id))
+            fresh_retired.push_back(Retired(replaced_txn, page_id));
+        else
+            durable_retired.push_back(Retired(replaced_txn, page_id));
+    }
+
+    // A reader pinned at txn sees the pages replaced after it. Both lists are
+    // in txn order.
+    Status CowTree::reclaim()
+    {
+        uint32_t oldest = txn;
+        for (int32_t i = 0; i < COW_READER_SLOTS; i++)
+        {
+            uint64_t state = readers[i].load();
+            if (state && txn_before((uint32_t) (state >> 32), oldest))
+                oldest = (uint32_t) (state >> 32);
+        }
+
+        while (!fresh_retired.empty() && !txn_before(oldest, fresh_retired.front().first))
+        {
+            RETHROW_ON_EXCEPTION(pf.ReleasePage(fresh_retired.front().second));
+            fresh_retired.pop_front();
+        }
+        while (!durable_retired.empty() && !txn_before(oldest, durable_retired.front().first) &&
+            !txn_before(previous_txn, durable_retired.front().first))
+        {
+            RETHROW_ON_EXCEPTION(pf.ReleasePage(durable_retired.front().second));
+            durable_retired.pop_front();
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status CowTree::load_node(int32_t id, CowNode * node)
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, id));
+        RETHROW_ON_EXCEPTION(ph.Read((int8_t *) node, sizeof(CowNode)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    // Caller holds write_mutex. The pages are synced before the meta page
+    // that leads to them, which goes to the other slot than the newest one:
+    // a crash at any point leaves a valid meta page and a complete tree.
+    Status CowTree::write_meta(bool is_closed)
+    {
+        RETHROW_ON_EXCEPTION(pf.ForcePage());
+        RETHROW_ON_EXCEPTION(pf.Sync());
+
+        CowMeta meta;
+        memset(&meta, 0, sizeof(CowMeta));
+        meta.seq = meta_seq + 1 ? meta_seq + 1 : 1;
+        meta.txn = txn;
+        meta.root = (int32_t) (published.load() & 0xffffffff);
+        meta.alloc_pages = pf.GetTotalPages();
+        meta.free_list_head = pf.GetFreeListHead();
+        meta.is_closed = is_closed;
+        meta.checksum = meta_checksum(meta);
+
+        // Not read, the page may be the torn one
+        int8_t * raw_page;
+        int32_t page_id = meta.seq % COW_META_PAGES;
+        RETHROW_ON_EXCEPTION(pf.FetchPage(page_id, &raw_page, false));
+        memset(raw_page, 0, PAGE_SIZE);
+        memcpy(raw_page, &meta, sizeof(CowMeta));
+        RETHROW_ON_EXCEPTION(pf.MarkDirty(page_id));
+        RETHROW_ON_EXCEPTION(pf.UnpinPage(page_id));
+        RETHROW_ON_EXCEPTION(pf.ForcePage(page_id));
+        RETHROW_ON_EXCEPTION(pf.Sync());
+        meta_seq = meta.seq;
+        RETURN_SUCCESS();
+    }
+
+    // A torn or never written meta page fails the page checksum, or its own.
+    bool CowTree::read_meta(int32_t page_id, CowMeta &meta)
+    {
+        PageHandle ph;
+        if (!(ph.OpenPage(pf, page_id) == STATUS_SUCCESS))
+            return false;
+        bool is_read = ph.Read((int8_t *) &meta, sizeof(CowMeta)) == STATUS_SUCCESS;
+        ph.ClosePage();
+        return is_read && meta.seq && meta.checksum == meta_checksum(meta) &&
+            meta.root >= COW_META_PAGES && meta.root < meta.alloc_pages &&
+            meta.alloc_pages <= pf.GetTotalPages();
+    }
+
+    // Every page neither root reaches is free, pages allocated after the
+    // newest meta page included: those are cut off. Pages only the older
+    // root reaches are retired, until the next commit replaces it.
+    Status CowTree::recover_free_space(const CowMeta &meta, const CowMeta * older)
+    {
+        std::vector<int8_t> reached(meta.alloc_pages, 0);
+        RETHROW_ON_EXCEPTION(mark_reached(meta.root, 1, reached));
+        if (older && mark_reached(older->root, 2, reached) == STATUS_SUCCESS)
+            previous_txn = older->txn;
+        else
+            std::replace(reached.begin(), reached.end(), (int8_t) 2, (int8_t) 0);
+
+        RETHROW_ON_EXCEPTION(pf.ResetFreeSpace(meta.alloc_pages, INVALID_PAGE_ID));
+        for (int32_t id = meta.alloc_pages - 1; id >= COW_META_PAGES; id--)
+        {
+            if (!reached[id])
+            {
+                RETHROW_ON_EXCEPTION(pf.ReleasePage(id, false));
+            }
+            else if (reached[id] == 2)
+                durable_retired.push_back(Retired(txn, id));
+        }
+        RETURN_SUCCESS();
+    }
+
+    // Pages marked already are shared with a tree walked before.
+    Status CowTree::mark_reached(int32_t root, int8_t mark, std::vector<int8_t> &reached)
+    {
+        std::vector<int32_t> pending(1, root);
+        while (!pending.empty())
+        {
+            int32_t id = pending.back();
+            pending.pop_back();
+            if (id < COW_META_PAGES || id >= (int32_t) reached.size())
+                RETURN_CORRUPTION("Bad copy-on-write tree page");
+            if (reached[id])
+                continue;
+            reached[id] = mark;
+
+            CowNode node;
+            RETHROW_ON_EXCEPTION(load_node(id, &node));
+            if (!node.is_leaf)
+                pending.insert(pending.end(), node.pointers, node.pointers + node.num_keys + 1);
+        }
+        RETURN_SUCCESS();
+    }
+
+    // Txn in the high half and root in the low half, so that readers get
+    // both in one load. Txn zero is skipped, a zero slot is a free one.
+    uint64_t CowTree::pack(uint32_t txn, int32_t root)
+    {
+        return ((uint64_t) txn << 32) | (uint32_t) root;
+    }
+
+    // Serial number order, txns wrap around
+    bool CowTree::txn_before(uint32_t lhs, uint32_t rhs)
+    {
+        return (int32_t) (lhs - rhs) < 0;
+    }
+} // namespace Pumper
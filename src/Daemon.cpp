@@ -7,17 +7,20 @@
 #include "Daemon.h"
 #include "Thread.h"
 #include "Epoll.h"
+#include "Statistics.h"
+
+#include <signal.h>
 
 namespace Pumper {
 	Message Daemon::func_put(int argc, char **argv, const Message &msg)
 	{
-		if (!engine.IsOpened()) 
+		if (!engine->IsOpened()) 
 			return Message(MessageType::Exception, "File not opened", msg);
 
 		if (argc != 3)
 			return Message(MessageType::Exception, "Usage: put <key> <value>", msg);
 
-		if (engine.Put(argv[1], argv[2]) == STATUS_SUCCESS)
+		if (engine->Put(argv[1], argv[2]) == STATUS_SUCCESS)
 			return Message(MessageType::Response,  "OK", msg);
 		else
 			return Message(MessageType::Exception, "Internal error", msg);
@@ -25,45 +28,49 @@ namespace Pumper {
 
 	Message Daemon::func_get(int argc, char **argv, const Message &msg)
 	{
-		if (!engine.IsOpened()) 
+		if (!engine->IsOpened()) 
 			return Message(MessageType::Exception, "File not opened", msg);
 
 		if (argc != 2)
 			return Message(MessageType::Exception, "Usage: get <key> ", msg);
 
-		if (!engine.Contains(argv[1]))
-			return Message(MessageType::Response,  "NULL", msg);
-		
+		// A miss comes back from Get itself, no separate lookup first.
 		String value;
-		if (engine.Get(argv[1], value) == STATUS_SUCCESS)
+		Status status = engine->Get(argv[1], value);
+		if (status == STATUS_SUCCESS)
 			return Message(MessageType::Response, value, msg);
+		else if (status.GetCode() == StatusNotFound)
+			return Message(MessageType::Response,  "NULL", msg);
 		else
 			return Message(MessageType::Exception, "Internal error", msg);
 	}
 
 	Message Daemon::func_remove(int argc, char **argv, const Message &msg)
 	{
-		if (!engine.IsOpened()) 
+		if (!engine->IsOpened()) 
 			return Message(MessageType::Exception, "File not opened", msg);
 
 		if (argc != 2)
 			return Message(MessageType::Exception, "Usage: remove <key> ", msg);
 
-		if (!engine.Contains(argv[1]))
-			return Message(MessageType::Response,  "NULL", msg);
-
-		if (engine.Remove(argv[1]) == STATUS_SUCCESS)
+		Status status = engine->Remove(argv[1]);
+		if (status == STATUS_SUCCESS)
 			return Message(MessageType::Response,  "OK", msg);
+		else if (status.GetCode() == StatusNotFound)
+			return Message(MessageType::Response,  "NULL", msg);
 		else
 			return Message(MessageType::Exception, "Internal error", msg);
 	}
 
 	Message Daemon::func_list(int argc, char **argv, const Message &msg)
 	{
-		if (!engine.IsOpened()) 
+		if (!engine->IsOpened()) 
 			return Message(MessageType::Exception, "File not opened", msg);
 
-		std::vector<String> keys = engine.ListKeys();
+		// Scan at a snapshot so that writers are not held up by long listings.
+		Snapshot * snapshot = engine->GetSnapshot();
+		std::vector<String> keys = engine->ListKeys(snapshot);
+		engine->ReleaseSnapshot(snapshot);
 		char output[MESSAGE_SIZE];
 		memset(output, 0, MESSAGE_SIZE);
 		for (uint32_t i = 0; i < keys.size(); i++)
@@ -72,21 +79,71 @@ namespace Pumper {
 		return Message(MessageType::Response, String(output), msg);
 	}
 
+	Message Daemon::func_scan(int argc, char **argv, const Message &msg)
+	{
+		if (!engine->IsOpened()) 
+			return Message(MessageType::Exception, "File not opened", msg);
+
+		if (argc != 3)
+			return Message(MessageType::Exception, "Usage: scan <start_key> <count>", msg);
+
+		KeyValueList items;
+		if (!(engine->Scan(argv[1], atoi(argv[2]), items) == STATUS_SUCCESS))
+			return Message(MessageType::Exception, "Internal error", msg);
+
+		// Keys only, as many as fit into one message.
+		String output;
+		for (uint32_t i = 0; i < items.size(); i++)
+		{
+			if (output.size() + items[i].first.size() + 32 >= (size_t) MESSAGE_SIZE)
+				break;
+			if (i > 0)
+				output += " ";
+			output += items[i].first;
+		}
+		return Message(MessageType::Response, output, msg);
+	}
+
+	Message Daemon::func_stats(int argc, char **argv, const Message &msg)
+	{
+		if (argc > 2)
+			return Message(MessageType::Exception, "Usage: stats [prefix]", msg);
+
+		// Whole lines only, as many as fit into one message.
+		String text = Singleton<Statistics>::Instance().ToString(argc == 2 ? argv[1] : "");
+		String output;
+		size_t begin = 0, end;
+		while ((end = text.find('\n', begin)) != String::npos)
+		{
+			if (output.size() + end - begin + 32 >= (size_t) MESSAGE_SIZE)
+				break;
+			output.append(text, begin, end - begin + 1);
+			begin = end + 1;
+		}
+		return Message(MessageType::Response, output, msg);
+	}
+
 	Daemon::Daemon() : epoll_thread([](){
 		Singleton<Epoll>::Instance().Loop();
-	}, "epoll_thread")
+	}, "epoll_thread"), engine(NULL)
 	{
 	}
 
     Daemon::~Daemon()
     {
-
+        if (engine)
+            delete engine;
     }
 
-	Status Daemon::Start(const String& file, int32_t port)
+	Status Daemon::Start(const String& file, int32_t port, size_t cache_capacity, EngineKind kind)
 	{
-		// RETHROW_ON_EXCEPTION(engine.CreateDb(file));
-		RETHROW_ON_EXCEPTION(engine.OpenDb(file));
+		WARNING_ASSERT(!engine);
+		// A client that goes away must not take the server down with it.
+		signal(SIGPIPE, SIG_IGN);
+		engine = KvEngine::New(kind);
+		// RETHROW_ON_EXCEPTION(engine->CreateDb(file));
+		RETHROW_ON_EXCEPTION(engine->EnableCache(cache_capacity));
+		RETHROW_ON_EXCEPTION(engine->OpenDb(file));
 
 		auto read_callback_bind = std::bind(&Daemon::read_callback, 
 			this, std::placeholders::_1, std::placeholders::_2);
@@ -104,14 +161,16 @@ namespace Pumper {
 
 	Status Daemon::Stop()
 	{
+		WARNING_ASSERT(engine);
 		RETHROW_ON_EXCEPTION(tcpServer.Stop());
-		RETHROW_ON_EXCEPTION(engine.CloseDb());
+		RETHROW_ON_EXCEPTION(engine->CloseDb());
 		RETURN_SUCCESS();
 	}
 
     Status Daemon::UpdateChanges()
     {
-        RETHROW_ON_EXCEPTION(engine.UpdateChanges());
+        WARNING_ASSERT(engine);
+        RETHROW_ON_EXCEPTION(engine->UpdateChanges());
         RETURN_SUCCESS();
     }
 
@@ -148,15 +207,38 @@ namespace Pumper {
 		strcpy(command, msg.Payload().c_str());
 
 		arg_cnt = parse(command, arg_val);
+		Statistics::Tick(NetworkCommands);
 		
 		if (strcasecmp(command, "put") == 0)	
+		{
+			StopWatch stop_watch(CommandPutNanos);
 			return func_put(arg_cnt, arg_val, msg);
+		}
 		if (strcasecmp(command, "get") == 0)
-			return func_get(arg_cnt, arg_val, msg);		
+		{
+			StopWatch stop_watch(CommandGetNanos);
+			return func_get(arg_cnt, arg_val, msg);
+		}
 		if (strcasecmp(command, "remove") == 0)	
+		{
+			StopWatch stop_watch(CommandRemoveNanos);
 			return func_remove(arg_cnt, arg_val, msg);
+		}
 		if (strcasecmp(command, "list") == 0)
+		{
+			StopWatch stop_watch(CommandListNanos);
 			return func_list(arg_cnt, arg_val, msg);
+		}
+		if (strcasecmp(command, "scan") == 0)
+		{
+			StopWatch stop_watch(CommandScanNanos);
+			return func_scan(arg_cnt, arg_val, msg);
+		}
+		if (strcasecmp(command, "stats") == 0)
+		{
+			StopWatch stop_watch(CommandStatsNanos);
+			return func_stats(arg_cnt, arg_val, msg);
+		}
 
 		return Message(MessageType::Exception, "Unknown operation", msg);
 	}
@@ -165,10 +247,11 @@ namespace Pumper {
 	{
 		String output;
 		Message incoming(msg);
-		if (incoming.Type() == MessageType::Command)
-			output = execute_command(incoming).ToPacket();
-		else
-			output = Message(MessageType::Exception, "Illegal Message Type", incoming).ToPacket();
+		Message response = incoming.Type() == MessageType::Command ? execute_command(incoming) :
+			Message(MessageType::Exception, "Illegal Message Type", incoming);
+		if (response.Type() == MessageType::Exception)
+			Statistics::Tick(NetworkErrors);
+		output = response.ToPacket();
 		return output;
 	}
 
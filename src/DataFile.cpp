@@ -23,9 +23,9 @@ namespace Pumper {
 
     }
 
-	Status DataFile::Create(const String& file)
+	Status DataFile::Create(const String& file, bool is_compressed)
     {
-        RETHROW_ON_EXCEPTION(PagedFile::Create(file));
+        RETHROW_ON_EXCEPTION(PagedFile::Create(file, is_compressed ? HEADER_COMPRESSED : 0));
         RETURN_SUCCESS();
     }
 
@@ -77,7 +77,39 @@ namespace Pumper {
         } 
         else
         {
-            RETURN_INFORMATION("Out of space");
+            RETURN_CODE(StatusOutOfSpace, "Out of space");
+        }
+    }
+
+    Status DataFile::Update(int32_t page_id, const String& key, const String& value)
+    {
+        PageHandle temp_ph;
+        Bucket bucket;
+        int8_t bucketblock[PAGE_SIZE] = { 0 };
+        RETHROW_ON_EXCEPTION(temp_ph.OpenPage(paged_file, page_id));
+        RETHROW_ON_EXCEPTION(temp_ph.Read(bucketblock, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(bucket.Import(bucketblock));
+        if (!bucket.Exist(key))
+        {
+            RETHROW_ON_EXCEPTION(temp_ph.ClosePage());
+            RETURN_NOT_FOUND();
+        }
+
+        bool status = bucket.Put(key, value);
+        if (!status)
+        {
+            RETHROW_ON_EXCEPTION(bucket.Remove(key));
+        }
+        RETHROW_ON_EXCEPTION(bucket.Export(bucketblock));
+        RETHROW_ON_EXCEPTION(temp_ph.Write(bucketblock, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(temp_ph.ClosePage());
+        if (status) 
+        {
+            RETURN_SUCCESS();
+        } 
+        else
+        {
+            RETURN_CODE(StatusOutOfSpace, "Out of space");
         }
     }
 
@@ -98,7 +130,7 @@ namespace Pumper {
         } 
         else
         {
-            RETURN_INFORMATION("Item not found");
+            RETURN_NOT_FOUND();
         }
     }
 
@@ -110,6 +142,11 @@ namespace Pumper {
         RETHROW_ON_EXCEPTION(temp_ph.OpenPage(paged_file, page_id));
         RETHROW_ON_EXCEPTION(temp_ph.Read(bucketblock, PAGE_SIZE));
         RETHROW_ON_EXCEPTION(bucket.Import(bucketblock));
+        if (!bucket.Exist(key))
+        {
+            RETHROW_ON_EXCEPTION(temp_ph.ClosePage());
+            RETURN_NOT_FOUND();
+        }
         RETHROW_ON_EXCEPTION(bucket.Remove(key));
         RETHROW_ON_EXCEPTION(bucket.Export(bucketblock));
         RETHROW_ON_EXCEPTION(temp_ph.Write(bucketblock, PAGE_SIZE));
@@ -139,15 +176,17 @@ namespace Pumper {
         return bucket.ListKeys();
     }
 
-    Status DataFile::Put(const String& key, const String& value)
+    Status DataFile::Put(const String& key, const String& value, bool &is_inserted)
     {
         int32_t page_id = 0;
         int32_t total_pages = paged_file.GetTotalPages();      
+        paged_file.Prefetch(page_id);
         for (; page_id < total_pages; page_id++)
         {
             if (Contains(page_id, key))
                 break;
         }
+        is_inserted = page_id == total_pages;
 
         if (page_id != total_pages)
         {
@@ -178,6 +217,7 @@ namespace Pumper {
     {
         page_id = first_scan;
         int32_t total_pages = paged_file.GetTotalPages();      
+        paged_file.Prefetch(page_id);
         for (; page_id < total_pages; page_id++)
         {
             if (Contains(page_id, key))
@@ -214,6 +254,7 @@ namespace Pumper {
     {
         int32_t page_id = 0;
         int32_t total_pages = paged_file.GetTotalPages();      
+        paged_file.Prefetch(page_id);
         for (; page_id < total_pages; page_id++)
         {
             if (Contains(page_id, key))
@@ -226,13 +267,14 @@ namespace Pumper {
             RETURN_SUCCESS();
         }
 
-        RETURN_INFORMATION("Item not found");
+        RETURN_NOT_FOUND();
     }
 
     Status DataFile::Remove(const String& key)
     {
         int32_t page_id = 0;
         int32_t total_pages = paged_file.GetTotalPages();      
+        paged_file.Prefetch(page_id);
         for (; page_id < total_pages; page_id++)
         {
             if (Contains(page_id, key))
@@ -245,13 +287,14 @@ namespace Pumper {
             RETURN_SUCCESS();
         }
 
-        RETURN_INFORMATION("Item not found");
+        RETURN_NOT_FOUND();
     }
 
     bool DataFile::Contains(const String& key)
     {
         int32_t page_id = 0;
         int32_t total_pages = paged_file.GetTotalPages();      
+        paged_file.Prefetch(page_id);
         for (; page_id < total_pages; page_id++)
         {
             if (Contains(page_id, key))
@@ -265,6 +308,7 @@ namespace Pumper {
         std::vector<String> response;
         int32_t page_id = 0;
         int32_t total_pages = paged_file.GetTotalPages();      
+        paged_file.Prefetch(page_id);
         for (; page_id < total_pages; page_id++)
         {
             std::vector<String> dummy;
@@ -5,10 +5,15 @@
 // Which could also support random lookup. 
 
 #include "Engine.h"
+#include "Statistics.h"
+
+#include <stdio.h>
+#include <unistd.h>
 
 namespace Pumper {
 
-    Engine::Engine() : data_file(NULL), index_file(NULL)
+    Engine::Engine() : data_file(NULL), index_file(NULL), filter_file(NULL), lsm_tree(NULL), 
+        clustered_tree(NULL), int_table(NULL), value_cache(NULL)
     {
 
     }
@@ -19,85 +24,231 @@ namespace Pumper {
             delete data_file;
         if (index_file)
             delete index_file;
+        if (filter_file)
+            delete filter_file;
+        if (lsm_tree)
+            delete lsm_tree;
+        if (clustered_tree)
+            delete clustered_tree;
+        if (int_table)
+            delete int_table;
+        if (value_cache)
+            delete value_cache;
     }
 
-    Status Engine::CreateDb(const String& file)
+    Status Engine::CreateDb(const String& file, StorageLayout layout, bool is_compressed, 
+        IndexType index_type)
     {
-        RETHROW_ON_EXCEPTION(PagedFile::Create(file + ".DATA"));
-        RETHROW_ON_EXCEPTION(PagedFile::Create(file + ".INDEX"));
+        if (layout == LogStructured)
+            return LsmTree::Create(file);
+        if (layout == Clustered)
+            return ClusteredTree::Create(file);
+        if (layout == IntegerKeys)
+            return IntTable::Create(file);
+
+        RETHROW_ON_EXCEPTION(DataFile::Create(file + ".DATA", is_compressed));
+        RETHROW_ON_EXCEPTION(IndexFile::Create(file + ".INDEX", index_type));
+        RETHROW_ON_EXCEPTION(FilterFile::Create(file + ".BLOOM"));
         RETURN_SUCCESS();
     }
 
     Status Engine::UnlinkDb(const String& file)
     {
+        if (LsmTree::Exists(file))
+            return LsmTree::Unlink(file);
+        if (ClusteredTree::Exists(file))
+            return ClusteredTree::Unlink(file);
+        if (IntTable::Exists(file))
+            return IntTable::Unlink(file);
+
         RETHROW_ON_EXCEPTION(PagedFile::Unlink(file + ".DATA"));
         RETHROW_ON_EXCEPTION(PagedFile::Unlink(file + ".INDEX"));
+        // Databases created by older versions have no filter
+        if (!access((file + ".BLOOM").c_str(), F_OK))
+            RETHROW_ON_EXCEPTION(FilterFile::Unlink(file + ".BLOOM"));
         RETURN_SUCCESS();
     }
 
     Status Engine::OpenDb(const String& file)
     {
-        WARNING_ASSERT(!data_file && !index_file);
+        LockGuard lock_guard(mutex);
+        WARNING_ASSERT(!data_file && !index_file && !lsm_tree && !clustered_tree && !int_table);
+
+        if (LsmTree::Exists(file))
+        {
+            lsm_tree = new LsmTree();
+            Status status = lsm_tree->Open(file);
+            if (!(status == STATUS_SUCCESS))
+            {
+                delete lsm_tree;
+                lsm_tree = NULL;
+                return status;
+            }
+            db_name = file;
+            RETURN_SUCCESS();
+        }
+
+        if (ClusteredTree::Exists(file))
+        {
+            clustered_tree = new ClusteredTree();
+            Status status = clustered_tree->Open(file);
+            if (!(status == STATUS_SUCCESS))
+            {
+                delete clustered_tree;
+                clustered_tree = NULL;
+                return status;
+            }
+            db_name = file;
+            RETURN_SUCCESS();
+        }
+
+        if (IntTable::Exists(file))
+        {
+            int_table = new IntTable();
+            Status status = int_table->Open(file);
+            if (!(status == STATUS_SUCCESS))
+            {
+                delete int_table;
+                int_table = NULL;
+                return status;
+            }
+            db_name = file;
+            RETURN_SUCCESS();
+        }
 
         data_file = new DataFile(data_paged_file);
         index_file = new IndexFile(index_paged_file);
 
         RETHROW_ON_EXCEPTION(data_file->OpenFile(file + ".DATA"));
         RETHROW_ON_EXCEPTION(index_file->OpenFile(file + ".INDEX"));
+
+        filter_file = new FilterFile(filter_paged_file);
+        if (access((file + ".BLOOM").c_str(), F_OK))
+            RETHROW_ON_EXCEPTION(FilterFile::Create(file + ".BLOOM"));
+        RETHROW_ON_EXCEPTION(filter_file->OpenFile(file + ".BLOOM"));
+        if (!filter_file->IsValid())
+            RETHROW_ON_EXCEPTION(rebuild_filter());
         db_name = file;
         RETURN_SUCCESS();
     }
 
     Status Engine::CloseDb()
     {
+        LockGuard lock_guard(mutex);
+        if (lsm_tree)
+        {
+            RETHROW_ON_EXCEPTION(lsm_tree->Close());
+            delete lsm_tree;
+            lsm_tree = NULL;
+            db_name = "";
+            if (value_cache)
+                value_cache->Clear();
+            RETURN_SUCCESS();
+        }
+
+        if (clustered_tree)
+        {
+            RETHROW_ON_EXCEPTION(clustered_tree->Close());
+            delete clustered_tree;
+            clustered_tree = NULL;
+            db_name = "";
+            if (value_cache)
+                value_cache->Clear();
+            RETURN_SUCCESS();
+        }
+
+        if (int_table)
+        {
+            RETHROW_ON_EXCEPTION(int_table->Close());
+            delete int_table;
+            int_table = NULL;
+            db_name = "";
+            if (value_cache)
+                value_cache->Clear();
+            RETURN_SUCCESS();
+        }
+
         WARNING_ASSERT(data_file && index_file);
         RETHROW_ON_EXCEPTION(data_file->Close());
         RETHROW_ON_EXCEPTION(index_file->Close());
+        RETHROW_ON_EXCEPTION(filter_file->Close());
         delete data_file;
         delete index_file;
+        delete filter_file;
         data_file = NULL;
         index_file = NULL;
+        filter_file = NULL;
         db_name = "";
+        if (value_cache)
+            value_cache->Clear();
         RETURN_SUCCESS();
     }
 
     Status Engine::UpdateChanges()
     {
+        LockGuard lock_guard(mutex);
+        if (lsm_tree)
+            return lsm_tree->UpdateChanges();
+        if (clustered_tree)
+            return clustered_tree->UpdateChanges();
+        if (int_table)
+            return int_table->UpdateChanges();
+
         WARNING_ASSERT(data_file && index_file);
         RETHROW_ON_EXCEPTION(data_file->UpdateChanges());
         RETHROW_ON_EXCEPTION(index_file->UpdateChanges());
+        RETHROW_ON_EXCEPTION(filter_file->UpdateChanges());
         RETURN_SUCCESS();
     }
 
-    Status Engine::Put(const String& key, const String& value)
+    Status Engine::put_entry(const String& key, const String& value)
     {
+        if (lsm_tree)
+            return lsm_tree->Put(key, value);
+        if (clustered_tree)
+            return clustered_tree->Put(key, value);
+        if (int_table)
+        {
+            uint64_t int_key;
+            if (!parse_int_key(key, int_key))
+                RETURN_WARNING("Key is not a 64-bit unsigned integer");
+            return int_table->Put(int_key, value);
+        }
+
         WARNING_ASSERT(data_file && index_file);
-        if (index_file->Exist(key))
+        int page_id;
+        if (index_file->Find(key, page_id))
         {
             // If I just want to update it, or conflict in same page, behave
-            // normally is ok.
-            int page_id;
-            RETHROW_ON_EXCEPTION(index_file->Get(key, page_id));
-            if (data_file->Contains(page_id, key))
+            // normally is ok. One index descent and one visit of the page.
+            int32_t conflict = page_id & 0x80000000;
+            Status update_status = data_file->Update(page_id & 0x7fffffff, key, value);
+            if (update_status.GetCode() == StatusOutOfSpace)
             {
-                if (!(data_file->Put(page_id, key, value) == STATUS_SUCCESS))
-                {
-                    RETHROW_ON_EXCEPTION(data_file->Remove(page_id, key));
-                    RETHROW_ON_EXCEPTION(data_file->Put(key, value, page_id));
-                    RETHROW_ON_EXCEPTION(index_file->Update(key, page_id));
-                }
+                // A full page has already dropped the entry, which moves elsewhere.
+                RETHROW_ON_EXCEPTION(data_file->Put(key, value, page_id));
+                RETHROW_ON_EXCEPTION(index_file->Update(key, page_id | conflict));
             }
-            else
+            else if (update_status.GetCode() == StatusNotFound)
             {
                 // Otherwise it will fallback.                
-                RETHROW_ON_EXCEPTION(data_file->Put(key, value));
-                RETHROW_ON_EXCEPTION(index_file->Update(key, page_id | 0x80000000));
+                bool is_inserted;
+                Statistics::Tick(EngineCollisionFallbacks);
+                RETHROW_ON_EXCEPTION(data_file->Put(key, value, is_inserted));
+                if (is_inserted)
+                    filter_file->Add(key);
+                if (!conflict)
+                {
+                    RETHROW_ON_EXCEPTION(index_file->Update(key, page_id | 0x80000000));
+                }
             }
+            else
+                RETHROW_ON_EXCEPTION(update_status);
         }
         else
         {
             // New entry here. Just insert it normally (very slow)
-            int page_id;
+            filter_file->Add(key);
             // XXX: To faster insert cost
             static int scan = 0;
             RETHROW_ON_EXCEPTION(data_file->Put(key, value, page_id, scan));
@@ -109,76 +260,138 @@ namespace Pumper {
         RETURN_SUCCESS();
     }
 
-    Status Engine::Get(const String& key, String& value)
+    Status Engine::get_entry(const String& key, String& value)
     {
+        if (lsm_tree)
+            return lsm_tree->Get(key, value);
+        if (clustered_tree)
+            return clustered_tree->Get(key, value);
+        if (int_table)
+        {
+            uint64_t int_key;
+            if (!parse_int_key(key, int_key))
+                RETURN_NOT_FOUND();
+            return int_table->Get(int_key, value);
+        }
+
         WARNING_ASSERT(data_file && index_file);
-        WARNING_ASSERT(index_file->Exist(key));
+        if (!filter_file->MayContain(key))
+        {
+            Statistics::Tick(EngineFilterNegatives);
+            RETURN_NOT_FOUND();
+        }
 
         int page_id;
-        RETHROW_ON_EXCEPTION(index_file->Get(key, page_id));
+        if (!index_file->Find(key, page_id))
+            RETURN_NOT_FOUND();
+        return get_at(key, page_id, value);
+    }
+
+    Status Engine::get_at(const String& key, int32_t page_id, String& value)
+    {
+        // Try to fetch major items here, a miss tells there is nothing
+        Status status = data_file->Get(page_id & 0x7fffffff, key, value);
 
         // The highest bit: determine whether there is a conflict
-        if (page_id & 0x80000000)
-        {            
-            if (data_file->Contains(page_id & 0x7fffffff, key)) 
-            {
-                // Try to fetch major items here
-                RETHROW_ON_EXCEPTION(data_file->Get(page_id & 0x7fffffff, key, value));
-            }
-            else
-            {
-                // Otherwise, use the slow method as fallback
-                RETHROW_ON_EXCEPTION(data_file->Get(key, value));
-            }
-        }
-        else 
+        if (status.GetCode() == StatusNotFound && (page_id & 0x80000000))
         {
-            RETHROW_ON_EXCEPTION(data_file->Get(page_id, key, value));
+            // Otherwise, use the slow method as fallback
+            Statistics::Tick(EngineCollisionFallbacks);
+            return data_file->Get(key, value);
         }
+        return status;
+    }
 
-        RETURN_SUCCESS();
+    Status Engine::get_cow_entry(const String& key, int32_t page_id, String& value)
+    {
+        Status status = get_at(key, page_id, value);
+        // The entry moved or went away after the index was searched. A page
+        // holds the only copy of its entries, so a hit is never stale.
+        if (status.GetCode() == StatusNotFound)
+            return get_entry(key, value);
+        return status;
     }
 
-    Status Engine::Remove(const String& key)
+    Status Engine::remove_entry(const String& key)
     {
+        if (lsm_tree)
+        {
+            // A tombstone is a blind write, but callers expect to learn
+            // whether the key was there.
+            if (!lsm_tree->Contains(key))
+                RETURN_NOT_FOUND();
+            return lsm_tree->Remove(key);
+        }
+        if (clustered_tree)
+            return clustered_tree->Remove(key);
+        if (int_table)
+        {
+            uint64_t int_key;
+            if (!parse_int_key(key, int_key))
+                RETURN_NOT_FOUND();
+            return int_table->Remove(int_key);
+        }
+
         WARNING_ASSERT(data_file && index_file);
-        WARNING_ASSERT(index_file->Exist(key));
+        if (!filter_file->MayContain(key))
+        {
+            Statistics::Tick(EngineFilterNegatives);
+            RETURN_NOT_FOUND();
+        }
 
         int page_id;
-        RETHROW_ON_EXCEPTION(index_file->Get(key, page_id));
+        if (!index_file->Find(key, page_id))
+            RETURN_NOT_FOUND();
+
+        // Try to remove major items here, in one visit of the page
+        Status status = data_file->Remove(page_id & 0x7fffffff, key);
 
         // The highest bit: determine whether there is a conflict
         if (page_id & 0x80000000)
         {
-            if (data_file->Contains(page_id & 0x7fffffff, key)) 
-            {
-                // Try to fetch major items here
-                RETHROW_ON_EXCEPTION(data_file->Remove(page_id & 0x7fffffff, key));
-            }
-            else
+            if (status.GetCode() == StatusNotFound)
             {
                 // Otherwise, use the slow method as fallback
-                RETHROW_ON_EXCEPTION(data_file->Remove(key));
+                Statistics::Tick(EngineCollisionFallbacks);
+                status = data_file->Remove(key);
             }
         }
-        else 
+        else if (status == STATUS_SUCCESS)
         {
             RETHROW_ON_EXCEPTION(index_file->Remove(key));
-            RETHROW_ON_EXCEPTION(data_file->Remove(page_id, key));
         }
 
-        RETURN_SUCCESS();
+        // A key that only shares its hash with a stored one is not counted
+        // in the filter, so it must not be taken out of it either.
+        if (status == STATUS_SUCCESS)
+            filter_file->Remove(key);
+        return status;
     }
 
-    bool Engine::Contains(const String& key)
+    bool Engine::contains_entry(const String& key)
     {
+        if (lsm_tree)
+            return lsm_tree->Contains(key);
+        if (clustered_tree)
+            return clustered_tree->Contains(key);
+        if (int_table)
+        {
+            uint64_t int_key;
+            return parse_int_key(key, int_key) && int_table->Contains(int_key);
+        }
+
         //WARNING_ASSERT(data_file && index_file);
-        // If same hash key is not found, it cannot be existed.
-        if (!index_file->Exist(key))
+        // Definite misses never reach the index.
+        if (!filter_file->MayContain(key))
+        {
+            Statistics::Tick(EngineFilterNegatives);
             return false;
+        }
 
+        // If same hash key is not found, it cannot be existed.
         int page_id;
-        index_file->Get(key, page_id);
+        if (!index_file->Find(key, page_id))
+            return false;
 
         // The highest bit: determine whether there is a conflict
         if (page_id & 0x80000000)
@@ -192,15 +405,341 @@ namespace Pumper {
         }
     }
 
+    Status Engine::Put(const String& key, const String& value)
+    {
+        StopWatch stop_watch(EnginePutNanos);
+        LockGuard lock_guard(mutex);
+        num_puts++;
+        return apply_put(key, value);
+    }
+
+    Status Engine::Get(const String& key, String& value)
+    {
+        StopWatch stop_watch(EngineGetNanos);
+        num_gets++;
+        // Hits are served without the engine lock.
+        if (value_cache)
+        {
+            if (value_cache->Lookup(key, value))
+            {
+                Statistics::Tick(EngineCacheHits);
+                RETURN_SUCCESS();
+            }
+            Statistics::Tick(EngineCacheMisses);
+        }
+
+        // A copy-on-write index is searched at a pinned root before the
+        // engine lock is taken, only the data page is read under it.
+        int32_t page_id;
+        CowTree * cow_tree = index_file ? index_file->GetCowTree() : NULL;
+        if (cow_tree && !cow_tree->Search(key, page_id))
+        {
+            num_get_misses++;
+            RETURN_NOT_FOUND();
+        }
+
+        LockGuard lock_guard(mutex);
+        Status status = cow_tree ? get_cow_entry(key, page_id, value) : get_entry(key, value);
+        if (!(status == STATUS_SUCCESS))
+            num_get_misses++;
+        else if (value_cache)
+            value_cache->Insert(key, value);
+        return status;
+    }
+
+    Status Engine::Remove(const String& key)
+    {
+        StopWatch stop_watch(EngineRemoveNanos);
+        LockGuard lock_guard(mutex);
+        num_removes++;
+        return apply_remove(key);
+    }
+
+    bool Engine::Contains(const String& key)
+    {
+        String value;
+        if (value_cache && value_cache->Lookup(key, value))
+            return true;
+
+        LockGuard lock_guard(mutex);
+        return contains_entry(key);
+    }
+
     std::vector<String> Engine::ListKeys()
     {
         //WARNING_ASSERT(data_file && index_file);
+        LockGuard lock_guard(mutex);
+        if (lsm_tree)
+            return lsm_tree->ListKeys();
+        if (clustered_tree)
+            return clustered_tree->ListKeys();
+        if (int_table)
+        {
+            std::vector<uint64_t> int_keys = int_table->ListKeys();
+            std::vector<String> keys;
+            keys.reserve(int_keys.size());
+            for (size_t i = 0; i < int_keys.size(); i++)
+                keys.push_back(format_int_key(int_keys[i]));
+            return keys;
+        }
         return data_file->ListKeys();
     }
 
+    Snapshot * Engine::GetSnapshot()
+    {
+        // Taken under the engine lock so that no write is half applied.
+        LockGuard lock_guard(mutex);
+        return version_log.CreateSnapshot();
+    }
+
+    Status Engine::ReleaseSnapshot(Snapshot * snapshot)
+    {
+        WARNING_ASSERT(snapshot);
+        RETHROW_ON_EXCEPTION(version_log.ReleaseSnapshot(snapshot));
+        RETURN_SUCCESS();
+    }
+
+    Status Engine::Get(const Snapshot * snapshot, const String& key, String& value)
+    {
+        WARNING_ASSERT(snapshot);
+        // As in Get(), but the miss is only told after the version log, as
+        // the key may have been removed since the snapshot.
+        int32_t page_id;
+        CowTree * cow_tree = index_file ? index_file->GetCowTree() : NULL;
+        bool is_indexed = cow_tree && cow_tree->Search(key, page_id);
+
+        LockGuard lock_guard(mutex);
+        switch (version_log.Lookup(snapshot, key, value))
+        {
+        case VersionPresent:
+            RETURN_SUCCESS();
+        case VersionAbsent:
+            RETURN_NOT_FOUND();
+        default:
+            break;
+        }
+
+        if (value_cache && value_cache->Lookup(key, value))
+            RETURN_SUCCESS();
+        if (!cow_tree)
+            return get_entry(key, value);
+        if (!is_indexed)
+            RETURN_NOT_FOUND();
+        return get_cow_entry(key, page_id, value);
+    }
+
+    bool Engine::Contains(const Snapshot * snapshot, const String& key)
+    {
+        String value;
+        LockGuard lock_guard(mutex);
+        switch (version_log.Lookup(snapshot, key, value))
+        {
+        case VersionPresent:
+            return true;
+        case VersionAbsent:
+            return false;
+        default:
+            return contains_entry(key);
+        }
+    }
+
+    std::vector<String> Engine::ListKeys(const Snapshot * snapshot)
+    {
+        std::vector<String> keys;
+        int32_t total_pages;
+        if (lsm_tree)
+        {
+            // The tree copies its state under its own lock. Writes record
+            // their pre-image before they are applied, so the merge below
+            // corrects any write the copy did or did not see.
+            keys = lsm_tree->ListKeys();
+            version_log.MergeKeys(snapshot, keys);
+            return keys;
+        }
+
+        if (clustered_tree)
+        {
+            // A leaf at a time, each from the key after the last one seen:
+            // keys not written since the snapshot are found wherever splits
+            // moved them meanwhile.
+            String start;
+            for (bool is_last = false; !is_last; )
+            {
+                std::vector<String> leaf_keys;
+                {
+                    LockGuard lock_guard(mutex);
+                    if (!(clustered_tree->ListKeys(start, leaf_keys, is_last) == STATUS_SUCCESS))
+                        break;
+                }
+                if (leaf_keys.empty())
+                    break;
+                keys.insert(keys.end(), leaf_keys.begin(), leaf_keys.end());
+                start = leaf_keys.back();
+                start.push_back('\0');
+            }
+            version_log.MergeKeys(snapshot, keys);
+            return keys;
+        }
+
+        {
+            LockGuard lock_guard(mutex);
+            total_pages = int_table ? int_table->GetTotalPages()
+                                    : data_paged_file.GetTotalPages();
+        }
+
+        // Keys not written since the snapshot stay in their page, so a page by
+        // page scan finds all of them. Everything else comes from the undo log.
+        // Pages allocated after the snapshot only hold newer writes.
+        for (int32_t page_id = 0; page_id < total_pages; page_id++)
+        {
+            LockGuard lock_guard(mutex);
+            if (int_table)
+            {
+                std::vector<uint64_t> int_keys = int_table->ListKeys(page_id);
+                for (size_t i = 0; i < int_keys.size(); i++)
+                    keys.push_back(format_int_key(int_keys[i]));
+                continue;
+            }
+            std::vector<String> page_keys = data_file->ListKeys(page_id);
+            keys.insert(keys.end(), page_keys.begin(), page_keys.end());
+        }
+
+        version_log.MergeKeys(snapshot, keys);
+        return keys;
+    }
+
+    Status Engine::Write(const WriteBatch& batch)
+    {
+        LockGuard lock_guard(mutex);
+        num_batches++;
+        const std::vector<WriteBatch::Operation>& operations = batch.Operations();
+        for (uint32_t i = 0; i < operations.size(); i++)
+        {
+            if (operations[i].is_remove)
+            {
+                num_removes++;
+                RETHROW_ON_EXCEPTION(apply_remove(operations[i].key));
+            }
+            else
+            {
+                num_puts++;
+                RETHROW_ON_EXCEPTION(apply_put(operations[i].key, operations[i].value));
+            }
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status Engine::Scan(const String& start, int32_t limit, KeyValueList& items)
+    {
+        if (lsm_tree)
+        {
+            // A merge of the MemTables and runs from start on, under the
+            // tree's own lock like ListKeys().
+            num_scans++;
+            return lsm_tree->Scan(start, limit, items);
+        }
+        if (!clustered_tree)
+            return KvEngine::Scan(start, limit, items);
+
+        // Records come out of the leaves in key order, values included.
+        num_scans++;
+        LockGuard lock_guard(mutex);
+        return clustered_tree->Scan(start, limit, items);
+    }
+
+    // Caller holds the engine lock
+    Status Engine::apply_put(const String& key, const String& value)
+    {
+        WARNING_ASSERT((data_file && index_file) || lsm_tree || clustered_tree || int_table);
+        record_version(key);
+        Status status = put_entry(key, value);
+        if (filter_file && filter_file->NeedsRebuild())
+            RETHROW_ON_EXCEPTION(rebuild_filter());
+        // Updated under the engine lock, so readers never cache a stale value.
+        if (value_cache)
+        {
+            if (status == STATUS_SUCCESS)
+                value_cache->Insert(key, value);
+            else
+                value_cache->Erase(key);
+        }
+        return status;
+    }
+
+    // Caller holds the engine lock
+    Status Engine::apply_remove(const String& key)
+    {
+        WARNING_ASSERT((data_file && index_file) || lsm_tree || clustered_tree || int_table);
+        record_version(key);
+        if (value_cache)
+            value_cache->Erase(key);
+        // A miss is passed on, so callers need no lookup beforehand.
+        Status remove_status = remove_entry(key);
+        RETHROW_ON_EXCEPTION(remove_status);
+        if (filter_file && filter_file->NeedsRebuild())
+            RETHROW_ON_EXCEPTION(rebuild_filter());
+        return remove_status;
+    }
+
+    void Engine::record_version(const String& key)
+    {
+        // Cheap when nobody holds a snapshot: pre-images are not needed at all.
+        if (!version_log.HasSnapshots())
+            return;
+
+        String old_value;
+        bool existed = get_entry(key, old_value) == STATUS_SUCCESS;
+        version_log.Record(key, existed, old_value);
+    }
+
+    Status Engine::rebuild_filter()
+    {
+        // Full scan of the data file; amortized by sizing the new filter
+        // for twice the current number of keys.
+        RETHROW_ON_EXCEPTION(filter_file->Rebuild(data_file->ListKeys()));
+        RETURN_SUCCESS();
+    }
+
+    bool Engine::parse_int_key(const String& key, uint64_t& int_key)
+    {
+        // No sign, no leading zeros and no overflow
+        if (key.empty() || key.size() > 20 || (key[0] == '0' && key.size() > 1))
+            return false;
+        int_key = 0;
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            if (key[i] < '0' || key[i] > '9')
+                return false;
+            uint64_t digit = key[i] - '0';
+            if (int_key > (~0ULL - digit) / 10)
+                return false;
+            int_key = int_key * 10 + digit;
+        }
+        return true;
+    }
+
+    String Engine::format_int_key(uint64_t int_key)
+    {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%llu", int_key);
+        return buf;
+    }
+
+    Status Engine::EnableCache(size_t capacity)
+    {
+        LockGuard lock_guard(mutex);
+        if (value_cache)
+            delete value_cache;
+        value_cache = NULL;
+        if (capacity > 0)
+            value_cache = new ValueCache(capacity);
+        RETURN_SUCCESS();
+    }
+
     bool Engine::IsOpened()
     {
-        return data_paged_file.IsFileOpened();
+        return lsm_tree != NULL || clustered_tree != NULL || int_table != NULL ||
+            data_paged_file.IsFileOpened();
     }
 
     String Engine::OpenDbName()
@@ -208,4 +747,9 @@ namespace Pumper {
         return db_name;
     }
 
+    const char * Engine::Name()
+    {
+        return "paged";
+    }
+
 } // namespace Pumper
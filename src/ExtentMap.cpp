@@ -0,0 +1,294 @@
+// ExtentMap.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Compressed pages in variable-length extents.
+
+#include "ExtentMap.h"
+#include "Checksum.h"
+#include "Compression.h"
+#include "Statistics.h"
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <algorithm>
+
+namespace Pumper {
+    static const int32_t SCAN_SECTORS = 2048;           // Read at a time by Load()
+    static const int32_t EXTENT_BUFFER_SIZE = MAX_EXTENT_SECTORS * SECTOR_SIZE;
+
+    static off_t sector_offset(int64_t sector)
+    {
+        return EXTENT_ZERO_OFFSET + (off_t) SECTOR_SIZE * sector;
+    }
+
+    ExtentMap::ExtentMap(int32_t fd) : fd(fd), end_sector(0), next_sequence(1)
+    {
+    }
+
+    Status ExtentMap::Load()
+    {
+        LockGuard lock_guard(mutex);
+        struct stat file_stat;
+        WARNING_ASSERT(!fstat(fd, &file_stat));
+        int64_t file_sectors = 0;
+        if (file_stat.st_size > EXTENT_ZERO_OFFSET)
+            file_sectors = (file_stat.st_size - EXTENT_ZERO_OFFSET) / SECTOR_SIZE;
+
+        // Headers may be anywhere: stale copies sit in free extents, and a
+        // live extent may start inside a stale one. An extent whose
+        // checksums hold was not overwritten, though, so it is skipped whole.
+        std::vector<int8_t> chunk((size_t) SCAN_SECTORS * SECTOR_SIZE);
+        std::vector<uint64_t> newest;           // Sequence of the newest header, by page
+        int64_t chunk_first = 0;
+        int64_t chunk_sectors = 0;
+        int64_t sector = 0;
+        while (sector < file_sectors)
+        {
+            // Whole extents in the chunk
+            if (sector + MAX_EXTENT_SECTORS > chunk_first + chunk_sectors && 
+                chunk_first + chunk_sectors < file_sectors)
+            {
+                chunk_first = sector;
+                chunk_sectors = std::min((int64_t) SCAN_SECTORS, file_sectors - sector);
+                ssize_t length = chunk_sectors * SECTOR_SIZE;
+                WARNING_ASSERT(pread(fd, chunk.data(), length, sector_offset(sector)) == length);
+            }
+
+            const int8_t * extent = chunk.data() + (sector - chunk_first) * SECTOR_SIZE;
+            int32_t size = (chunk_first + chunk_sectors - sector) * SECTOR_SIZE;
+            ExtentHeader header;
+            memcpy(&header, extent, sizeof(header));
+            if (!is_header_valid(header))
+            {
+                sector++;
+                continue;
+            }
+
+            if (header.page_id >= (int32_t) newest.size())
+                newest.resize(header.page_id + 1, 0);
+            newest[header.page_id] = std::max(newest[header.page_id], header.sequence);
+            next_sequence = std::max(next_sequence, header.sequence + 1);
+            if (!decode(extent, size, header.page_id, NULL))
+            {
+                sector++;
+                continue;
+            }
+
+            if (header.page_id >= (int32_t) extents.size())
+                extents.resize(header.page_id + 1, Extent { 0, 0, 0, false });
+            Extent& current = extents[header.page_id];
+            int32_t num_sectors = sectors_of(header.length);
+            if (!current.num_sectors || current.sequence < header.sequence)
+                current = Extent { sector, num_sectors, header.sequence, false };
+            sector += num_sectors;
+        }
+
+        // Everything between live extents is free, the end of file after
+        // the last one.
+        std::vector<std::pair<int64_t, int32_t> > live;
+        for (uint32_t page_id = 0; page_id < newest.size(); page_id++)
+        {
+            if (page_id >= extents.size())
+                extents.resize(page_id + 1, Extent { 0, 0, 0, false });
+            Extent& extent = extents[page_id];
+            extent.is_superseded = newest[page_id] > extent.sequence;
+            if (extent.num_sectors)
+                live.push_back(std::make_pair(extent.sector, extent.num_sectors));
+        }
+        std::sort(live.begin(), live.end());
+        int64_t position = 0;
+        for (uint32_t i = 0; i < live.size(); i++)
+        {
+            for (; position < live[i].first; position += MAX_EXTENT_SECTORS)
+                release(position, std::min((int64_t) MAX_EXTENT_SECTORS, live[i].first - position));
+            position = live[i].first + live[i].second;
+        }
+        end_sector = position;
+        RETURN_SUCCESS();
+    }
+
+    Status ExtentMap::ReadPage(int32_t page_id, int8_t * mapping)
+    {
+        Extent extent;
+        {
+            LockGuard lock_guard(mutex);
+            WARNING_ASSERT(page_id >= 0 && page_id < (int32_t) extents.size() && 
+                extents[page_id].num_sectors);
+            extent = extents[page_id];
+        }
+
+        int8_t buffer[EXTENT_BUFFER_SIZE];
+        ssize_t length = extent.num_sectors * SECTOR_SIZE;
+        WARNING_ASSERT(pread(fd, buffer, length, sector_offset(extent.sector)) == length);
+        if (!decode(buffer, length, page_id, mapping))
+        {
+            Statistics::Tick(PageChecksumFailures);
+            char message[64];
+            snprintf(message, sizeof(message), "Checksum mismatch: fd %d, page %d", fd, page_id);
+            RETURN_CORRUPTION(message);
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status ExtentMap::WritePage(int32_t page_id, const int8_t * mapping)
+    {
+        int8_t buffer[EXTENT_BUFFER_SIZE];
+        int8_t * data = buffer + sizeof(ExtentHeader);
+        ExtentHeader header;
+
+        // Pages that do not shrink are kept as they are.
+        header.length = Lz4Compress(mapping, PAGE_SIZE, data, PAGE_SIZE - 1);
+        if (!header.length)
+        {
+            memcpy(data, mapping, PAGE_SIZE);
+            header.length = PAGE_SIZE;
+        }
+        header.page_id = page_id;
+        header.data_checksum = Crc32c(data, header.length);
+        int32_t used = sizeof(header) + header.length;
+        int32_t num_sectors = sectors_of(header.length);
+        memset(buffer + used, 0, num_sectors * SECTOR_SIZE - used);
+
+        int64_t sector;
+        {
+            LockGuard lock_guard(mutex);
+            header.sequence = next_sequence++;
+            sector = allocate(num_sectors);
+        }
+        header.header_checksum = Crc32c(&header.data_checksum, sizeof(header) - sizeof(uint32_t));
+        memcpy(buffer, &header, sizeof(header));
+        ssize_t length = num_sectors * SECTOR_SIZE;
+        bool is_written = pwrite(fd, buffer, length, sector_offset(sector)) == length;
+        Statistics::Tick(PageCompressedBytes, used);
+
+        LockGuard lock_guard(mutex);
+        if (!is_written)
+        {
+            release(sector, num_sectors);
+            RETURN_WARNING("pwrite() of an extent failed");
+        }
+
+        if (page_id >= (int32_t) extents.size())
+            extents.resize(page_id + 1, Extent { 0, 0, 0, false });
+        Extent& extent = extents[page_id];
+        // A copy written meanwhile by someone else is newer.
+        if (extent.num_sectors && extent.sequence > header.sequence)
+        {
+            retired.push_back(std::make_pair(sector, num_sectors));
+            RETURN_SUCCESS();
+        }
+        if (extent.num_sectors)
+            retired.push_back(std::make_pair(extent.sector, extent.num_sectors));
+        extent = Extent { sector, num_sectors, header.sequence, false };
+        RETURN_SUCCESS();
+    }
+
+    Status ExtentMap::Sync()
+    {
+        // Extents retired meanwhile wait for the next call: the copies that
+        // replaced them may not be covered by this sync.
+        std::vector<std::pair<int64_t, int32_t> > synced;
+        {
+            LockGuard lock_guard(mutex);
+            synced.swap(retired);
+        }
+        if (synced.empty())
+            RETURN_SUCCESS();
+
+        bool is_synced = !fdatasync(fd);
+        LockGuard lock_guard(mutex);
+        if (!is_synced)
+        {
+            retired.insert(retired.end(), synced.begin(), synced.end());
+            RETURN_WARNING("fdatasync() of a compressed file failed");
+        }
+        for (uint32_t i = 0; i < synced.size(); i++)
+            release(synced[i].first, synced[i].second);
+        RETURN_SUCCESS();
+    }
+
+    int32_t ExtentMap::NumPages()
+    {
+        LockGuard lock_guard(mutex);
+        return extents.size();
+    }
+
+    Status ExtentMap::Verify(int32_t num_pages, std::vector<int32_t>& bad_pages)
+    {
+        int8_t page[PAGE_SIZE];
+        bad_pages.clear();
+        for (int32_t page_id = 0; page_id < num_pages; page_id++)
+        {
+            bool is_stored;
+            {
+                LockGuard lock_guard(mutex);
+                is_stored = page_id < (int32_t) extents.size() && extents[page_id].num_sectors &&
+                    !extents[page_id].is_superseded;
+            }
+            if (!is_stored || !(ReadPage(page_id, page) == STATUS_SUCCESS))
+                bad_pages.push_back(page_id);
+        }
+        RETURN_SUCCESS();
+    }
+
+    int32_t ExtentMap::sectors_of(int32_t length)
+    {
+        return (sizeof(ExtentHeader) + length + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    }
+
+    bool ExtentMap::is_header_valid(const ExtentHeader& header)
+    {
+        return header.page_id >= 0 && header.length > 0 && header.length <= PAGE_SIZE &&
+            header.header_checksum == Crc32c(&header.data_checksum, sizeof(header) - sizeof(uint32_t));
+    }
+
+    // Checks the extent of size bytes at most, and decompresses it unless
+    // mapping is NULL.
+    bool ExtentMap::decode(const int8_t * extent, int32_t size, int32_t page_id, int8_t * mapping)
+    {
+        ExtentHeader header;
+        memcpy(&header, extent, sizeof(header));
+        const int8_t * data = extent + sizeof(header);
+        if (!is_header_valid(header) || header.page_id != page_id || 
+            (int32_t) sizeof(header) + header.length > size ||
+            header.data_checksum != Crc32c(data, header.length))
+            return false;
+
+        if (!mapping)
+            return true;
+        if (header.length == PAGE_SIZE)
+        {
+            memcpy(mapping, data, PAGE_SIZE);
+            return true;
+        }
+        return Lz4Decompress(data, header.length, mapping, PAGE_SIZE) == PAGE_SIZE;
+    }
+
+    // Caller holds the lock. Exact fits first, then a larger extent is
+    // split, then the file grows.
+    int64_t ExtentMap::allocate(int32_t num_sectors)
+    {
+        for (int32_t size = num_sectors; size <= MAX_EXTENT_SECTORS; size++)
+        {
+            if (free_extents[size].empty())
+                continue;
+            int64_t sector = free_extents[size].back();
+            free_extents[size].pop_back();
+            if (size > num_sectors)
+                release(sector + num_sectors, size - num_sectors);
+            return sector;
+        }
+
+        int64_t sector = end_sector;
+        end_sector += num_sectors;
+        return sector;
+    }
+
+    // Caller holds the lock.
+    void ExtentMap::release(int64_t sector, int32_t num_sectors)
+    {
+        free_extents[num_sectors].push_back(sector);
+    }
+
+} // namespace Pumper
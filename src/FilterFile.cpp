@@ -0,0 +1,182 @@
+// FilterFile.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Bloom filter of all keys of a database, persisted in one file *.BLOOM
+
+#include "FilterFile.h"
+#include "PagedFile.h"
+#include "PageHandle.h"
+
+#include <string.h>
+
+namespace Pumper {
+    FilterFile::FilterFile(PagedFile& paged_file) : paged_file(paged_file), 
+        is_valid(false), is_dirty(false)
+    {
+        memset(&header, 0, sizeof(FilterHeader));
+    }
+
+    FilterFile::~FilterFile()
+    {
+
+    }
+
+    Status FilterFile::Create(const String& file)
+    {
+        RETHROW_ON_EXCEPTION(PagedFile::Create(file));
+        RETURN_SUCCESS();
+    }
+
+    Status FilterFile::Unlink(const String& file)
+    {
+        RETHROW_ON_EXCEPTION(PagedFile::Unlink(file));
+        RETURN_SUCCESS();
+    }
+
+    Status FilterFile::OpenFile(const String& file)
+    {
+        RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
+        RETHROW_ON_EXCEPTION(load());
+
+        // From now on the bitmap on disk may fall behind the data.
+        if (is_valid)
+            RETHROW_ON_EXCEPTION(save(false));
+        RETURN_SUCCESS();
+    }
+
+    Status FilterFile::Close()
+    {
+        if (is_valid)
+            RETHROW_ON_EXCEPTION(save(true));
+        RETHROW_ON_EXCEPTION(paged_file.Close());
+        is_valid = false;
+        RETURN_SUCCESS();
+    }
+
+    Status FilterFile::UpdateChanges()
+    {
+        // Nothing to do: the bitmap is only trusted after a clean Close(),
+        // writing it while the database is open would not save a rebuild.
+        RETURN_SUCCESS();
+    }
+
+    bool FilterFile::IsValid()
+    {
+        return is_valid;
+    }
+
+    Status FilterFile::Rebuild(const std::vector<String>& keys)
+    {
+        // Leave room to double before the next rebuild
+        int32_t num_bytes = (int32_t) keys.size() * 2 * BLOOM_BITS_PER_KEY / 8;
+        int32_t num_pages = (num_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (num_pages < BLOOM_MIN_PAGES)
+            num_pages = BLOOM_MIN_PAGES;
+
+        bloom_filter.Reset(num_pages * PAGE_SIZE);
+        for (uint32_t i = 0; i < keys.size(); i++)
+            bloom_filter.Add(keys[i]);
+
+        header.num_pages = num_pages;
+        header.num_hashes = bloom_filter.NumHashes();
+        header.num_keys = (int32_t) keys.size();
+        header.num_removed = 0;
+        is_valid = true;
+        is_dirty = true;
+        RETURN_SUCCESS();
+    }
+
+    void FilterFile::Add(const String& key)
+    {
+        if (!is_valid)
+            return;
+        bloom_filter.Add(key);
+        header.num_keys++;
+        is_dirty = true;
+    }
+
+    void FilterFile::Remove(const String& key)
+    {
+        if (!is_valid)
+            return;
+        header.num_removed++;
+        is_dirty = true;
+    }
+
+    bool FilterFile::MayContain(const String& key)
+    {
+        return !is_valid || bloom_filter.MayContain(key);
+    }
+
+    bool FilterFile::NeedsRebuild()
+    {
+        if (!is_valid)
+            return true;
+        if (header.num_keys > bloom_filter.Capacity())
+            return true;
+        return header.num_removed > bloom_filter.Capacity() / 4 && 
+            header.num_removed > header.num_keys / 2;
+    }
+
+    int32_t FilterFile::NumKeys() const
+    {
+        return header.num_keys;
+    }
+
+    Status FilterFile::load()
+    {
+        PageHandle ph;
+        is_valid = false;
+        is_dirty = false;
+        if (paged_file.GetTotalPages() == 0)
+            RETURN_SUCCESS();
+
+        RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, 0));
+        RETHROW_ON_EXCEPTION(ph.Read((int8_t *) &header, sizeof(FilterHeader)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+
+        if (strncmp(header.magic, "BLOOM", 8) || !header.is_valid || header.num_pages <= 0 ||
+            header.num_pages >= paged_file.GetTotalPages())
+            RETURN_SUCCESS();
+
+        bloom_filter.Reset(header.num_pages * PAGE_SIZE, header.num_hashes);
+        for (int32_t i = 0; i < header.num_pages; i++)
+        {
+            RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, i + 1));
+            RETHROW_ON_EXCEPTION(ph.Read((int8_t *) bloom_filter.Bits() + i * PAGE_SIZE, PAGE_SIZE));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+        }
+
+        is_valid = true;
+        RETURN_SUCCESS();
+    }
+
+    Status FilterFile::save(bool is_valid)
+    {
+        PageHandle ph;
+        int32_t page_id;
+        while (paged_file.GetTotalPages() < header.num_pages + 1)
+            RETHROW_ON_EXCEPTION(paged_file.AllocatePage(page_id));
+
+        if (is_dirty)
+        {
+            for (int32_t i = 0; i < header.num_pages; i++)
+            {
+                RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, i + 1));
+                RETHROW_ON_EXCEPTION(ph.Write((int8_t *) bloom_filter.Bits() + i * PAGE_SIZE, PAGE_SIZE));
+                RETHROW_ON_EXCEPTION(ph.ClosePage());
+            }
+        }
+
+        // The bitmap is written before the header claims it is valid.
+        RETHROW_ON_EXCEPTION(paged_file.ForcePage());
+        strncpy(header.magic, "BLOOM", 8);
+        header.is_valid = is_valid;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, 0));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) &header, sizeof(FilterHeader), 0, true));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        is_dirty = false;
+        RETURN_SUCCESS();
+    }
+
+} // namespace Pumper
@@ -0,0 +1,331 @@
+// HashIndex.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Extendible hashing over bucket pages, with the directory in memory.
+
+#include "HashIndex.h"
+#include "PageHandle.h"
+#include "KeyHash.h"
+#include "KeySearch.h"
+#include "Statistics.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Pumper {
+    static const int8_t HASH_MAGIC[8] = { 'P', 'M', 'P', 'H', 'A', 'S', 'H', '\0' };
+
+    static_assert(sizeof(HashMeta) <= PAGE_SIZE, "HashMeta must fit in one page");
+    static_assert(sizeof(HashBucket) <= PAGE_SIZE, "HashBucket must fit in one page");
+    static_assert((1 << HASH_MAX_DEPTH) / HASH_DIRECTORY_SLOTS <= HASH_MAX_DIRECTORY_PAGES,
+        "Directory of the deepest index must fit in the root page");
+
+    HashIndex::HashIndex(PagedFile &pf) : pf(pf), meta_page(INVALID_PAGE_ID), is_meta_dirty(false)
+    {
+        ERROR_ASSERT(pf.IsFileOpened());
+        memset(&meta, 0, sizeof(HashMeta));
+    }
+
+    HashIndex::~HashIndex()
+    {
+
+    }
+
+    Status HashIndex::Format(PagedFile &pf)
+    {
+        HashMeta new_meta;
+        HashBucket bucket;
+        int32_t new_meta_page, directory_page, bucket_page;
+
+        WARNING_ASSERT(pf.GetTotalPages() == 0);
+        RETHROW_ON_EXCEPTION(pf.SetKeyHash(KeyHashWide));
+
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(new_meta_page));
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(directory_page));
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(bucket_page));
+
+        memset(&new_meta, 0, sizeof(HashMeta));
+        memcpy(new_meta.magic, HASH_MAGIC, sizeof(HASH_MAGIC));
+        new_meta.global_depth = 0;
+        new_meta.num_directory_pages = 1;
+        new_meta.directory_pages[0] = directory_page;
+
+        memset(&bucket, 0, sizeof(bucket));
+
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, new_meta_page));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) &new_meta, sizeof(HashMeta)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, directory_page));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) &bucket_page, sizeof(int32_t)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, bucket_page));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) &bucket, sizeof(bucket)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETHROW_ON_EXCEPTION(pf.SetRootPage(new_meta_page));
+        RETURN_SUCCESS();
+    }
+
+    bool HashIndex::IsHashIndex(PagedFile &pf)
+    {
+        int32_t root;
+        int8_t magic[8];
+        PageHandle ph;
+
+        pf.GetRootPage(root);
+        if (root < 0 || root >= pf.GetTotalPages())
+            return false;
+        if (!(ph.OpenPage(pf, root) == STATUS_SUCCESS))
+            return false;
+        ph.Read(magic, sizeof(magic));
+        ph.ClosePage();
+        return !memcmp(magic, HASH_MAGIC, sizeof(HASH_MAGIC));
+    }
+
+    Status HashIndex::Load()
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(pf.GetRootPage(meta_page));
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, meta_page));
+        RETHROW_ON_EXCEPTION(ph.Read((int8_t *) &meta, sizeof(HashMeta)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        if (memcmp(meta.magic, HASH_MAGIC, sizeof(HASH_MAGIC)) || meta.global_depth < 0 ||
+            meta.global_depth > HASH_MAX_DEPTH)
+            RETURN_CORRUPTION("Bad hash index root page");
+
+        int32_t num_entries = 1 << meta.global_depth;
+        directory.resize(num_entries);
+        dirty_pages.assign(meta.num_directory_pages, false);
+        for (int32_t i = 0; i < meta.num_directory_pages; i++)
+        {
+            int32_t first = i * HASH_DIRECTORY_SLOTS;
+            int32_t count = std::min(num_entries - first, HASH_DIRECTORY_SLOTS);
+            if (count <= 0)
+                break;
+            RETHROW_ON_EXCEPTION(ph.OpenPage(pf, meta.directory_pages[i]));
+            RETHROW_ON_EXCEPTION(ph.Read((int8_t *) &directory[first], count * sizeof(int32_t)));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status HashIndex::Insert(const String &key, int32_t page_id)
+    {
+        uint64_t hash = KeyHash64(key);
+        uint32_t mixed = mix(hash);
+        HashBucket bucket;
+
+        for (;;)
+        {
+            uint32_t slot = mixed & (directory.size() - 1);
+            RETHROW_ON_EXCEPTION(read_bucket(directory[slot], bucket));
+
+            int32_t insert_point = LowerBound(bucket.keys, bucket.num_keys, hash);
+            if (insert_point < bucket.num_keys && bucket.keys[insert_point] == hash)
+            {
+                bucket.pointers[insert_point] = page_id;
+                return write_bucket(directory[slot], bucket);
+            }
+
+            if (bucket.num_keys < HASH_BUCKET_SLOTS)
+            {
+                int32_t num_moved = bucket.num_keys - insert_point;
+                memmove(&bucket.keys[insert_point + 1], &bucket.keys[insert_point], 
+                    num_moved * sizeof(uint64_t));
+                memmove(&bucket.pointers[insert_point + 1], &bucket.pointers[insert_point], 
+                    num_moved * sizeof(int32_t));
+                bucket.keys[insert_point] = hash;
+                bucket.pointers[insert_point] = page_id;
+                bucket.num_keys++;
+                return write_bucket(directory[slot], bucket);
+            }
+
+            // Full: split and look again, the key may need several splits
+            Status status = split_bucket(slot, bucket);
+            if (!(status == STATUS_SUCCESS))
+                return status;
+        }
+    }
+
+    Status HashIndex::Remove(const String &key)
+    {
+        uint64_t hash = KeyHash64(key);
+        int32_t bucket_page = directory[mix(hash) & (directory.size() - 1)];
+        HashBucket bucket;
+
+        RETHROW_ON_EXCEPTION(read_bucket(bucket_page, bucket));
+        int32_t slot = LowerBound(bucket.keys, bucket.num_keys, hash);
+        if (slot == bucket.num_keys || bucket.keys[slot] != hash)
+            RETURN_NOT_FOUND();
+
+        int32_t num_moved = bucket.num_keys - slot - 1;
+        memmove(&bucket.keys[slot], &bucket.keys[slot + 1], num_moved * sizeof(uint64_t));
+        memmove(&bucket.pointers[slot], &bucket.pointers[slot + 1], num_moved * sizeof(int32_t));
+        bucket.num_keys--;
+        return write_bucket(bucket_page, bucket);
+    }
+
+    bool HashIndex::Search(const String &key, int32_t &page_id)
+    {
+        uint64_t hash = KeyHash64(key);
+        HashBucket bucket;
+
+        if (!(read_bucket(directory[mix(hash) & (directory.size() - 1)], bucket) == STATUS_SUCCESS))
+            return false;
+        int32_t slot = LowerBound(bucket.keys, bucket.num_keys, hash);
+        if (slot == bucket.num_keys || bucket.keys[slot] != hash)
+            return false;
+        page_id = bucket.pointers[slot];
+        return true;
+    }
+
+    bool HashIndex::Update(const String &key, int32_t new_page_id)
+    {
+        uint64_t hash = KeyHash64(key);
+        int32_t bucket_page = directory[mix(hash) & (directory.size() - 1)];
+        HashBucket bucket;
+
+        if (!(read_bucket(bucket_page, bucket) == STATUS_SUCCESS))
+            return false;
+        int32_t slot = LowerBound(bucket.keys, bucket.num_keys, hash);
+        if (slot == bucket.num_keys || bucket.keys[slot] != hash)
+            return false;
+        bucket.pointers[slot] = new_page_id;
+        return write_bucket(bucket_page, bucket) == STATUS_SUCCESS;
+    }
+
+    int32_t HashIndex::GlobalDepth() const
+    {
+        return meta.global_depth;
+    }
+
+    // Key hashes are well mixed already, their low bits pick the slot
+    uint32_t HashIndex::mix(uint64_t hash)
+    {
+        return (uint32_t) hash;
+    }
+
+    Status HashIndex::read_bucket(int32_t page_id, HashBucket &bucket)
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, page_id));
+        RETHROW_ON_EXCEPTION(ph.Read((int8_t *) &bucket, sizeof(bucket)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    Status HashIndex::write_bucket(int32_t page_id, const HashBucket &bucket)
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(pf, page_id));
+        RETHROW_ON_EXCEPTION(ph.Write((const int8_t *) &bucket, sizeof(bucket)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    // Moves the keys of bucket (at directory slot) with the next bit set into
+    // a new bucket, and points the half of its directory entries with that
+    // bit set to it.
+    Status HashIndex::split_bucket(uint32_t slot, HashBucket &bucket)
+    {
+        if (bucket.local_depth == meta.global_depth)
+        {
+            if (meta.global_depth == HASH_MAX_DEPTH)
+                RETURN_CODE(StatusOutOfSpace, "Hash index directory is full");
+            RETHROW_ON_EXCEPTION(double_directory());
+        }
+
+        Statistics::Tick(HashIndexSplits);
+        int32_t old_page = directory[slot];
+        int32_t new_page;
+        RETHROW_ON_EXCEPTION(pf.AllocatePage(new_page));
+
+        uint32_t bit = 1u << bucket.local_depth;
+        HashBucket high;
+        memset(&high, 0, sizeof(high));
+        bucket.local_depth++;
+        high.local_depth = bucket.local_depth;
+
+        // Both halves stay sorted
+        int32_t num_low = 0;
+        for (int32_t i = 0; i < bucket.num_keys; i++)
+        {
+            if (mix(bucket.keys[i]) & bit)
+            {
+                high.keys[high.num_keys] = bucket.keys[i];
+                high.pointers[high.num_keys] = bucket.pointers[i];
+                high.num_keys++;
+            }
+            else
+            {
+                bucket.keys[num_low] = bucket.keys[i];
+                bucket.pointers[num_low] = bucket.pointers[i];
+                num_low++;
+            }
+        }
+        bucket.num_keys = num_low;
+
+        RETHROW_ON_EXCEPTION(write_bucket(new_page, high));
+        RETHROW_ON_EXCEPTION(write_bucket(old_page, bucket));
+
+        // Entries of the bucket are the slots agreeing with it on its old
+        // local_depth bits
+        for (uint32_t entry = (slot & (bit - 1)) | bit; entry < directory.size(); entry += bit << 1)
+            set_entry(entry, new_page);
+        RETHROW_ON_EXCEPTION(flush_directory());
+        RETURN_SUCCESS();
+    }
+
+    Status HashIndex::double_directory()
+    {
+        uint32_t num_entries = directory.size();
+        int32_t num_pages = (num_entries * 2 + HASH_DIRECTORY_SLOTS - 1) / HASH_DIRECTORY_SLOTS;
+
+        while (meta.num_directory_pages < num_pages)
+        {
+            RETHROW_ON_EXCEPTION(pf.AllocatePage(meta.directory_pages[meta.num_directory_pages]));
+            meta.num_directory_pages++;
+            dirty_pages.push_back(false);
+        }
+
+        directory.resize(num_entries * 2);
+        for (uint32_t entry = 0; entry < num_entries; entry++)
+            set_entry(num_entries + entry, directory[entry]);
+        meta.global_depth++;
+        is_meta_dirty = true;
+        RETURN_SUCCESS();
+    }
+
+    void HashIndex::set_entry(uint32_t slot, int32_t page_id)
+    {
+        directory[slot] = page_id;
+        dirty_pages[slot / HASH_DIRECTORY_SLOTS] = true;
+    }
+
+    // Directory pages first, so that the root never names a depth whose
+    // entries are not on disk yet.
+    Status HashIndex::flush_directory()
+    {
+        PageHandle ph;
+        for (int32_t i = 0; i < meta.num_directory_pages; i++)
+        {
+            if (!dirty_pages[i])
+                continue;
+            int32_t first = i * HASH_DIRECTORY_SLOTS;
+            int32_t count = std::min((int32_t) directory.size() - first, HASH_DIRECTORY_SLOTS);
+            RETHROW_ON_EXCEPTION(ph.OpenPage(pf, meta.directory_pages[i]));
+            RETHROW_ON_EXCEPTION(ph.Write((const int8_t *) &directory[first], count * sizeof(int32_t)));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+            dirty_pages[i] = false;
+        }
+
+        if (is_meta_dirty)
+        {
+            RETHROW_ON_EXCEPTION(ph.OpenPage(pf, meta_page));
+            RETHROW_ON_EXCEPTION(ph.Write((const int8_t *) &meta, sizeof(HashMeta)));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+            is_meta_dirty = false;
+        }
+        RETURN_SUCCESS();
+    }
+} // namespace Pumper
@@ -5,21 +5,50 @@
 // Which could also support random lookup. 
 
 #include "IndexFile.h"
+#include "KeyHash.h"
 
 namespace Pumper {
 	IndexFile::IndexFile(PagedFile& paged_file) : paged_file(paged_file)
     {
         btree = NULL;
+        hash_index = NULL;
+        buffered_tree = NULL;
+        cow_tree = NULL;
     }
 
 	IndexFile::~IndexFile()
     {
         delete btree;
+        delete hash_index;
+        delete buffered_tree;
+        delete cow_tree;
     }
 
-	Status IndexFile::Create(const String& file)
+	Status IndexFile::Create(const String& file, IndexType type)
     {
-        RETHROW_ON_EXCEPTION(PagedFile::Create(file));
+        RETHROW_ON_EXCEPTION(PagedFile::Create(file, 
+            type == CopyOnWriteIndex ? HEADER_COPY_ON_WRITE : 0));
+        if (type == HashedIndex)
+        {
+            PagedFile paged_file;
+            RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
+            RETHROW_ON_EXCEPTION(HashIndex::Format(paged_file));
+            RETHROW_ON_EXCEPTION(paged_file.Close());
+        }
+        else if (type == BufferedIndex)
+        {
+            PagedFile paged_file;
+            RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
+            RETHROW_ON_EXCEPTION(BufferedTree::Format(paged_file));
+            RETHROW_ON_EXCEPTION(paged_file.Close());
+        }
+        else if (type == CopyOnWriteIndex)
+        {
+            PagedFile paged_file;
+            RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
+            RETHROW_ON_EXCEPTION(CowTree::Format(paged_file));
+            RETHROW_ON_EXCEPTION(paged_file.Close());
+        }
         RETURN_SUCCESS();
     }
 
@@ -37,29 +66,70 @@ namespace Pumper {
     // function, without modify hard disk, but most functions work well like disk.
     Status IndexFile::OpenFile(const String& file)
     {
-        WARNING_ASSERT(!btree);
+        WARNING_ASSERT(!btree && !hash_index && !buffered_tree && !cow_tree);
         RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
-        btree = new BTree(paged_file);
+        // Files of older versions hold BKDR hashes, which are no longer read
+        if (paged_file.GetTotalPages() > 0 && paged_file.GetKeyHash() != KeyHashWide)
+        {
+            paged_file.Close();
+            RETURN_WARNING("Index file hashed by an older version");
+        }
+        if (paged_file.GetFlags() & HEADER_COPY_ON_WRITE)
+        {
+            cow_tree = new CowTree(paged_file);
+            RETHROW_ON_EXCEPTION(cow_tree->Load());
+        }
+        else if (HashIndex::IsHashIndex(paged_file))
+        {
+            hash_index = new HashIndex(paged_file);
+            RETHROW_ON_EXCEPTION(hash_index->Load());
+        }
+        else if (BufferedTree::IsBufferedTree(paged_file))
+        {
+            buffered_tree = new BufferedTree(paged_file);
+            RETHROW_ON_EXCEPTION(buffered_tree->Load());
+        }
+        else
+            btree = new BTree(paged_file);
         RETURN_SUCCESS();
     }
 
     Status IndexFile::Close()
     {
-        WARNING_ASSERT(btree);
+        WARNING_ASSERT(btree || hash_index || buffered_tree || cow_tree);
+        // Pages retired since the last commit go back before the header does
+        if (cow_tree)
+        {
+            RETHROW_ON_EXCEPTION(cow_tree->Close());
+        }
         RETHROW_ON_EXCEPTION(paged_file.Close());
         delete btree;
+        delete hash_index;
+        delete buffered_tree;
+        delete cow_tree;
         btree = NULL;
+        hash_index = NULL;
+        buffered_tree = NULL;
+        cow_tree = NULL;
         RETURN_SUCCESS();
     }
 
     Status IndexFile::UpdateChanges()
     {
+        if (cow_tree)
+            return cow_tree->Commit();
         RETHROW_ON_EXCEPTION(paged_file.ForcePage());
         RETURN_SUCCESS();
     }
 
     Status IndexFile::Put(const String& key, int32_t data_pid)
     {
+        if (hash_index)
+            return hash_index->Insert(key, data_pid);
+        if (buffered_tree)
+            return buffered_tree->Insert(key, data_pid);
+        if (cow_tree)
+            return cow_tree->Insert(key, data_pid);
         btree->Insert(key, data_pid);
         RETURN_SUCCESS();
     }
@@ -67,28 +137,79 @@ namespace Pumper {
     bool IndexFile::Exist(const String& key)
     {
         int32_t data_pid;
+        if (hash_index)
+            return hash_index->Search(key, data_pid);
+        if (buffered_tree)
+            return buffered_tree->Search(key, data_pid);
+        if (cow_tree)
+            return cow_tree->Search(key, data_pid);
         if (!btree->Search(key, data_pid))
             return false;
         return true;
     }
 
+    bool IndexFile::Find(const String& key, int32_t &data_pid)
+    {
+        if (hash_index)
+            return hash_index->Search(key, data_pid);
+        if (buffered_tree)
+            return buffered_tree->Search(key, data_pid);
+        if (cow_tree)
+            return cow_tree->Search(key, data_pid);
+        return btree->Search(key, data_pid);
+    }
+
     Status IndexFile::Get(const String& key, int32_t &data_pid)
     {
-        btree->Search(key, data_pid);
+        if (hash_index)
+            hash_index->Search(key, data_pid);
+        else if (buffered_tree)
+            buffered_tree->Search(key, data_pid);
+        else if (cow_tree)
+            cow_tree->Search(key, data_pid);
+        else
+            btree->Search(key, data_pid);
         RETURN_SUCCESS();
     }
 
     Status IndexFile::Update(const String& key, int32_t data_pid)
     {
-        btree->Update(key, data_pid);
+        if (hash_index)
+            hash_index->Update(key, data_pid);
+        else if (buffered_tree)
+            buffered_tree->Update(key, data_pid);
+        else if (cow_tree)
+            cow_tree->Update(key, data_pid);
+        else
+            btree->Update(key, data_pid);
         RETURN_SUCCESS();
     }
 
     Status IndexFile::Remove(const String& key)
     {
-        btree->Remove(key);
+        if (hash_index)
+            hash_index->Remove(key);
+        else if (buffered_tree)
+            buffered_tree->Remove(key);
+        else if (cow_tree)
+            cow_tree->Remove(key);
+        else
+            btree->Remove(key);
         RETURN_SUCCESS();
     }
 
+    IndexType IndexFile::Type()
+    {
+        if (hash_index)
+            return HashedIndex;
+        if (cow_tree)
+            return CopyOnWriteIndex;
+        return buffered_tree ? BufferedIndex : OrderedIndex;
+    }
+
+    CowTree * IndexFile::GetCowTree()
+    {
+        return cow_tree;
+    }
 
 } // namespace Pumper
@@ -0,0 +1,134 @@
+// IntBucket.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Fixed size records in front, values at the back of the page.
+
+#include "IntBucket.h"
+
+#include <string.h>
+
+namespace Pumper {
+    IntBucket::IntBucket(int8_t * page) : page(page)
+    {
+        header = (IntBucketHeader *) page;
+        records = (IntRecord *) (page + sizeof(IntBucketHeader));
+    }
+
+    bool IntBucket::Put(uint64_t key, const String &value)
+    {
+        int32_t slot = find(key);
+        int32_t length = value.size();
+        bool is_existed = slot < header->num_records && records[slot].key == key;
+
+        // Shrinking values are rewritten where they are
+        if (is_existed && length <= records[slot].length)
+        {
+            memcpy(page + records[slot].offset, value.data(), length);
+            records[slot].length = length;
+            return true;
+        }
+
+        int32_t needed = length + (is_existed ? -records[slot].length : sizeof(IntRecord));
+        if (needed > free_space())
+            return false;
+
+        if (is_existed)
+        {
+            memmove(&records[slot], &records[slot + 1], 
+                (header->num_records - slot - 1) * sizeof(IntRecord));
+            header->num_records--;
+        }
+
+        int32_t records_end = sizeof(IntBucketHeader) + (header->num_records + 1) * sizeof(IntRecord);
+        if (heap_start() - length < records_end)
+            compact();
+
+        memmove(&records[slot + 1], &records[slot], (header->num_records - slot) * sizeof(IntRecord));
+        header->heap_start = heap_start() - length;
+        memcpy(page + header->heap_start, value.data(), length);
+        records[slot].key = key;
+        records[slot].offset = header->heap_start;
+        records[slot].length = length;
+        records[slot].reserved = 0;
+        header->num_records++;
+        return true;
+    }
+
+    bool IntBucket::Get(uint64_t key, String &value)
+    {
+        int32_t slot = find(key);
+        if (slot == header->num_records || records[slot].key != key)
+            return false;
+        value.assign(page + records[slot].offset, records[slot].length);
+        return true;
+    }
+
+    bool IntBucket::Remove(uint64_t key)
+    {
+        int32_t slot = find(key);
+        if (slot == header->num_records || records[slot].key != key)
+            return false;
+        memmove(&records[slot], &records[slot + 1], (header->num_records - slot - 1) * sizeof(IntRecord));
+        header->num_records--;
+        if (header->num_records == 0)
+            header->heap_start = 0;
+        return true;
+    }
+
+    bool IntBucket::Exist(uint64_t key)
+    {
+        int32_t slot = find(key);
+        return slot < header->num_records && records[slot].key == key;
+    }
+
+    std::vector<uint64_t> IntBucket::ListKeys()
+    {
+        std::vector<uint64_t> keys;
+        for (int32_t i = 0; i < header->num_records; i++)
+            keys.push_back(records[i].key);
+        return keys;
+    }
+
+    // First slot with a key >= key
+    int32_t IntBucket::find(uint64_t key)
+    {
+        int32_t low = 0, high = header->num_records;
+        while (low < high)
+        {
+            int32_t middle = (low + high) / 2;
+            if (records[middle].key < key)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+    int32_t IntBucket::heap_start()
+    {
+        return header->heap_start ? header->heap_start : PAGE_SIZE;
+    }
+
+    int32_t IntBucket::free_space()
+    {
+        int32_t used = sizeof(IntBucketHeader) + header->num_records * sizeof(IntRecord);
+        for (int32_t i = 0; i < header->num_records; i++)
+            used += records[i].length;
+        return PAGE_SIZE - used;
+    }
+
+    // Packs the values against the end of the page again
+    void IntBucket::compact()
+    {
+        int8_t values[PAGE_SIZE];
+        int32_t end = PAGE_SIZE;
+        for (int32_t i = 0; i < header->num_records; i++)
+        {
+            end -= records[i].length;
+            memcpy(values + end, page + records[i].offset, records[i].length);
+            records[i].offset = end;
+        }
+        memcpy(page + end, values + end, PAGE_SIZE - end);
+        header->heap_start = end == PAGE_SIZE ? 0 : end;
+    }
+} // namespace Pumper
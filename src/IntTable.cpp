@@ -0,0 +1,198 @@
+// IntTable.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Integer keyed table: B+Tree on the integers, fixed size records.
+
+#include "IntTable.h"
+#include "IntBucket.h"
+#include "PageHandle.h"
+
+#include <unistd.h>
+
+namespace Pumper {
+    IntTable::IntTable() : index(NULL)
+    {
+
+    }
+
+    IntTable::~IntTable()
+    {
+        if (index)
+            Close();
+    }
+
+    Status IntTable::Create(const String& name)
+    {
+        RETHROW_ON_EXCEPTION(PagedFile::Create(name + ".INTINDEX"));
+        RETHROW_ON_EXCEPTION(PagedFile::Create(name + ".INTDATA"));
+        RETURN_SUCCESS();
+    }
+
+    Status IntTable::Unlink(const String& name)
+    {
+        RETHROW_ON_EXCEPTION(PagedFile::Unlink(name + ".INTINDEX"));
+        RETHROW_ON_EXCEPTION(PagedFile::Unlink(name + ".INTDATA"));
+        RETURN_SUCCESS();
+    }
+
+    bool IntTable::Exists(const String& name)
+    {
+        return !access((name + ".INTINDEX").c_str(), F_OK);
+    }
+
+    Status IntTable::Open(const String& name)
+    {
+        WARNING_ASSERT(!index);
+        RETHROW_ON_EXCEPTION(index_file.OpenFile(name + ".INTINDEX"));
+        RETHROW_ON_EXCEPTION(data_file.OpenFile(name + ".INTDATA"));
+        index = new IntBTree(index_file);
+        RETURN_SUCCESS();
+    }
+
+    Status IntTable::Close()
+    {
+        WARNING_ASSERT(index);
+        delete index;
+        index = NULL;
+        RETHROW_ON_EXCEPTION(index_file.Close());
+        RETHROW_ON_EXCEPTION(data_file.Close());
+        RETURN_SUCCESS();
+    }
+
+    Status IntTable::UpdateChanges()
+    {
+        RETHROW_ON_EXCEPTION(data_file.ForcePage());
+        RETHROW_ON_EXCEPTION(index_file.ForcePage());
+        RETURN_SUCCESS();
+    }
+
+    Status IntTable::Put(uint64_t key, const String& value)
+    {
+        int32_t page_id;
+        WARNING_ASSERT(value.size() <= (size_t) INT_MAX_VALUE);
+        if (index->Search(key, page_id))
+        {
+            // A value that outgrows its page has been taken out of it.
+            bool is_stored;
+            RETHROW_ON_EXCEPTION(put_in_page(page_id, key, value, is_stored));
+            if (is_stored)
+                RETURN_SUCCESS();
+            RETHROW_ON_EXCEPTION(append(key, value, page_id));
+            index->Update(key, page_id);
+            RETURN_SUCCESS();
+        }
+
+        RETHROW_ON_EXCEPTION(append(key, value, page_id));
+        index->Insert(key, page_id);
+        RETURN_SUCCESS();
+    }
+
+    Status IntTable::Get(uint64_t key, String& value)
+    {
+        int32_t page_id;
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+
+        if (!index->Search(key, page_id))
+            RETURN_NOT_FOUND();
+        RETHROW_ON_EXCEPTION(ph.OpenPage(data_file, page_id));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        if (!IntBucket(page).Get(key, value))
+            RETURN_NOT_FOUND();
+        RETURN_SUCCESS();
+    }
+
+    Status IntTable::Remove(uint64_t key)
+    {
+        int32_t page_id;
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+
+        if (!index->Search(key, page_id))
+            RETURN_NOT_FOUND();
+        RETHROW_ON_EXCEPTION(ph.OpenPage(data_file, page_id));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+        IntBucket(page).Remove(key);
+        RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        index->Remove(key);
+        RETURN_SUCCESS();
+    }
+
+    bool IntTable::Contains(uint64_t key)
+    {
+        // The index is exact, the data page need not be read.
+        int32_t page_id;
+        return index->Search(key, page_id);
+    }
+
+    std::vector<uint64_t> IntTable::ListKeys()
+    {
+        std::vector<uint64_t> keys;
+        int32_t total_pages = data_file.GetTotalPages();
+
+        data_file.Prefetch(0);
+        for (int32_t page_id = 0; page_id < total_pages; page_id++)
+        {
+            std::vector<uint64_t> page_keys = ListKeys(page_id);
+            keys.insert(keys.end(), page_keys.begin(), page_keys.end());
+        }
+        return keys;
+    }
+
+    int32_t IntTable::GetTotalPages() const
+    {
+        return data_file.GetTotalPages();
+    }
+
+    std::vector<uint64_t> IntTable::ListKeys(int32_t page_id)
+    {
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+
+        if (!(ph.OpenPage(data_file, page_id) == STATUS_SUCCESS))
+            return std::vector<uint64_t>();
+        ph.Read(page, PAGE_SIZE);
+        ph.ClosePage();
+        return IntBucket(page).ListKeys();
+    }
+
+    // New records go to the last page, or to a new one once it is full.
+    Status IntTable::append(uint64_t key, const String& value, int32_t& page_id)
+    {
+        bool is_stored = false;
+        int32_t total_pages = data_file.GetTotalPages();
+        if (total_pages > 0)
+        {
+            page_id = total_pages - 1;
+            RETHROW_ON_EXCEPTION(put_in_page(page_id, key, value, is_stored));
+        }
+        if (!is_stored)
+        {
+            RETHROW_ON_EXCEPTION(data_file.AllocatePage(page_id));
+            RETHROW_ON_EXCEPTION(put_in_page(page_id, key, value, is_stored));
+            WARNING_ASSERT(is_stored);
+        }
+        RETURN_SUCCESS();
+    }
+
+    // One visit of the page. If the key is there but the new value does
+    // not fit, the key is removed from the page and is_stored is false.
+    Status IntTable::put_in_page(int32_t page_id, uint64_t key, const String& value, bool& is_stored)
+    {
+        int8_t page[PAGE_SIZE];
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(data_file, page_id));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+
+        IntBucket bucket(page);
+        is_stored = bucket.Put(key, value);
+        if (is_stored || bucket.Remove(key))
+        {
+            RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE));
+        }
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+} // namespace Pumper
@@ -0,0 +1,100 @@
+// KeyHash.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// wyhash, after the public domain reference implementation by Wang Yi.
+
+#include "KeyHash.h"
+
+#include <string.h>
+
+namespace Pumper {
+    static const uint64_t WY_SECRET[4] = {
+        0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+    };
+
+    static inline void wy_mum(uint64_t &a, uint64_t &b)
+    {
+        __uint128_t product = (__uint128_t) a * b;
+        a = (uint64_t) product;
+        b = (uint64_t) (product >> 64);
+    }
+
+    static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+    {
+        wy_mum(a, b);
+        return a ^ b;
+    }
+
+    // Unaligned little endian loads
+    static inline uint64_t wy_read8(const uint8_t * p)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint64_t wy_read4(const uint8_t * p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint64_t wy_read3(const uint8_t * p, size_t k)
+    {
+        return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+    }
+
+    uint64_t KeyHash64(const void * data, size_t length, uint64_t seed)
+    {
+        const uint8_t * p = (const uint8_t *) data;
+        uint64_t a, b;
+
+        seed ^= wy_mix(seed ^ WY_SECRET[0], WY_SECRET[1]);
+        if (length <= 16)
+        {
+            if (length >= 4)
+            {
+                a = (wy_read4(p) << 32) | wy_read4(p + ((length >> 3) << 2));
+                b = (wy_read4(p + length - 4) << 32) | wy_read4(p + length - 4 - ((length >> 3) << 2));
+            }
+            else if (length > 0)
+            {
+                a = wy_read3(p, length);
+                b = 0;
+            }
+            else
+                a = b = 0;
+        }
+        else
+        {
+            size_t i = length;
+            if (i > 48)
+            {
+                uint64_t seed1 = seed, seed2 = seed;
+                do
+                {
+                    seed = wy_mix(wy_read8(p) ^ WY_SECRET[1], wy_read8(p + 8) ^ seed);
+                    seed1 = wy_mix(wy_read8(p + 16) ^ WY_SECRET[2], wy_read8(p + 24) ^ seed1);
+                    seed2 = wy_mix(wy_read8(p + 32) ^ WY_SECRET[3], wy_read8(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while (i > 16)
+            {
+                seed = wy_mix(wy_read8(p) ^ WY_SECRET[1], wy_read8(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+            a = wy_read8(p + i - 16);
+            b = wy_read8(p + i - 8);
+        }
+
+        a ^= WY_SECRET[1];
+        b ^= seed;
+        wy_mum(a, b);
+        return wy_mix(a ^ WY_SECRET[0] ^ length, b ^ WY_SECRET[1]);
+    }
+} // namespace Pumper
@@ -0,0 +1,83 @@
+// KeySearch.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Branch free binary search with a vectorized final window.
+
+#include "KeySearch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Pumper {
+    // Keys left when the halving stops; four SSE2 vectors
+    static const int32_t SEARCH_WINDOW = 16;
+
+    // Number of keys < key (or <= key) in keys[0, num_keys). SSE2 has no
+    // unsigned 64-bit compare, so wide keys are counted one at a time.
+    template <bool is_upper, typename Key>
+    static inline int32_t count_window(const Key * keys, int32_t num_keys, Key key)
+    {
+        int32_t count = 0;
+        for (int32_t i = 0; i < num_keys; i++)
+            count += is_upper ? keys[i] <= key : keys[i] < key;
+        return count;
+    }
+
+    template <bool is_upper>
+    static inline int32_t count_window(const int32_t * keys, int32_t num_keys, int32_t key)
+    {
+        int32_t count = 0;
+        int32_t i = 0;
+#if defined(__SSE2__)
+        // keys[i] < key is key > keys[i]; keys[i] <= key is !(keys[i] > key)
+        __m128i pivot = _mm_set1_epi32(key);
+        for (; i + 4 <= num_keys; i += 4)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i *) (keys + i));
+            __m128i mask = is_upper ? _mm_cmpgt_epi32(block, pivot) : _mm_cmpgt_epi32(pivot, block);
+            int32_t hits = __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(mask)));
+            count += is_upper ? 4 - hits : hits;
+        }
+#endif
+        for (; i < num_keys; i++)
+            count += is_upper ? keys[i] <= key : keys[i] < key;
+        return count;
+    }
+
+    template <bool is_upper, typename Key>
+    static inline int32_t search(const Key * keys, int32_t num_keys, Key key)
+    {
+        // Keys before base are all below the bound, keys from base + num_keys
+        // on are not; the conditional move keeps the loop free of branches.
+        const Key * base = keys;
+        while (num_keys > SEARCH_WINDOW)
+        {
+            int32_t half = num_keys / 2;
+            bool is_below = is_upper ? base[half] <= key : base[half] < key;
+            base = is_below ? base + half : base;
+            num_keys -= half;
+        }
+        return (int32_t) (base - keys) + count_window<is_upper>(base, num_keys, key);
+    }
+
+    int32_t LowerBound(const int32_t * keys, int32_t num_keys, int32_t key)
+    {
+        return search<false>(keys, num_keys, key);
+    }
+
+    int32_t UpperBound(const int32_t * keys, int32_t num_keys, int32_t key)
+    {
+        return search<true>(keys, num_keys, key);
+    }
+
+    int32_t LowerBound(const uint64_t * keys, int32_t num_keys, uint64_t key)
+    {
+        return search<false>(keys, num_keys, key);
+    }
+
+    int32_t UpperBound(const uint64_t * keys, int32_t num_keys, uint64_t key)
+    {
+        return search<true>(keys, num_keys, key);
+    }
+} // namespace Pumper
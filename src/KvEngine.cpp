@@ -0,0 +1,119 @@
+// KvEngine.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Abstract key/value engine, default batch and scan, and the factory.
+
+#include "KvEngine.h"
+#include "Engine.h"
+#include "MemoryEngine.h"
+
+#include <algorithm>
+
+namespace Pumper {
+    void WriteBatch::Put(const String& key, const String& value)
+    {
+        Operation operation;
+        operation.is_remove = false;
+        operation.key = key;
+        operation.value = value;
+        operations.push_back(operation);
+    }
+
+    void WriteBatch::Remove(const String& key)
+    {
+        Operation operation;
+        operation.is_remove = true;
+        operation.key = key;
+        operations.push_back(operation);
+    }
+
+    void WriteBatch::Clear()
+    {
+        operations.clear();
+    }
+
+    KvEngine::KvEngine() : num_gets(0), num_get_misses(0), num_puts(0),
+        num_removes(0), num_batches(0), num_scans(0)
+    {
+
+    }
+
+    KvEngine::~KvEngine()
+    {
+
+    }
+
+    KvEngine * KvEngine::New(EngineKind kind)
+    {
+        switch (kind)
+        {
+        case EngineMemory:
+            return new MemoryEngine();
+        default:
+            return new Engine();
+        }
+    }
+
+    Status KvEngine::ParseKind(const String& name, EngineKind& kind)
+    {
+        if (name == "paged")
+            kind = EnginePaged;
+        else if (name == "memory")
+            kind = EngineMemory;
+        else
+            RETURN_WARNING("Unknown engine kind");
+        RETURN_SUCCESS();
+    }
+
+    Status KvEngine::Write(const WriteBatch& batch)
+    {
+        num_batches++;
+        const std::vector<WriteBatch::Operation>& operations = batch.Operations();
+        for (uint32_t i = 0; i < operations.size(); i++)
+        {
+            if (operations[i].is_remove)
+            {
+                RETHROW_ON_EXCEPTION(Remove(operations[i].key));
+            }
+            else
+            {
+                RETHROW_ON_EXCEPTION(Put(operations[i].key, operations[i].value));
+            }
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status KvEngine::Scan(const String& start, int32_t limit, KeyValueList& items)
+    {
+        num_scans++;
+        items.clear();
+        Snapshot * snapshot = GetSnapshot();
+        std::vector<String> keys = ListKeys(snapshot);
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<String>::iterator it = std::lower_bound(keys.begin(), keys.end(), start);
+        for (; it != keys.end() && (limit <= 0 || (int32_t) items.size() < limit); ++it)
+        {
+            String value;
+            if (Get(snapshot, *it, value) == STATUS_SUCCESS)
+                items.push_back(std::make_pair(*it, value));
+        }
+
+        RETHROW_ON_EXCEPTION(ReleaseSnapshot(snapshot));
+        RETURN_SUCCESS();
+    }
+
+    EngineStats KvEngine::Stats()
+    {
+        EngineStats stats;
+        stats.engine = Name();
+        stats.num_gets = num_gets;
+        stats.num_get_misses = num_get_misses;
+        stats.num_puts = num_puts;
+        stats.num_removes = num_removes;
+        stats.num_batches = num_batches;
+        stats.num_scans = num_scans;
+        return stats;
+    }
+
+} // namespace Pumper
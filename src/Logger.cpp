@@ -5,6 +5,7 @@
 
 #include "Status.h"
 #include "Singleton.h"
+#include "Thread.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -13,74 +14,235 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <algorithm>
+#include <atomic>
 
 namespace Pumper
 {
+    struct LogEntry
+    {
+        // Equals the ring position when free, position + 1 once published
+        std::atomic<uint64_t> sequence;
+        LogLevel log_level;
+        time_t time_stamp;
+        int32_t num_frames;
+        void * frames[STACK_TRACE_FRAMES];
+        char message[LOG_ENTRY_LENGTH];
+    };
+
+    // Bounded multi-producer, single-consumer ring (D. Vyukov's design):
+    // producers claim a position with one CAS and publish by storing the
+    // sequence, the flusher thread is the only consumer.
+    struct Logger::LogQueue
+    {
+        LogQueue() : head(0), tail(0), dropped(0), level(PUMPER_MIN_LOG_LEVEL), trace_level(Error),
+            is_stopping(false), reported(0), last_second(0), flusher(NULL)
+        {
+            for (int32_t i = 0; i < LOG_QUEUE_LENGTH; i++)
+                entries[i].sequence.store(i, std::memory_order_relaxed);
+            memset(time_format, 0, sizeof(time_format));
+        }
+
+        LogEntry entries[LOG_QUEUE_LENGTH];
+        std::atomic<uint64_t> head;             // Next position to claim
+        std::atomic<uint64_t> tail;             // Next position to write out
+        std::atomic<uint64_t> dropped;
+        std::atomic<int32_t> level;
+        std::atomic<int32_t> trace_level;
+        std::atomic<bool> is_stopping;
+
+        // Owned by the flusher thread
+        int32_t log_fd;
+        uint64_t reported;                      // Drops already written out
+        time_t last_second;
+        char time_format[32];
+        Thread * flusher;
+    };
+
+    static void append_stacktrace(String &out, void ** frames, int32_t num_frames);
 
-    Logger::Logger()
+    Logger::Logger() : queue(new LogQueue())
     {
-        log_fd = open("pumper.log", O_APPEND | O_WRONLY | O_CREAT, 0644);
+        queue->log_fd = open("pumper.log", O_APPEND | O_WRONLY | O_CREAT, 0644);
         // if (log_fd < 0)
         // bugcheck("open() from Logger failed.");
+        queue->flusher = new Thread(std::bind(&Logger::flusher_func, queue), "log_flusher");
+        queue->flusher->Start();
     }
 
     Logger::~Logger()
     {
-        close(log_fd);
+        queue->is_stopping.store(true, std::memory_order_release);
+        queue->flusher->Join();
+        delete queue->flusher;
+        // Entries appended while the flusher was exiting
+        drain(queue);
+        close(queue->log_fd);
+        delete queue;
     }
 
     void Logger::Append(LogLevel log_level, const String &message, bool with_stacktrace)
     {
-        if ((int32_t) log_level <= (int32_t) ignored_level)
+        if ((int32_t) log_level < queue->level.load(std::memory_order_relaxed))
             return;
 
-        char buffer[LOG_ENTRY_LENGTH] = { 0 };
-        char level_format[8] = { 0 };
-        time_t time_stamp = time(NULL);
+        LogEntry * entry;
+        uint64_t position = queue->head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            entry = &queue->entries[position & (LOG_QUEUE_LENGTH - 1)];
+            uint64_t sequence = entry->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t) (sequence - position);
+            if (diff == 0)
+            {
+                if (queue->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // Full: an error storm must not stall the request path.
+                queue->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+                position = queue->head.load(std::memory_order_relaxed);
+        }
 
-        if (log_level == LogLevel::Warning)
-            strcpy(level_format, "Warning");
-        else if (log_level == LogLevel::Error)
-            strcpy(level_format, "Error");
+        entry->log_level = log_level;
+        entry->time_stamp = time(NULL);
+        // Only the return addresses here; the flusher symbolizes them.
+        with_stacktrace = with_stacktrace &&
+            (int32_t) log_level >= queue->trace_level.load(std::memory_order_relaxed);
+        entry->num_frames = with_stacktrace ? ::backtrace(entry->frames, STACK_TRACE_FRAMES) : 0;
+        size_t length = std::min(message.size(), (size_t) LOG_ENTRY_LENGTH - 1);
+        memcpy(entry->message, message.c_str(), length);
+        entry->message[length] = '\0';
+        entry->sequence.store(position + 1, std::memory_order_release);
+    }
 
-        sprintf(buffer, "%s", ctime(&time_stamp));
-        buffer[strlen(buffer) - 1] = '\0';      // suppress \n
-        sprintf(buffer, "%s: [%s] %s", buffer, level_format, message.c_str());
-        write(log_fd, buffer, strlen(buffer));
+    void Logger::SetLevel(LogLevel log_level)
+    {
+        queue->level.store((int32_t) log_level, std::memory_order_relaxed);
+    }
 
-        fprintf(stderr, "%s", buffer);
+    LogLevel Logger::GetLevel()
+    {
+        return (LogLevel) queue->level.load(std::memory_order_relaxed);
+    }
 
-        if (with_stacktrace)
-            print_stacktrace();
+    void Logger::SetTraceLevel(LogLevel log_level)
+    {
+        queue->trace_level.store((int32_t) log_level, std::memory_order_relaxed);
     }
 
-    void Logger::print_stacktrace(unsigned int max_frames)
+    LogLevel Logger::GetTraceLevel()
     {
-        char out[STACK_TRACE_LENGTH];
-        sprintf(out, "Stacktrace:\n");
+        return (LogLevel) queue->trace_level.load(std::memory_order_relaxed);
+    }
 
-        // storage array for stack trace address data
-        void* addrlist[max_frames+1];
+    void Logger::Flush()
+    {
+        uint64_t position = queue->head.load(std::memory_order_acquire);
+        while (queue->tail.load(std::memory_order_acquire) < position)
+            usleep(100);
+    }
 
-        // retrieve current stack addresses
-        int addrlen = backtrace(addrlist, sizeof(addrlist) / sizeof(void*));
+    uint64_t Logger::Dropped()
+    {
+        return queue->dropped.load(std::memory_order_relaxed);
+    }
 
-        if (addrlen == 0) {
-            sprintf(out, "%s  <empty, possibly corrupt>\n", out);
-            return;
+    void Logger::flusher_func(LogQueue * queue)
+    {
+        // Back off while idle, up to 50ms between polls.
+        useconds_t idle = 1000;
+        while (!queue->is_stopping.load(std::memory_order_acquire))
+        {
+            if (drain(queue))
+                idle = 1000;
+            else
+            {
+                usleep(idle);
+                idle = std::min(idle * 2, (useconds_t) 50000);
+            }
+        }
+    }
+
+    // Writes out every published entry, one write() per call.
+    int32_t Logger::drain(LogQueue * queue)
+    {
+        static const char * level_names[] = { "", "Warning", "Error" };
+        String out;
+        int32_t count = 0;
+        uint64_t position = queue->tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            LogEntry * entry = &queue->entries[position & (LOG_QUEUE_LENGTH - 1)];
+            if (entry->sequence.load(std::memory_order_acquire) != position + 1)
+                break;
+
+            // The timestamp text only changes once a second.
+            if (entry->time_stamp != queue->last_second)
+            {
+                struct tm local_time;
+                localtime_r(&entry->time_stamp, &local_time);
+                strftime(queue->time_format, sizeof(queue->time_format), "%a %b %e %H:%M:%S %Y",
+                    &local_time);
+                queue->last_second = entry->time_stamp;
+            }
+
+            out += queue->time_format;
+            out += ": [";
+            out += level_names[entry->log_level];
+            out += "] ";
+            out += entry->message;
+            if (entry->num_frames)
+                append_stacktrace(out, entry->frames, entry->num_frames);
+
+            entry->sequence.store(position + LOG_QUEUE_LENGTH, std::memory_order_release);
+            position++;
+            count++;
         }
 
+        uint64_t dropped = queue->dropped.load(std::memory_order_relaxed);
+        if (dropped != queue->reported)
+        {
+            char buffer[64];
+            sprintf(buffer, "[Warning] %llu log entries dropped\n", dropped - queue->reported);
+            out += buffer;
+            queue->reported = dropped;
+        }
+
+        if (!out.empty())
+        {
+            write(queue->log_fd, out.c_str(), out.size());
+            fprintf(stderr, "%s", out.c_str());
+        }
+        queue->tail.store(position, std::memory_order_release);
+        return count;
+    }
+
+    static void append_stacktrace(String &out, void ** frames, int32_t num_frames)
+    {
+        out += "Stacktrace:\n";
+
         // resolve addresses into strings containing "filename(function+address)",
         // this array must be free()-ed
-        char** symbollist = backtrace_symbols(addrlist, addrlen);
+        char** symbollist = backtrace_symbols(frames, num_frames);
+        if (!symbollist)
+        {
+            out += "  <empty, possibly corrupt>\n";
+            return;
+        }
 
         // allocate string which will be filled with the demangled function name
         size_t funcnamesize = 256;
         char* funcname = (char*) malloc(funcnamesize);
+        char line[STACK_TRACE_LENGTH / 64];
 
         // iterate over the returned symbol lines. skip the first, it is the
-        // address of this function.
-        for (int i = 1; i < addrlen; i++)
+        // address of Logger::Append.
+        for (int i = 1; i < num_frames; i++)
         {
             char *begin_name = 0, *begin_offset = 0, *end_offset = 0;
 
@@ -112,27 +274,25 @@ namespace Pumper
                 char* ret = abi::__cxa_demangle(begin_name, funcname, &funcnamesize, &status);
                 if (status == 0) {
                     funcname = ret; // use possibly realloc()-ed string
-                    sprintf(out, "%s  %s : %s+%s\n", out, symbollist[i], funcname, begin_offset);
+                    snprintf(line, sizeof(line), "  %s : %s+%s\n", symbollist[i], funcname, begin_offset);
                 }
                 else {
                     // demangling failed. Output function name as a C function with
                     // no arguments.
-                    sprintf(out, "%s  %s : %s()+%s\n", out, symbollist[i], begin_name, begin_offset);
+                    snprintf(line, sizeof(line), "  %s : %s()+%s\n", symbollist[i], begin_name, begin_offset);
                 }
             }
             else
             {
                 // couldn't parse the line? print the whole line.
-                sprintf(out, "%s  %s\n", out, symbollist[i]);
+                snprintf(line, sizeof(line), "  %s\n", symbollist[i]);
             }
+            out += line;
         }
+        out += "\n";
 
         free(funcname);
         free(symbollist);
-
-        write(log_fd, out, strlen(out));
-        fprintf(stderr, "%s\n", out);
     }
 
 } // namespace Pumper
-
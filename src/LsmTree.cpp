@@ -0,0 +1,624 @@
+// LsmTree.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Log-structured storage: MemTable, sorted runs and leveled compaction.
+
+#include "LsmTree.h"
+#include "PageHandle.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+
+namespace Pumper {
+    const int32_t MAX_MANIFEST_RUNS = (PAGE_SIZE - sizeof(ManifestHeader)) / 8;
+
+    LsmTree::LsmTree(size_t memtable_size) : memtable_size(memtable_size), work_cond(mutex),
+        done_cond(mutex), active(NULL), immutable(NULL), next_run_id(0), background_thread(NULL),
+        is_opened(false), is_closing(false)
+    {
+
+    }
+
+    LsmTree::~LsmTree()
+    {
+        if (is_opened)
+            Close();
+    }
+
+    Status LsmTree::Create(const String& name)
+    {
+        PagedFile manifest;
+        PageHandle ph;
+        int32_t page_id;
+        ManifestHeader header;
+
+        RETHROW_ON_EXCEPTION(PagedFile::Create(name + ".LSM"));
+        RETHROW_ON_EXCEPTION(manifest.OpenFile(name + ".LSM"));
+        RETHROW_ON_EXCEPTION(manifest.AllocatePage(page_id));
+
+        memset(&header, 0, sizeof(ManifestHeader));
+        strncpy(header.magic, "LSMTREE", 8);
+        RETHROW_ON_EXCEPTION(ph.OpenPage(manifest, page_id));
+        RETHROW_ON_EXCEPTION(ph.Write((int8_t *) &header, sizeof(ManifestHeader)));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETHROW_ON_EXCEPTION(manifest.Close());
+        RETURN_SUCCESS();
+    }
+
+    Status LsmTree::Unlink(const String& name)
+    {
+        PagedFile manifest;
+        PageHandle ph;
+        int8_t page[PAGE_SIZE];
+
+        RETHROW_ON_EXCEPTION(manifest.OpenFile(name + ".LSM"));
+        RETHROW_ON_EXCEPTION(ph.OpenPage(manifest, 0));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETHROW_ON_EXCEPTION(manifest.Close());
+
+        ManifestHeader * header = (ManifestHeader *) page;
+        int32_t * entry = (int32_t *) (page + sizeof(ManifestHeader));
+        for (int32_t i = 0; i < header->num_runs; i++)
+        {
+            char buf[16];
+            sprintf(buf, ".RUN.%d", entry[i * 2 + 1]);
+            RETHROW_ON_EXCEPTION(PagedFile::Unlink(name + buf));
+        }
+
+        RETHROW_ON_EXCEPTION(PagedFile::Unlink(name + ".LSM"));
+        RETURN_SUCCESS();
+    }
+
+    bool LsmTree::Exists(const String& name)
+    {
+        return !access((name + ".LSM").c_str(), F_OK);
+    }
+
+    Status LsmTree::Open(const String& name)
+    {
+        PageHandle ph;
+        int8_t page[PAGE_SIZE];
+
+        WARNING_ASSERT(!is_opened);
+        this->name = name;
+        RETHROW_ON_EXCEPTION(manifest_file.OpenFile(name + ".LSM"));
+        RETHROW_ON_EXCEPTION(ph.OpenPage(manifest_file, 0));
+        RETHROW_ON_EXCEPTION(ph.Read(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+
+        ManifestHeader * header = (ManifestHeader *) page;
+        WARNING_ASSERT(!strncmp(header->magic, "LSMTREE", 8));
+        next_run_id = header->next_run_id;
+
+        levels.assign(LSM_MAX_LEVELS, std::vector<RunEntry>());
+        int32_t * entry = (int32_t *) (page + sizeof(ManifestHeader));
+        for (int32_t i = 0; i < header->num_runs; i++)
+        {
+            RunEntry run_entry;
+            run_entry.run_id = entry[i * 2 + 1];
+            run_entry.run = std::make_shared<SortedRun>();
+            RETHROW_ON_EXCEPTION(run_entry.run->Open(run_file(run_entry.run_id)));
+            levels[entry[i * 2]].push_back(run_entry);
+        }
+
+        active = new MemTable();
+        immutable = NULL;
+        is_closing = false;
+        is_opened = true;
+
+        background_thread = new Thread(std::bind(&LsmTree::background_func, this), "lsm_compaction");
+        RETHROW_ON_EXCEPTION(background_thread->Start());
+        RETURN_SUCCESS();
+    }
+
+    Status LsmTree::Close()
+    {
+        WARNING_ASSERT(is_opened);
+        {
+            LockGuard lock_guard(mutex);
+            is_closing = true;
+            work_cond.Notify();
+        }
+        background_thread->Join();
+        delete background_thread;
+        background_thread = NULL;
+
+        // The background thread is gone, so the last MemTable is written here.
+        RETHROW_ON_EXCEPTION(UpdateChanges());
+
+        levels.clear();
+        delete active;
+        active = NULL;
+        RETHROW_ON_EXCEPTION(manifest_file.Close());
+        is_opened = false;
+        RETURN_SUCCESS();
+    }
+
+    Status LsmTree::UpdateChanges()
+    {
+        WARNING_ASSERT(is_opened);
+        LockGuard work_guard(work_mutex);
+
+        // A frozen MemTable may be waiting for the background thread, write
+        // it first. We cannot stall in freeze_memtable() while holding
+        // work_mutex, so the active table is frozen here directly.
+        RETHROW_ON_EXCEPTION(flush_memtable());
+        {
+            LockGuard lock_guard(mutex);
+            if (immutable == NULL && active->Count() > 0)
+            {
+                immutable = active;
+                active = new MemTable();
+            }
+        }
+        RETHROW_ON_EXCEPTION(flush_memtable());
+        RETURN_SUCCESS();
+    }
+
+    Status LsmTree::Put(const String& key, const String& value)
+    {
+        WARNING_ASSERT(RUN_RECORD_OVERHEAD + key.size() + value.size() <= (size_t) RUN_MAX_RECORD);
+        bool is_full;
+        {
+            LockGuard lock_guard(mutex);
+            active->Put(key, value);
+            is_full = active->ApproximateSize() >= memtable_size;
+        }
+
+        if (is_full)
+            RETHROW_ON_EXCEPTION(freeze_memtable());
+        RETURN_SUCCESS();
+    }
+
+    Status LsmTree::Get(const String& key, String& value)
+    {
+        bool is_deleted = false;
+        LevelList current;
+        {
+            LockGuard lock_guard(mutex);
+            if (active->Get(key, value, is_deleted) ||
+                (immutable && immutable->Get(key, value, is_deleted)))
+            {
+                if (is_deleted)
+                    RETURN_NOT_FOUND();
+                RETURN_SUCCESS();
+            }
+            current = levels;
+        }
+
+        // Runs are immutable, search them without the lock. Level 0 runs may
+        // overlap and are ordered newest first; deeper levels are older.
+        for (uint32_t level = 0; level < current.size(); level++)
+        {
+            for (uint32_t i = 0; i < current[level].size(); i++)
+            {
+                if (current[level][i].run->Get(key, value, is_deleted))
+                {
+                    if (is_deleted)
+                        RETURN_NOT_FOUND();
+                    RETURN_SUCCESS();
+                }
+            }
+        }
+
+        RETURN_NOT_FOUND();
+    }
+
+    Status LsmTree::Remove(const String& key)
+    {
+        bool is_full;
+        {
+            LockGuard lock_guard(mutex);
+            active->Remove(key);
+            is_full = active->ApproximateSize() >= memtable_size;
+        }
+
+        if (is_full)
+            RETHROW_ON_EXCEPTION(freeze_memtable());
+        RETURN_SUCCESS();
+    }
+
+    bool LsmTree::Contains(const String& key)
+    {
+        String value;
+        return Get(key, value) == STATUS_SUCCESS;
+    }
+
+    std::vector<String> LsmTree::ListKeys()
+    {
+        // key -> still alive. Sources are applied from oldest to newest.
+        std::map<String, bool> live;
+        LevelList current;
+        {
+            LockGuard lock_guard(mutex);
+            current = levels;
+
+            MemTable * tables[2] = { immutable, active };
+            for (int32_t i = 0; i < 2; i++)
+            {
+                if (tables[i] == NULL)
+                    continue;
+                for (MemTable::Iterator it(tables[i]); it.Valid(); it.Next())
+                    live[it.Key()] = !it.IsDeleted();
+            }
+        }
+
+        // Memtable entries are newer than any run, runs must not override them.
+        std::map<String, bool> memtable_keys;
+        memtable_keys.swap(live);
+        for (int32_t level = (int32_t) current.size() - 1; level >= 0; level--)
+        {
+            for (int32_t i = (int32_t) current[level].size() - 1; i >= 0; i--)
+            {
+                SortedRun::Iterator it(current[level][i].run.get());
+                for (; it.Valid(); it.Next())
+                    live[it.Key()] = !it.IsDeleted();
+            }
+        }
+        for (std::map<String, bool>::iterator it = memtable_keys.begin(); it != memtable_keys.end(); ++it)
+            live[it->first] = it->second;
+
+        std::vector<String> keys;
+        for (std::map<String, bool>::iterator it = live.begin(); it != live.end(); ++it)
+            if (it->second)
+                keys.push_back(it->first);
+        return keys;
+    }
+
+    Status LsmTree::Scan(const String& start, int32_t limit, KeyValueList& items)
+    {
+        items.clear();
+        String from = start;
+        for (;;)
+        {
+            int32_t remaining = limit > 0 ? limit - (int32_t) items.size() : 0;
+            String end;
+            if (!scan_batch(from, remaining, items, end))
+                break;
+            if (limit > 0 && (int32_t) items.size() >= limit)
+                break;
+            from = end;
+            from.push_back('\0');
+        }
+        RETURN_SUCCESS();
+    }
+
+    // Appends the live records of [start, end] to items, up to limit. Only
+    // limit entries of each MemTable are copied under the lock, so end is
+    // the last key copied from a MemTable that has more; returns whether
+    // there is such a key, in which case the scan goes on after it.
+    bool LsmTree::scan_batch(const String& start, int32_t limit, KeyValueList& items, String& end)
+    {
+        struct Record {
+            String key, value;
+            bool is_deleted;
+        };
+
+        // Sources newest first: MemTables, then level 0 runs newest first,
+        // then the deeper levels.
+        std::vector<std::vector<Record> > tables;
+        LevelList current;
+        bool is_bounded = false;
+        {
+            LockGuard lock_guard(mutex);
+            current = levels;
+            MemTable * memtables[2] = { active, immutable };
+            for (int32_t i = 0; i < 2; i++)
+            {
+                if (memtables[i] == NULL)
+                    continue;
+                tables.push_back(std::vector<Record>());
+                MemTable::Iterator it(memtables[i], start);
+                for (; it.Valid() && (limit <= 0 || (int32_t) tables.back().size() < limit); it.Next())
+                    tables.back().push_back(Record { it.Key(), it.Value(), it.IsDeleted() });
+                if (it.Valid() && (!is_bounded || tables.back().back().key < end))
+                {
+                    end = tables.back().back().key;
+                    is_bounded = true;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<SortedRun::Iterator> > runs;
+        for (uint32_t level = 0; level < current.size(); level++)
+            for (uint32_t i = 0; i < current[level].size(); i++)
+                runs.push_back(std::unique_ptr<SortedRun::Iterator>(
+                    new SortedRun::Iterator(current[level][i].run.get(), start)));
+
+        size_t first_item = items.size();
+        std::vector<size_t> positions(tables.size(), 0);
+        for (;;)
+        {
+            if (limit > 0 && (int32_t) (items.size() - first_item) >= limit)
+                return false;
+
+            // The smallest key; the newest source holding it has its record.
+            const String * key = NULL;
+            const String * value = NULL;
+            bool is_deleted = false;
+            for (uint32_t i = 0; i < tables.size(); i++)
+            {
+                if (positions[i] == tables[i].size())
+                    continue;
+                const Record& record = tables[i][positions[i]];
+                if (key == NULL || record.key < *key)
+                {
+                    key = &record.key;
+                    value = &record.value;
+                    is_deleted = record.is_deleted;
+                }
+            }
+            for (uint32_t i = 0; i < runs.size(); i++)
+            {
+                if (runs[i]->Valid() && (key == NULL || runs[i]->Key() < *key))
+                {
+                    key = &runs[i]->Key();
+                    value = &runs[i]->Value();
+                    is_deleted = runs[i]->IsDeleted();
+                }
+            }
+            if (key == NULL || (is_bounded && end < *key))
+                return is_bounded;
+
+            if (!is_deleted)
+                items.push_back(std::make_pair(*key, *value));
+
+            // Past the key in every source, copied first: it may point into
+            // one of them.
+            String passed = *key;
+            for (uint32_t i = 0; i < tables.size(); i++)
+                if (positions[i] < tables[i].size() && tables[i][positions[i]].key == passed)
+                    positions[i]++;
+            for (uint32_t i = 0; i < runs.size(); i++)
+                if (runs[i]->Valid() && runs[i]->Key() == passed)
+                    runs[i]->Next();
+        }
+    }
+
+    std::vector<int32_t> LsmTree::RunsPerLevel()
+    {
+        LockGuard lock_guard(mutex);
+        std::vector<int32_t> runs;
+        for (uint32_t level = 0; level < levels.size(); level++)
+            runs.push_back(levels[level].size());
+        return runs;
+    }
+
+    void LsmTree::background_func()
+    {
+        while (true)
+        {
+            {
+                LockGuard lock_guard(mutex);
+                while (!is_closing && immutable == NULL && !needs_compaction())
+                    work_cond.Wait();
+                if (is_closing)
+                    break;
+            }
+
+            LockGuard work_guard(work_mutex);
+            flush_memtable();
+            bool pending;
+            {
+                LockGuard lock_guard(mutex);
+                pending = needs_compaction();
+            }
+            if (pending)
+                compact();
+        }
+    }
+
+    // Caller holds mutex
+    bool LsmTree::needs_compaction()
+    {
+        if ((int32_t) levels[0].size() >= LSM_L0_COMPACTION_TRIGGER)
+            return true;
+
+        for (int32_t level = 1; level < LSM_MAX_LEVELS - 1; level++)
+        {
+            int32_t pages = 0;
+            for (uint32_t i = 0; i < levels[level].size(); i++)
+                pages += levels[level][i].run->NumPages();
+            if (pages > level_budget(level))
+                return true;
+        }
+        return false;
+    }
+
+    Status LsmTree::freeze_memtable()
+    {
+        LockGuard lock_guard(mutex);
+        // Write stall: only one MemTable can wait for its flush.
+        while (immutable != NULL)
+            done_cond.Wait();
+
+        if (active->Count() == 0)
+            RETURN_SUCCESS();
+
+        immutable = active;
+        active = new MemTable();
+        work_cond.Notify();
+        RETURN_SUCCESS();
+    }
+
+    // Caller holds work_mutex
+    Status LsmTree::flush_memtable()
+    {
+        MemTable * mem_table;
+        RunEntry run_entry;
+        {
+            LockGuard lock_guard(mutex);
+            mem_table = immutable;
+            if (mem_table == NULL)
+                RETURN_SUCCESS();
+            run_entry.run_id = next_run_id++;
+        }
+
+        // Tombstones are kept: older runs may still hold the key.
+        SortedRunBuilder builder;
+        RETHROW_ON_EXCEPTION(builder.Open(run_file(run_entry.run_id)));
+        for (MemTable::Iterator it(mem_table); it.Valid(); it.Next())
+            RETHROW_ON_EXCEPTION(builder.Add(it.Key(), it.Value(), it.IsDeleted()));
+        RETHROW_ON_EXCEPTION(builder.Finish());
+
+        run_entry.run = std::make_shared<SortedRun>();
+        RETHROW_ON_EXCEPTION(run_entry.run->Open(run_file(run_entry.run_id)));
+
+        {
+            LockGuard lock_guard(mutex);
+            levels[0].insert(levels[0].begin(), run_entry);
+            immutable = NULL;
+            done_cond.NotifyAll();
+        }
+
+        delete mem_table;
+        RETHROW_ON_EXCEPTION(write_manifest());
+        RETURN_SUCCESS();
+    }
+
+    // Caller holds work_mutex
+    Status LsmTree::compact()
+    {
+        int32_t source, target;
+        std::vector<RunEntry> inputs;
+        bool is_bottom = true;
+        RunEntry output;
+        {
+            LockGuard lock_guard(mutex);
+            if ((int32_t) levels[0].size() >= LSM_L0_COMPACTION_TRIGGER)
+                source = 0;
+            else
+            {
+                for (source = 1; source < LSM_MAX_LEVELS - 1; source++)
+                {
+                    int32_t pages = 0;
+                    for (uint32_t i = 0; i < levels[source].size(); i++)
+                        pages += levels[source][i].run->NumPages();
+                    if (pages > level_budget(source))
+                        break;
+                }
+                if (source == LSM_MAX_LEVELS - 1)
+                    RETURN_SUCCESS();
+            }
+
+            // Newest input first, so the first copy of a key wins the merge.
+            target = source + 1;
+            inputs = levels[source];
+            inputs.insert(inputs.end(), levels[target].begin(), levels[target].end());
+            for (int32_t level = target + 1; level < LSM_MAX_LEVELS; level++)
+                if (!levels[level].empty())
+                    is_bottom = false;
+            output.run_id = next_run_id++;
+        }
+
+        std::vector<SortedRun::Iterator *> iterators;
+        for (uint32_t i = 0; i < inputs.size(); i++)
+            iterators.push_back(new SortedRun::Iterator(inputs[i].run.get()));
+
+        SortedRunBuilder builder;
+        Status status = builder.Open(run_file(output.run_id));
+        while (status == STATUS_SUCCESS)
+        {
+            int32_t winner = -1;
+            for (uint32_t i = 0; i < iterators.size(); i++)
+            {
+                if (iterators[i]->Valid() && (winner < 0 || iterators[i]->Key() < iterators[winner]->Key()))
+                    winner = i;
+            }
+            if (winner < 0)
+                break;
+
+            String key = iterators[winner]->Key();
+            // Nothing older is left to shadow in the bottom level.
+            if (!(is_bottom && iterators[winner]->IsDeleted()))
+                status = builder.Add(key, iterators[winner]->Value(), iterators[winner]->IsDeleted());
+
+            for (uint32_t i = 0; i < iterators.size(); i++)
+                if (iterators[i]->Valid() && iterators[i]->Key() == key)
+                    iterators[i]->Next();
+        }
+
+        for (uint32_t i = 0; i < iterators.size(); i++)
+            delete iterators[i];
+        if (!(status == STATUS_SUCCESS))
+            return status;
+
+        RETHROW_ON_EXCEPTION(builder.Finish());
+        bool is_empty = builder.NumPages() == 0;
+        if (is_empty)
+            PagedFile::Unlink(run_file(output.run_id));
+        else
+        {
+            output.run = std::make_shared<SortedRun>();
+            RETHROW_ON_EXCEPTION(output.run->Open(run_file(output.run_id)));
+        }
+
+        {
+            LockGuard lock_guard(mutex);
+            // Flushes are serialized with us, so the source and target levels
+            // still hold exactly the inputs.
+            levels[source].clear();
+            levels[target].clear();
+            if (!is_empty)
+                levels[target].push_back(output);
+        }
+
+        RETHROW_ON_EXCEPTION(write_manifest());
+
+        // Readers that still hold an input keep its file until they finish.
+        for (uint32_t i = 0; i < inputs.size(); i++)
+            inputs[i].run->MarkObsolete();
+        RETURN_SUCCESS();
+    }
+
+    // Caller holds work_mutex
+    Status LsmTree::write_manifest()
+    {
+        int8_t page[PAGE_SIZE];
+        memset(page, 0, PAGE_SIZE);
+        ManifestHeader * header = (ManifestHeader *) page;
+        int32_t * entry = (int32_t *) (page + sizeof(ManifestHeader));
+        strncpy(header->magic, "LSMTREE", 8);
+
+        {
+            LockGuard lock_guard(mutex);
+            header->next_run_id = next_run_id;
+            for (uint32_t level = 0; level < levels.size(); level++)
+            {
+                for (uint32_t i = 0; i < levels[level].size(); i++)
+                {
+                    WARNING_ASSERT(header->num_runs < MAX_MANIFEST_RUNS);
+                    entry[header->num_runs * 2] = level;
+                    entry[header->num_runs * 2 + 1] = levels[level][i].run_id;
+                    header->num_runs++;
+                }
+            }
+        }
+
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(manifest_file, 0));
+        RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE, 0, true));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    String LsmTree::run_file(int32_t run_id)
+    {
+        char buf[16];
+        sprintf(buf, ".RUN.%d", run_id);
+        return name + buf;
+    }
+
+    int32_t LsmTree::level_budget(int32_t level)
+    {
+        // Level 1 holds about ten MemTables, every next level ten times more.
+        int32_t budget = (int32_t) (memtable_size / PAGE_SIZE + 1) * LSM_LEVEL_MULTIPLIER;
+        for (int32_t i = 1; i < level; i++)
+            budget *= LSM_LEVEL_MULTIPLIER;
+        return budget;
+    }
+
+} // namespace Pumper
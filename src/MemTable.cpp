@@ -0,0 +1,124 @@
+// MemTable.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// In-memory write buffer of the log-structured engine, as a skip list.
+
+#include "MemTable.h"
+
+namespace Pumper {
+    MemTable::MemTable() : height(1), approximate_size(0), count(0), random_seed(0xdeadbeef)
+    {
+        head = new Node();
+        head->is_deleted = false;
+        head->next.assign(SKIPLIST_MAX_HEIGHT, NULL);
+    }
+
+    MemTable::~MemTable()
+    {
+        Node * node = head;
+        while (node != NULL)
+        {
+            Node * next = node->next[0];
+            delete node;
+            node = next;
+        }
+    }
+
+    void MemTable::Put(const String& key, const String& value)
+    {
+        insert(key, value, false);
+    }
+
+    void MemTable::Remove(const String& key)
+    {
+        insert(key, String(), true);
+    }
+
+    bool MemTable::Get(const String& key, String& value, bool& is_deleted)
+    {
+        Node * node = find_greater_or_equal(key, NULL);
+        if (node == NULL || node->key != key)
+            return false;
+
+        is_deleted = node->is_deleted;
+        if (!is_deleted)
+            value = node->value;
+        return true;
+    }
+
+    size_t MemTable::ApproximateSize() const
+    {
+        return approximate_size;
+    }
+
+    int32_t MemTable::Count() const
+    {
+        return count;
+    }
+
+    void MemTable::insert(const String& key, const String& value, bool is_deleted)
+    {
+        Node * prev[SKIPLIST_MAX_HEIGHT];
+        Node * node = find_greater_or_equal(key, prev);
+
+        if (node != NULL && node->key == key)
+        {
+            // Overwrite in place, the newest write wins.
+            approximate_size += value.size();
+            approximate_size -= node->value.size();
+            node->value = value;
+            node->is_deleted = is_deleted;
+            return;
+        }
+
+        int32_t node_height = random_height();
+        if (node_height > height)
+        {
+            for (int32_t i = height; i < node_height; i++)
+                prev[i] = head;
+            height = node_height;
+        }
+
+        node = new Node();
+        node->key = key;
+        node->value = value;
+        node->is_deleted = is_deleted;
+        node->next.resize(node_height);
+        for (int32_t i = 0; i < node_height; i++)
+        {
+            node->next[i] = prev[i]->next[i];
+            prev[i]->next[i] = node;
+        }
+
+        approximate_size += key.size() + value.size();
+        count++;
+    }
+
+    MemTable::Node * MemTable::find_greater_or_equal(const String& key, Node ** prev) const
+    {
+        Node * node = head;
+        for (int32_t level = height - 1; level >= 0; level--)
+        {
+            while (node->next[level] != NULL && node->next[level]->key < key)
+                node = node->next[level];
+            if (prev != NULL)
+                prev[level] = node;
+        }
+        return node->next[0];
+    }
+
+    // Geometric distribution with p = 1/4
+    int32_t MemTable::random_height()
+    {
+        int32_t node_height = 1;
+        while (node_height < SKIPLIST_MAX_HEIGHT)
+        {
+            random_seed = random_seed * 1103515245 + 12345;
+            if ((random_seed >> 16) & 3)
+                break;
+            node_height++;
+        }
+        return node_height;
+    }
+
+} // namespace Pumper
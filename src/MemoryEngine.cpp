@@ -0,0 +1,252 @@
+// MemoryEngine.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// KvEngine kept entirely in a hash table in memory.
+
+#include "MemoryEngine.h"
+
+#include <algorithm>
+
+namespace Pumper {
+    MemoryEngine::MemoryEngine() : is_opened(false)
+    {
+
+    }
+
+    MemoryEngine::~MemoryEngine()
+    {
+
+    }
+
+    Status MemoryEngine::OpenDb(const String& file)
+    {
+        LockGuard lock_guard(mutex);
+        WARNING_ASSERT(!is_opened);
+        db_name = file;
+        is_opened = true;
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::CloseDb()
+    {
+        LockGuard lock_guard(mutex);
+        WARNING_ASSERT(is_opened);
+        table.clear();
+        db_name = "";
+        is_opened = false;
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::UpdateChanges()
+    {
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::Put(const String& key, const String& value)
+    {
+        LockGuard lock_guard(mutex);
+        WARNING_ASSERT(is_opened);
+        num_puts++;
+        put_entry(key, value);
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::Get(const String& key, String& value)
+    {
+        LockGuard lock_guard(mutex);
+        num_gets++;
+        std::unordered_map<String, String>::iterator it = table.find(key);
+        if (it == table.end())
+        {
+            num_get_misses++;
+            RETURN_NOT_FOUND();
+        }
+        value = it->second;
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::Remove(const String& key)
+    {
+        LockGuard lock_guard(mutex);
+        WARNING_ASSERT(is_opened);
+        num_removes++;
+        if (!remove_entry(key))
+            RETURN_NOT_FOUND();
+        RETURN_SUCCESS();
+    }
+
+    bool MemoryEngine::Contains(const String& key)
+    {
+        LockGuard lock_guard(mutex);
+        return table.count(key) > 0;
+    }
+
+    std::vector<String> MemoryEngine::ListKeys()
+    {
+        LockGuard lock_guard(mutex);
+        std::vector<String> keys;
+        keys.reserve(table.size());
+        std::unordered_map<String, String>::iterator it;
+        for (it = table.begin(); it != table.end(); ++it)
+            keys.push_back(it->first);
+        return keys;
+    }
+
+    Snapshot * MemoryEngine::GetSnapshot()
+    {
+        LockGuard lock_guard(mutex);
+        return version_log.CreateSnapshot();
+    }
+
+    Status MemoryEngine::ReleaseSnapshot(Snapshot * snapshot)
+    {
+        WARNING_ASSERT(snapshot);
+        RETHROW_ON_EXCEPTION(version_log.ReleaseSnapshot(snapshot));
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::Get(const Snapshot * snapshot, const String& key, String& value)
+    {
+        WARNING_ASSERT(snapshot);
+        LockGuard lock_guard(mutex);
+        switch (version_log.Lookup(snapshot, key, value))
+        {
+        case VersionPresent:
+            RETURN_SUCCESS();
+        case VersionAbsent:
+            RETURN_NOT_FOUND();
+        default:
+            break;
+        }
+
+        std::unordered_map<String, String>::iterator it = table.find(key);
+        if (it == table.end())
+            RETURN_NOT_FOUND();
+        value = it->second;
+        RETURN_SUCCESS();
+    }
+
+    bool MemoryEngine::Contains(const Snapshot * snapshot, const String& key)
+    {
+        String value;
+        LockGuard lock_guard(mutex);
+        switch (version_log.Lookup(snapshot, key, value))
+        {
+        case VersionPresent:
+            return true;
+        case VersionAbsent:
+            return false;
+        default:
+            return table.count(key) > 0;
+        }
+    }
+
+    std::vector<String> MemoryEngine::ListKeys(const Snapshot * snapshot)
+    {
+        std::vector<String> keys = ListKeys();
+        version_log.MergeKeys(snapshot, keys);
+        return keys;
+    }
+
+    Status MemoryEngine::Write(const WriteBatch& batch)
+    {
+        LockGuard lock_guard(mutex);
+        WARNING_ASSERT(is_opened);
+        num_batches++;
+        const std::vector<WriteBatch::Operation>& operations = batch.Operations();
+        for (uint32_t i = 0; i < operations.size(); i++)
+        {
+            if (operations[i].is_remove)
+            {
+                num_removes++;
+                remove_entry(operations[i].key);
+            }
+            else
+            {
+                num_puts++;
+                put_entry(operations[i].key, operations[i].value);
+            }
+        }
+        RETURN_SUCCESS();
+    }
+
+    static bool compare_entry(const std::pair<const String, String> * lhs, const std::pair<const String, String> * rhs)
+    {
+        return lhs->first < rhs->first;
+    }
+
+    Status MemoryEngine::Scan(const String& start, int32_t limit, KeyValueList& items)
+    {
+        LockGuard lock_guard(mutex);
+        num_scans++;
+
+        // Order pointers, copy only the pairs that are returned.
+        std::vector<const std::pair<const String, String> *> entries;
+        std::unordered_map<String, String>::iterator it;
+        for (it = table.begin(); it != table.end(); ++it)
+            if (it->first >= start)
+                entries.push_back(&*it);
+
+        if (limit > 0 && (size_t) limit < entries.size())
+        {
+            std::partial_sort(entries.begin(), entries.begin() + limit, entries.end(), compare_entry);
+            entries.resize(limit);
+        }
+        else
+            std::sort(entries.begin(), entries.end(), compare_entry);
+
+        items.clear();
+        for (uint32_t i = 0; i < entries.size(); i++)
+            items.push_back(*entries[i]);
+        RETURN_SUCCESS();
+    }
+
+    Status MemoryEngine::EnableCache(size_t capacity)
+    {
+        RETURN_SUCCESS();
+    }
+
+    bool MemoryEngine::IsOpened()
+    {
+        return is_opened;
+    }
+
+    String MemoryEngine::OpenDbName()
+    {
+        return db_name;
+    }
+
+    const char * MemoryEngine::Name()
+    {
+        return "memory";
+    }
+
+    void MemoryEngine::put_entry(const String& key, const String& value)
+    {
+        record_version(key);
+        table[key] = value;
+    }
+
+    bool MemoryEngine::remove_entry(const String& key)
+    {
+        std::unordered_map<String, String>::iterator it = table.find(key);
+        if (it == table.end())
+            return false;
+        record_version(key);
+        table.erase(it);
+        return true;
+    }
+
+    void MemoryEngine::record_version(const String& key)
+    {
+        if (!version_log.HasSnapshots())
+            return;
+
+        std::unordered_map<String, String>::iterator it = table.find(key);
+        if (it == table.end())
+            version_log.Record(key, false, String());
+        else
+            version_log.Record(key, true, it->second);
+    }
+
+} // namespace Pumper
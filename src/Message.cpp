@@ -7,12 +7,11 @@
 #include "Message.h"
 
 namespace Pumper {
-    int Message::seq_cnt = 0;
+    std::atomic<int> Message::seq_cnt(0);
 
     Message::Message(MessageType type, const String& command) : 
-        seq_number(seq_cnt), type(type), payload(command)
+        seq_number(seq_cnt++), type(type), payload(command)
     {
-        seq_cnt++;
     }
 
     Message::Message(MessageType type, const String& payload, const Message& refer) : 
@@ -89,7 +88,7 @@ namespace Pumper {
 
     String Message::ToPacket() const
     {
-        char seq_char[5];
+        char seq_char[16];
         sprintf(seq_char, "%d", seq_number);
         String builder(seq_char);
 
@@ -106,14 +106,12 @@ namespace Pumper {
             memcpy(buffer_image + offset, data, length);
         }
 
+        // ForcePage only writes dirty pages, so mark it first in both cases.
+        RETHROW_ON_EXCEPTION(paged_file->MarkDirty(page_id));
         if (need_force) 
         {
             RETHROW_ON_EXCEPTION(paged_file->ForcePage(page_id));
         }
-        else 
-        {
-            RETHROW_ON_EXCEPTION(paged_file->MarkDirty(page_id));
-        }
         RETURN_SUCCESS();
     }
 
@@ -0,0 +1,432 @@
+// PageIo.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Asynchronous page reads and writes on a pool of I/O threads.
+
+#include "PageIo.h"
+#include "Checksum.h"
+#include "Statistics.h"
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <atomic>
+#include <unordered_set>
+
+namespace Pumper {
+    struct PageIo::Batch {
+        Batch(int32_t num_runs, const PageIoCallback& callback)
+            : remaining(num_runs), status(STATUS_SUCCESS), callback(callback) { }
+
+        std::atomic<int32_t> remaining;
+        MutexLock mutex;
+        Status status;                          // First failure
+        PageIoCallback callback;
+    };
+
+    static bool compare_request(const PageIoRequest& lhs, const PageIoRequest& rhs)
+    {
+        return lhs.fd < rhs.fd || (lhs.fd == rhs.fd && lhs.page_id < rhs.page_id);
+    }
+
+    // Short transfers continue where they stopped; a read that hits the end
+    // of file is a failure. iov is consumed.
+    static bool transfer_vector(int32_t fd, struct iovec * iov, int32_t count, off_t offset, 
+        bool is_write)
+    {
+        while (count > 0)
+        {
+            ssize_t done = is_write ? pwritev(fd, iov, count, offset) : preadv(fd, iov, count, offset);
+            if (done <= 0)
+                return false;
+            offset += done;
+            while (count > 0 && (size_t) done >= iov->iov_len)
+            {
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0)
+            {
+                iov->iov_base = (int8_t *) iov->iov_base + done;
+                iov->iov_len -= done;
+            }
+        }
+        return true;
+    }
+
+    PageIo::PageIo(int32_t num_threads) : cond(mutex), is_stopping(false)
+    {
+        for (int32_t i = 0; i < num_threads; i++)
+        {
+            Thread * worker = new Thread(std::bind(&PageIo::worker_func, this), "page_io");
+            worker->Start();
+            workers.push_back(worker);
+        }
+    }
+
+    PageIo::~PageIo()
+    {
+        {
+            LockGuard lock_guard(mutex);
+            is_stopping = true;
+            cond.NotifyAll();
+        }
+        for (uint32_t i = 0; i < workers.size(); i++)
+        {
+            workers[i]->Join();
+            delete workers[i];
+        }
+        for (auto it = extent_maps.begin(); it != extent_maps.end(); ++it)
+            delete it->second;
+    }
+
+    void PageIo::Submit(std::vector<PageIoRequest> requests, const PageIoCallback& callback)
+    {
+        if (requests.empty())
+        {
+            callback(STATUS_SUCCESS);
+            return;
+        }
+
+        // Adjacent pages of one file and one direction become one run.
+        std::sort(requests.begin(), requests.end(), compare_request);
+        std::vector<Run> batch_runs;
+        for (uint32_t i = 0; i < requests.size(); i++)
+        {
+            const PageIoRequest& request = requests[i];
+            if (batch_runs.empty() || batch_runs.back().fd != request.fd ||
+                batch_runs.back().is_write != request.is_write ||
+                batch_runs.back().first_page + (int32_t) batch_runs.back().mappings.size() != request.page_id ||
+                batch_runs.back().mappings.size() >= (size_t) PAGE_IO_MAX_VECTOR)
+            {
+                Run run;
+                run.fd = request.fd;
+                run.first_page = request.page_id;
+                run.is_write = request.is_write;
+                batch_runs.push_back(run);
+            }
+            batch_runs.back().mappings.push_back(request.mapping);
+        }
+
+        std::shared_ptr<Batch> batch = std::make_shared<Batch>(batch_runs.size(), callback);
+        LockGuard lock_guard(mutex);
+        for (uint32_t i = 0; i < batch_runs.size(); i++)
+        {
+            batch_runs[i].batch = batch;
+            auto it = extent_maps.find(batch_runs[i].fd);
+            batch_runs[i].extent_map = it == extent_maps.end() ? NULL : it->second;
+            runs.push_back(batch_runs[i]);
+        }
+        cond.NotifyAll();
+    }
+
+    Status PageIo::Execute(const std::vector<PageIoRequest>& requests)
+    {
+        std::vector<int32_t> journaled_fds, journal_fds;
+        {
+            LockGuard lock_guard(journal_mutex);
+            for (uint32_t i = 0; i < requests.size(); i++)
+            {
+                if (requests[i].is_write && journals.count(requests[i].fd) &&
+                    std::find(journaled_fds.begin(), journaled_fds.end(), requests[i].fd) == journaled_fds.end())
+                {
+                    journaled_fds.push_back(requests[i].fd);
+                    journal_fds.push_back(journals[requests[i].fd]);
+                }
+            }
+        }
+        if (journaled_fds.empty())
+            return execute(requests);
+
+        // Journal copies must be durable before a page is overwritten in
+        // place, and the pages before the journal is reused by the next
+        // batch: hence the lock across the batch.
+        LockGuard batch_guard(journal_batch_mutex);
+        Status status = STATUS_SUCCESS;
+        for (uint32_t i = 0; i < journaled_fds.size() && status == STATUS_SUCCESS; i++)
+        {
+            std::vector<PageIoRequest> journaled;
+            for (uint32_t j = 0; j < requests.size(); j++)
+                if (requests[j].is_write && requests[j].fd == journaled_fds[i])
+                    journaled.push_back(requests[j]);
+            status = write_journal(journal_fds[i], journaled);
+        }
+        if (status == STATUS_SUCCESS)
+            status = execute(requests);
+        for (uint32_t i = 0; i < journaled_fds.size() && status == STATUS_SUCCESS; i++)
+        {
+            if (fdatasync(journaled_fds[i]) < 0)
+                status = Status(Warning, "fdatasync() of a journaled file failed");
+        }
+        return status;
+    }
+
+    Status PageIo::execute(const std::vector<PageIoRequest>& requests)
+    {
+        MutexLock done_mutex;
+        Condition done_cond(done_mutex);
+        bool is_done = false;
+        Status result = STATUS_SUCCESS;
+
+        Submit(requests, [&](const Status& status) {
+            LockGuard lock_guard(done_mutex);
+            result = status;
+            is_done = true;
+            done_cond.Notify();
+        });
+
+        LockGuard lock_guard(done_mutex);
+        while (!is_done)
+            done_cond.Wait();
+        return result;
+    }
+
+    Status PageIo::ReadPage(int32_t fd, int32_t page_id, int8_t * mapping)
+    {
+        return transfer(fd, page_id, false, find_extent_map(fd), &mapping, 1);
+    }
+
+    Status PageIo::WritePage(int32_t fd, int32_t page_id, int8_t * mapping)
+    {
+        return transfer(fd, page_id, true, find_extent_map(fd), &mapping, 1);
+    }
+
+    Status PageIo::SetCompressed(int32_t fd, bool is_compressed)
+    {
+        ExtentMap * extent_map = NULL;
+        if (is_compressed)
+        {
+            extent_map = new ExtentMap(fd);
+            Status status = extent_map->Load();
+            if (!(status == STATUS_SUCCESS))
+            {
+                delete extent_map;
+                return status;
+            }
+        }
+
+        LockGuard lock_guard(mutex);
+        auto it = extent_maps.find(fd);
+        if (it != extent_maps.end())
+        {
+            delete it->second;
+            extent_maps.erase(it);
+        }
+        if (extent_map)
+            extent_maps[fd] = extent_map;
+        RETURN_SUCCESS();
+    }
+
+    Status PageIo::SyncExtents(int32_t fd)
+    {
+        ExtentMap * extent_map = find_extent_map(fd);
+        if (extent_map)
+            return extent_map->Sync();
+        RETURN_SUCCESS();
+    }
+
+    int32_t PageIo::DiskPages(int32_t fd)
+    {
+        ExtentMap * extent_map = find_extent_map(fd);
+        if (extent_map)
+            return extent_map->NumPages();
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) < 0 || file_stat.st_size < PAGE_ZERO_OFFSET)
+            return 0;
+        return (file_stat.st_size - PAGE_ZERO_OFFSET) / PHYSICAL_PAGE_SIZE;
+    }
+
+    void PageIo::SetJournal(int32_t fd, int32_t journal_fd)
+    {
+        LockGuard lock_guard(journal_mutex);
+        if (journal_fd == INVALID_FD)
+            journals.erase(fd);
+        else
+            journals[fd] = journal_fd;
+    }
+
+    bool PageIo::HasJournal(int32_t fd)
+    {
+        LockGuard lock_guard(journal_mutex);
+        return journals.count(fd) != 0;
+    }
+
+    Status PageIo::RecoverJournal(int32_t fd, int32_t journal_fd, int32_t& num_restored)
+    {
+        int8_t record[PHYSICAL_PAGE_SIZE];
+        int8_t current[PHYSICAL_PAGE_SIZE];
+        std::unordered_set<int32_t> seen;
+        num_restored = 0;
+
+        // The last batch is at the front of the journal. Its pages that fail
+        // in place were torn by the crash; older copies further on are
+        // skipped, their batches completed.
+        for (off_t offset = 0; pread(journal_fd, record, PHYSICAL_PAGE_SIZE, offset) == PHYSICAL_PAGE_SIZE;
+            offset += PHYSICAL_PAGE_SIZE)
+        {
+            PageTrailer trailer;
+            memcpy(&trailer, record + PAGE_SIZE, PAGE_TRAILER_SIZE);
+            if (trailer.page_id < 0 || !VerifyPage(trailer.page_id, record, trailer, false) ||
+                !seen.insert(trailer.page_id).second)
+                continue;
+
+            ssize_t length = pread(fd, current, PHYSICAL_PAGE_SIZE, PageOffset(trailer.page_id));
+            PageTrailer current_trailer;
+            memcpy(&current_trailer, current + PAGE_SIZE, PAGE_TRAILER_SIZE);
+            if (length == PHYSICAL_PAGE_SIZE && VerifyPage(trailer.page_id, current, current_trailer))
+                continue;
+
+            WARNING_ASSERT(pwrite(fd, record, PHYSICAL_PAGE_SIZE, PageOffset(trailer.page_id)) ==
+                PHYSICAL_PAGE_SIZE);
+            Statistics::Tick(PagesRestored);
+            num_restored++;
+        }
+
+        WARNING_ASSERT(!fdatasync(fd));
+        WARNING_ASSERT(!ftruncate(journal_fd, 0));
+        RETURN_SUCCESS();
+    }
+
+    off_t PageIo::PageOffset(int32_t page_id)
+    {
+        return PAGE_ZERO_OFFSET + (off_t) PHYSICAL_PAGE_SIZE * page_id;
+    }
+
+    void PageIo::SealPage(int32_t page_id, const int8_t * mapping, PageTrailer * trailer)
+    {
+        trailer->page_id = page_id;
+        trailer->checksum = Crc32c(&page_id, sizeof(page_id), Crc32c(mapping, PAGE_SIZE));
+    }
+
+    bool PageIo::VerifyPage(int32_t page_id, const int8_t * mapping, const PageTrailer& trailer, 
+        bool allow_blank)
+    {
+        if (trailer.page_id == page_id && 
+            trailer.checksum == Crc32c(&page_id, sizeof(page_id), Crc32c(mapping, PAGE_SIZE)))
+            return true;
+
+        // Slow path, taken on failures only
+        if (!allow_blank || trailer.checksum != 0 || trailer.page_id != 0)
+            return false;
+        for (int32_t i = 0; i < PAGE_SIZE; i++)
+            if (mapping[i])
+                return false;
+        return true;
+    }
+
+    ExtentMap * PageIo::find_extent_map(int32_t fd)
+    {
+        LockGuard lock_guard(mutex);
+        auto it = extent_maps.find(fd);
+        return it == extent_maps.end() ? NULL : it->second;
+    }
+
+    void PageIo::worker_func()
+    {
+        while (true)
+        {
+            Run run;
+            {
+                LockGuard lock_guard(mutex);
+                while (runs.empty() && !is_stopping)
+                    cond.Wait();
+                if (runs.empty())
+                    return;
+                run = runs.front();
+                runs.pop_front();
+            }
+
+            Status status = transfer(run.fd, run.first_page, run.is_write, run.extent_map,
+                run.mappings.data(), run.mappings.size());
+            Batch * batch = run.batch.get();
+            if (!(status == STATUS_SUCCESS))
+            {
+                LockGuard lock_guard(batch->mutex);
+                if (batch->status == STATUS_SUCCESS)
+                    batch->status = status;
+            }
+            if (batch->remaining.fetch_sub(1) == 1)
+                batch->callback(batch->status);
+        }
+    }
+
+    Status PageIo::write_journal(int32_t journal_fd, const std::vector<PageIoRequest>& requests)
+    {
+        Statistics::Tick(PageJournalWrites, requests.size());
+        struct iovec iov[2 * PAGE_IO_MAX_VECTOR];
+        PageTrailer trailers[PAGE_IO_MAX_VECTOR];
+        off_t offset = 0;
+        for (uint32_t first = 0; first < requests.size(); first += PAGE_IO_MAX_VECTOR)
+        {
+            int32_t count = std::min(requests.size() - first, (size_t) PAGE_IO_MAX_VECTOR);
+            for (int32_t i = 0; i < count; i++)
+            {
+                const PageIoRequest& request = requests[first + i];
+                SealPage(request.page_id, request.mapping, &trailers[i]);
+                iov[2 * i].iov_base = request.mapping;
+                iov[2 * i].iov_len = PAGE_SIZE;
+                iov[2 * i + 1].iov_base = &trailers[i];
+                iov[2 * i + 1].iov_len = PAGE_TRAILER_SIZE;
+            }
+            WARNING_ASSERT(transfer_vector(journal_fd, iov, 2 * count, offset, true));
+            offset += (off_t) PHYSICAL_PAGE_SIZE * count;
+        }
+        WARNING_ASSERT(!fdatasync(journal_fd));
+        RETURN_SUCCESS();
+    }
+
+    Status PageIo::transfer(int32_t fd, int32_t first_page, bool is_write, ExtentMap * extent_map,
+        int8_t * const * mappings, int32_t count)
+    {
+        StopWatch stop_watch(is_write ? PageWriteNanos : PageReadNanos);
+        Statistics::Tick(is_write ? PageWrites : PageReads, count);
+        if (extent_map)
+        {
+            for (int32_t i = 0; i < count; i++)
+            {
+                if (is_write)
+                {
+                    RETHROW_ON_EXCEPTION(extent_map->WritePage(first_page + i, mappings[i]));
+                }
+                else
+                {
+                    RETHROW_ON_EXCEPTION(extent_map->ReadPage(first_page + i, mappings[i]));
+                }
+            }
+            RETURN_SUCCESS();
+        }
+
+        // Each page and its trailer
+        struct iovec iov[2 * PAGE_IO_MAX_VECTOR];
+        PageTrailer trailers[PAGE_IO_MAX_VECTOR];
+        for (int32_t i = 0; i < count; i++)
+        {
+            if (is_write)
+                SealPage(first_page + i, mappings[i], &trailers[i]);
+            iov[2 * i].iov_base = mappings[i];
+            iov[2 * i].iov_len = PAGE_SIZE;
+            iov[2 * i + 1].iov_base = &trailers[i];
+            iov[2 * i + 1].iov_len = PAGE_TRAILER_SIZE;
+        }
+        WARNING_ASSERT(transfer_vector(fd, iov, 2 * count, PageOffset(first_page), is_write));
+
+        if (!is_write)
+        {
+            for (int32_t i = 0; i < count; i++)
+            {
+                if (VerifyPage(first_page + i, mappings[i], trailers[i]))
+                    continue;
+                Statistics::Tick(PageChecksumFailures);
+                char message[64];
+                snprintf(message, sizeof(message), "Checksum mismatch: fd %d, page %d", fd, 
+                    first_page + i);
+                RETURN_CORRUPTION(message);
+            }
+        }
+        RETURN_SUCCESS();
+    }
+
+} // namespace Pumper
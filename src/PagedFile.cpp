@@ -5,6 +5,7 @@
 #include "Status.h"
 #include "Buffer.h"
 #include "Singleton.h"
+#include "Statistics.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -12,11 +13,13 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 
 namespace Pumper {
-    PagedFile::PagedFile() : is_file_opened(false), fd(-2), is_header_dirty(false)
+    static_assert(SIZEOF_HEADER == sizeof(Header), "Header must fill SIZEOF_HEADER bytes");
+
+    PagedFile::PagedFile() : is_file_opened(false), fd(-2), journal_fd(INVALID_FD), is_header_dirty(false)
     {
-        // static_assert(SIZEOF_HEADER == sizeof(Header));        
         memset(&header_content, 0, SIZEOF_HEADER);
     }
 
@@ -26,12 +29,13 @@ namespace Pumper {
             Close();
     }
 
-    Status PagedFile::Create(const String& file)
+    Status PagedFile::Create(const String& file, int8_t flags)
     {
         int32_t new_fd;
         Header new_header;
 
         WARNING_ASSERT(access(file.c_str(), F_OK));
+        WARNING_ASSERT(!((flags & HEADER_DOUBLE_WRITE) && (flags & HEADER_COMPRESSED)));
         new_fd = open(file.c_str(), O_CREAT | O_WRONLY, 0664);
         ERROR_ASSERT(new_fd >= 0);
         
@@ -40,10 +44,11 @@ namespace Pumper {
 
         new_header.free_list_head = INVALID_PAGE_ID;
         new_header.first_page = INVALID_PAGE_ID;
+        new_header.flags = flags;
 
         int32_t header_length;
 
-        // new_header.checksum = calculate_checksum(&new_header);
+        new_header.checksum = calculate_checksum(&new_header);
         lseek(new_fd, 0, SEEK_SET);
         header_length = write(new_fd, &new_header, SIZEOF_HEADER);
         ERROR_ASSERT(header_length == SIZEOF_HEADER);
@@ -55,6 +60,45 @@ namespace Pumper {
     Status PagedFile::Unlink(const String& file)
     {
         WARNING_ASSERT(!unlink(file.c_str()));
+        // Only files with HEADER_DOUBLE_WRITE have one.
+        unlink((file + ".DW").c_str());
+        RETURN_SUCCESS();
+    }
+
+    Status PagedFile::Scrub(const String& file, std::vector<int32_t>& bad_pages)
+    {
+        Header header;
+        int8_t page[PHYSICAL_PAGE_SIZE];
+        int32_t scrub_fd = open(file.c_str(), O_RDONLY);
+        WARNING_ASSERT(scrub_fd >= 0);
+        bool is_header_valid = read(scrub_fd, &header, SIZEOF_HEADER) == SIZEOF_HEADER &&
+            !strncmp(header.magic, "PUMPER", 8) && calculate_checksum(&header) == 0;
+        if (!is_header_valid)
+        {
+            close(scrub_fd);
+            RETURN_CORRUPTION("Header checksum mismatch");
+        }
+
+        if (header.flags & HEADER_COMPRESSED)
+        {
+            ExtentMap extent_map(scrub_fd);
+            Status status = extent_map.Load();
+            if (status == STATUS_SUCCESS)
+                status = extent_map.Verify(header.alloc_pages, bad_pages);
+            close(scrub_fd);
+            return status;
+        }
+
+        bad_pages.clear();
+        for (int32_t page_id = 0; page_id < header.alloc_pages; page_id++)
+        {
+            PageTrailer trailer;
+            ssize_t length = pread(scrub_fd, page, PHYSICAL_PAGE_SIZE, PageIo::PageOffset(page_id));
+            memcpy(&trailer, page + PAGE_SIZE, PAGE_TRAILER_SIZE);
+            if (length != PHYSICAL_PAGE_SIZE || !PageIo::VerifyPage(page_id, page, trailer))
+                bad_pages.push_back(page_id);
+        }
+        close(scrub_fd);
         RETURN_SUCCESS();
     }
 
@@ -74,7 +118,33 @@ namespace Pumper {
         header_length = read(fd, &header_content, SIZEOF_HEADER);
         ERROR_ASSERT(header_length == SIZEOF_HEADER);
         ERROR_ASSERT(!strncmp(header_content.magic, "PUMPER", 8));
-        // ERROR_ASSERT(calculate_checksum(&header_content) == 0xffff);
+        if (calculate_checksum(&header_content) != 0)
+        {
+            close(fd);
+            fd = INVALID_FD;
+            RETURN_CORRUPTION("Header checksum mismatch");
+        }
+
+        // Pages of an interrupted batch are restored before anyone reads them.
+        if (header_content.flags & HEADER_DOUBLE_WRITE)
+        {
+            int32_t num_restored;
+            journal_fd = open((file + ".DW").c_str(), O_RDWR | O_CREAT, 0664);
+            ERROR_ASSERT(journal_fd >= 0);
+            RETHROW_ON_EXCEPTION(PageIo::RecoverJournal(fd, journal_fd, num_restored));
+            Singleton<Buffer>::Instance().SetJournal(fd, journal_fd);
+        }
+        if (header_content.flags & HEADER_COMPRESSED)
+        {
+            Status status = Singleton<Buffer>::Instance().SetCompressed(fd, true);
+            if (!(status == STATUS_SUCCESS))
+            {
+                close(fd);
+                fd = INVALID_FD;
+                return status;
+            }
+        }
+
         is_file_opened = true;
         is_header_dirty = false;
         RETURN_SUCCESS();
@@ -84,17 +154,17 @@ namespace Pumper {
     {
         WARNING_ASSERT(is_file_opened);
         RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().FlushPages(fd));
+        RETHROW_ON_EXCEPTION(write_header());
 
-        if (is_header_dirty)
+        if (journal_fd != INVALID_FD)
         {
-            header_content.checksum = 0;
-            // header_content.checksum = calculate_checksum(&header_content);
-            int32_t header_length;
-            lseek(fd, 0, SEEK_SET);
-            header_length = write(fd, &header_content, SIZEOF_HEADER);
-            ERROR_ASSERT(header_length == SIZEOF_HEADER);
-
-            is_header_dirty = false;
+            Singleton<Buffer>::Instance().SetJournal(fd, INVALID_FD);
+            close(journal_fd);
+            journal_fd = INVALID_FD;
+        }
+        if (header_content.flags & HEADER_COMPRESSED)
+        {
+            RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().SetCompressed(fd, false));
         }
 
         close(fd);
@@ -107,6 +177,7 @@ namespace Pumper {
     {
         int8_t * raw_page;
         WARNING_ASSERT(is_file_opened);
+        Statistics::Tick(PageAllocations);
         // if there is a free page, reuse it.
         if (header_content.free_list_head == INVALID_PAGE_ID)
         {
@@ -115,6 +186,9 @@ namespace Pumper {
             memset(raw_page, 0, PAGE_SIZE);
             page_id = header_content.alloc_pages;
             header_content.alloc_pages++;
+            // The page is past the end of the file until written back, so it
+            // must not be dropped like a clean page and read again.
+            RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().MarkDirty(fd, page_id));
         }
         else
         {
@@ -130,13 +204,18 @@ namespace Pumper {
         RETURN_SUCCESS();
     }
 
-    Status PagedFile::ReleasePage(int32_t page_id)
+    Status PagedFile::ReleasePage(int32_t page_id, bool read_physical_page)
     {
         int8_t * raw_page;
         WARNING_ASSERT(is_file_opened);
         WARNING_ASSERT(page_id >= 0 && page_id < header_content.alloc_pages);
-        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().FetchPage(fd, page_id, &raw_page));
+        Statistics::Tick(PageReleases);
+        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().FetchPage(fd, page_id, &raw_page,
+            read_physical_page));
+        if (!read_physical_page)
+            memset(raw_page, 0, PAGE_SIZE);
          *(int32_t *) raw_page = header_content.free_list_head;
+        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().MarkDirty(fd, page_id));
         RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().UnpinPage(fd, page_id));
         header_content.free_list_head = page_id;
 
@@ -145,16 +224,50 @@ namespace Pumper {
     }
     
 
-    Status PagedFile::FetchPage(int32_t page_id, int8_t** raw_page)
+    Status PagedFile::ResetFreeSpace(int32_t alloc_pages, int32_t free_list_head)
+    {
+        WARNING_ASSERT(is_file_opened);
+        WARNING_ASSERT(alloc_pages >= 0 && free_list_head < alloc_pages);
+        header_content.alloc_pages = alloc_pages;
+        header_content.free_list_head = free_list_head;
+        is_header_dirty = true;
+        RETURN_SUCCESS();
+    }
+
+    int32_t PagedFile::GetFreeListHead() const
+    {
+        return header_content.free_list_head;
+    }
+
+    Status PagedFile::FetchPage(int32_t page_id, int8_t** raw_page, bool read_physical_page)
     {
         WARNING_ASSERT(is_file_opened);
         WARNING_ASSERT(page_id >= 0 && page_id < header_content.alloc_pages);
         //int8_t * raw_page;
-        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().FetchPage(fd, page_id, raw_page));
+        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().FetchPage(fd, page_id, raw_page,
+            read_physical_page));
         // page.OpenPage(page_id, *raw_page);
         RETURN_SUCCESS();
     }
 
+    Status PagedFile::FetchPageAsync(int32_t page_id, const PageFetchCallback& callback)
+    {
+        WARNING_ASSERT(is_file_opened);
+        WARNING_ASSERT(page_id >= 0 && page_id < header_content.alloc_pages);
+        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().FetchPageAsync(fd, page_id, callback));
+        RETURN_SUCCESS();
+    }
+
+    Status PagedFile::Prefetch(int32_t first_page, int32_t num_pages)
+    {
+        WARNING_ASSERT(is_file_opened);
+        num_pages = std::min(num_pages, header_content.alloc_pages - first_page);
+        if (first_page < 0 || num_pages <= 0)
+            RETURN_SUCCESS();
+        RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().Prefetch(fd, first_page, num_pages));
+        RETURN_SUCCESS();
+    }
+
     Status PagedFile::MarkDirty(int32_t page_id)
     {
         WARNING_ASSERT(is_file_opened);
@@ -176,19 +289,15 @@ namespace Pumper {
         WARNING_ASSERT(is_file_opened);
         WARNING_ASSERT(page_id == ALL_PAGES || (page_id >= 0 && page_id < header_content.alloc_pages));
         RETHROW_ON_EXCEPTION(Singleton<Buffer>::Instance().ForcePage(fd, page_id));
+        RETHROW_ON_EXCEPTION(write_header());
+        RETURN_SUCCESS();
+    }
 
-        if (is_header_dirty)
-        {
-            header_content.checksum = 0;
-            // header_content.checksum = calculate_checksum(&header_content);
-            int32_t header_length;
-            lseek(fd, 0, SEEK_SET);
-            header_length = write(fd, &header_content, SIZEOF_HEADER);
-            ERROR_ASSERT(header_length == SIZEOF_HEADER);
-
-            is_header_dirty = false;
-        }
-
+    Status PagedFile::Sync()
+    {
+        WARNING_ASSERT(is_file_opened);
+        if (fdatasync(fd) < 0)
+            RETURN_WARNING("fdatasync() of a paged file failed");
         RETURN_SUCCESS();
     }
 
@@ -208,6 +317,24 @@ namespace Pumper {
         RETURN_SUCCESS();
     }
 
+    Status PagedFile::SetKeyHash(int8_t key_hash)
+    {
+        WARNING_ASSERT(is_file_opened);
+        header_content.key_hash = key_hash;
+        is_header_dirty = true;
+        RETURN_SUCCESS();
+    }
+
+    int8_t PagedFile::GetKeyHash() const
+    {
+        return header_content.key_hash;
+    }
+
+    int8_t PagedFile::GetFlags() const
+    {
+        return header_content.flags;
+    }
+
     bool PagedFile::IsFileOpened() const
     {
         return is_file_opened;
@@ -218,6 +345,22 @@ namespace Pumper {
         return header_content.alloc_pages;
     }
 
+    Status PagedFile::write_header()
+    {
+        if (!is_header_dirty)
+            RETURN_SUCCESS();
+
+        header_content.checksum = 0;
+        header_content.checksum = calculate_checksum(&header_content);
+        int32_t header_length;
+        lseek(fd, 0, SEEK_SET);
+        header_length = write(fd, &header_content, SIZEOF_HEADER);
+        ERROR_ASSERT(header_length == SIZEOF_HEADER);
+
+        is_header_dirty = false;
+        RETURN_SUCCESS();
+    }
+
     uint16_t PagedFile::calculate_checksum(Header *hdr)
     {
         uint16_t *reinterpret = (uint16_t *) hdr;
@@ -0,0 +1,149 @@
+// Snapshot.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Consistent read views of an Engine, implemented with an in-memory undo
+// log of record pre-images.
+
+#include "Snapshot.h"
+
+#include <set>
+
+namespace Pumper {
+    VersionLog::VersionLog() : sequence(0)
+    {
+
+    }
+
+    VersionLog::~VersionLog()
+    {
+        std::list<Snapshot *>::iterator it;
+        for (it = snapshots.begin(); it != snapshots.end(); ++it)
+            delete *it;
+    }
+
+    Snapshot * VersionLog::CreateSnapshot()
+    {
+        LockGuard lock_guard(mutex);
+        Snapshot * snapshot = new Snapshot(sequence);
+        snapshots.push_back(snapshot);
+        return snapshot;
+    }
+
+    Status VersionLog::ReleaseSnapshot(Snapshot * snapshot)
+    {
+        LockGuard lock_guard(mutex);
+        std::list<Snapshot *>::iterator it;
+        for (it = snapshots.begin(); it != snapshots.end(); ++it)
+            if (*it == snapshot)
+                break;
+
+        WARNING_ASSERT(it != snapshots.end());
+        snapshots.erase(it);
+        delete snapshot;
+        purge();
+        RETURN_SUCCESS();
+    }
+
+    bool VersionLog::HasSnapshots()
+    {
+        LockGuard lock_guard(mutex);
+        return !snapshots.empty();
+    }
+
+    void VersionLog::Record(const String& key, bool existed, const String& old_value)
+    {
+        LockGuard lock_guard(mutex);
+        sequence++;
+        if (snapshots.empty())
+            return;
+
+        // Only the first pre-image after each snapshot is observable. If the key
+        // was already overwritten after the newest snapshot, nobody can see
+        // the image we are about to lose.
+        std::vector<Version>& chain = versions[key];
+        if (!chain.empty() && chain.back().sequence > snapshots.back()->sequence)
+            return;
+
+        Version version;
+        version.sequence = sequence;
+        version.existed = existed;
+        if (existed)
+            version.value = old_value;
+        chain.push_back(version);
+    }
+
+    VersionVisibility VersionLog::Lookup(const Snapshot * snapshot, const String& key, String& value)
+    {
+        LockGuard lock_guard(mutex);
+        std::map<String, std::vector<Version> >::iterator it = versions.find(key);
+        if (it == versions.end())
+            return VersionLive;
+
+        std::vector<Version>& chain = it->second;
+        for (uint32_t i = 0; i < chain.size(); i++)
+        {
+            if (chain[i].sequence > snapshot->sequence)
+            {
+                if (!chain[i].existed)
+                    return VersionAbsent;
+                value = chain[i].value;
+                return VersionPresent;
+            }
+        }
+        return VersionLive;
+    }
+
+    void VersionLog::MergeKeys(const Snapshot * snapshot, std::vector<String>& keys)
+    {
+        // A key may be seen twice if it moved between pages during the scan.
+        std::set<String> key_set(keys.begin(), keys.end());
+
+        {
+            LockGuard lock_guard(mutex);
+            std::map<String, std::vector<Version> >::iterator it;
+            for (it = versions.begin(); it != versions.end(); ++it)
+            {
+                std::vector<Version>& chain = it->second;
+                for (uint32_t i = 0; i < chain.size(); i++)
+                {
+                    if (chain[i].sequence > snapshot->sequence)
+                    {
+                        if (chain[i].existed)
+                            key_set.insert(it->first);
+                        else
+                            key_set.erase(it->first);
+                        break;
+                    }
+                }
+            }
+        }
+
+        keys.assign(key_set.begin(), key_set.end());
+    }
+
+    void VersionLog::purge()
+    {
+        if (snapshots.empty())
+        {
+            versions.clear();
+            return;
+        }
+
+        uint64_t oldest = snapshots.front()->sequence;
+        std::map<String, std::vector<Version> >::iterator it = versions.begin();
+        while (it != versions.end())
+        {
+            std::vector<Version>& chain = it->second;
+            uint32_t keep = 0;
+            while (keep < chain.size() && chain[keep].sequence <= oldest)
+                keep++;
+            chain.erase(chain.begin(), chain.begin() + keep);
+
+            if (chain.empty())
+                versions.erase(it++);
+            else
+                ++it;
+        }
+    }
+
+} // namespace Pumper
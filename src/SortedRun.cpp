@@ -0,0 +1,313 @@
+// SortedRun.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Immutable file of key/value records sorted by key.
+
+#include "SortedRun.h"
+#include "PageHandle.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Pumper {
+    static int32_t encode_record(int8_t * dst, const String& key, const String& value, bool is_deleted)
+    {
+        uint16_t key_length = key.size(), value_length = value.size();
+        memcpy(dst, &key_length, 2);
+        memcpy(dst + 2, &value_length, 2);
+        dst[4] = is_deleted ? 1 : 0;
+        memcpy(dst + RUN_RECORD_OVERHEAD, key.data(), key_length);
+        memcpy(dst + RUN_RECORD_OVERHEAD + key_length, value.data(), value_length);
+        return RUN_RECORD_OVERHEAD + key_length + value_length;
+    }
+
+    static int32_t decode_record(const int8_t * src, String& key, String& value, bool& is_deleted)
+    {
+        uint16_t key_length, value_length;
+        memcpy(&key_length, src, 2);
+        memcpy(&value_length, src + 2, 2);
+        is_deleted = src[4] != 0;
+        key.assign(src + RUN_RECORD_OVERHEAD, key_length);
+        value.assign(src + RUN_RECORD_OVERHEAD + key_length, value_length);
+        return RUN_RECORD_OVERHEAD + key_length + value_length;
+    }
+
+    SortedRun::SortedRun() : is_obsolete(false)
+    {
+
+    }
+
+    SortedRun::~SortedRun()
+    {
+        if (paged_file.IsFileOpened())
+            Close();
+        if (is_obsolete)
+            PagedFile::Unlink(file_name);
+    }
+
+    Status SortedRun::Open(const String& file)
+    {
+        int32_t index_page;
+        int8_t buffer[PAGE_SIZE];
+
+        RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
+        file_name = file;
+        fence_keys.clear();
+        fence_pages.clear();
+
+        RETHROW_ON_EXCEPTION(paged_file.GetRootPage(index_page));
+        while (index_page != INVALID_PAGE_ID)
+        {
+            RETHROW_ON_EXCEPTION(read_page(index_page, buffer));
+            RunPageHeader * header = (RunPageHeader *) buffer;
+            int32_t offset = sizeof(RunPageHeader);
+            for (int16_t i = 0; i < header->count; i++)
+            {
+                int32_t page_id;
+                uint16_t key_length;
+                memcpy(&page_id, buffer + offset, 4);
+                memcpy(&key_length, buffer + offset + 4, 2);
+                fence_pages.push_back(page_id);
+                fence_keys.push_back(String(buffer + offset + 6, key_length));
+                offset += 6 + key_length;
+            }
+            index_page = header->next;
+        }
+        RETURN_SUCCESS();
+    }
+
+    Status SortedRun::Close()
+    {
+        RETHROW_ON_EXCEPTION(paged_file.Close());
+        RETURN_SUCCESS();
+    }
+
+    void SortedRun::MarkObsolete()
+    {
+        is_obsolete = true;
+    }
+
+    bool SortedRun::Get(const String& key, String& value, bool& is_deleted)
+    {
+        // The page whose first key is the greatest one not above key
+        std::vector<String>::iterator it = std::upper_bound(fence_keys.begin(), fence_keys.end(), key);
+        if (it == fence_keys.begin())
+            return false;
+
+        int8_t buffer[PAGE_SIZE];
+        if (!(read_page(fence_pages[it - fence_keys.begin() - 1], buffer) == STATUS_SUCCESS))
+            return false;
+
+        RunPageHeader * header = (RunPageHeader *) buffer;
+        int32_t offset = sizeof(RunPageHeader);
+        String record_key, record_value;
+        bool record_deleted;
+        for (int16_t i = 0; i < header->count; i++)
+        {
+            offset += decode_record(buffer + offset, record_key, record_value, record_deleted);
+            if (record_key == key)
+            {
+                value = record_value;
+                is_deleted = record_deleted;
+                return true;
+            }
+            if (record_key > key)
+                break;
+        }
+        return false;
+    }
+
+    int32_t SortedRun::NumPages() const
+    {
+        return (int32_t) fence_pages.size();
+    }
+
+    const String& SortedRun::FileName() const
+    {
+        return file_name;
+    }
+
+    Status SortedRun::read_page(int32_t page_id, int8_t * buffer)
+    {
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, page_id));
+        RETHROW_ON_EXCEPTION(ph.Read(buffer, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+        RETURN_SUCCESS();
+    }
+
+    SortedRun::Iterator::Iterator(SortedRun * run) : run(run), fence(0), record(0), offset(0)
+    {
+        load_page();
+    }
+
+    SortedRun::Iterator::Iterator(SortedRun * run, const String& start) : run(run), fence(0),
+        record(0), offset(0)
+    {
+        // The page whose first key is the greatest one not above start
+        std::vector<String>::iterator it = std::upper_bound(run->fence_keys.begin(), 
+            run->fence_keys.end(), start);
+        if (it != run->fence_keys.begin())
+            fence = it - run->fence_keys.begin() - 1;
+        load_page();
+        while (Valid() && key < start)
+            Next();
+    }
+
+    bool SortedRun::Iterator::Valid() const
+    {
+        return fence < (int32_t) run->fence_pages.size();
+    }
+
+    void SortedRun::Iterator::Next()
+    {
+        record++;
+        if (record >= ((RunPageHeader *) page)->count)
+        {
+            fence++;
+            load_page();
+        }
+        else
+            decode();
+    }
+
+    void SortedRun::Iterator::load_page()
+    {
+        // Skip pages that can not be read rather than looping forever
+        while (Valid())
+        {
+            if (run->read_page(run->fence_pages[fence], page) == STATUS_SUCCESS && 
+                ((RunPageHeader *) page)->count > 0)
+                break;
+            fence++;
+        }
+
+        record = 0;
+        offset = sizeof(RunPageHeader);
+        if (Valid())
+            decode();
+    }
+
+    void SortedRun::Iterator::decode()
+    {
+        offset += decode_record(page + offset, key, value, is_deleted);
+    }
+
+    SortedRunBuilder::SortedRunBuilder()
+    {
+        memset(page, 0, PAGE_SIZE);
+        page_header = (RunPageHeader *) page;
+        page_header->used = sizeof(RunPageHeader);
+        page_header->next = INVALID_PAGE_ID;
+    }
+
+    SortedRunBuilder::~SortedRunBuilder()
+    {
+        if (paged_file.IsFileOpened())
+            paged_file.Close();
+    }
+
+    Status SortedRunBuilder::Open(const String& file)
+    {
+        RETHROW_ON_EXCEPTION(PagedFile::Create(file));
+        RETHROW_ON_EXCEPTION(paged_file.OpenFile(file));
+        RETURN_SUCCESS();
+    }
+
+    Status SortedRunBuilder::Add(const String& key, const String& value, bool is_deleted)
+    {
+        int32_t length = RUN_RECORD_OVERHEAD + key.size() + value.size();
+        WARNING_ASSERT(length <= RUN_MAX_RECORD);
+
+        if (page_header->used + length > PAGE_SIZE)
+            RETHROW_ON_EXCEPTION(flush_page());
+
+        if (page_header->count == 0)
+            first_key = key;
+        page_header->used += encode_record(page + page_header->used, key, value, is_deleted);
+        page_header->count++;
+        RETURN_SUCCESS();
+    }
+
+    Status SortedRunBuilder::Finish()
+    {
+        if (page_header->count > 0)
+            RETHROW_ON_EXCEPTION(flush_page());
+        RETHROW_ON_EXCEPTION(write_index());
+        RETHROW_ON_EXCEPTION(paged_file.Close());
+        RETURN_SUCCESS();
+    }
+
+    int32_t SortedRunBuilder::NumPages() const
+    {
+        return (int32_t) fence_pages.size();
+    }
+
+    Status SortedRunBuilder::flush_page()
+    {
+        int32_t page_id;
+        PageHandle ph;
+        RETHROW_ON_EXCEPTION(paged_file.AllocatePage(page_id));
+        RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, page_id));
+        RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE));
+        RETHROW_ON_EXCEPTION(ph.ClosePage());
+
+        fence_keys.push_back(first_key);
+        fence_pages.push_back(page_id);
+
+        memset(page, 0, PAGE_SIZE);
+        page_header->used = sizeof(RunPageHeader);
+        page_header->next = INVALID_PAGE_ID;
+        RETURN_SUCCESS();
+    }
+
+    Status SortedRunBuilder::write_index()
+    {
+        // Work out how the fence keys split into index pages first. The index
+        // pages are then allocated together after all data pages, so the
+        // successor of each one is simply the next page id.
+        std::vector<int32_t> first_entry;
+        int32_t used = PAGE_SIZE;
+        for (uint32_t i = 0; i < fence_keys.size(); i++)
+        {
+            int32_t length = 6 + fence_keys[i].size();
+            if (used + length > PAGE_SIZE)
+            {
+                first_entry.push_back(i);
+                used = sizeof(RunPageHeader);
+            }
+            used += length;
+        }
+
+        int32_t base_page = paged_file.GetTotalPages(), page_id;
+        for (uint32_t i = 0; i < first_entry.size(); i++)
+            RETHROW_ON_EXCEPTION(paged_file.AllocatePage(page_id));
+
+        for (uint32_t n = 0; n < first_entry.size(); n++)
+        {
+            uint32_t end = (n + 1 < first_entry.size()) ? first_entry[n + 1] : fence_keys.size();
+            memset(page, 0, PAGE_SIZE);
+            page_header->used = sizeof(RunPageHeader);
+            page_header->next = (n + 1 < first_entry.size()) ? base_page + n + 1 : INVALID_PAGE_ID;
+            for (uint32_t i = first_entry[n]; i < end; i++)
+            {
+                uint16_t key_length = fence_keys[i].size();
+                memcpy(page + page_header->used, &fence_pages[i], 4);
+                memcpy(page + page_header->used + 4, &key_length, 2);
+                memcpy(page + page_header->used + 6, fence_keys[i].data(), key_length);
+                page_header->used += 6 + key_length;
+                page_header->count++;
+            }
+
+            PageHandle ph;
+            RETHROW_ON_EXCEPTION(ph.OpenPage(paged_file, base_page + n));
+            RETHROW_ON_EXCEPTION(ph.Write(page, PAGE_SIZE));
+            RETHROW_ON_EXCEPTION(ph.ClosePage());
+        }
+
+        if (!first_entry.empty())
+            RETHROW_ON_EXCEPTION(paged_file.SetRootPage(base_page));
+        RETURN_SUCCESS();
+    }
+
+} // namespace Pumper
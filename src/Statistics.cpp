@@ -0,0 +1,468 @@
+// Statistics.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Process wide runtime statistics with per-thread recording blocks.
+
+#include "Statistics.h"
+#include "Singleton.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace Pumper {
+    static const char * ticker_names[] = {
+        "buffer_hits",
+        "buffer_misses",
+        "buffer_evictions",
+        "buffer_dirty_evictions",
+        "buffer_prefetches",
+        "buffer_background_writes",
+        "buffer_checkpoints",
+        "page_reads",
+        "page_writes",
+        "page_journal_writes",
+        "page_checksum_failures",
+        "page_compressed_bytes",
+        "pages_restored",
+        "page_allocations",
+        "page_releases",
+        "btree_splits",
+        "btree_merges",
+        "hash_index_splits",
+        "buffered_index_flushes",
+        "engine_collision_fallbacks",
+        "engine_filter_negatives",
+        "engine_cache_hits",
+        "engine_cache_misses",
+        "network_connections",
+        "network_commands",
+        "network_errors",
+    };
+
+    static const char * gauge_names[] = {
+        "btree_depth",
+    };
+
+    static const char * histogram_names[] = {
+        "page_read_latency",
+        "page_write_latency",
+        "engine_get_latency",
+        "engine_put_latency",
+        "engine_remove_latency",
+        "command_put_latency",
+        "command_get_latency",
+        "command_remove_latency",
+        "command_list_latency",
+        "command_scan_latency",
+        "command_stats_latency",
+    };
+
+    static_assert(sizeof(ticker_names) / sizeof(ticker_names[0]) == NUM_TICKERS,
+        "ticker_names out of sync with Ticker");
+    static_assert(sizeof(gauge_names) / sizeof(gauge_names[0]) == NUM_GAUGES,
+        "gauge_names out of sync with Gauge");
+    static_assert(sizeof(histogram_names) / sizeof(histogram_names[0]) == NUM_HISTOGRAMS,
+        "histogram_names out of sync with HistogramType");
+
+    HistogramData::HistogramData() : buckets(HISTOGRAM_BUCKETS, 0), count(0), sum(0), max(0)
+    {
+
+    }
+
+    void HistogramData::Add(int32_t bucket, uint64_t count)
+    {
+        buckets[bucket] += count;
+        this->count += count;
+    }
+
+    void HistogramData::Merge(const HistogramData& that)
+    {
+        for (int32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            buckets[i] += that.buckets[i];
+        count += that.count;
+        sum += that.sum;
+        max = std::max(max, that.max);
+    }
+
+    double HistogramData::Average() const
+    {
+        return count ? (double) sum / count : 0.0;
+    }
+
+    uint64_t HistogramData::Percentile(double quantile) const
+    {
+        if (!count)
+            return 0;
+
+        uint64_t rank = (uint64_t) (quantile * count + 0.5);
+        rank = std::max(rank, (uint64_t) 1);
+        uint64_t seen = 0;
+        for (int32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+                return std::min(BucketLimit(i), max);
+        }
+        return max;
+    }
+
+    int32_t HistogramData::BucketOf(uint64_t value)
+    {
+        const uint64_t sub_count = 1ull << HISTOGRAM_SUB_BITS;
+        if (value < sub_count)
+            return (int32_t) value;
+
+        // Position of the highest bit picks the group, the bits just below
+        // it the bucket inside the group.
+        int32_t shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+        return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int32_t) ((value >> shift) & (sub_count - 1));
+    }
+
+    uint64_t HistogramData::BucketLimit(int32_t bucket)
+    {
+        const uint64_t sub_count = 1ull << HISTOGRAM_SUB_BITS;
+        if (bucket < (int32_t) sub_count)
+            return bucket;
+
+        int32_t shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+        uint64_t lower = (sub_count + (bucket & (sub_count - 1))) << shift;
+        return lower + ((1ull << shift) - 1);
+    }
+
+    // Written by its owner thread only (except for Reset), read by anyone.
+    struct Statistics::ThreadBlock {
+        struct Histogram {
+            std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+            std::atomic<uint64_t> sum;
+            std::atomic<uint64_t> max;
+        };
+
+        ThreadBlock()
+        {
+            Clear();
+        }
+
+        void Clear()
+        {
+            for (int32_t i = 0; i < NUM_TICKERS; i++)
+                tickers[i].store(0, std::memory_order_relaxed);
+            for (int32_t i = 0; i < NUM_HISTOGRAMS; i++)
+            {
+                for (int32_t j = 0; j < HISTOGRAM_BUCKETS; j++)
+                    histograms[i].buckets[j].store(0, std::memory_order_relaxed);
+                histograms[i].sum.store(0, std::memory_order_relaxed);
+                histograms[i].max.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void MergeInto(ThreadBlock * that)
+        {
+            for (int32_t i = 0; i < NUM_TICKERS; i++)
+                that->tickers[i].fetch_add(tickers[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            for (int32_t i = 0; i < NUM_HISTOGRAMS; i++)
+            {
+                Histogram& from = histograms[i];
+                Histogram& to = that->histograms[i];
+                for (int32_t j = 0; j < HISTOGRAM_BUCKETS; j++)
+                    to.buckets[j].fetch_add(from.buckets[j].load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+                to.sum.fetch_add(from.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                uint64_t max = from.max.load(std::memory_order_relaxed);
+                if (max > to.max.load(std::memory_order_relaxed))
+                    to.max.store(max, std::memory_order_relaxed);
+            }
+        }
+
+        void ReadHistogram(int32_t type, HistogramData& data)
+        {
+            Histogram& histogram = histograms[type];
+            for (int32_t j = 0; j < HISTOGRAM_BUCKETS; j++)
+            {
+                uint64_t count = histogram.buckets[j].load(std::memory_order_relaxed);
+                if (count)
+                    data.Add(j, count);
+            }
+            data.sum += histogram.sum.load(std::memory_order_relaxed);
+            data.max = std::max(data.max, histogram.max.load(std::memory_order_relaxed));
+        }
+
+        std::atomic<uint64_t> tickers[NUM_TICKERS];
+        Histogram histograms[NUM_HISTOGRAMS];
+    };
+
+    // Set once the singleton is gone at exit; threads still running, such as
+    // I/O threads of other singletons, then record into a discarded block.
+    static std::atomic<bool> is_shut_down(false);
+
+    // Hands the block of an exiting thread back, so its counts survive it.
+    struct Statistics::BlockHolder {
+        BlockHolder() : block(NULL) { }
+
+        ~BlockHolder()
+        {
+            if (block && !is_shut_down.load())
+                Singleton<Statistics>::Instance().retire_block(block);
+        }
+
+        ThreadBlock * block;
+    };
+
+    Statistics::Statistics() : retired(new ThreadBlock()), dumper_cond(dumper_mutex),
+        dumper_thread(NULL), dumper_interval(0), is_dumper_stopping(false)
+    {
+        for (int32_t i = 0; i < NUM_GAUGES; i++)
+            gauges[i].store(0, std::memory_order_relaxed);
+    }
+
+    Statistics::~Statistics()
+    {
+        is_shut_down.store(true);
+        StopDumper();
+        // Blocks of threads still running at exit are left to them.
+        delete retired;
+    }
+
+    Statistics::ThreadBlock * Statistics::local_block()
+    {
+        static thread_local BlockHolder holder;
+        if (is_shut_down.load(std::memory_order_relaxed))
+        {
+            static ThreadBlock * discarded = new ThreadBlock();
+            return discarded;
+        }
+        if (!holder.block)
+        {
+            holder.block = new ThreadBlock();
+            Singleton<Statistics>::Instance().register_block(holder.block);
+        }
+        return holder.block;
+    }
+
+    void Statistics::register_block(ThreadBlock * block)
+    {
+        LockGuard lock_guard(mutex);
+        blocks.push_back(block);
+    }
+
+    void Statistics::retire_block(ThreadBlock * block)
+    {
+        LockGuard lock_guard(mutex);
+        block->MergeInto(retired);
+        blocks.erase(std::find(blocks.begin(), blocks.end(), block));
+        delete block;
+    }
+
+    void Statistics::Tick(Ticker ticker, uint64_t count)
+    {
+        local_block()->tickers[ticker].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void Statistics::SetGauge(Gauge gauge, int64_t value)
+    {
+        Singleton<Statistics>::Instance().gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+
+    void Statistics::Record(HistogramType type, uint64_t value)
+    {
+        ThreadBlock::Histogram& histogram = local_block()->histograms[type];
+        histogram.buckets[HistogramData::BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        histogram.sum.fetch_add(value, std::memory_order_relaxed);
+        if (value > histogram.max.load(std::memory_order_relaxed))
+            histogram.max.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Statistics::GetTicker(Ticker ticker)
+    {
+        LockGuard lock_guard(mutex);
+        uint64_t count = retired->tickers[ticker].load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < blocks.size(); i++)
+            count += blocks[i]->tickers[ticker].load(std::memory_order_relaxed);
+        return count;
+    }
+
+    int64_t Statistics::GetGauge(Gauge gauge)
+    {
+        return gauges[gauge].load(std::memory_order_relaxed);
+    }
+
+    HistogramData Statistics::GetHistogram(HistogramType type)
+    {
+        LockGuard lock_guard(mutex);
+        HistogramData data;
+        retired->ReadHistogram(type, data);
+        for (uint32_t i = 0; i < blocks.size(); i++)
+            blocks[i]->ReadHistogram(type, data);
+        return data;
+    }
+
+    void Statistics::Reset()
+    {
+        LockGuard lock_guard(mutex);
+        retired->Clear();
+        for (uint32_t i = 0; i < blocks.size(); i++)
+            blocks[i]->Clear();
+        for (int32_t i = 0; i < NUM_GAUGES; i++)
+            gauges[i].store(0, std::memory_order_relaxed);
+    }
+
+    const char * Statistics::TickerName(Ticker ticker)
+    {
+        return ticker_names[ticker];
+    }
+
+    const char * Statistics::GaugeName(Gauge gauge)
+    {
+        return gauge_names[gauge];
+    }
+
+    const char * Statistics::HistogramName(HistogramType type)
+    {
+        return histogram_names[type];
+    }
+
+    static bool has_prefix(const char * name, const String& prefix)
+    {
+        return strncmp(name, prefix.c_str(), prefix.size()) == 0;
+    }
+
+    String Statistics::ToString(const String& prefix)
+    {
+        String output;
+        char line[256];
+        for (int32_t i = 0; i < NUM_TICKERS; i++)
+        {
+            if (!has_prefix(ticker_names[i], prefix))
+                continue;
+            sprintf(line, "%s %llu\n", ticker_names[i], GetTicker((Ticker) i));
+            output += line;
+        }
+
+        for (int32_t i = 0; i < NUM_GAUGES; i++)
+        {
+            if (!has_prefix(gauge_names[i], prefix))
+                continue;
+            sprintf(line, "%s %lld\n", gauge_names[i], GetGauge((Gauge) i));
+            output += line;
+        }
+
+        // Latencies in microseconds; histograms never recorded are left out.
+        for (int32_t i = 0; i < NUM_HISTOGRAMS; i++)
+        {
+            if (!has_prefix(histogram_names[i], prefix))
+                continue;
+            HistogramData data = GetHistogram((HistogramType) i);
+            if (!data.Count())
+                continue;
+            sprintf(line, "%s count=%llu avg=%.1f p50=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+                histogram_names[i], data.Count(), data.Average() / 1e3,
+                data.Percentile(0.5) / 1e3, data.Percentile(0.99) / 1e3,
+                data.Percentile(0.999) / 1e3, data.Max() / 1e3);
+            output += line;
+        }
+        return output;
+    }
+
+    String Statistics::ToPrometheus()
+    {
+        String output;
+        char line[256];
+        for (int32_t i = 0; i < NUM_TICKERS; i++)
+        {
+            sprintf(line, "# TYPE pumper_%s_total counter\npumper_%s_total %llu\n",
+                ticker_names[i], ticker_names[i], GetTicker((Ticker) i));
+            output += line;
+        }
+
+        for (int32_t i = 0; i < NUM_GAUGES; i++)
+        {
+            sprintf(line, "# TYPE pumper_%s gauge\npumper_%s %lld\n",
+                gauge_names[i], gauge_names[i], GetGauge((Gauge) i));
+            output += line;
+        }
+
+        static const double quantiles[] = { 0.5, 0.99, 0.999 };
+        for (int32_t i = 0; i < NUM_HISTOGRAMS; i++)
+        {
+            HistogramData data = GetHistogram((HistogramType) i);
+            const char * name = histogram_names[i];
+            sprintf(line, "# TYPE pumper_%s_seconds summary\n", name);
+            output += line;
+            for (uint32_t j = 0; j < sizeof(quantiles) / sizeof(quantiles[0]); j++)
+            {
+                sprintf(line, "pumper_%s_seconds{quantile=\"%g\"} %.9f\n",
+                    name, quantiles[j], data.Percentile(quantiles[j]) / 1e9);
+                output += line;
+            }
+            sprintf(line, "pumper_%s_seconds_sum %.9f\npumper_%s_seconds_count %llu\n",
+                name, data.Sum() / 1e9, name, data.Count());
+            output += line;
+        }
+        return output;
+    }
+
+    Status Statistics::DumpPrometheus(const String& file)
+    {
+        String temp_file = file + ".tmp";
+        FILE * output = fopen(temp_file.c_str(), "w");
+        WARNING_ASSERT(output);
+
+        String content = ToPrometheus();
+        bool is_written = fwrite(content.c_str(), 1, content.size(), output) == content.size();
+        fclose(output);
+        if (!is_written)
+        {
+            unlink(temp_file.c_str());
+            RETURN_WARNING("Cannot write statistics");
+        }
+        WARNING_ASSERT(rename(temp_file.c_str(), file.c_str()) == 0);
+        RETURN_SUCCESS();
+    }
+
+    Status Statistics::StartDumper(const String& file, int32_t interval_seconds)
+    {
+        WARNING_ASSERT(interval_seconds > 0);
+        LockGuard lock_guard(dumper_mutex);
+        WARNING_ASSERT(!dumper_thread);
+        dumper_file = file;
+        dumper_interval = interval_seconds;
+        is_dumper_stopping = false;
+        dumper_thread = new Thread(std::bind(&Statistics::dumper_func, this), "stats_dumper");
+        RETHROW_ON_EXCEPTION(dumper_thread->Start());
+        RETURN_SUCCESS();
+    }
+
+    Status Statistics::StopDumper()
+    {
+        Thread * thread;
+        {
+            LockGuard lock_guard(dumper_mutex);
+            if (!dumper_thread)
+                RETURN_SUCCESS();
+            thread = dumper_thread;
+            is_dumper_stopping = true;
+            dumper_cond.NotifyAll();
+        }
+
+        thread->Join();
+        delete thread;
+
+        LockGuard lock_guard(dumper_mutex);
+        dumper_thread = NULL;
+        // A last dump, so the file reflects everything up to the stop.
+        RETHROW_ON_EXCEPTION(DumpPrometheus(dumper_file));
+        RETURN_SUCCESS();
+    }
+
+    void Statistics::dumper_func()
+    {
+        LockGuard lock_guard(dumper_mutex);
+        while (!is_dumper_stopping)
+        {
+            if (dumper_cond.Wait(dumper_interval) && !is_dumper_stopping)
+                DumpPrometheus(dumper_file);
+        }
+    }
+
+} // namespace Pumper
@@ -10,6 +10,7 @@
 #include "EventHandler.h"
 #include "Singleton.h"
 #include "Epoll.h"
+#include "Statistics.h"
 
 #include <functional>
 #include <memory>
@@ -50,6 +51,7 @@ namespace Pumper {
         client->SetReuseAddress();        
 
         printf("Notify: %s ARRIVAL\n", client->GetAddressPort().c_str());
+        Statistics::Tick(NetworkConnections);
         std::shared_ptr<TcpConnection> connection(
             new TcpConnection(client, callback_map[socket], this));
         connection_pool[client] = connection;
@@ -0,0 +1,124 @@
+// ValueCache.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Sharded LRU cache of decoded key/value pairs.
+
+#include "ValueCache.h"
+
+#include <functional>
+
+namespace Pumper {
+    ValueCache::ValueCache(size_t capacity, int32_t shards) : capacity(capacity), shards(shards)
+    {
+        ERROR_ASSERT(shards > 0);
+        shard_capacity = capacity / shards;
+        shard_list = new Shard[shards];
+        for (int32_t i = 0; i < shards; i++)
+            shard_list[i].usage = 0;
+    }
+
+    ValueCache::~ValueCache()
+    {
+        delete [] shard_list;
+    }
+
+    bool ValueCache::Lookup(const String& key, String& value)
+    {
+        Shard & shard = get_shard(key);
+        LockGuard lock_guard(shard.mutex);
+
+        std::unordered_map<String, LruList::iterator>::iterator it = shard.table.find(key);
+        if (it == shard.table.end())
+            return false;
+
+        // Move to the front of LRU list
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        value = it->second->value;
+        return true;
+    }
+
+    void ValueCache::Insert(const String& key, const String& value)
+    {
+        Shard & shard = get_shard(key);
+        LockGuard lock_guard(shard.mutex);
+        size_t charge = key.size() + value.size() + CACHE_ENTRY_OVERHEAD;
+
+        std::unordered_map<String, LruList::iterator>::iterator it = shard.table.find(key);
+        if (it != shard.table.end())
+        {
+            shard.usage -= it->second->charge;
+            shard.lru.erase(it->second);
+            shard.table.erase(it);
+        }
+
+        if (charge > shard_capacity)
+            return;
+
+        CacheEntry entry;
+        entry.key = key;
+        entry.value = value;
+        entry.charge = charge;
+        shard.lru.push_front(entry);
+        shard.table[key] = shard.lru.begin();
+        shard.usage += charge;
+        evict(shard);
+    }
+
+    void ValueCache::Erase(const String& key)
+    {
+        Shard & shard = get_shard(key);
+        LockGuard lock_guard(shard.mutex);
+
+        std::unordered_map<String, LruList::iterator>::iterator it = shard.table.find(key);
+        if (it == shard.table.end())
+            return;
+
+        shard.usage -= it->second->charge;
+        shard.lru.erase(it->second);
+        shard.table.erase(it);
+    }
+
+    void ValueCache::Clear()
+    {
+        for (int32_t i = 0; i < shards; i++)
+        {
+            LockGuard lock_guard(shard_list[i].mutex);
+            shard_list[i].lru.clear();
+            shard_list[i].table.clear();
+            shard_list[i].usage = 0;
+        }
+    }
+
+    size_t ValueCache::Capacity() const
+    {
+        return capacity;
+    }
+
+    size_t ValueCache::Usage()
+    {
+        size_t usage = 0;
+        for (int32_t i = 0; i < shards; i++)
+        {
+            LockGuard lock_guard(shard_list[i].mutex);
+            usage += shard_list[i].usage;
+        }
+        return usage;
+    }
+
+    ValueCache::Shard & ValueCache::get_shard(const String& key)
+    {
+        return shard_list[std::hash<String>()(key) % shards];
+    }
+
+    void ValueCache::evict(Shard & shard)
+    {
+        while (shard.usage > shard_capacity && !shard.lru.empty())
+        {
+            CacheEntry & victim = shard.lru.back();
+            shard.usage -= victim.charge;
+            shard.table.erase(victim.key);
+            shard.lru.pop_back();
+        }
+    }
+
+} // namespace Pumper
@@ -0,0 +1,342 @@
+// benchStorage.cpp
+// Part of PUMPER, copyright (C) 2015 Alogfans.
+//
+// Micro-benchmarks of the storage layers, each one measured in isolation:
+// buffer pool hits and misses, the buffer hash table, bucket operations by
+// key/value size, B+Tree insert and search by tree size, data file scans,
+// and the index key hashes (throughput and collisions). Every operation is timed on its own, and the results (throughput
+// and latency percentiles) are written out as JSON to track regressions.
+//
+// Usage: benchStorage [operations] [output.json]
+
+#include "Types.h"
+#include "Status.h"
+#include "PagedFile.h"
+#include "HashTable.h"
+#include "Bucket.h"
+#include "BTree.h"
+#include "DataFile.h"
+#include "KeyHash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+// Inside the namespace, so that its integer types win over the global ones.
+namespace Pumper {
+uint64_t now_nanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Latencies of one benchmark, in nanoseconds
+class Recorder {
+public:
+    Recorder(const String& name, const String& params) : name(name), params(params), elapsed(0) { }
+
+    void Start()
+    {
+        start = now_nanos();
+    }
+
+    void Stop()
+    {
+        uint64_t latency = now_nanos() - start;
+        samples.push_back(latency);
+        elapsed += latency;
+    }
+
+    void Report(FILE * output, bool is_first)
+    {
+        std::sort(samples.begin(), samples.end());
+        double seconds = elapsed / 1e9;
+        fprintf(output, "%s    {\"name\": \"%s\", \"params\": {%s}, \"ops\": %llu, "
+            "\"ops_per_sec\": %.1f, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+            "\"p999_ns\": %llu, \"max_ns\": %llu}",
+            is_first ? "" : ",\n", name.c_str(), params.c_str(),
+            (uint64_t) samples.size(), seconds > 0 ? samples.size() / seconds : 0.0,
+            percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+            samples.empty() ? 0 : samples.back());
+    }
+
+private:
+    uint64_t percentile(double fraction)
+    {
+        if (samples.empty())
+            return 0;
+        size_t index = (size_t) (fraction * samples.size());
+        return samples[std::min(index, samples.size() - 1)];
+    }
+
+    String name, params;
+    std::vector<uint64_t> samples;
+    uint64_t start, elapsed;
+};
+
+std::vector<Recorder *> results;
+
+Recorder * new_recorder(const String& name, const String& params)
+{
+    Recorder * recorder = new Recorder(name, params);
+    results.push_back(recorder);
+    return recorder;
+}
+
+String make_string(int32_t index, int32_t length)
+{
+    char buf[32];
+    sprintf(buf, "%d:", index);
+    String str(buf);
+    str.resize(std::max((int32_t) str.size(), length), 'x');
+    return str;
+}
+
+void bench_buffer(int32_t ops)
+{
+    PagedFile::Create("bench_buffer");
+    PagedFile pf;
+    pf.OpenFile("bench_buffer");
+
+    // Twice the pool size, so a sweep misses on every fetch. The sweep has
+    // a stride of 7 so that read ahead does not take it for a sequential
+    // scan. Pages are marked dirty so that they exist on disk once evicted.
+    int32_t num_pages = BUFFER_SIZE * 2;
+    int8_t * page;
+    for (int32_t i = 0; i < num_pages; i++)
+    {
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        pf.FetchPage(page_id, &page);
+        pf.MarkDirty(page_id);
+        pf.UnpinPage(page_id);
+    }
+
+    Recorder * hit = new_recorder("buffer_fetch_hit", "");
+    pf.FetchPage(0, &page);
+    pf.UnpinPage(0);
+    for (int32_t i = 0; i < ops; i++)
+    {
+        hit->Start();
+        pf.FetchPage(0, &page);
+        hit->Stop();
+        pf.UnpinPage(0);
+    }
+
+    Recorder * miss = new_recorder("buffer_fetch_miss", "");
+    for (int32_t i = 0; i < ops; i++)
+    {
+        int32_t page_id = (i * 7) % num_pages;
+        miss->Start();
+        pf.FetchPage(page_id, &page);
+        miss->Stop();
+        pf.UnpinPage(page_id);
+    }
+
+    pf.Close();
+    PagedFile::Unlink("bench_buffer");
+}
+
+void bench_hash_table(int32_t ops)
+{
+    HashTable hash_table;
+    for (int32_t i = 0; i < BUFFER_SIZE; i++)
+        hash_table.Insert(3, i, i);
+
+    Recorder * hit = new_recorder("hash_table_try_find", "\"outcome\": \"hit\"");
+    Recorder * miss = new_recorder("hash_table_try_find", "\"outcome\": \"miss\"");
+    for (int32_t i = 0; i < ops; i++)
+    {
+        int32_t slot_id;
+        hit->Start();
+        hash_table.TryFind(3, i % BUFFER_SIZE, slot_id);
+        hit->Stop();
+        miss->Start();
+        hash_table.TryFind(4, i % BUFFER_SIZE, slot_id);
+        miss->Stop();
+    }
+}
+
+void bench_bucket(int32_t ops, int32_t key_size, int32_t value_size)
+{
+    char params[64];
+    sprintf(params, "\"key_size\": %d, \"value_size\": %d", key_size, value_size);
+    Recorder * put = new_recorder("bucket_put", params);
+    Recorder * get = new_recorder("bucket_get", params);
+
+    // Fill a fresh bucket until it is full, read everything back, repeat.
+    Bucket bucket;
+    int32_t done = 0;
+    while (done < ops)
+    {
+        bucket.Import(NULL);
+        int32_t count = 0;
+        while (true)
+        {
+            String key = make_string(count, key_size);
+            put->Start();
+            bool is_put = bucket.Put(key, make_string(count, value_size));
+            put->Stop();
+            if (!is_put)
+                break;
+            count++;
+        }
+        if (count == 0)
+            break;
+
+        for (int32_t i = 0; i < count; i++)
+        {
+            String value;
+            String key = make_string(i, key_size);
+            get->Start();
+            bucket.Get(key, value);
+            get->Stop();
+        }
+        done += count;
+    }
+}
+
+void bench_btree(int32_t tree_size, int32_t ops)
+{
+    char params[64];
+    sprintf(params, "\"tree_size\": %d", tree_size);
+    Recorder * insert = new_recorder("btree_insert", params);
+    Recorder * search = new_recorder("btree_search", params);
+
+    PagedFile::Create("bench_btree");
+    PagedFile pf;
+    pf.OpenFile("bench_btree");
+    {
+        BTree btree(pf);
+        for (int32_t i = 0; i < tree_size; i++)
+        {
+            String key = make_string(i, 16);
+            insert->Start();
+            btree.Insert(key, i);
+            insert->Stop();
+        }
+
+        srand(tree_size);
+        for (int32_t i = 0; i < ops; i++)
+        {
+            int32_t page_id;
+            String key = make_string(rand() % tree_size, 16);
+            search->Start();
+            btree.Search(key, page_id);
+            search->Stop();
+        }
+    }
+    pf.Close();
+    PagedFile::Unlink("bench_btree");
+}
+
+// Collisions among num_keys distinct keys go into the params, next to the
+// hashing latencies.
+void bench_key_hash(int32_t num_keys, int32_t key_size)
+{
+    std::vector<String> keys;
+    for (int32_t i = 0; i < num_keys; i++)
+        keys.push_back(make_string(i, key_size));
+
+    std::vector<uint64_t> hashes(num_keys);
+    uint64_t start = now_nanos();
+    for (int32_t i = 0; i < num_keys; i++)
+        hashes[i] = KeyHash64(keys[i]);
+    uint64_t elapsed = now_nanos() - start;
+
+    std::sort(hashes.begin(), hashes.end());
+    int32_t collisions = 0;
+    for (int32_t i = 1; i < num_keys; i++)
+        collisions += hashes[i] == hashes[i - 1];
+
+    char params[128];
+    sprintf(params, "\"keys\": %d, \"key_size\": %d, \"collisions\": %d, \"mb_per_sec\": %.1f",
+        num_keys, key_size, collisions, elapsed > 0 ? 1e3 * num_keys * key_size / elapsed : 0.0);
+    Recorder * hash = new_recorder("key_hash_wide", params);
+    for (int32_t i = 0; i < num_keys; i++)
+    {
+        hash->Start();
+        volatile uint64_t value = KeyHash64(keys[i]);
+        (void) value;
+        hash->Stop();
+    }
+}
+
+void bench_data_file(int32_t num_keys, int32_t rounds)
+{
+    char params[64];
+    sprintf(params, "\"keys\": %d", num_keys);
+    Recorder * scan = new_recorder("data_file_scan", params);
+    Recorder * page_scan = new_recorder("data_file_page_scan", params);
+
+    DataFile::Create("bench_data");
+    PagedFile pf;
+    DataFile data_file(pf);
+    data_file.OpenFile("bench_data");
+
+    int32_t page_id = 0;
+    for (int32_t i = 0; i < num_keys; i++)
+        data_file.Put(make_string(i, 16), make_string(i, 32), page_id, page_id);
+
+    for (int32_t i = 0; i < rounds; i++)
+    {
+        scan->Start();
+        data_file.ListKeys();
+        scan->Stop();
+    }
+
+    int32_t total_pages = pf.GetTotalPages();
+    for (int32_t i = 0; i < rounds * total_pages; i++)
+    {
+        page_scan->Start();
+        data_file.ListKeys(i % total_pages);
+        page_scan->Stop();
+    }
+
+    data_file.Close();
+    DataFile::Unlink("bench_data");
+}
+
+} // namespace Pumper
+
+using namespace Pumper;
+
+int main(int argc, char **argv)
+{
+    int32_t ops = argc > 1 ? atoi(argv[1]) : 100000;
+    FILE * output = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (ops <= 0 || output == NULL)
+    {
+        printf("Usage: %s [operations] [output.json]\n", argv[0]);
+        return 1;
+    }
+
+    bench_buffer(ops);
+    bench_hash_table(ops);
+    bench_bucket(ops, 8, 8);
+    bench_bucket(ops, 16, 64);
+    bench_bucket(ops, 32, 256);
+    bench_btree(1000, ops);
+    bench_btree(10000, ops);
+    bench_btree(100000, ops);
+    bench_data_file(1000, 20);
+    bench_data_file(10000, 5);
+    bench_key_hash(ops, 16);
+    bench_key_hash(ops, 256);
+
+    fprintf(output, "{\n  \"suite\": \"storage\",\n  \"operations\": %d,\n  \"results\": [\n", ops);
+    for (uint32_t i = 0; i < results.size(); i++)
+    {
+        results[i]->Report(output, i == 0);
+        delete results[i];
+    }
+    fprintf(output, "\n  ]\n}\n");
+
+    if (output != stdout)
+        fclose(output);
+    return 0;
+}
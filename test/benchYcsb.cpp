@@ -0,0 +1,591 @@
+// benchYcsb.cpp
+// Part of PUMPER, copyright (C) 2016 Alogfans.
+//
+// YCSB-style load generator for the Daemon. It speaks the wire protocol
+// (fixed size command frames) over a number of connections, one thread
+// each, and runs the core workloads:
+//   A  50% read, 50% update              zipfian
+//   B  95% read, 5% update               zipfian
+//   C  100% read                         zipfian
+//   D  95% read, 5% insert               latest
+//   E  95% scan, 5% insert               zipfian
+//   F  50% read, 50% read-modify-write   zipfian
+// In closed loop every connection keeps `pipeline` operations in flight.
+// In open loop operations are issued at a fixed rate and latency is taken
+// from the intended start time, so a stalled server cannot hide its queue
+// (coordinated omission). Results are written as JSON.
+//
+// Usage: benchYcsb [--option=value ...], e.g. against `testDaemon memory`:
+//   benchYcsb --load --workload=A --records=10000 --operations=100000
+//             --connections=4 --pipeline=8
+
+#include "Types.h"
+#include "Status.h"
+#include "Socket.h"
+#include "Message.h"
+#include "Thread.h"
+
+#include <poll.h>
+#include <time.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+// Inside the namespace, so that its integer types win over the global ones.
+namespace Pumper {
+enum Distribution {
+    DistUniform = 0,
+    DistZipfian,
+    DistLatest
+};
+
+enum OperationKind {
+    OpRead = 0,
+    OpUpdate,
+    OpInsert,
+    OpScan,
+    OpReadModifyWrite,
+    NUM_OPERATION_KINDS
+};
+
+const char * OPERATION_NAMES[NUM_OPERATION_KINDS] = {
+    "read", "update", "insert", "scan", "read_modify_write"
+};
+
+const char * DISTRIBUTION_NAMES[] = { "uniform", "zipfian", "latest" };
+
+struct Workload {
+    char name;
+    double proportions[NUM_OPERATION_KINDS];
+    Distribution distribution;
+};
+
+const Workload WORKLOADS[] = {
+    { 'A', { 0.50, 0.50, 0.00, 0.00, 0.00 }, DistZipfian },
+    { 'B', { 0.95, 0.05, 0.00, 0.00, 0.00 }, DistZipfian },
+    { 'C', { 1.00, 0.00, 0.00, 0.00, 0.00 }, DistZipfian },
+    { 'D', { 0.95, 0.00, 0.05, 0.00, 0.00 }, DistLatest },
+    { 'E', { 0.00, 0.00, 0.05, 0.95, 0.00 }, DistZipfian },
+    { 'F', { 0.50, 0.00, 0.00, 0.00, 0.50 }, DistZipfian },
+};
+
+const double ZIPFIAN_CONSTANT = 0.99;
+
+struct Options {
+    String host;
+    int32_t port;
+    Workload workload;
+    bool is_load;                   // Insert all records before the run
+    int64_t records;
+    int64_t operations;
+    int32_t key_size;
+    int32_t value_size;
+    int32_t connections;
+    int32_t pipeline;               // Operations in flight per connection
+    double rate;                    // Open loop target, ops/s; 0 = closed loop
+    int32_t max_scan_length;
+    String output;
+};
+
+uint64_t now_nanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t fnv_hash(uint64_t value)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int32_t i = 0; i < 8; i++)
+    {
+        hash ^= value & 0xff;
+        hash *= 0x100000001b3ull;
+        value >>= 8;
+    }
+    return hash;
+}
+
+// xorshift64*, one per thread
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed ? seed : 1) { }
+
+    uint64_t Next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ull;
+    }
+
+    double NextDouble()
+    {
+        return (Next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t state;
+};
+
+// Gray et al., "Quickly generating billion-record synthetic databases", as
+// used by YCSB. Returns 0 .. items - 1, small values most popular.
+class ZipfianGenerator {
+public:
+    explicit ZipfianGenerator(int64_t items) : items(items)
+    {
+        theta = ZIPFIAN_CONSTANT;
+        zeta2 = zeta(2);
+        zetan = zeta(items);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetan);
+    }
+
+    int64_t Next(Random& random)
+    {
+        double u = random.NextDouble();
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + pow(0.5, theta))
+            return 1;
+        int64_t value = (int64_t) (items * pow(eta * u - eta + 1, alpha));
+        return std::min(value, items - 1);
+    }
+
+private:
+    double zeta(int64_t n)
+    {
+        double sum = 0;
+        for (int64_t i = 0; i < n; i++)
+            sum += 1 / pow(i + 1, theta);
+        return sum;
+    }
+
+    int64_t items;
+    double theta, zeta2, zetan, alpha, eta;
+};
+
+// Shared by all client threads
+struct Context {
+    Options options;
+    ZipfianGenerator * zipfian;
+    std::atomic<int64_t> insert_count;      // Next record number to insert
+    std::atomic<int64_t> next_load;         // Next record of the load phase
+    std::atomic<int64_t> errors;
+};
+
+typedef std::vector<uint64_t> LatencyList;
+
+struct Pending {
+    uint64_t start;
+    OperationKind kind;
+    int32_t frames;                         // Responses still expected
+};
+
+class Client {
+public:
+    Client(Context * context, int32_t id, bool is_load) : context(context),
+        random(fnv_hash(id + 1) ^ now_nanos()), is_load(is_load) { }
+
+    Status Connect()
+    {
+        RETHROW_ON_EXCEPTION(socket.Connect(context->options.host, context->options.port));
+        RETURN_SUCCESS();
+    }
+
+    void Run(int64_t quota)
+    {
+        const Options& options = context->options;
+        uint64_t interval = options.rate > 0 ? (uint64_t) (1e9 * options.connections / options.rate) : 0;
+        uint64_t next_time = now_nanos();
+        int64_t issued = 0;
+        std::deque<Pending> pending;
+
+        while (issued < quota || !pending.empty())
+        {
+            bool can_issue = issued < quota && (int32_t) pending.size() < options.pipeline;
+            if (can_issue && (interval == 0 || now_nanos() >= next_time))
+            {
+                if (!issue(pending, interval ? next_time : now_nanos()))
+                    return;
+                issued++;
+                next_time += interval;
+                continue;
+            }
+
+            if (can_issue && !wait_readable(pending.empty(), next_time))
+                continue;
+            if (!receive(pending))
+                return;
+        }
+        socket.Close();
+    }
+
+    std::vector<uint64_t> latencies[NUM_OPERATION_KINDS];
+
+private:
+    // Wait until a response can be read (true) or it is time to issue the
+    // next open loop operation (false).
+    bool wait_readable(bool is_idle, uint64_t next_time)
+    {
+        uint64_t now = now_nanos();
+        if (now >= next_time)
+            return false;
+        if (is_idle)
+        {
+            struct timespec ts;
+            ts.tv_sec = (next_time - now) / 1000000000ull;
+            ts.tv_nsec = (next_time - now) % 1000000000ull;
+            nanosleep(&ts, NULL);
+            return false;
+        }
+
+        struct pollfd fds;
+        fds.fd = socket.GetSocketDescriptor();
+        fds.events = POLLIN;
+        return poll(&fds, 1, (int) ((next_time - now) / 1000000)) > 0;
+    }
+
+    OperationKind choose_operation()
+    {
+        if (is_load)
+            return OpInsert;
+        double u = random.NextDouble();
+        const double * proportions = context->options.workload.proportions;
+        for (int32_t i = 0; i < NUM_OPERATION_KINDS; i++)
+        {
+            if (u < proportions[i])
+                return (OperationKind) i;
+            u -= proportions[i];
+        }
+        return OpRead;
+    }
+
+    int64_t choose_record()
+    {
+        int64_t count = context->insert_count;
+        int64_t record;
+        switch (context->options.workload.distribution)
+        {
+        case DistUniform:
+            record = random.Next() % count;
+            break;
+        case DistLatest:
+            // Newest records are the most popular.
+            record = count - 1 - context->zipfian->Next(random);
+            break;
+        default:
+            // Scrambled, so that popular records are spread over the key space.
+            record = fnv_hash(context->zipfian->Next(random)) % context->options.records;
+            break;
+        }
+        return std::max(std::min(record, count - 1), (int64_t) 0);
+    }
+
+    String make_key(int64_t record)
+    {
+        char buf[32];
+        sprintf(buf, "user%llu", fnv_hash(record));
+        String key(buf);
+        if ((int32_t) key.size() < context->options.key_size)
+            key.append(context->options.key_size - key.size(), '0');
+        return key;
+    }
+
+    String make_value()
+    {
+        String value(context->options.value_size, 'a');
+        for (uint32_t i = 0; i < value.size(); i++)
+            value[i] = 'a' + random.Next() % 26;
+        return value;
+    }
+
+    bool send(const String& command)
+    {
+        char frame[MESSAGE_SIZE];
+        memset(frame, 0, MESSAGE_SIZE);
+        strncpy(frame, Message(MessageType::Command, command).ToPacket().c_str(), MESSAGE_SIZE - 1);
+        return socket.SendBytes(frame, MESSAGE_SIZE) == MESSAGE_SIZE;
+    }
+
+    bool issue(std::deque<Pending>& pending, uint64_t start)
+    {
+        Pending operation;
+        operation.start = start;
+        operation.kind = choose_operation();
+        operation.frames = 1;
+
+        bool is_sent;
+        switch (operation.kind)
+        {
+        case OpInsert:
+        {
+            int64_t record = is_load ? context->next_load++ : context->insert_count++;
+            is_sent = send("put " + make_key(record) + " " + make_value());
+            break;
+        }
+        case OpUpdate:
+            is_sent = send("put " + make_key(choose_record()) + " " + make_value());
+            break;
+        case OpScan:
+        {
+            char length[24];
+            sprintf(length, "%llu", 1 + random.Next() % context->options.max_scan_length);
+            is_sent = send("scan " + make_key(choose_record()) + " " + length);
+            break;
+        }
+        case OpReadModifyWrite:
+        {
+            // Both frames are pipelined; the new value does not depend on the old one.
+            String key = make_key(choose_record());
+            operation.frames = 2;
+            is_sent = send("get " + key) && send("put " + key + " " + make_value());
+            break;
+        }
+        default:
+            is_sent = send("get " + make_key(choose_record()));
+            break;
+        }
+
+        pending.push_back(operation);
+        return is_sent;
+    }
+
+    bool receive(std::deque<Pending>& pending)
+    {
+        char frame[MESSAGE_SIZE + 1];
+        if (socket.ReceiveBytes(frame, MESSAGE_SIZE) != MESSAGE_SIZE)
+            return false;
+        frame[MESSAGE_SIZE] = '\0';
+        if (Message(String(frame)).Type() != MessageType::Response)
+            context->errors++;
+
+        // The Daemon answers the frames of one connection in order.
+        Pending& front = pending.front();
+        if (--front.frames == 0)
+        {
+            latencies[front.kind].push_back(now_nanos() - front.start);
+            pending.pop_front();
+        }
+        return true;
+    }
+
+    Context * context;
+    Socket socket;
+    Random random;
+    bool is_load;
+};
+
+uint64_t percentile(const std::vector<uint64_t>& samples, double fraction)
+{
+    if (samples.empty())
+        return 0;
+    size_t index = (size_t) (fraction * samples.size());
+    return samples[std::min(index, samples.size() - 1)];
+}
+
+// Runs one phase on all connections, returns the elapsed seconds.
+double run_phase(Context * context, bool is_load, int64_t operations,
+    std::vector<uint64_t> * latencies)
+{
+    int32_t connections = context->options.connections;
+    std::vector<Client *> clients;
+    std::vector<Thread *> threads;
+
+    // Connect one by one: the listen backlog of the Daemon is small.
+    for (int32_t i = 0; i < connections; i++)
+    {
+        clients.push_back(new Client(context, i, is_load));
+        if (!(clients[i]->Connect() == STATUS_SUCCESS))
+        {
+            fprintf(stderr, "Cannot connect to %s:%d\n", context->options.host.c_str(),
+                context->options.port);
+            exit(1);
+        }
+    }
+
+    uint64_t start = now_nanos();
+    for (int32_t i = 0; i < connections; i++)
+    {
+        int64_t quota = operations / connections + (i < operations % connections ? 1 : 0);
+        threads.push_back(new Thread(std::bind(&Client::Run, clients[i], quota), "ycsb_client"));
+        threads[i]->Start();
+    }
+    for (int32_t i = 0; i < connections; i++)
+        threads[i]->Join();
+    double seconds = (now_nanos() - start) / 1e9;
+
+    for (int32_t i = 0; i < connections; i++)
+    {
+        for (int32_t kind = 0; kind < NUM_OPERATION_KINDS; kind++)
+            latencies[kind].insert(latencies[kind].end(), clients[i]->latencies[kind].begin(),
+                clients[i]->latencies[kind].end());
+        delete threads[i];
+        delete clients[i];
+    }
+    return seconds;
+}
+
+void report(FILE * output, const char * phase, double seconds,
+    std::vector<uint64_t> * latencies, int64_t errors, bool is_last)
+{
+    uint64_t total = 0;
+    for (int32_t kind = 0; kind < NUM_OPERATION_KINDS; kind++)
+        total += latencies[kind].size();
+
+    fprintf(output, "    {\"phase\": \"%s\", \"seconds\": %.3f, \"ops\": %llu, \"ops_per_sec\": %.1f, "
+        "\"errors\": %lld, \"operations\": [", phase, seconds, total,
+        seconds > 0 ? total / seconds : 0.0, errors);
+
+    bool is_first = true;
+    for (int32_t kind = 0; kind < NUM_OPERATION_KINDS; kind++)
+    {
+        std::vector<uint64_t>& samples = latencies[kind];
+        if (samples.empty())
+            continue;
+        std::sort(samples.begin(), samples.end());
+        fprintf(output, "%s\n      {\"operation\": \"%s\", \"ops\": %llu, \"p50_ns\": %llu, "
+            "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+            is_first ? "" : ",", OPERATION_NAMES[kind], (uint64_t) samples.size(),
+            percentile(samples, 0.5), percentile(samples, 0.99), percentile(samples, 0.999),
+            samples.back());
+        is_first = false;
+    }
+    fprintf(output, "]}%s\n", is_last ? "" : ",");
+}
+
+bool parse_options(int argc, char **argv, Options& options)
+{
+    options.host = "127.0.0.1";
+    options.port = 12306;
+    options.workload = WORKLOADS[0];
+    options.is_load = false;
+    options.records = 10000;
+    options.operations = 100000;
+    options.key_size = 24;
+    options.value_size = 100;
+    options.connections = 4;
+    options.pipeline = 1;
+    options.rate = 0;
+    options.max_scan_length = 100;
+
+    int32_t distribution = -1;
+    for (int32_t i = 1; i < argc; i++)
+    {
+        String arg(argv[i]);
+        size_t equal = arg.find('=');
+        String name = arg.substr(0, equal);
+        String value = equal == String::npos ? "" : arg.substr(equal + 1);
+
+        if (name == "--host")
+            options.host = value;
+        else if (name == "--port")
+            options.port = atoi(value.c_str());
+        else if (name == "--workload")
+        {
+            if (value.size() != 1 || toupper(value[0]) < 'A' || toupper(value[0]) > 'F')
+                return false;
+            options.workload = WORKLOADS[toupper(value[0]) - 'A'];
+        }
+        else if (name == "--distribution")
+        {
+            for (int32_t d = DistUniform; d <= DistLatest; d++)
+                if (value == DISTRIBUTION_NAMES[d])
+                    distribution = d;
+            if (distribution < 0)
+                return false;
+        }
+        else if (name == "--load")
+            options.is_load = true;
+        else if (name == "--records")
+            options.records = atoll(value.c_str());
+        else if (name == "--operations")
+            options.operations = atoll(value.c_str());
+        else if (name == "--key-size")
+            options.key_size = atoi(value.c_str());
+        else if (name == "--value-size")
+            options.value_size = atoi(value.c_str());
+        else if (name == "--connections")
+            options.connections = atoi(value.c_str());
+        else if (name == "--pipeline")
+            options.pipeline = atoi(value.c_str());
+        else if (name == "--rate")
+            options.rate = atof(value.c_str());
+        else if (name == "--max-scan-length")
+            options.max_scan_length = atoi(value.c_str());
+        else if (name == "--output")
+            options.output = value;
+        else
+            return false;
+    }
+
+    if (distribution >= 0)
+        options.workload.distribution = (Distribution) distribution;
+
+    // Key, value and command words must fit into one frame.
+    return options.records > 0 && options.operations >= 0 && options.connections > 0 &&
+        options.pipeline > 0 && options.max_scan_length > 0 && options.key_size >= 0 &&
+        options.value_size > 0 && options.key_size + options.value_size < MESSAGE_SIZE - 64;
+}
+} // namespace Pumper
+
+using namespace Pumper;
+
+int main(int argc, char **argv)
+{
+    Context context;
+    if (!parse_options(argc, argv, context.options))
+    {
+        printf("Usage: %s [--host=127.0.0.1] [--port=12306] [--workload=A..F]\n"
+            "  [--distribution=uniform|zipfian|latest] [--load] [--records=N] [--operations=N]\n"
+            "  [--key-size=N] [--value-size=N] [--connections=N] [--pipeline=N]\n"
+            "  [--rate=ops_per_sec] [--max-scan-length=N] [--output=file.json]\n", argv[0]);
+        return 1;
+    }
+
+    const Options& options = context.options;
+    FILE * output = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+    if (output == NULL)
+    {
+        printf("Cannot open %s\n", options.output.c_str());
+        return 1;
+    }
+
+    context.zipfian = new ZipfianGenerator(options.records);
+    context.insert_count = options.records;
+    context.next_load = 0;
+    context.errors = 0;
+
+    fprintf(output, "{\n  \"workload\": \"%c\", \"distribution\": \"%s\", \"mode\": \"%s\", "
+        "\"records\": %lld, \"key_size\": %d, \"value_size\": %d, \"connections\": %d, "
+        "\"pipeline\": %d, \"rate\": %.1f,\n  \"phases\": [\n", options.workload.name,
+        DISTRIBUTION_NAMES[options.workload.distribution], options.rate > 0 ? "open" : "closed",
+        options.records, options.key_size, options.value_size, options.connections,
+        options.pipeline, options.rate);
+
+    if (options.is_load)
+    {
+        LatencyList latencies[NUM_OPERATION_KINDS];
+        double seconds = run_phase(&context, true, options.records, latencies);
+        report(output, "load", seconds, latencies, context.errors, options.operations == 0);
+        context.errors = 0;
+    }
+    if (options.operations > 0)
+    {
+        LatencyList latencies[NUM_OPERATION_KINDS];
+        double seconds = run_phase(&context, false, options.operations, latencies);
+        report(output, "run", seconds, latencies, context.errors, true);
+    }
+    fprintf(output, "  ]\n}\n");
+
+    delete context.zipfian;
+    if (output != stdout)
+        fclose(output);
+    return 0;
+}
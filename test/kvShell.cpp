@@ -6,6 +6,8 @@
 //
 
 #include "Engine.h"
+#include "Statistics.h"
+#include "PagedFile.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -36,6 +38,9 @@ void func_put(int argc, char **argv);
 void func_get(int argc, char **argv);
 void func_remove(int argc, char **argv);
 void func_list(int argc, char **argv);
+void func_scan(int argc, char **argv);
+void func_stats(int argc, char **argv);
+void func_scrub(int argc, char **argv);
 void func_exit(int argc, char **argv);
 void func_help(int argc, char **argv);
 
@@ -52,6 +57,9 @@ static exec_map_type exec_map[] = {
 	{"get",		func_get,		"Get the latest value according to key."}, 
 	{"remove",	func_remove,	"Remove the key/value pair."}, 
 	{"list",	func_list,		"List all key/value sets."}, 
+	{"scan",	func_scan,		"List key/value sets from a key in key order."}, 
+	{"stats",	func_stats,		"Display engine and runtime statistics, [prefix] to filter."}, 
+	{"scrub",	func_scrub,		"Verify page checksums of closed database files."}, 
 	{"exit",	func_exit,		"Exit the program."}, 
 	{"help",	func_help,		"Display help message."}, 	
 };
@@ -60,17 +68,32 @@ static exec_map_type exec_map[] = {
 
 // ****************************************************************************
 
-Engine engine;
+KvEngine * engine;
 
 void func_create(int argc, char **argv)
 {
-	if (argc != 2)
+	if (argc != 2 && !(argc == 3 && (!strcmp(argv[2], "lsm") || !strcmp(argv[2], "compressed") ||
+		!strcmp(argv[2], "hashed") || !strcmp(argv[2], "clustered") ||
+		!strcmp(argv[2], "integer") || !strcmp(argv[2], "buffered") || !strcmp(argv[2], "cow"))))
 	{
-		printf("Usage: create <db_name>\n");
+		printf("Usage: create <db_name> [lsm|compressed|hashed|clustered|integer|buffered|cow]\n");
 		return;
 	}
 
-	Engine::CreateDb(argv[1]);
+	if (argc == 3 && !strcmp(argv[2], "lsm"))
+		Engine::CreateDb(argv[1], LogStructured);
+	else if (argc == 3 && !strcmp(argv[2], "clustered"))
+		Engine::CreateDb(argv[1], Clustered);
+	else if (argc == 3 && !strcmp(argv[2], "integer"))
+		Engine::CreateDb(argv[1], IntegerKeys);
+	else if (argc == 3 && !strcmp(argv[2], "hashed"))
+		Engine::CreateDb(argv[1], UpdateInPlace, false, HashedIndex);
+	else if (argc == 3 && !strcmp(argv[2], "buffered"))
+		Engine::CreateDb(argv[1], UpdateInPlace, false, BufferedIndex);
+	else if (argc == 3 && !strcmp(argv[2], "cow"))
+		Engine::CreateDb(argv[1], UpdateInPlace, false, CopyOnWriteIndex);
+	else
+		Engine::CreateDb(argv[1], UpdateInPlace, argc == 3);
 }
 
 void func_unlink(int argc, char **argv)
@@ -86,8 +109,8 @@ void func_unlink(int argc, char **argv)
 
 void func_pwd(int argc, char **argv)
 {
-	if (engine.IsOpened())
-		printf("%s\n", engine.OpenDbName().c_str());
+	if (engine->IsOpened())
+		printf("%s\n", engine->OpenDbName().c_str());
 	else
 		printf("No database file opened\n");
 }
@@ -100,30 +123,30 @@ void func_open(int argc, char **argv)
 		return;
 	}
 
-	if (engine.IsOpened()) 
+	if (engine->IsOpened()) 
 	{
 		printf("Currently a database file is opened\n");
 		return;
 	}
 
-	engine.OpenDb(argv[1]);
+	engine->OpenDb(argv[1]);
 }
 
 void func_close(int argc, char **argv)
 {
-	if (!engine.IsOpened()) 
+	if (!engine->IsOpened()) 
 	{
 		printf("Currently no database file is opened\n");
 		return;
 	}
 
-	engine.CloseDb();
+	engine->CloseDb();
 }
 
 
 void func_put(int argc, char **argv)
 {
-	if (!engine.IsOpened()) 
+	if (!engine->IsOpened()) 
 	{
 		printf("Currently no database file is opened\n");
 		return;
@@ -135,12 +158,12 @@ void func_put(int argc, char **argv)
 		return;
 	}
 
-	engine.Put(argv[1], argv[2]);
+	engine->Put(argv[1], argv[2]);
 }
 
 void func_get(int argc, char **argv)
 {
-	if (!engine.IsOpened()) 
+	if (!engine->IsOpened()) 
 	{
 		printf("Currently no database file is opened\n");
 		return;
@@ -153,19 +176,19 @@ void func_get(int argc, char **argv)
 		return;
 	}
 
-	if (!engine.Contains(argv[1]))
+	if (!engine->Contains(argv[1]))
 	{
 		printf("Such key doesn't exist\n");
 		return;
 	}
 
-	engine.Get(argv[1], value);
+	engine->Get(argv[1], value);
 	printf("%s\n", value.c_str());
 }
 
 void func_remove(int argc, char **argv)
 {
-	if (!engine.IsOpened()) 
+	if (!engine->IsOpened()) 
 	{
 		printf("Currently no database file is opened\n");
 		return;
@@ -177,37 +200,92 @@ void func_remove(int argc, char **argv)
 		return;
 	}
 
-	if (!engine.Contains(argv[1]))
+	if (!engine->Contains(argv[1]))
 	{
 		printf("Such key doesn't exist\n");
 		return;
 	}
 
-	engine.Remove(argv[1]);
+	engine->Remove(argv[1]);
 }
 
 void func_list(int argc, char **argv)
 {
-	if (!engine.IsOpened()) 
+	if (!engine->IsOpened()) 
 	{
 		printf("Currently no database file is opened\n");
 		return;
 	}
 
-	std::vector<String> keys = engine.ListKeys();
+	std::vector<String> keys = engine->ListKeys();
 
 	for (uint32_t i = 0; i < keys.size(); i++)
 	{
 		String value;
-		engine.Get(keys[i], value);
+		engine->Get(keys[i], value);
 		printf("%s <-> %s\n", keys[i].c_str(), value.c_str());
 	}
 }
 
+void func_scan(int argc, char **argv)
+{
+	if (!engine->IsOpened()) 
+	{
+		printf("Currently no database file is opened\n");
+		return;
+	}
+	if (argc != 2 && argc != 3)
+	{
+		printf("Usage: scan <start_key> [limit]\n");
+		return;
+	}
+
+	KeyValueList items;
+	engine->Scan(argv[1], argc == 3 ? atoi(argv[2]) : 0, items);
+	for (uint32_t i = 0; i < items.size(); i++)
+		printf("%s <-> %s\n", items[i].first.c_str(), items[i].second.c_str());
+}
+
+void func_stats(int argc, char **argv)
+{
+	EngineStats stats = engine->Stats();
+	printf("engine\t%s\n", stats.engine.c_str());
+	printf("gets\t%llu (%llu misses)\n", stats.num_gets, stats.num_get_misses);
+	printf("puts\t%llu\n", stats.num_puts);
+	printf("removes\t%llu\n", stats.num_removes);
+	printf("batches\t%llu\n", stats.num_batches);
+	printf("scans\t%llu\n", stats.num_scans);
+	printf("%s", Singleton<Statistics>::Instance().ToString(argc > 1 ? argv[1] : "").c_str());
+}
+
+void func_scrub(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: scrub <file> [file ...]\n");
+		return;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::vector<int32_t> bad_pages;
+		if (!(PagedFile::Scrub(argv[i], bad_pages) == STATUS_SUCCESS))
+		{
+			printf("%s\tunreadable or bad header\n", argv[i]);
+			continue;
+		}
+
+		printf("%s\t%u bad pages", argv[i], (uint32_t) bad_pages.size());
+		for (uint32_t j = 0; j < bad_pages.size(); j++)
+			printf(" %d", bad_pages[j]);
+		printf("\n");
+	}
+}
+
 void func_exit(int argc, char **argv)
 {
-	if (engine.IsOpened()) 
-		engine.CloseDb();
+	if (engine->IsOpened()) 
+		engine->CloseDb();
 
 	exit(0);
 }
@@ -269,8 +347,17 @@ void execute(char *command, int argc, char **argv)
 	printf("ERROR: Command \"%s\" unrecognized.\n", command);
 }
 
-int main()
+// Usage: kvShell [paged|memory]
+int main(int argc, char **argv)
 {
+	EngineKind kind = EnginePaged;
+	if (argc > 1 && !(KvEngine::ParseKind(argv[1], kind) == STATUS_SUCCESS))
+	{
+		printf("Usage: %s [paged|memory]\n", argv[0]);
+		return 1;
+	}
+	engine = KvEngine::New(kind);
+
 	// Print banner
 	printf("Key/value Storage System: Desktop Edition\n");
 	printf("Copyright (C) 2015 Alogfans. All rights reserved.\n");
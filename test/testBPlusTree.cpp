@@ -0,0 +1,203 @@
+#include "Status.h"
+#include "Types.h"
+#include "BTree.h"
+#include "PagedFile.h"
+#include "Statistics.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+
+using namespace Pumper;
+
+TEST(b_plus_tree_test, records)
+{
+    PagedFile::Create("test_b_plus_tree.idx");
+    PagedFile pf;
+    pf.OpenFile("test_b_plus_tree.idx");
+    {
+        BTree bt(pf);
+        char buf[60];
+        for (int i = 0; i < 20000; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            bt.Insert(buf, i);
+        }
+        for (int i = 0; i < 20000; i += 2)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_TRUE(bt.Update(buf, -i));
+        }
+        for (int i = 0; i < 20000; i++)
+        {
+            int page_id = 0;
+            sprintf(buf, "Item %d", i);
+            EXPECT_TRUE(bt.Search(buf, page_id));
+            EXPECT_EQ(page_id, i % 2 ? i : -i);
+        }
+        for (int i = 0; i < 20000; i += 3)
+        {
+            sprintf(buf, "Item %d", i);
+            bt.Remove(buf);
+        }
+        for (int i = 0; i < 20000; i++)
+        {
+            int page_id = 0;
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(bt.Search(buf, page_id), i % 3 != 0);
+        }
+        int page_id = 0;
+        EXPECT_FALSE(bt.Search("Missing", page_id));
+    }
+    pf.Close();
+    PagedFile::Unlink("test_b_plus_tree.idx");
+}
+
+
+TEST(b_plus_tree_test, sequential)
+{
+    const int num_keys = 100000;
+    const int leaf_keys = BTNodeOf<unsigned long long>::ORDER - 1;
+    PagedFile::Create("test_b_plus_tree.idx");
+    PagedFile pf;
+    pf.OpenFile("test_b_plus_tree.idx");
+    {
+        IntBTree bt(pf);
+        for (int i = 0; i < num_keys; i++)
+            bt.Insert(1000 + i, i);
+        // Leaves are filled up instead of split in halves
+        EXPECT_LT(pf.GetTotalPages(), num_keys / leaf_keys * 11 / 10);
+
+        // Keys below the appended ones still split in the middle
+        for (int i = 0; i < 1000; i++)
+            bt.Insert(i, -i);
+        for (int i = 0; i < num_keys + 1000; i++)
+        {
+            int page_id = 0;
+            EXPECT_TRUE(bt.Search(i, page_id));
+            EXPECT_EQ(page_id, i < 1000 ? -i : i - 1000);
+        }
+    }
+    {
+        // Appends after reopening find the rightmost leaf again
+        IntBTree bt(pf);
+        for (int i = num_keys + 1000; i < 2 * num_keys; i++)
+            bt.Insert(i, i);
+        for (int i = 0; i < 2 * num_keys; i += 7)
+        {
+            int page_id = 0;
+            EXPECT_TRUE(bt.Search(i, page_id));
+        }
+        EXPECT_LT(pf.GetTotalPages(), 2 * num_keys / leaf_keys * 11 / 10 + 10);
+    }
+    pf.Close();
+    PagedFile::Unlink("test_b_plus_tree.idx");
+}
+
+
+TEST(b_plus_tree_test, rebalance)
+{
+    const int num_keys = 100000;
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    PagedFile::Create("test_b_plus_tree.idx");
+    PagedFile pf;
+    pf.OpenFile("test_b_plus_tree.idx");
+    {
+        IntBTree bt(pf);
+        for (int i = 0; i < num_keys; i++)
+            bt.Insert(i, i);
+
+        // A delete writes its leaf only, merges come in passes
+        statistics.Reset();
+        for (int i = 0; i < num_keys; i++)
+        {
+            if (i % 10)
+                bt.Remove(i);
+        }
+        EXPECT_GT(statistics.GetTicker(BTreeMerges), 0u);
+        EXPECT_EQ(statistics.GetTicker(PageReleases), statistics.GetTicker(BTreeMerges));
+        EXPECT_GT(bt.Rebalance(), 0);
+        EXPECT_EQ(bt.Rebalance(), 0);
+        EXPECT_GT(statistics.GetTicker(PageReleases), 
+            (unsigned long long) num_keys / (BTNodeOf<unsigned long long>::ORDER - 1) / 2);
+
+        for (int i = 0; i < num_keys; i++)
+        {
+            int page_id = 0;
+            EXPECT_EQ(bt.Search(i, page_id), i % 10 == 0);
+        }
+
+        // Merged leaves take inserts again
+        for (int i = 1; i < num_keys; i += 10)
+            bt.Insert(i, -i);
+        for (int i = 0; i < num_keys; i++)
+        {
+            int page_id = 0;
+            EXPECT_EQ(bt.Search(i, page_id), i % 10 < 2);
+            if (i % 10 == 1)
+            {
+                EXPECT_EQ(page_id, -i);
+            }
+        }
+
+        // Removing everything leaves a single leaf as root
+        for (int i = 0; i < num_keys; i++)
+            bt.Remove(i);
+        bt.Rebalance();
+        int page_id = 0;
+        EXPECT_FALSE(bt.Search(0, page_id));
+        bt.Insert(42, 42);
+        EXPECT_TRUE(bt.Search(42, page_id));
+        EXPECT_EQ(page_id, 42);
+    }
+    pf.Close();
+    PagedFile::Unlink("test_b_plus_tree.idx");
+}
+
+
+TEST(b_plus_tree_test, rebalance_writes)
+{
+    const int num_keys = 100000;
+    const int num_removed = 20000;
+    const int leaf_keys = BTNodeOf<unsigned long long>::ORDER - 1;
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    PagedFile::Create("test_b_plus_tree.idx");
+    PagedFile pf;
+    pf.OpenFile("test_b_plus_tree.idx");
+    {
+        IntBTree bt(pf);
+        for (int i = 0; i < num_keys; i++)
+            bt.Insert(i, i);
+        pf.ForcePage();
+
+        // Only the leaves deletes went through are visited, and only the
+        // merged ones are written again.
+        statistics.Reset();
+        for (int i = 0; i < num_removed; i++)
+        {
+            if (i % 10)
+                bt.Remove(i);
+        }
+        bt.Rebalance();
+        pf.ForcePage();
+        EXPECT_GT(statistics.GetTicker(BTreeMerges), 0u);
+        EXPECT_LT(statistics.GetTicker(PageWrites), (unsigned long long) num_removed / leaf_keys * 3);
+
+        statistics.Reset();
+        EXPECT_EQ(bt.Rebalance(), 0);
+        pf.ForcePage();
+        EXPECT_EQ(statistics.GetTicker(PageWrites), 0u);
+
+        for (int i = 0; i < num_keys; i++)
+        {
+            int page_id = 0;
+            EXPECT_EQ(bt.Search(i, page_id), i >= num_removed || i % 10 == 0);
+        }
+    }
+    pf.Close();
+    PagedFile::Unlink("test_b_plus_tree.idx");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,158 @@
+#include "Status.h"
+#include "Types.h"
+#include "BloomFilter.h"
+#include "FilterFile.h"
+#include "PagedFile.h"
+#include "Engine.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(bloom_filter_test, false_positive_rate)
+{
+    BloomFilter filter;
+    filter.Reset(10000 * BLOOM_BITS_PER_KEY / 8);
+    for (int i = 0; i < 10000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item %d", i);
+        filter.Add(buf);
+    }
+
+    int false_positives = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(filter.MayContain(buf), true);
+        sprintf(buf, "Missing %d", i);
+        if (filter.MayContain(buf))
+            false_positives++;
+    }
+    EXPECT_LT(false_positives, 300);
+}
+
+TEST(bloom_filter_test, persistence)
+{
+    FilterFile::Create("filter.BLOOM");
+    {
+        PagedFile pf;
+        FilterFile filter_file(pf);
+        filter_file.OpenFile("filter.BLOOM");
+        EXPECT_EQ(filter_file.IsValid(), false);
+        std::vector<String> keys;
+        keys.push_back("alpha");
+        filter_file.Rebuild(keys);
+        filter_file.Add("beta");
+        filter_file.Close();
+    }
+    {
+        PagedFile pf;
+        FilterFile filter_file(pf);
+        filter_file.OpenFile("filter.BLOOM");
+        EXPECT_EQ(filter_file.IsValid(), true);
+        EXPECT_EQ(filter_file.MayContain("alpha"), true);
+        EXPECT_EQ(filter_file.MayContain("beta"), true);
+        filter_file.Close();
+    }
+    FilterFile::Unlink("filter.BLOOM");
+}
+
+TEST(bloom_filter_test, engine_misses)
+{
+    Engine::CreateDb("filter");
+    {
+        Engine engine;
+        engine.OpenDb("filter");
+        for (int i = 0; i < 3000; i++)
+        {
+            char buf[60];
+            sprintf(buf, "Item%d", i);
+            engine.Put(buf, buf);
+        }
+        for (int i = 0; i < 3000; i += 3)
+        {
+            char buf[60];
+            sprintf(buf, "Item%d", i);
+            engine.Remove(buf);
+        }
+        engine.CloseDb();
+    }
+
+    Engine engine;
+    engine.OpenDb("filter");
+    for (int i = 0; i < 3000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item%d", i);
+        EXPECT_EQ(engine.Contains(buf), i % 3 != 0);
+    }
+    engine.CloseDb();
+    Engine::UnlinkDb("filter");
+}
+
+// Keys whose hash collides with an indexed one are stored apart; updates
+// of such a key are not new keys to the filter.
+TEST(bloom_filter_test, collision_updates)
+{
+    char buf[60];
+    String first("Key0"), second("Key1");
+
+    // 64-bit hashes do not collide in practice: the index is given an entry
+    // for the second key that leads to the page of the first, as the hash
+    // of the first would.
+    Engine::CreateDb("filter");
+    {
+        Engine engine;
+        EXPECT_EQ(engine.OpenDb("filter"), STATUS_SUCCESS);
+        EXPECT_EQ(engine.Put(first, "first"), STATUS_SUCCESS);
+        EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    }
+    {
+        PagedFile pf;
+        IndexFile index(pf);
+        int32_t page_id = -1;
+        EXPECT_EQ(index.OpenFile("filter.INDEX"), STATUS_SUCCESS);
+        EXPECT_TRUE(index.Find(first, page_id));
+        EXPECT_EQ(index.Put(second, page_id), STATUS_SUCCESS);
+        EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    }
+
+    const int num_fillers = 10;
+    {
+        Engine engine;
+        EXPECT_EQ(engine.OpenDb("filter"), STATUS_SUCCESS);
+        // The colliding key goes to another page than the first one
+        for (int i = 0; i < num_fillers; i++)
+        {
+            sprintf(buf, "Filler%d", i);
+            EXPECT_EQ(engine.Put(buf, String(1000, 'f')), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < 50; i++)
+        {
+            sprintf(buf, "second %d", i);
+            EXPECT_EQ(engine.Put(second, buf), STATUS_SUCCESS);
+        }
+        String value;
+        EXPECT_EQ(engine.Get(second, value), STATUS_SUCCESS);
+        EXPECT_EQ(value, "second 49");
+        EXPECT_EQ(engine.Get(first, value), STATUS_SUCCESS);
+        EXPECT_EQ(value, "first");
+        EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    }
+
+    PagedFile pf;
+    FilterFile filter(pf);
+    EXPECT_EQ(filter.OpenFile("filter.BLOOM"), STATUS_SUCCESS);
+    EXPECT_EQ(filter.NumKeys(), num_fillers + 2);
+    EXPECT_EQ(filter.Close(), STATUS_SUCCESS);
+    Engine::UnlinkDb("filter");
+}
+
+int main(int argc, char *argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -14,8 +14,9 @@ int main()
 	for (int i = 0; i < 1000; i++)
 	{
 		char buf[60];
+		bool is_inserted;
 		sprintf(buf, "Item %d", i);
-		df.Put(buf, buf);
+		df.Put(buf, buf, is_inserted);
 	}
 	std::string val;
 	df.Get("Item 555", val);
@@ -0,0 +1,99 @@
+#include "Status.h"
+#include "Types.h"
+#include "IndexFile.h"
+#include "Statistics.h"
+#include "Singleton.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(buffered_tree_test, records)
+{
+    const int num_keys = 50000;
+    char buf[60];
+    IndexFile::Create("test_buffered.idx", BufferedIndex);
+    PagedFile pf;
+    {
+        IndexFile index(pf);
+        EXPECT_EQ(index.OpenFile("test_buffered.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(index.Type(), BufferedIndex);
+        for (int i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Put(buf, i), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 2)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Update(buf, -i), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 3)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Remove(buf), STATUS_SUCCESS);
+        }
+        // Pending messages answer before the leaves
+        int page_id = 0;
+        EXPECT_FALSE(index.Find("Item 0", page_id));
+        EXPECT_TRUE(index.Find("Item 2", page_id));
+        EXPECT_EQ(page_id, -2);
+        EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    }
+
+    // Messages still buffered are read back from disk
+    IndexFile index(pf);
+    EXPECT_EQ(index.OpenFile("test_buffered.idx"), STATUS_SUCCESS);
+    for (int i = 0; i < num_keys; i++)
+    {
+        int page_id = 0;
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(index.Find(buf, page_id), i % 3 != 0);
+        if (i % 3 != 0)
+        {
+            EXPECT_EQ(page_id, i % 2 ? i : -i);
+        }
+    }
+    EXPECT_FALSE(index.Exist("Missing"));
+    EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    IndexFile::Unlink("test_buffered.idx");
+}
+
+// Page reads and writes of the buffer pool for random inserts
+static unsigned long long insert_io(IndexType type, int num_keys)
+{
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    char buf[60];
+    IndexFile::Create("test_buffered.idx", type);
+    PagedFile pf;
+    IndexFile index(pf);
+    index.OpenFile("test_buffered.idx");
+
+    unsigned long long before = statistics.GetTicker(PageReads) + statistics.GetTicker(PageWrites);
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        index.Put(buf, i);
+    }
+    index.UpdateChanges();
+    unsigned long long io = statistics.GetTicker(PageReads) + statistics.GetTicker(PageWrites) - before;
+    index.Close();
+    IndexFile::Unlink("test_buffered.idx");
+    return io;
+}
+
+TEST(buffered_tree_test, insert_io)
+{
+    unsigned long long btree_io = insert_io(OrderedIndex, 100000);
+    unsigned long long buffered_io = insert_io(BufferedIndex, 100000);
+    printf("Page I/O for 100000 inserts: B+Tree %llu, buffered %llu\n", btree_io, buffered_io);
+    EXPECT_GT(Singleton<Statistics>::Instance().GetTicker(BufferedIndexFlushes), 0u);
+    EXPECT_LT(buffered_io * 5, btree_io);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,87 @@
+#include "Status.h"
+#include "Types.h"
+#include "ClusteredTree.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+static String make_value(int i)
+{
+    // Every seventh value needs overflow pages
+    char buf[60];
+    sprintf(buf, "Value %d ", i);
+    String value = buf;
+    if (i % 7 == 0)
+        value.append(3 * PAGE_SIZE + i, 'x');
+    return value;
+}
+
+TEST(clustered_tree_test, records)
+{
+    const int num_keys = 5000;
+    char buf[60];
+    ClusteredTree::Create("test_clustered");
+    {
+        ClusteredTree tree;
+        EXPECT_EQ(tree.Open("test_clustered"), STATUS_SUCCESS);
+        // Keys in random order, so that splits happen all over the tree
+        for (int i = 0; i < num_keys; i++)
+        {
+            int k = (i * 7919) % num_keys;
+            sprintf(buf, "Key%06d", k);
+            EXPECT_EQ(tree.Put(buf, make_value(k)), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 2)
+        {
+            sprintf(buf, "Key%06d", i);
+            EXPECT_EQ(tree.Put(buf, make_value(i + 1)), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 5)
+        {
+            sprintf(buf, "Key%06d", i);
+            EXPECT_EQ(tree.Remove(buf), STATUS_SUCCESS);
+        }
+        EXPECT_EQ(tree.Remove("Key000000").GetCode(), StatusNotFound);
+        EXPECT_EQ(tree.Close(), STATUS_SUCCESS);
+    }
+
+    ClusteredTree tree;
+    EXPECT_EQ(tree.Open("test_clustered"), STATUS_SUCCESS);
+    for (int i = 0; i < num_keys; i++)
+    {
+        String value;
+        sprintf(buf, "Key%06d", i);
+        if (i % 5 == 0)
+        {
+            EXPECT_FALSE(tree.Contains(buf));
+            continue;
+        }
+        EXPECT_TRUE(tree.Contains(buf));
+        EXPECT_EQ(tree.Get(buf, value), STATUS_SUCCESS);
+        EXPECT_EQ(value, make_value(i % 2 ? i : i + 1));
+    }
+    EXPECT_EQ(tree.ListKeys().size(), (size_t) (num_keys - num_keys / 5));
+
+    // Scans cross leaves in key order
+    KeyValueList items;
+    EXPECT_EQ(tree.Scan("Key001234", 10, items), STATUS_SUCCESS);
+    EXPECT_EQ(items.size(), 10u);
+    EXPECT_EQ(items[0].first, "Key001234");
+    EXPECT_EQ(items[1].first, "Key001236");
+    EXPECT_EQ(items[1].second, make_value(1237));
+    for (size_t i = 1; i < items.size(); i++)
+        EXPECT_TRUE(items[i - 1].first < items[i].first);
+    EXPECT_EQ(tree.Scan("", 0, items), STATUS_SUCCESS);
+    EXPECT_EQ(items.size(), (size_t) (num_keys - num_keys / 5));
+    EXPECT_EQ(tree.Close(), STATUS_SUCCESS);
+    ClusteredTree::Unlink("test_clustered");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,377 @@
+#include "Status.h"
+#include "Types.h"
+#include "IndexFile.h"
+#include "Engine.h"
+#include "Thread.h"
+#include "PageIo.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <stdio.h>
+
+using namespace std;
+using namespace Pumper;
+
+// The file as a crash at this point would leave it
+static void copy_file(const char * from, const char * to)
+{
+    char buf[4096];
+    FILE * in = fopen(from, "rb");
+    FILE * out = fopen(to, "wb");
+    for (size_t length; (length = fread(buf, 1, sizeof(buf), in)) > 0; )
+        fwrite(buf, 1, length, out);
+    fclose(in);
+    fclose(out);
+}
+
+static void corrupt_page(const char * file, int32_t page_id)
+{
+    FILE * out = fopen(file, "r+b");
+    fseek(out, PageIo::PageOffset(page_id) + 8, SEEK_SET);
+    fwrite("garbage", 1, 7, out);
+    fclose(out);
+}
+
+// Keys [0, num_keys) must be there with their value, [num_keys, end) not
+static int count_errors(IndexFile &index, int num_keys, int end)
+{
+    char buf[60];
+    int num_errors = 0;
+    for (int i = 0; i < end; i++)
+    {
+        int page_id = -1;
+        sprintf(buf, "Item %d", i);
+        bool is_found = index.Find(buf, page_id);
+        if (is_found != (i < num_keys) || (is_found && page_id != i))
+            num_errors++;
+    }
+    return num_errors;
+}
+
+TEST(cow_tree_test, records)
+{
+    const int num_keys = 50000;
+    char buf[60];
+    IndexFile::Create("test_cow.idx", CopyOnWriteIndex);
+    PagedFile pf;
+    {
+        IndexFile index(pf);
+        EXPECT_EQ(index.OpenFile("test_cow.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(index.Type(), CopyOnWriteIndex);
+        for (int i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Put(buf, i), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 2)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Update(buf, -i), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 3)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Remove(buf), STATUS_SUCCESS);
+        }
+        EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    }
+    {
+        // The root of the last commit is found again
+        IndexFile index(pf);
+        EXPECT_EQ(index.OpenFile("test_cow.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(index.Type(), CopyOnWriteIndex);
+        for (int i = 0; i < num_keys; i++)
+        {
+            int page_id = 0;
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Find(buf, page_id), i % 3 != 0);
+            if (i % 3 != 0)
+            {
+                EXPECT_EQ(page_id, i % 2 ? i : -i);
+            }
+        }
+        EXPECT_EQ(index.GetCowTree()->RetiredPages(), 0);
+
+        // Emptied leaves are dropped, down to a single one
+        for (int i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Remove(buf), STATUS_SUCCESS);
+        }
+        int page_id = 0;
+        EXPECT_FALSE(index.Find("Item 1", page_id));
+        EXPECT_EQ(index.Put("Item 1", 1), STATUS_SUCCESS);
+        EXPECT_TRUE(index.Find("Item 1", page_id));
+        EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    }
+    IndexFile::Unlink("test_cow.idx");
+}
+
+TEST(cow_tree_test, pinned_root)
+{
+    const int num_keys = 20000;
+    char buf[60];
+    IndexFile::Create("test_cow.idx", CopyOnWriteIndex);
+    PagedFile pf;
+    IndexFile index(pf);
+    EXPECT_EQ(index.OpenFile("test_cow.idx"), STATUS_SUCCESS);
+    CowTree * tree = index.GetCowTree();
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(tree->Insert(buf, i), STATUS_SUCCESS);
+    }
+    // The other meta page still leads to the pages of the empty tree
+    EXPECT_EQ(tree->Commit(), STATUS_SUCCESS);
+    EXPECT_GT(tree->RetiredPages(), 0);
+    EXPECT_EQ(tree->Commit(), STATUS_SUCCESS);
+    EXPECT_EQ(tree->RetiredPages(), 0);
+
+    // Writes after BeginRead() are not seen, and keep their pages
+    CowReader reader;
+    EXPECT_EQ(tree->BeginRead(reader), STATUS_SUCCESS);
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(tree->Remove(buf), STATUS_SUCCESS);
+    }
+    EXPECT_EQ(tree->Commit(), STATUS_SUCCESS);
+    EXPECT_GT(tree->RetiredPages(), 0);
+    for (int i = 0; i < num_keys; i++)
+    {
+        int page_id = 0;
+        sprintf(buf, "Item %d", i);
+        EXPECT_TRUE(tree->Search(reader, buf, page_id));
+        EXPECT_EQ(page_id, i);
+        EXPECT_FALSE(tree->Search(buf, page_id));
+    }
+    tree->EndRead(reader);
+
+    // Released for good once the reader is gone, and taken again
+    EXPECT_EQ(tree->Commit(), STATUS_SUCCESS);
+    EXPECT_EQ(tree->RetiredPages(), 0);
+    int total_pages = pf.GetTotalPages();
+    for (int round = 0; round < 5; round++)
+    {
+        for (int i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(tree->Insert(buf, round), STATUS_SUCCESS);
+        }
+        EXPECT_EQ(tree->Commit(), STATUS_SUCCESS);
+    }
+    EXPECT_LT(pf.GetTotalPages(), total_pages + total_pages / 2);
+    EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    IndexFile::Unlink("test_cow.idx");
+}
+
+TEST(cow_tree_test, concurrent_readers)
+{
+    const int num_keys = 5000;
+    char buf[60];
+    IndexFile::Create("test_cow.idx", CopyOnWriteIndex);
+    PagedFile pf;
+    IndexFile index(pf);
+    EXPECT_EQ(index.OpenFile("test_cow.idx"), STATUS_SUCCESS);
+    CowTree * tree = index.GetCowTree();
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(tree->Insert(buf, i), STATUS_SUCCESS);
+    }
+
+    // Readers check the keys the writer never touches, and that each
+    // snapshot has the newer keys in the order they were written.
+    std::atomic<bool> is_stopping(false);
+    std::atomic<int> num_errors(0);
+    std::vector<Thread *> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(new Thread([&]() {
+            char key[60];
+            while (!is_stopping.load())
+            {
+                CowReader reader;
+                if (!(tree->BeginRead(reader) == STATUS_SUCCESS))
+                    continue;
+                int page_id = 0;
+                bool is_gap = false;
+                for (int i = 0; i < num_keys; i += 97)
+                {
+                    sprintf(key, "Item %d", i);
+                    if (!tree->Search(reader, key, page_id) || page_id != i)
+                        num_errors++;
+                }
+                for (int i = num_keys; i < 3 * num_keys; i += 101)
+                {
+                    sprintf(key, "Item %d", i);
+                    bool is_found = tree->Search(reader, key, page_id);
+                    if (is_found && is_gap)
+                        num_errors++;
+                    is_gap = !is_found;
+                }
+                tree->EndRead(reader);
+            }
+        }));
+        threads.back()->Start();
+    }
+
+    for (int i = num_keys; i < 3 * num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(tree->Insert(buf, i), STATUS_SUCCESS);
+        if (i % 1000 == 0)
+        {
+            EXPECT_EQ(tree->Commit(), STATUS_SUCCESS);
+        }
+    }
+    is_stopping.store(true);
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t]->Join();
+        delete threads[t];
+    }
+    EXPECT_EQ(num_errors.load(), 0);
+    EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    IndexFile::Unlink("test_cow.idx");
+}
+
+// Engine reads search the index without the engine lock, while the
+// writer moves entries to other pages by growing their values.
+TEST(cow_tree_test, engine_reads)
+{
+    const int num_keys = 200;
+    char buf[60];
+    Engine::CreateDb("test_cow", UpdateInPlace, false, CopyOnWriteIndex);
+    Engine engine;
+    EXPECT_EQ(engine.OpenDb("test_cow"), STATUS_SUCCESS);
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(engine.Put(buf, buf), STATUS_SUCCESS);
+    }
+    Snapshot * snapshot = engine.GetSnapshot();
+
+    std::atomic<bool> is_stopping(false);
+    std::atomic<int> num_errors(0);
+    std::vector<Thread *> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(new Thread([&, t]() {
+            char key[60];
+            String value;
+            for (int i = t; !is_stopping.load(); i = (i + 7) % num_keys)
+            {
+                sprintf(key, "Item %d", i);
+                if (!(engine.Get(key, value) == STATUS_SUCCESS) ||
+                    value.compare(0, strlen(key), key) != 0)
+                    num_errors++;
+                if (!(engine.Get(snapshot, key, value) == STATUS_SUCCESS) || value != key)
+                    num_errors++;
+                if (engine.Get("Missing", value) == STATUS_SUCCESS)
+                    num_errors++;
+            }
+        }));
+        threads.back()->Start();
+    }
+
+    for (int size = 100; size <= 700; size += 300)
+    {
+        for (int i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(engine.Put(buf, String(buf) + String(size, 'v')), STATUS_SUCCESS);
+        }
+    }
+    is_stopping.store(true);
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t]->Join();
+        delete threads[t];
+    }
+    EXPECT_EQ(num_errors.load(), 0);
+    EXPECT_EQ(engine.ReleaseSnapshot(snapshot), STATUS_SUCCESS);
+    EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    Engine::UnlinkDb("test_cow");
+}
+
+TEST(cow_tree_test, recovery)
+{
+    const int num_keys = 20000;
+    char buf[60];
+    IndexFile::Create("test_cow.idx", CopyOnWriteIndex);
+    PagedFile pf;
+    IndexFile index(pf);
+    EXPECT_EQ(index.OpenFile("test_cow.idx"), STATUS_SUCCESS);
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(index.Put(buf, i), STATUS_SUCCESS);
+    }
+    EXPECT_EQ(index.UpdateChanges(), STATUS_SUCCESS);
+    for (int i = num_keys; i < 2 * num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(index.Put(buf, i), STATUS_SUCCESS);
+    }
+    // Every page and the header of the uncommitted writes reach the disk
+    EXPECT_EQ(pf.ForcePage(), STATUS_SUCCESS);
+    copy_file("test_cow.idx", "test_cow_crash.idx");
+
+    // One copy per meta page torn, after a second commit
+    EXPECT_EQ(index.UpdateChanges(), STATUS_SUCCESS);
+    copy_file("test_cow.idx", "test_cow_torn0.idx");
+    copy_file("test_cow.idx", "test_cow_torn1.idx");
+    corrupt_page("test_cow_torn0.idx", 0);
+    corrupt_page("test_cow_torn1.idx", 1);
+    EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    int total_pages = pf.GetTotalPages();
+
+    {
+        // Opens at the first commit, the free list made again
+        PagedFile crash_pf;
+        IndexFile crash_index(crash_pf);
+        EXPECT_EQ(crash_index.OpenFile("test_cow_crash.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(count_errors(crash_index, num_keys, 2 * num_keys), 0);
+        for (int i = num_keys; i < 2 * num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(crash_index.Put(buf, i), STATUS_SUCCESS);
+        }
+        EXPECT_EQ(crash_index.Close(), STATUS_SUCCESS);
+        EXPECT_EQ(crash_index.OpenFile("test_cow_crash.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(count_errors(crash_index, 2 * num_keys, 2 * num_keys), 0);
+        // The pages of the lost writes were taken again
+        EXPECT_LE(crash_pf.GetTotalPages(), total_pages);
+        EXPECT_EQ(crash_index.Close(), STATUS_SUCCESS);
+    }
+
+    // The torn one was the newest or the older meta page: either the second
+    // or the first commit, never anything else.
+    int num_first = 0;
+    const char * torn_files[] = { "test_cow_torn0.idx", "test_cow_torn1.idx" };
+    for (int i = 0; i < 2; i++)
+    {
+        PagedFile torn_pf;
+        IndexFile torn_index(torn_pf);
+        EXPECT_EQ(torn_index.OpenFile(torn_files[i]), STATUS_SUCCESS);
+        if (count_errors(torn_index, num_keys, 2 * num_keys) == 0)
+            num_first++;
+        else
+        {
+            EXPECT_EQ(count_errors(torn_index, 2 * num_keys, 2 * num_keys), 0);
+        }
+        EXPECT_EQ(torn_index.Close(), STATUS_SUCCESS);
+    }
+    EXPECT_EQ(num_first, 1);
+
+    IndexFile::Unlink("test_cow.idx");
+    IndexFile::Unlink("test_cow_crash.idx");
+    IndexFile::Unlink("test_cow_torn0.idx");
+    IndexFile::Unlink("test_cow_torn1.idx");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -2,7 +2,9 @@
 #include "Types.h"
 #include "Daemon.h"
 #include "Singleton.h"
+#include "Statistics.h"
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
@@ -10,10 +12,24 @@
 using namespace std;
 using namespace Pumper;
 
+// Memory budget of the value cache in front of the engine
+const size_t CACHE_CAPACITY = 64 << 20;
 
-int main()
+// Usage: testDaemon [paged|memory] [metrics_file] [interval_seconds]
+int main(int argc, char **argv)
 {
-	Singleton<Daemon>::Instance().Start("master", 12306);	
+	EngineKind kind = EnginePaged;
+	if (argc > 1 && !(KvEngine::ParseKind(argv[1], kind) == STATUS_SUCCESS))
+	{
+		printf("Usage: %s [paged|memory] [metrics_file] [interval_seconds]\n", argv[0]);
+		return 1;
+	}
+
+	// Prometheus text dump for a node exporter textfile collector or alike
+	if (argc > 2)
+		Singleton<Statistics>::Instance().StartDumper(argv[2], argc > 3 ? atoi(argv[3]) : 10);
+
+	Singleton<Daemon>::Instance().Start("master", 12306, CACHE_CAPACITY, kind);	
 	while(1)
 	{
 		sleep(1);
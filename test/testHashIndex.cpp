@@ -0,0 +1,153 @@
+#include "Status.h"
+#include "Types.h"
+#include "IndexFile.h"
+#include "Statistics.h"
+#include "Singleton.h"
+#include "KeyHash.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(hash_index_test, basic)
+{
+    IndexFile::Create("test_hash.idx", HashedIndex);
+    PagedFile pf;
+    IndexFile index(pf);
+    EXPECT_EQ(index.OpenFile("test_hash.idx"), STATUS_SUCCESS);
+    EXPECT_EQ(index.Type(), HashedIndex);
+
+    int page_id = 0;
+    EXPECT_FALSE(index.Exist("Missing"));
+    EXPECT_EQ(index.Put("Item", 7), STATUS_SUCCESS);
+    EXPECT_TRUE(index.Exist("Item"));
+    EXPECT_EQ(index.Get("Item", page_id), STATUS_SUCCESS);
+    EXPECT_EQ(page_id, 7);
+    EXPECT_EQ(index.Update("Item", 8), STATUS_SUCCESS);
+    EXPECT_EQ(index.Get("Item", page_id), STATUS_SUCCESS);
+    EXPECT_EQ(page_id, 8);
+    EXPECT_EQ(index.Remove("Item"), STATUS_SUCCESS);
+    EXPECT_FALSE(index.Exist("Item"));
+
+    EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    IndexFile::Unlink("test_hash.idx");
+
+    // B+Tree files are told apart
+    IndexFile::Create("test_hash.idx");
+    EXPECT_EQ(index.OpenFile("test_hash.idx"), STATUS_SUCCESS);
+    EXPECT_EQ(index.Type(), OrderedIndex);
+    EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    IndexFile::Unlink("test_hash.idx");
+}
+
+TEST(hash_index_test, split)
+{
+    const int num_keys = 50000;
+    char buf[60];
+    Singleton<Statistics>::Instance().Reset();
+    IndexFile::Create("test_hash.idx", HashedIndex);
+    PagedFile pf;
+    {
+        IndexFile index(pf);
+        index.OpenFile("test_hash.idx");
+        for (int i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Item %d", i);
+            EXPECT_EQ(index.Put(buf, i), STATUS_SUCCESS);
+        }
+        for (int i = 0; i < num_keys; i += 3)
+        {
+            sprintf(buf, "Item %d", i);
+            index.Remove(buf);
+        }
+        index.Close();
+    }
+    // 50000 keys need a hundred buckets at least
+    EXPECT_GE(Singleton<Statistics>::Instance().GetTicker(HashIndexSplits), 
+        (unsigned long long) (num_keys / HASH_BUCKET_SLOTS));
+
+    // Directory read back from disk
+    IndexFile index(pf);
+    EXPECT_EQ(index.OpenFile("test_hash.idx"), STATUS_SUCCESS);
+    for (int i = 0; i < num_keys; i++)
+    {
+        int page_id = -1;
+        sprintf(buf, "Item %d", i);
+        EXPECT_EQ(index.Exist(buf), i % 3 != 0);
+        if (i % 3 != 0)
+        {
+            index.Get(buf, page_id);
+            EXPECT_EQ(page_id, i);
+        }
+    }
+    index.Close();
+    IndexFile::Unlink("test_hash.idx");
+}
+
+TEST(hash_index_test, key_hash)
+{
+    // Every byte counts, NULs included
+    String left("Item\0A", 6), right("Item\0B", 6);
+    EXPECT_FALSE(KeyHash64(left) == KeyHash64(right));
+    EXPECT_FALSE(KeyHash64(String(100, 'x') + "1") == KeyHash64(String(100, 'x') + "2"));
+
+    const int num_keys = 200000;
+    char buf[60];
+    vector<unsigned long long> hashes;
+    for (int i = 0; i < num_keys; i++)
+    {
+        sprintf(buf, "Item %d", i);
+        hashes.push_back(KeyHash64(buf));
+    }
+    sort(hashes.begin(), hashes.end());
+    EXPECT_TRUE(unique(hashes.begin(), hashes.end()) == hashes.end());
+
+    // New indexes record the wide hash
+    IndexFile::Create("test_hash.idx");
+    {
+        PagedFile pf;
+        IndexFile index(pf);
+        EXPECT_EQ(index.OpenFile("test_hash.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(pf.GetKeyHash(), KeyHashWide);
+        EXPECT_EQ(index.Put(left, 1), STATUS_SUCCESS);
+        EXPECT_EQ(index.Put(right, 2), STATUS_SUCCESS);
+        EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    }
+    {
+        PagedFile pf;
+        IndexFile index(pf);
+        int page_id = 0;
+        EXPECT_EQ(index.OpenFile("test_hash.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(pf.GetKeyHash(), KeyHashWide);
+        EXPECT_TRUE(index.Find(left, page_id));
+        EXPECT_EQ(page_id, 1);
+        EXPECT_TRUE(index.Find(right, page_id));
+        EXPECT_EQ(page_id, 2);
+        EXPECT_EQ(index.Close(), STATUS_SUCCESS);
+    }
+    IndexFile::Unlink("test_hash.idx");
+
+    // Files of older versions are refused
+    PagedFile::Create("test_hash.idx");
+    {
+        PagedFile pf;
+        int32_t page_id;
+        EXPECT_EQ(pf.OpenFile("test_hash.idx"), STATUS_SUCCESS);
+        EXPECT_EQ(pf.AllocatePage(page_id), STATUS_SUCCESS);
+        EXPECT_EQ(pf.Close(), STATUS_SUCCESS);
+    }
+    PagedFile pf;
+    IndexFile index(pf);
+    EXPECT_FALSE(index.OpenFile("test_hash.idx") == STATUS_SUCCESS);
+    EXPECT_FALSE(pf.IsFileOpened());
+    IndexFile::Unlink("test_hash.idx");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
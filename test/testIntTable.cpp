@@ -0,0 +1,125 @@
+#include "Status.h"
+#include "Types.h"
+#include "IntBucket.h"
+#include "IntTable.h"
+#include "Engine.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(int_table_test, bucket)
+{
+    char page[PAGE_SIZE];
+    memset(page, 0, PAGE_SIZE);
+    IntBucket bucket(page);
+
+    String value;
+    EXPECT_FALSE(bucket.Get(1, value));
+    EXPECT_TRUE(bucket.Put(30, "thirty"));
+    EXPECT_TRUE(bucket.Put(10, "ten"));
+    EXPECT_TRUE(bucket.Put(~0ULL, "max"));
+    EXPECT_TRUE(bucket.Put(20, "twenty"));
+    EXPECT_TRUE(bucket.Get(~0ULL, value));
+    EXPECT_EQ(value, "max");
+
+    vector<unsigned long long> keys = bucket.ListKeys();
+    EXPECT_EQ(keys.size(), 4u);
+    EXPECT_EQ(keys[0], 10u);
+    EXPECT_EQ(keys[3], ~0ULL);
+
+    // Holes of removed and replaced values are reused
+    EXPECT_TRUE(bucket.Remove(30));
+    EXPECT_FALSE(bucket.Remove(30));
+    EXPECT_TRUE(bucket.Put(10, String(3000, 'a')));
+    EXPECT_FALSE(bucket.Put(40, String(1500, 'b')));
+    EXPECT_TRUE(bucket.Get(20, value));
+    EXPECT_EQ(value, "twenty");
+    EXPECT_TRUE(bucket.Put(10, "ten"));
+    EXPECT_TRUE(bucket.Put(40, String(1500, 'b')));
+    EXPECT_TRUE(bucket.Get(40, value));
+    EXPECT_EQ(value, String(1500, 'b'));
+    EXPECT_TRUE(bucket.Exist(10));
+    EXPECT_FALSE(bucket.Exist(30));
+}
+
+TEST(int_table_test, records)
+{
+    const unsigned long long num_keys = 20000;
+    const unsigned long long stride = 0x9e3779b97f4a7c15ULL;
+    char buf[60];
+    IntTable::Create("test_int");
+    {
+        IntTable table;
+        EXPECT_EQ(table.Open("test_int"), STATUS_SUCCESS);
+        for (unsigned long long i = 0; i < num_keys; i++)
+        {
+            sprintf(buf, "Value %llu", i);
+            EXPECT_EQ(table.Put(i * stride, buf), STATUS_SUCCESS);
+        }
+        // Values that outgrow their page move to another one
+        for (unsigned long long i = 0; i < num_keys; i += 100)
+            EXPECT_EQ(table.Put(i * stride, String(1000, 'x')), STATUS_SUCCESS);
+        for (unsigned long long i = 1; i < num_keys; i += 3)
+            EXPECT_EQ(table.Remove(i * stride), STATUS_SUCCESS);
+        EXPECT_EQ(table.Remove(stride).GetCode(), StatusNotFound);
+        EXPECT_EQ(table.Close(), STATUS_SUCCESS);
+    }
+
+    IntTable table;
+    EXPECT_EQ(table.Open("test_int"), STATUS_SUCCESS);
+    for (unsigned long long i = 0; i < num_keys; i++)
+    {
+        String value;
+        if (i % 3 == 1)
+        {
+            EXPECT_FALSE(table.Contains(i * stride));
+            EXPECT_EQ(table.Get(i * stride, value).GetCode(), StatusNotFound);
+            continue;
+        }
+        EXPECT_EQ(table.Get(i * stride, value), STATUS_SUCCESS);
+        sprintf(buf, "Value %llu", i);
+        EXPECT_EQ(value, i % 100 == 0 ? String(1000, 'x') : String(buf));
+    }
+    EXPECT_EQ(table.ListKeys().size(), num_keys - (num_keys + 1) / 3);
+    EXPECT_EQ(table.Close(), STATUS_SUCCESS);
+    IntTable::Unlink("test_int");
+}
+
+TEST(int_table_test, engine)
+{
+    Engine::CreateDb("test_int", IntegerKeys);
+    Engine engine;
+    EXPECT_EQ(engine.OpenDb("test_int"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Put("42", "answer"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Put("18446744073709551615", "max"), STATUS_SUCCESS);
+
+    // Only the canonical spelling of an integer is a key
+    EXPECT_FALSE(engine.Put("042", "x") == STATUS_SUCCESS);
+    EXPECT_FALSE(engine.Put("18446744073709551616", "x") == STATUS_SUCCESS);
+    EXPECT_FALSE(engine.Put("Item", "x") == STATUS_SUCCESS);
+    EXPECT_FALSE(engine.Contains("042"));
+
+    String value;
+    EXPECT_EQ(engine.Get("18446744073709551615", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "max");
+    EXPECT_EQ(engine.Get("Item", value).GetCode(), StatusNotFound);
+    EXPECT_EQ(engine.ListKeys().size(), 2u);
+    EXPECT_EQ(engine.Remove("42"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Remove("42").GetCode(), StatusNotFound);
+    EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+
+    EXPECT_EQ(engine.OpenDb("test_int"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.ListKeys()[0], "18446744073709551615");
+    EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    Engine::UnlinkDb("test_int");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,37 @@
+#include "Status.h"
+#include "Types.h"
+#include "KeySearch.h"
+#include "BTree.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(key_search_test, bounds)
+{
+    srand(41);
+    for (int n = 0; n <= N_ORDER; n++)
+    {
+        vector<int> keys;
+        for (int i = 0; i < n; i++)
+            keys.push_back(rand() % (2 * n + 1) - n);
+        sort(keys.begin(), keys.end());
+
+        for (int key = -n - 2; key <= n + 2; key++)
+        {
+            int lower = lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            int upper = upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+            EXPECT_EQ(LowerBound(keys.data(), n, key), lower);
+            EXPECT_EQ(UpperBound(keys.data(), n, key), upper);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,173 @@
+#include "Status.h"
+#include "Types.h"
+#include "KvEngine.h"
+#include "Engine.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+// Every implementation must behave the same behind the interface.
+void check_engine(KvEngine * engine)
+{
+    EXPECT_EQ(engine->OpenDb("kv_engine"), STATUS_SUCCESS);
+    EXPECT_EQ(engine->IsOpened(), true);
+
+    WriteBatch batch;
+    for (int i = 0; i < 100; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item%03d", i);
+        batch.Put(buf, buf);
+    }
+    batch.Remove("Item050");
+    EXPECT_EQ(engine->Write(batch), STATUS_SUCCESS);
+    EXPECT_EQ(engine->Contains("Item050"), false);
+    EXPECT_EQ(engine->ListKeys().size(), 99u);
+
+    String value;
+    EXPECT_EQ(engine->Get("Item007", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "Item007");
+    EXPECT_EQ(engine->Get("Item100", value) == STATUS_SUCCESS, false);
+
+    KeyValueList items;
+    EXPECT_EQ(engine->Scan("Item048", 4, items), STATUS_SUCCESS);
+    EXPECT_EQ(items.size(), 4u);
+    EXPECT_EQ(items[0].first, "Item048");
+    EXPECT_EQ(items[1].first, "Item049");
+    EXPECT_EQ(items[2].first, "Item051");
+    EXPECT_EQ(items[3].second, "Item052");
+    EXPECT_EQ(engine->Scan("Item095", 0, items), STATUS_SUCCESS);
+    EXPECT_EQ(items.size(), 5u);
+
+    Snapshot * snapshot = engine->GetSnapshot();
+    engine->Remove("Item001");
+    EXPECT_EQ(engine->Contains(snapshot, "Item001"), true);
+    EXPECT_EQ(engine->ListKeys(snapshot).size(), 99u);
+    engine->ReleaseSnapshot(snapshot);
+
+    EngineStats stats = engine->Stats();
+    EXPECT_EQ(stats.engine, engine->Name());
+    EXPECT_EQ(stats.num_batches, 1u);
+    EXPECT_EQ(stats.num_puts, 100u);
+    EXPECT_EQ(stats.num_removes, 2u);
+    EXPECT_EQ(stats.num_gets, 2u);
+    EXPECT_EQ(stats.num_get_misses, 1u);
+    EXPECT_EQ(stats.num_scans, 2u);
+
+    EXPECT_EQ(engine->CloseDb(), STATUS_SUCCESS);
+}
+
+TEST(kv_engine_test, paged)
+{
+    Engine::CreateDb("kv_engine");
+    KvEngine * engine = KvEngine::New(EnginePaged);
+    EXPECT_STREQ(engine->Name(), "paged");
+    check_engine(engine);
+    delete engine;
+    Engine::UnlinkDb("kv_engine");
+}
+
+TEST(kv_engine_test, paged_upsert)
+{
+    Engine::CreateDb("kv_engine");
+    Engine engine;
+    EXPECT_EQ(engine.OpenDb("kv_engine"), STATUS_SUCCESS);
+    for (int i = 0; i < 40; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item%03d", i);
+        EXPECT_EQ(engine.Put(buf, buf), STATUS_SUCCESS);
+    }
+
+    // Growing values overflow their page and move to another one
+    String value;
+    for (int size = 100; size <= 1600; size += 300)
+    {
+        EXPECT_EQ(engine.Put("Item007", String(size, 'v')), STATUS_SUCCESS);
+        EXPECT_EQ(engine.Get("Item007", value), STATUS_SUCCESS);
+        EXPECT_EQ(value, String(size, 'v'));
+    }
+    EXPECT_EQ(engine.Get("Item008", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "Item008");
+
+    EXPECT_EQ(engine.Remove("Item007"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Remove("Item007").GetCode(), StatusNotFound);
+    EXPECT_EQ(engine.Get("Item007", value).GetCode(), StatusNotFound);
+    EXPECT_EQ(engine.ListKeys().size(), 39u);
+    EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    Engine::UnlinkDb("kv_engine");
+}
+
+TEST(kv_engine_test, paged_compressed)
+{
+    Engine::CreateDb("kv_engine", UpdateInPlace, true);
+    KvEngine * engine = KvEngine::New(EnginePaged);
+    check_engine(engine);
+
+    // Pages read back after reopening
+    EXPECT_EQ(engine->OpenDb("kv_engine"), STATUS_SUCCESS);
+    String value;
+    EXPECT_EQ(engine->Get("Item099", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "Item099");
+    EXPECT_EQ(engine->ListKeys().size(), 98u);
+    EXPECT_EQ(engine->CloseDb(), STATUS_SUCCESS);
+    delete engine;
+    Engine::UnlinkDb("kv_engine");
+}
+
+// Every index type behind the paged engine
+class kv_engine_index_test : public testing::TestWithParam<IndexType> {};
+
+TEST_P(kv_engine_index_test, paged)
+{
+    Engine::CreateDb("kv_engine", UpdateInPlace, false, GetParam());
+    KvEngine * engine = KvEngine::New(EnginePaged);
+    check_engine(engine);
+
+    EXPECT_EQ(engine->OpenDb("kv_engine"), STATUS_SUCCESS);
+    String value;
+    EXPECT_EQ(engine->Get("Item042", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "Item042");
+    EXPECT_EQ(engine->Get("Item050", value).GetCode(), StatusNotFound);
+    EXPECT_EQ(engine->CloseDb(), STATUS_SUCCESS);
+    delete engine;
+    Engine::UnlinkDb("kv_engine");
+}
+
+INSTANTIATE_TEST_SUITE_P(index_types, kv_engine_index_test,
+    testing::Values(HashedIndex, BufferedIndex, CopyOnWriteIndex));
+
+TEST(kv_engine_test, paged_clustered)
+{
+    Engine::CreateDb("kv_engine", Clustered);
+    KvEngine * engine = KvEngine::New(EnginePaged);
+    check_engine(engine);
+
+    EXPECT_EQ(engine->OpenDb("kv_engine"), STATUS_SUCCESS);
+    String value;
+    EXPECT_EQ(engine->Get("Item042", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "Item042");
+    EXPECT_EQ(engine->ListKeys().size(), 98u);
+    EXPECT_EQ(engine->CloseDb(), STATUS_SUCCESS);
+    delete engine;
+    Engine::UnlinkDb("kv_engine");
+}
+
+TEST(kv_engine_test, memory)
+{
+    EngineKind kind;
+    EXPECT_EQ(KvEngine::ParseKind("memory", kind), STATUS_SUCCESS);
+    KvEngine * engine = KvEngine::New(kind);
+    EXPECT_STREQ(engine->Name(), "memory");
+    check_engine(engine);
+    EXPECT_EQ(engine->IsOpened(), false);
+    delete engine;
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,84 @@
+#include "Status.h"
+#include "Types.h"
+#include "Thread.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(logger_test, runtime_level)
+{
+    Logger& logger = Singleton<Logger>::Instance();
+    logger.SetLevel(Error);
+    EXPECT_EQ(logger.GetLevel(), Error);
+    logger.Append(Warning, "filtered at runtime\n", true);
+    logger.Flush();
+    logger.SetLevel(Warning);
+    logger.Append(Warning, "written\n");
+    logger.Flush();
+}
+
+TEST(logger_test, storm_does_not_block)
+{
+    Logger& logger = Singleton<Logger>::Instance();
+    unsigned long long dropped = logger.Dropped();
+
+    // Far more entries than the queue holds, with stack traces.
+    Thread * threads[4];
+    for (int i = 0; i < 4; i++)
+    {
+        threads[i] = new Thread([&logger]() {
+            for (int j = 0; j < LOG_QUEUE_LENGTH * 4; j++)
+                logger.Append(Warning, "storm entry\n", true);
+        });
+        threads[i]->Start();
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        threads[i]->Join();
+        delete threads[i];
+    }
+    logger.Flush();
+    EXPECT_GT(logger.Dropped(), dropped);
+}
+
+Status find_item(bool is_present)
+{
+    if (!is_present)
+        RETURN_NOT_FOUND();
+    RETURN_SUCCESS();
+}
+
+Status check_item(bool is_present)
+{
+    WARNING_ASSERT(is_present);
+    RETURN_SUCCESS();
+}
+
+TEST(status_test, codes)
+{
+    unsigned long long dropped = Singleton<Logger>::Instance().Dropped();
+    EXPECT_EQ(find_item(true), STATUS_SUCCESS);
+    Status status = find_item(false);
+    EXPECT_FALSE(status == STATUS_SUCCESS);
+    EXPECT_EQ(status.GetLogLevel(), Success);
+    EXPECT_EQ(status.GetCode(), StatusNotFound);
+    EXPECT_EQ(status.GetBacktrace(), "Item not found");
+
+    // Misses are not logged, faults are.
+    for (int i = 0; i < LOG_QUEUE_LENGTH * 4; i++)
+        find_item(false);
+    EXPECT_EQ(Singleton<Logger>::Instance().Dropped(), dropped);
+
+    status = check_item(false);
+    EXPECT_EQ(status.GetLogLevel(), Warning);
+    EXPECT_EQ(status.GetCode(), StatusFault);
+    EXPECT_NE(status.GetBacktrace().find("is_present"), String::npos);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,234 @@
+#include "Status.h"
+#include "Types.h"
+#include "MemTable.h"
+#include "SortedRun.h"
+#include "LsmTree.h"
+#include "Engine.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <map>
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(lsm_test, memtable)
+{
+    MemTable mem_table;
+    mem_table.Put("b", "2");
+    mem_table.Put("a", "1");
+    mem_table.Put("c", "3");
+    mem_table.Put("a", "10");
+    mem_table.Remove("c");
+
+    String value;
+    bool is_deleted;
+    EXPECT_EQ(mem_table.Get("a", value, is_deleted), true);
+    EXPECT_EQ(is_deleted, false);
+    EXPECT_EQ(value, "10");
+    EXPECT_EQ(mem_table.Get("c", value, is_deleted), true);
+    EXPECT_EQ(is_deleted, true);
+    EXPECT_EQ(mem_table.Get("d", value, is_deleted), false);
+    EXPECT_EQ(mem_table.Count(), 3);
+
+    String order;
+    for (MemTable::Iterator it(&mem_table); it.Valid(); it.Next())
+        order += it.Key();
+    EXPECT_EQ(order, "abc");
+}
+
+TEST(lsm_test, sorted_run)
+{
+    SortedRunBuilder builder;
+    EXPECT_EQ(builder.Open("lsm_run"), STATUS_SUCCESS);
+    for (int i = 0; i < 5000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item%06d", i);
+        EXPECT_EQ(builder.Add(buf, buf, i % 7 == 0), STATUS_SUCCESS);
+    }
+    EXPECT_EQ(builder.Finish(), STATUS_SUCCESS);
+    EXPECT_GT(builder.NumPages(), 1);
+
+    SortedRun run;
+    EXPECT_EQ(run.Open("lsm_run"), STATUS_SUCCESS);
+    String value;
+    bool is_deleted;
+    for (int i = 0; i < 5000; i += 13)
+    {
+        char buf[60];
+        sprintf(buf, "Item%06d", i);
+        EXPECT_EQ(run.Get(buf, value, is_deleted), true);
+        EXPECT_EQ(is_deleted, i % 7 == 0);
+        if (!is_deleted)
+        {
+            EXPECT_EQ(value, buf);
+        }
+    }
+    EXPECT_EQ(run.Get("Item", value, is_deleted), false);
+    EXPECT_EQ(run.Get("Item999999", value, is_deleted), false);
+
+    int count = 0;
+    for (SortedRun::Iterator it(&run); it.Valid(); it.Next())
+        count++;
+    EXPECT_EQ(count, 5000);
+
+    run.MarkObsolete();
+}
+
+TEST(lsm_test, flush_and_compaction)
+{
+    LsmTree::Create("lsm_tree");
+    {
+        // A tiny MemTable, so that flushes and compactions really happen.
+        LsmTree tree(16 << 10);
+        EXPECT_EQ(tree.Open("lsm_tree"), STATUS_SUCCESS);
+        for (int round = 0; round < 3; round++)
+        {
+            for (int i = 0; i < 3000; i++)
+            {
+                char key[60], value[60];
+                sprintf(key, "Item%d", i);
+                sprintf(value, "Value%d-%d", i, round);
+                EXPECT_EQ(tree.Put(key, value), STATUS_SUCCESS);
+            }
+        }
+        for (int i = 0; i < 3000; i += 3)
+        {
+            char key[60];
+            sprintf(key, "Item%d", i);
+            EXPECT_EQ(tree.Remove(key), STATUS_SUCCESS);
+        }
+
+        for (int i = 0; i < 3000; i++)
+        {
+            char key[60], value[60];
+            String result;
+            sprintf(key, "Item%d", i);
+            sprintf(value, "Value%d-2", i);
+            if (i % 3 == 0)
+                EXPECT_EQ(tree.Contains(key), false);
+            else
+            {
+                EXPECT_EQ(tree.Get(key, result), STATUS_SUCCESS);
+                EXPECT_EQ(result, value);
+            }
+        }
+
+        vector<int32_t> runs = tree.RunsPerLevel();
+        int32_t deeper = 0;
+        for (uint32_t level = 1; level < runs.size(); level++)
+            deeper += runs[level];
+        EXPECT_GT(deeper, 0);
+        EXPECT_EQ(tree.ListKeys().size(), 2000u);
+        EXPECT_EQ(tree.Close(), STATUS_SUCCESS);
+    }
+
+    {
+        LsmTree tree(16 << 10);
+        EXPECT_EQ(tree.Open("lsm_tree"), STATUS_SUCCESS);
+        String result;
+        EXPECT_EQ(tree.Get("Item1", result), STATUS_SUCCESS);
+        EXPECT_EQ(result, "Value1-2");
+        EXPECT_EQ(tree.Contains("Item3"), false);
+        EXPECT_EQ(tree.ListKeys().size(), 2000u);
+        EXPECT_EQ(tree.Close(), STATUS_SUCCESS);
+    }
+    EXPECT_EQ(LsmTree::Unlink("lsm_tree"), STATUS_SUCCESS);
+    EXPECT_EQ(LsmTree::Exists("lsm_tree"), false);
+}
+
+// Scans merge MemTables and runs, newest record first, and stop at limit.
+TEST(lsm_test, scan)
+{
+    LsmTree::Create("lsm_tree");
+    LsmTree tree(16 << 10);
+    EXPECT_EQ(tree.Open("lsm_tree"), STATUS_SUCCESS);
+    map<String, String> expected;
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < 3000; i++)
+        {
+            char key[60], value[60];
+            sprintf(key, "Item%04d", i);
+            sprintf(value, "Value%d-%d", i, round);
+            EXPECT_EQ(tree.Put(key, value), STATUS_SUCCESS);
+            expected[key] = value;
+        }
+    }
+    // Tombstones in the runs and in the MemTable
+    for (int i = 0; i < 3000; i += 3)
+    {
+        char key[60];
+        sprintf(key, "Item%04d", i);
+        EXPECT_EQ(tree.Remove(key), STATUS_SUCCESS);
+        expected.erase(key);
+    }
+    for (int i = 2990; i < 3000; i++)
+    {
+        char key[60];
+        sprintf(key, "Item%04d", i);
+        EXPECT_EQ(tree.Put(key, "last"), STATUS_SUCCESS);
+        expected[key] = "last";
+    }
+
+    const char * starts[] = { "", "Item0500", "Item1499x", "Item2995", "Item9" };
+    const int32_t limits[] = { 1, 7, 500, 0 };
+    for (int s = 0; s < 5; s++)
+    {
+        for (int l = 0; l < 4; l++)
+        {
+            KeyValueList items;
+            EXPECT_EQ(tree.Scan(starts[s], limits[l], items), STATUS_SUCCESS);
+            KeyValueList wanted;
+            map<String, String>::iterator it = expected.lower_bound(starts[s]);
+            for (; it != expected.end() && (limits[l] <= 0 || (int32_t) wanted.size() < limits[l]); ++it)
+                wanted.push_back(*it);
+            EXPECT_TRUE(items == wanted) << "start " << starts[s] << ", limit " << limits[l];
+        }
+    }
+    EXPECT_EQ(tree.Close(), STATUS_SUCCESS);
+    EXPECT_EQ(LsmTree::Unlink("lsm_tree"), STATUS_SUCCESS);
+}
+
+TEST(lsm_test, engine_layout)
+{
+    Engine::CreateDb("lsm_engine", LogStructured);
+    Engine engine;
+    EXPECT_EQ(engine.OpenDb("lsm_engine"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.IsOpened(), true);
+    engine.Put("alpha", "1");
+    engine.Put("beta", "2");
+
+    Snapshot * snapshot = engine.GetSnapshot();
+    engine.Put("alpha", "10");
+    EXPECT_EQ(engine.Remove("beta"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Contains("beta"), false);
+
+    String value;
+    EXPECT_EQ(engine.Get(snapshot, "alpha", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "1");
+    EXPECT_EQ(engine.Contains(snapshot, "beta"), true);
+    EXPECT_EQ(engine.ListKeys(snapshot).size(), 2u);
+    EXPECT_EQ(engine.ListKeys().size(), 1u);
+    engine.ReleaseSnapshot(snapshot);
+
+    KeyValueList items;
+    EXPECT_EQ(engine.Scan("", 0, items), STATUS_SUCCESS);
+    ASSERT_EQ(items.size(), 1u);
+    EXPECT_EQ(items[0].first, "alpha");
+    EXPECT_EQ(items[0].second, "10");
+
+    EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    EXPECT_EQ(engine.OpenDb("lsm_engine"), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Get("alpha", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "10");
+    EXPECT_EQ(engine.CloseDb(), STATUS_SUCCESS);
+    Engine::UnlinkDb("lsm_engine");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,327 @@
+#include "Status.h"
+#include "Types.h"
+#include "PageIo.h"
+#include "PagedFile.h"
+#include "Statistics.h"
+#include "Buffer.h"
+#include "Singleton.h"
+#include "Thread.h"
+#include "gtest/gtest.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+const int32_t NUM_PAGES = 200;
+
+TEST(page_io_test, batch_write_and_read)
+{
+    int32_t fd = open("test_page_io", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+
+    // Out of order, with gaps, so runs are sorted and split.
+    vector<char *> pages;
+    vector<PageIoRequest> writes;
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        int32_t page_id = (i * 7) % NUM_PAGES;
+        pages.push_back(new char[PAGE_SIZE]);
+        memset(pages.back(), page_id & 0x7f, PAGE_SIZE);
+        if (page_id % 50 != 49)
+            writes.push_back(PageIoRequest(fd, page_id, pages.back(), true));
+    }
+    PageIo page_io(3);
+    EXPECT_EQ(page_io.Execute(writes), STATUS_SUCCESS);
+
+    vector<PageIoRequest> reads;
+    for (uint32_t i = 0; i < writes.size(); i++)
+    {
+        memset(pages[i], 0xff, PAGE_SIZE);
+        reads.push_back(PageIoRequest(fd, writes[i].page_id, pages[i], false));
+    }
+    EXPECT_EQ(page_io.Execute(reads), STATUS_SUCCESS);
+    for (uint32_t i = 0; i < reads.size(); i++)
+    {
+        EXPECT_EQ(reads[i].mapping[0], reads[i].page_id & 0x7f);
+        EXPECT_EQ(reads[i].mapping[PAGE_SIZE - 1], reads[i].page_id & 0x7f);
+    }
+
+    // Past the end of file
+    reads.assign(1, PageIoRequest(fd, NUM_PAGES + 10, pages[0], false));
+    EXPECT_FALSE(page_io.Execute(reads) == STATUS_SUCCESS);
+
+    for (uint32_t i = 0; i < pages.size(); i++)
+        delete [] pages[i];
+    close(fd);
+    unlink("test_page_io");
+}
+
+TEST(page_io_test, async_fetch)
+{
+    PagedFile::Create("test_page_io");
+    PagedFile pf;
+    pf.OpenFile("test_page_io");
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        char * page;
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        pf.FetchPage(page_id, &page);
+        sprintf((char *) page, "page %d", page_id);
+        pf.MarkDirty(page_id);
+        pf.UnpinPage(page_id);
+    }
+    pf.ForcePage();
+
+    // A few at a time, the pool has BUFFER_SIZE slots.
+    unsigned long long writes = Singleton<Statistics>::Instance().GetTicker(PageWrites);
+    for (int32_t i = 0; i < NUM_PAGES; i += 8)
+    {
+        std::atomic<int32_t> done(0);
+        for (int32_t j = i; j < i + 8; j++)
+        {
+            EXPECT_EQ(pf.FetchPageAsync(j, [&done, j](const Status& status, char * page) {
+                char expected[32];
+                sprintf(expected, "page %d", j);
+                EXPECT_EQ(status, STATUS_SUCCESS);
+                EXPECT_STREQ((char *) page, expected);
+                done++;
+            }), STATUS_SUCCESS);
+        }
+        while (done < 8)
+            usleep(100);
+        for (int32_t j = i; j < i + 8; j++)
+            pf.UnpinPage(j);
+    }
+    EXPECT_EQ(Singleton<Statistics>::Instance().GetTicker(PageWrites), writes);
+
+    pf.Close();
+    PagedFile::Unlink("test_page_io");
+}
+
+TEST(page_io_test, sequential_readahead)
+{
+    PagedFile::Create("test_page_io");
+    PagedFile pf;
+    pf.OpenFile("test_page_io");
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        char * page;
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        pf.FetchPage(page_id, &page);
+        sprintf(page, "page %d", page_id);
+        pf.MarkDirty(page_id);
+        pf.UnpinPage(page_id);
+    }
+    pf.Close();
+
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    statistics.Reset();
+    pf.OpenFile("test_page_io");
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        char * page;
+        char expected[32];
+        sprintf(expected, "page %d", i);
+        EXPECT_EQ(pf.FetchPage(i, &page), STATUS_SUCCESS);
+        EXPECT_STREQ(page, expected);
+        pf.UnpinPage(i);
+    }
+
+    // Only the first pages of the sweep miss.
+    EXPECT_GT(statistics.GetTicker(BufferPrefetches), (unsigned long long) NUM_PAGES / 2);
+    EXPECT_LT(statistics.GetTicker(BufferMisses), (unsigned long long) NUM_PAGES / 4);
+
+    // Explicit hint
+    unsigned long long misses = statistics.GetTicker(BufferMisses);
+    EXPECT_EQ(pf.Prefetch(10, 4), STATUS_SUCCESS);
+    for (int32_t i = 10; i < 14; i++)
+    {
+        char * page;
+        EXPECT_EQ(pf.FetchPage(i, &page), STATUS_SUCCESS);
+        pf.UnpinPage(i);
+    }
+    EXPECT_EQ(statistics.GetTicker(BufferMisses), misses);
+
+    pf.Close();
+    PagedFile::Unlink("test_page_io");
+}
+
+// Reads ahead take free or clean slots only, and a bounded number of them.
+TEST(page_io_test, prefetch_slots)
+{
+    Buffer& buffer = Singleton<Buffer>::Instance();
+    buffer.SetDirtyRatio(1.0);
+    buffer.SetCheckpointInterval(0);
+    PagedFile::Create("test_page_io");
+    PagedFile pf;
+    pf.OpenFile("test_page_io");
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        char * page;
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        pf.FetchPage(page_id, &page);
+        pf.MarkDirty(page_id);
+        pf.UnpinPage(page_id);
+    }
+    pf.Close();
+
+    // Every slot dirty, fetched out of order so nothing is read ahead.
+    pf.OpenFile("test_page_io");
+    for (int32_t i = 0; i < BUFFER_SIZE; i++)
+    {
+        char * page;
+        pf.FetchPage(i * 3, &page);
+        sprintf(page, "page %d", i * 3);
+        pf.MarkDirty(i * 3);
+        pf.UnpinPage(i * 3);
+    }
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    statistics.Reset();
+    EXPECT_EQ(pf.Prefetch(100, READAHEAD_PAGES), STATUS_SUCCESS);
+    EXPECT_EQ(statistics.GetTicker(BufferPrefetches), 0u);
+    EXPECT_EQ(statistics.GetTicker(PageWrites), 0u);
+    pf.Close();
+
+    pf.OpenFile("test_page_io");
+    statistics.Reset();
+    EXPECT_EQ(pf.Prefetch(100, BUFFER_SIZE), STATUS_SUCCESS);
+    EXPECT_GT(statistics.GetTicker(BufferPrefetches), 0u);
+    EXPECT_LE(statistics.GetTicker(BufferPrefetches), (unsigned long long) MAX_READAHEAD_SLOTS);
+    pf.Close();
+    PagedFile::Unlink("test_page_io");
+    buffer.SetDirtyRatio(DEFAULT_DIRTY_RATIO);
+    buffer.SetCheckpointInterval(DEFAULT_CHECKPOINT_INTERVAL);
+}
+
+TEST(page_io_test, background_writer)
+{
+    Buffer& buffer = Singleton<Buffer>::Instance();
+    buffer.SetCheckpointInterval(1);
+    PagedFile::Create("test_page_io");
+    PagedFile pf;
+    pf.OpenFile("test_page_io");
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    statistics.Reset();
+
+    // Few enough to stay under the dirty ratio: only a checkpoint takes them.
+    for (int32_t i = 0; i < 3; i++)
+    {
+        char * page;
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        pf.FetchPage(page_id, &page);
+        sprintf(page, "page %d", page_id);
+        pf.MarkDirty(page_id);
+        pf.UnpinPage(page_id);
+    }
+    sleep(3);
+    EXPECT_GT(statistics.GetTicker(BufferCheckpoints), 0u);
+    EXPECT_GE(statistics.GetTicker(BufferBackgroundWrites), 3u);
+
+    // Past the ratio the writer runs ahead of eviction.
+    buffer.SetCheckpointInterval(0);
+    statistics.Reset();
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        char * page;
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        pf.FetchPage(page_id, &page);
+        sprintf(page, "page %d", page_id);
+        pf.MarkDirty(page_id);
+        pf.UnpinPage(page_id);
+        usleep(1000);
+    }
+    EXPECT_GT(statistics.GetTicker(BufferBackgroundWrites), 0u);
+    EXPECT_LT(statistics.GetTicker(BufferDirtyEvictions), (unsigned long long) NUM_PAGES);
+    pf.Close();
+
+    pf.OpenFile("test_page_io");
+    for (int32_t i = 0; i < NUM_PAGES + 3; i++)
+    {
+        char * page;
+        char expected[32];
+        sprintf(expected, "page %d", i);
+        EXPECT_EQ(pf.FetchPage(i, &page), STATUS_SUCCESS);
+        EXPECT_STREQ(page, expected);
+        pf.UnpinPage(i);
+    }
+    pf.Close();
+    PagedFile::Unlink("test_page_io");
+    buffer.SetCheckpointInterval(DEFAULT_CHECKPOINT_INTERVAL);
+}
+
+// Loads finishing on the I/O threads while a journaled batch is forced:
+// neither may wait for the other.
+TEST(page_io_test, force_during_loads)
+{
+    PagedFile::Create("test_page_io");
+    PagedFile::Create("test_page_io.journaled", HEADER_DOUBLE_WRITE);
+    PagedFile pf, journaled;
+    pf.OpenFile("test_page_io");
+    journaled.OpenFile("test_page_io.journaled");
+    for (int32_t i = 0; i < NUM_PAGES; i++)
+    {
+        int32_t page_id;
+        pf.AllocatePage(page_id);
+        if (i < 8)
+            journaled.AllocatePage(page_id);
+    }
+    pf.ForcePage();
+
+    std::atomic<bool> is_stopping(false);
+    Thread reader([&]() {
+        for (int32_t round = 0; !is_stopping; round++)
+        {
+            std::atomic<int32_t> done(0);
+            for (int32_t j = 0; j < 16; j++)
+            {
+                pf.FetchPageAsync((round * 16 + j) % NUM_PAGES, [&done](const Status&, char *) {
+                    done++;
+                });
+            }
+            while (done < 16)
+                usleep(10);
+            for (int32_t j = 0; j < 16; j++)
+                pf.UnpinPage((round * 16 + j) % NUM_PAGES);
+        }
+    });
+    reader.Start();
+
+    for (int32_t round = 0; round < 200; round++)
+    {
+        for (int32_t i = 0; i < 8; i++)
+        {
+            char * page;
+            journaled.FetchPage(i, &page);
+            sprintf(page, "round %d", round);
+            journaled.MarkDirty(i);
+            journaled.UnpinPage(i);
+        }
+        EXPECT_EQ(journaled.ForcePage(), STATUS_SUCCESS);
+    }
+    is_stopping = true;
+    reader.Join();
+
+    char * page;
+    EXPECT_EQ(journaled.FetchPage(7, &page), STATUS_SUCCESS);
+    EXPECT_STREQ(page, "round 199");
+    journaled.UnpinPage(7);
+    journaled.Close();
+    pf.Close();
+    PagedFile::Unlink("test_page_io.journaled");
+    PagedFile::Unlink("test_page_io");
+}
+
+int main(int argc, char *argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
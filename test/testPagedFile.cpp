@@ -2,9 +2,16 @@
 #include "Types.h"
 #include "PagedFile.h"
 #include "PageHandle.h"
+#include "PageIo.h"
+#include "Checksum.h"
+#include "Compression.h"
 #include "gtest/gtest.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace Pumper;
@@ -45,6 +52,265 @@ TEST(storage_test, read)
     pp.Unlink("test.dat");
 }
 
+TEST(storage_test, crc32c)
+{
+    // Check value of the Castagnoli polynomial
+    EXPECT_EQ(Crc32c("123456789", 9), 0xe3069283u);
+    EXPECT_EQ(Crc32c("56789", 5, Crc32c("1234", 4)), 0xe3069283u);
+    EXPECT_EQ(Crc32c("", 0), 0u);
+}
+
+static void corrupt(const char * file, off_t offset, int32_t length)
+{
+    char junk[PAGE_SIZE];
+    memset(junk, 0x5a, sizeof(junk));
+    int fd = open(file, O_WRONLY);
+    pwrite(fd, junk, length, offset);
+    close(fd);
+}
+
+static void write_pages(PagedFile& pp, int32_t num_pages, const char * text)
+{
+    for (int32_t i = 0; i < num_pages; i++)
+    {
+        char * page;
+        if (pp.GetTotalPages() <= i)
+        {
+            int32_t page_id;
+            pp.AllocatePage(page_id);
+        }
+        pp.FetchPage(i, &page);
+        sprintf(page, "%s %d", text, i);
+        pp.MarkDirty(i);
+        pp.UnpinPage(i);
+    }
+}
+
+TEST(storage_test, checksum)
+{
+    PagedFile pp;
+    PagedFile::Create("test_checksum.dat");
+    pp.OpenFile("test_checksum.dat");
+    write_pages(pp, 50, "page");
+    pp.Close();
+
+    std::vector<int32_t> bad_pages;
+    EXPECT_EQ(PagedFile::Scrub("test_checksum.dat", bad_pages), STATUS_SUCCESS);
+    EXPECT_TRUE(bad_pages.empty());
+
+    corrupt("test_checksum.dat", PageIo::PageOffset(7) + 100, 1);
+    EXPECT_EQ(PagedFile::Scrub("test_checksum.dat", bad_pages), STATUS_SUCCESS);
+    ASSERT_EQ(bad_pages.size(), 1u);
+    EXPECT_EQ(bad_pages[0], 7);
+
+    char * page;
+    pp.OpenFile("test_checksum.dat");
+    EXPECT_EQ(pp.FetchPage(6, &page), STATUS_SUCCESS);
+    pp.UnpinPage(6);
+    EXPECT_EQ(pp.FetchPage(7, &page).GetCode(), StatusCorruption);
+    pp.Close();
+
+    // A damaged header is caught at open.
+    corrupt("test_checksum.dat", 12, 2);
+    EXPECT_EQ(pp.OpenFile("test_checksum.dat").GetCode(), StatusCorruption);
+    EXPECT_FALSE(pp.IsFileOpened());
+    PagedFile::Unlink("test_checksum.dat");
+}
+
+TEST(storage_test, double_write)
+{
+    PagedFile pp;
+    PagedFile::Create("test_checksum.dat", HEADER_DOUBLE_WRITE);
+    pp.OpenFile("test_checksum.dat");
+    write_pages(pp, 10, "first");
+    pp.ForcePage();
+    write_pages(pp, 10, "second");
+    pp.Close();
+
+    // The crash tore the in-place write of a page of the last batch, which
+    // is at the front of the journal.
+    PageTrailer trailer;
+    int fd = open("test_checksum.dat.DW", O_RDONLY);
+    ASSERT_EQ(pread(fd, &trailer, PAGE_TRAILER_SIZE, PAGE_SIZE), PAGE_TRAILER_SIZE);
+    close(fd);
+    corrupt("test_checksum.dat", PageIo::PageOffset(trailer.page_id) + PAGE_SIZE / 2, PAGE_SIZE / 2);
+    std::vector<int32_t> bad_pages;
+    PagedFile::Scrub("test_checksum.dat", bad_pages);
+    EXPECT_EQ(bad_pages.size(), 1u);
+
+    pp.OpenFile("test_checksum.dat");
+    for (int32_t i = 0; i < 10; i++)
+    {
+        char * page;
+        char expected[32];
+        sprintf(expected, "second %d", i);
+        ASSERT_EQ(pp.FetchPage(i, &page), STATUS_SUCCESS);
+        EXPECT_STREQ(page, expected);
+        pp.UnpinPage(i);
+    }
+    pp.Close();
+    PagedFile::Scrub("test_checksum.dat", bad_pages);
+    EXPECT_TRUE(bad_pages.empty());
+    PagedFile::Unlink("test_checksum.dat");
+    EXPECT_NE(access("test_checksum.dat.DW", F_OK), 0);
+
+    // A lone dirty page goes through the journal as well
+    PagedFile::Create("test_checksum.dat", HEADER_DOUBLE_WRITE);
+    pp.OpenFile("test_checksum.dat");
+    write_pages(pp, 1, "single");
+    EXPECT_EQ(pp.ForcePage(0), STATUS_SUCCESS);
+    write_pages(pp, 1, "closed");
+    pp.Close();
+
+    char * page;
+    ASSERT_EQ(pp.OpenFile("test_checksum.dat"), STATUS_SUCCESS);
+    ASSERT_EQ(pp.FetchPage(0, &page), STATUS_SUCCESS);
+    EXPECT_STREQ(page, "closed 0");
+    pp.UnpinPage(0);
+    pp.Close();
+    PagedFile::Unlink("test_checksum.dat");
+}
+
+TEST(storage_test, lz4)
+{
+    char input[PAGE_SIZE];
+    char output[PAGE_SIZE + 64];
+    char restored[PAGE_SIZE];
+
+    // Sparse text, as in buckets
+    memset(input, 0, sizeof(input));
+    for (int32_t i = 0; i < 40; i++)
+        sprintf(input + i * 100, "{\"id\": %d, \"name\": \"user%d\"}", i, i * 7);
+    int32_t length = Lz4Compress(input, PAGE_SIZE, output, sizeof(output));
+    EXPECT_GT(length, 0);
+    EXPECT_LT(length, PAGE_SIZE / 3);
+    EXPECT_EQ(Lz4Decompress(output, length, restored, PAGE_SIZE), PAGE_SIZE);
+    EXPECT_EQ(memcmp(input, restored, PAGE_SIZE), 0);
+
+    // Noise does not shrink, and does not fit a smaller output.
+    srand(1);
+    for (int32_t i = 0; i < PAGE_SIZE; i++)
+        input[i] = rand();
+    EXPECT_EQ(Lz4Compress(input, PAGE_SIZE, output, PAGE_SIZE - 1), 0);
+    length = Lz4Compress(input, PAGE_SIZE, output, sizeof(output));
+    EXPECT_GT(length, PAGE_SIZE);
+    EXPECT_EQ(Lz4Decompress(output, length, restored, PAGE_SIZE), PAGE_SIZE);
+    EXPECT_EQ(memcmp(input, restored, PAGE_SIZE), 0);
+
+    // Truncated or too large for the output
+    EXPECT_EQ(Lz4Decompress(output, length - 1, restored, PAGE_SIZE), -1);
+    EXPECT_EQ(Lz4Decompress(output, length, restored, PAGE_SIZE / 2), -1);
+}
+
+TEST(storage_test, compressed)
+{
+    PagedFile pp;
+    EXPECT_FALSE(PagedFile::Create("test_compressed.dat", HEADER_COMPRESSED | HEADER_DOUBLE_WRITE) == 
+        STATUS_SUCCESS);
+    PagedFile::Create("test_compressed.dat", HEADER_COMPRESSED);
+    pp.OpenFile("test_compressed.dat");
+    write_pages(pp, 100, "compressed");
+    // One page that does not shrink
+    char * page;
+    pp.FetchPage(50, &page);
+    srand(2);
+    for (int32_t i = 0; i < PAGE_SIZE; i++)
+        page[i] = rand();
+    pp.MarkDirty(50);
+    pp.UnpinPage(50);
+    pp.Close();
+
+    struct stat file_stat;
+    stat("test_compressed.dat", &file_stat);
+    EXPECT_LT(file_stat.st_size, 100 * PAGE_SIZE / 4);
+
+    std::vector<int32_t> bad_pages;
+    EXPECT_EQ(PagedFile::Scrub("test_compressed.dat", bad_pages), STATUS_SUCCESS);
+    EXPECT_TRUE(bad_pages.empty());
+
+    pp.OpenFile("test_compressed.dat");
+    for (int32_t i = 0; i < 100; i++)
+    {
+        if (i == 50)
+            continue;
+        char expected[32];
+        sprintf(expected, "compressed %d", i);
+        ASSERT_EQ(pp.FetchPage(i, &page), STATUS_SUCCESS);
+        EXPECT_STREQ(page, expected);
+        pp.UnpinPage(i);
+    }
+    ASSERT_EQ(pp.FetchPage(50, &page), STATUS_SUCCESS);
+    srand(2);
+    bool is_equal = true;
+    for (int32_t i = 0; i < PAGE_SIZE; i++)
+        is_equal = is_equal && page[i] == (char) rand();
+    EXPECT_TRUE(is_equal);
+    pp.UnpinPage(50);
+    pp.Close();
+
+    // Literals of page 20 are somewhere in its extent.
+    FILE * file = fopen("test_compressed.dat", "rb");
+    std::string content(file_stat.st_size, '\0');
+    ASSERT_EQ(fread(&content[0], 1, content.size(), file), content.size());
+    fclose(file);
+    size_t offset = content.find("compressed 20");
+    ASSERT_NE(offset, std::string::npos);
+    corrupt("test_compressed.dat", offset, 1);
+    EXPECT_EQ(PagedFile::Scrub("test_compressed.dat", bad_pages), STATUS_SUCCESS);
+    ASSERT_EQ(bad_pages.size(), 1u);
+    EXPECT_EQ(bad_pages[0], 20);
+    PagedFile::Unlink("test_compressed.dat");
+}
+
+// An extent replaced by a newer copy is not reused before a sync: a torn
+// write of the newer copy leaves the older one readable.
+TEST(storage_test, extent_reuse)
+{
+    int32_t fd = open("test_extents.dat", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    char page[PAGE_SIZE];
+    struct stat file_stat;
+    ExtentMap extent_map(fd);
+    EXPECT_EQ(extent_map.Load(), STATUS_SUCCESS);
+
+    memset(page, 0, PAGE_SIZE);
+    strcpy(page, "first");
+    EXPECT_EQ(extent_map.WritePage(0, page), STATUS_SUCCESS);
+    EXPECT_EQ(extent_map.Sync(), STATUS_SUCCESS);
+    fstat(fd, &file_stat);
+    off_t extent_size = file_stat.st_size - EXTENT_ZERO_OFFSET;
+    ASSERT_GT(extent_size, 0);
+
+    // The extent of "first" stays taken, so page 1 goes to the end.
+    strcpy(page, "second");
+    EXPECT_EQ(extent_map.WritePage(0, page), STATUS_SUCCESS);
+    strcpy(page, "third");
+    EXPECT_EQ(extent_map.WritePage(1, page), STATUS_SUCCESS);
+    fstat(fd, &file_stat);
+    EXPECT_EQ(file_stat.st_size, EXTENT_ZERO_OFFSET + 3 * extent_size);
+
+    // Torn "second"
+    std::vector<char> zeros(extent_size, 0);
+    ASSERT_EQ(pwrite(fd, zeros.data(), extent_size, EXTENT_ZERO_OFFSET + extent_size), extent_size);
+    {
+        ExtentMap reopened(fd);
+        EXPECT_EQ(reopened.Load(), STATUS_SUCCESS);
+        EXPECT_EQ(reopened.ReadPage(0, page), STATUS_SUCCESS);
+        EXPECT_STREQ(page, "first");
+        EXPECT_EQ(reopened.ReadPage(1, page), STATUS_SUCCESS);
+        EXPECT_STREQ(page, "third");
+    }
+
+    // Once synced, the extent is taken again.
+    EXPECT_EQ(extent_map.Sync(), STATUS_SUCCESS);
+    strcpy(page, "fourth");
+    EXPECT_EQ(extent_map.WritePage(2, page), STATUS_SUCCESS);
+    fstat(fd, &file_stat);
+    EXPECT_EQ(file_stat.st_size, EXTENT_ZERO_OFFSET + 3 * extent_size);
+    close(fd);
+    unlink("test_extents.dat");
+}
+
 int main(int argc, char *argv[])
 {
     testing::InitGoogleTest(&argc, argv);
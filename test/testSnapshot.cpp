@@ -0,0 +1,130 @@
+#include "Status.h"
+#include "Types.h"
+#include "Engine.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(snapshot_test, point_reads)
+{
+    Engine::CreateDb("snapshot");
+    Engine engine;
+    engine.OpenDb("snapshot");
+    engine.Put("alpha", "1");
+    engine.Put("beta", "2");
+
+    Snapshot * snapshot = engine.GetSnapshot();
+    engine.Put("alpha", "10");
+    engine.Put("alpha", "100");
+    engine.Remove("beta");
+    engine.Put("gamma", "3");
+
+    String value;
+    EXPECT_EQ(engine.Get(snapshot, "alpha", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "1");
+    EXPECT_EQ(engine.Get(snapshot, "beta", value), STATUS_SUCCESS);
+    EXPECT_EQ(value, "2");
+    EXPECT_EQ(engine.Contains(snapshot, "gamma"), false);
+    EXPECT_EQ(engine.Contains("gamma"), true);
+
+    engine.Get("alpha", value);
+    EXPECT_EQ(value, "100");
+    engine.ReleaseSnapshot(snapshot);
+
+    engine.CloseDb();
+    Engine::UnlinkDb("snapshot");
+}
+
+TEST(snapshot_test, scan)
+{
+    Engine::CreateDb("snapshot");
+    Engine engine;
+    engine.OpenDb("snapshot");
+    for (int i = 0; i < 500; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item%d", i);
+        engine.Put(buf, buf);
+    }
+
+    Snapshot * older = engine.GetSnapshot();
+    for (int i = 0; i < 500; i += 2)
+    {
+        char buf[60];
+        sprintf(buf, "Item%d", i);
+        engine.Remove(buf);
+    }
+    Snapshot * newer = engine.GetSnapshot();
+    for (int i = 500; i < 1000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "Item%d", i);
+        engine.Put(buf, buf);
+    }
+
+    EXPECT_EQ(engine.ListKeys(older).size(), 500u);
+    EXPECT_EQ(engine.ListKeys(newer).size(), 250u);
+    engine.ReleaseSnapshot(older);
+    EXPECT_EQ(engine.ListKeys(newer).size(), 250u);
+    engine.ReleaseSnapshot(newer);
+    EXPECT_EQ(engine.ListKeys().size(), 750u);
+
+    engine.CloseDb();
+    Engine::UnlinkDb("snapshot");
+}
+
+class snapshot_layout_test : public testing::TestWithParam<StorageLayout> {};
+
+TEST_P(snapshot_layout_test, scan_across_pages)
+{
+    Engine::CreateDb("snapshot", GetParam());
+    Engine engine;
+    engine.OpenDb("snapshot");
+    std::vector<String> expected;
+    for (int i = 0; i < 3000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "%d", i);
+        engine.Put(buf, buf);
+        expected.push_back(buf);
+    }
+
+    // Removes and inserts after the snapshot split and merge pages under
+    // the keys it still has to see.
+    Snapshot * snapshot = engine.GetSnapshot();
+    for (int i = 0; i < 3000; i += 2)
+    {
+        char buf[60];
+        sprintf(buf, "%d", i);
+        engine.Remove(buf);
+    }
+    for (int i = 3000; i < 6000; i++)
+    {
+        char buf[60];
+        sprintf(buf, "%d", i);
+        engine.Put(buf, buf);
+    }
+
+    std::vector<String> keys = engine.ListKeys(snapshot);
+    std::sort(keys.begin(), keys.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(keys, expected);
+    engine.ReleaseSnapshot(snapshot);
+    EXPECT_EQ(engine.ListKeys().size(), 4500u);
+
+    engine.CloseDb();
+    Engine::UnlinkDb("snapshot");
+}
+
+INSTANTIATE_TEST_SUITE_P(layouts, snapshot_layout_test,
+                         testing::Values(UpdateInPlace, Clustered, IntegerKeys));
+
+int main(int argc, char *argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+#include "Status.h"
+#include "Types.h"
+#include "Statistics.h"
+#include "Engine.h"
+#include "Thread.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(statistics_test, histogram_buckets)
+{
+    // Exact below 2^HISTOGRAM_SUB_BITS, bounded relative error above.
+    for (unsigned long long value = 0; value < 16; value++)
+        EXPECT_EQ(HistogramData::BucketLimit(HistogramData::BucketOf(value)), value);
+
+    for (unsigned long long value = 16; value < (1ull << 40); value = value * 3 + 1)
+    {
+        int32_t bucket = HistogramData::BucketOf(value);
+        EXPECT_LT(bucket, HISTOGRAM_BUCKETS);
+        EXPECT_GE(HistogramData::BucketLimit(bucket), value);
+        EXPECT_LE(HistogramData::BucketLimit(bucket) - value, value / 16);
+        EXPECT_LT(HistogramData::BucketLimit(bucket - 1), value);
+    }
+    EXPECT_EQ(HistogramData::BucketOf(~0ull), HISTOGRAM_BUCKETS - 1);
+    EXPECT_EQ(HistogramData::BucketLimit(HISTOGRAM_BUCKETS - 1), ~0ull);
+}
+
+TEST(statistics_test, percentiles)
+{
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    statistics.Reset();
+    for (unsigned long long i = 1; i <= 1000; i++)
+        Statistics::Record(EngineGetNanos, i * 1000);
+
+    HistogramData data = statistics.GetHistogram(EngineGetNanos);
+    EXPECT_EQ(data.Count(), 1000u);
+    EXPECT_EQ(data.Sum(), 500500000u);
+    EXPECT_EQ(data.Max(), 1000000u);
+    EXPECT_NEAR((double) data.Percentile(0.5), 500000.0, 500000.0 / 16);
+    EXPECT_NEAR((double) data.Percentile(0.99), 990000.0, 990000.0 / 16);
+    EXPECT_EQ(data.Percentile(1.0), 1000000u);
+}
+
+TEST(statistics_test, threads_are_merged)
+{
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    statistics.Reset();
+
+    // Counts of exited threads are kept.
+    Thread * threads[4];
+    for (int i = 0; i < 4; i++)
+    {
+        threads[i] = new Thread([]() {
+            for (int j = 0; j < 10000; j++)
+            {
+                Statistics::Tick(NetworkCommands);
+                Statistics::Record(CommandGetNanos, j);
+            }
+        });
+        threads[i]->Start();
+    }
+    Statistics::Tick(NetworkCommands, 5);
+    for (int i = 0; i < 4; i++)
+    {
+        threads[i]->Join();
+        delete threads[i];
+    }
+
+    EXPECT_EQ(statistics.GetTicker(NetworkCommands), 40005u);
+    EXPECT_EQ(statistics.GetHistogram(CommandGetNanos).Count(), 40000u);
+    EXPECT_EQ(statistics.GetHistogram(CommandGetNanos).Max(), 9999u);
+}
+
+TEST(statistics_test, engine_and_buffer_are_instrumented)
+{
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    Engine::CreateDb("test_statistics");
+    Engine engine;
+    engine.OpenDb("test_statistics");
+    statistics.Reset();
+
+    for (int i = 0; i < 200; i++)
+    {
+        char key[16];
+        sprintf(key, "key%d", i);
+        engine.Put(key, "value");
+    }
+    String value;
+    EXPECT_EQ(engine.Get("key7", value), STATUS_SUCCESS);
+    EXPECT_EQ(engine.Contains("missing"), false);
+
+    EXPECT_EQ(statistics.GetHistogram(EnginePutNanos).Count(), 200u);
+    EXPECT_EQ(statistics.GetHistogram(EngineGetNanos).Count(), 1u);
+    EXPECT_GT(statistics.GetTicker(BufferHits), 0u);
+    EXPECT_GT(statistics.GetTicker(EngineFilterNegatives), 0u);
+    EXPECT_GT(statistics.GetGauge(BTreeDepth), 0);
+
+    engine.CloseDb();
+    Engine::UnlinkDb("test_statistics");
+}
+
+TEST(statistics_test, text_and_prometheus)
+{
+    Statistics& statistics = Singleton<Statistics>::Instance();
+    statistics.Reset();
+    Statistics::Tick(BufferHits, 3);
+    Statistics::Record(PageReadNanos, 2000);
+
+    String text = statistics.ToString("buffer");
+    EXPECT_NE(text.find("buffer_hits 3\n"), String::npos);
+    EXPECT_EQ(text.find("page_reads"), String::npos);
+    EXPECT_NE(statistics.ToString().find("page_read_latency count=1"), String::npos);
+
+    EXPECT_EQ(statistics.DumpPrometheus("test_statistics.prom"), STATUS_SUCCESS);
+    FILE * file = fopen("test_statistics.prom", "r");
+    ASSERT_TRUE(file != NULL);
+    char buffer[65536];
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[length] = '\0';
+    fclose(file);
+    unlink("test_statistics.prom");
+
+    String prometheus(buffer);
+    EXPECT_NE(prometheus.find("# TYPE pumper_buffer_hits_total counter\npumper_buffer_hits_total 3\n"), String::npos);
+    EXPECT_NE(prometheus.find("pumper_page_read_latency_seconds_count 1\n"), String::npos);
+    EXPECT_NE(prometheus.find("pumper_page_read_latency_seconds{quantile=\"0.99\"}"), String::npos);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
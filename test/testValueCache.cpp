@@ -0,0 +1,70 @@
+#include "Status.h"
+#include "Types.h"
+#include "ValueCache.h"
+#include "Engine.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace std;
+using namespace Pumper;
+
+TEST(value_cache_test, lookup_and_erase)
+{
+    ValueCache cache(1 << 20);
+    String value;
+    EXPECT_EQ(cache.Lookup("alpha", value), false);
+    cache.Insert("alpha", "1");
+    EXPECT_EQ(cache.Lookup("alpha", value), true);
+    EXPECT_EQ(value, "1");
+    cache.Insert("alpha", "2");
+    EXPECT_EQ(cache.Lookup("alpha", value), true);
+    EXPECT_EQ(value, "2");
+    cache.Erase("alpha");
+    EXPECT_EQ(cache.Lookup("alpha", value), false);
+    EXPECT_EQ(cache.Usage(), 0u);
+}
+
+TEST(value_cache_test, eviction)
+{
+    // One shard, room for about ten entries
+    ValueCache cache(10 * (CACHE_ENTRY_OVERHEAD + 8), 1);
+    String value;
+    for (int i = 0; i < 100; i++)
+    {
+        char buf[8];
+        sprintf(buf, "k%03d", i);
+        cache.Insert(buf, "vvvv");
+        // Keep the first key hot
+        EXPECT_EQ(cache.Lookup("k000", value), true);
+    }
+    EXPECT_LE(cache.Usage(), cache.Capacity());
+    EXPECT_EQ(cache.Lookup("k099", value), true);
+    EXPECT_EQ(cache.Lookup("k050", value), false);
+}
+
+TEST(value_cache_test, engine_read_through)
+{
+    Engine::CreateDb("cache");
+    Engine engine;
+    engine.EnableCache(1 << 20);
+    engine.OpenDb("cache");
+
+    String value;
+    engine.Put("alpha", "1");
+    engine.Get("alpha", value);
+    EXPECT_EQ(value, "1");
+    engine.Put("alpha", "2");
+    engine.Get("alpha", value);
+    EXPECT_EQ(value, "2");
+    engine.Remove("alpha");
+    EXPECT_EQ(engine.Contains("alpha"), false);
+
+    engine.CloseDb();
+    Engine::UnlinkDb("cache");
+}
+
+int main(int argc, char *argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}